@@ -93,3 +93,16 @@ void ukarch_ectx_load(struct ukarch_ectx *state)
 
 	restore_extregs(state);
 }
+
+int ukarch_ectx_is_initial(void)
+{
+	/* Not detectable without trapping FP/SIMD accesses */
+	return 0;
+}
+
+void ukarch_ectx_load_initial(void)
+{
+	static struct fpsimd_state initial __align(ECTX_ALIGN);
+
+	restore_extregs(&initial);
+}
@@ -48,12 +48,49 @@ enum x86_save_method {
 	X86_SAVE_FSAVE,
 	X86_SAVE_FXSAVE,
 	X86_SAVE_XSAVE,
-	X86_SAVE_XSAVEOPT
+	X86_SAVE_XSAVEOPT,
+	X86_SAVE_XSAVEC,
+	X86_SAVE_XSAVES
 };
 
+/* Layout of the legacy region and the XSAVE header */
+#define X86_ECTX_FCW_OFFSET	0
+#define X86_ECTX_MXCSR_OFFSET	24
+#define X86_ECTX_XSTATE_BV	64 /* in quad words */
+#define X86_ECTX_XCOMP_BV	65 /* in quad words */
+#define X86_ECTX_HDR_END	576
+
+#define X86_XCOMP_BV_COMPACTED	(1UL << 63)
+
+#define X86_FCW_DEFAULT		0x037f
+#define X86_MXCSR_DEFAULT	0x1f80
+
 static enum x86_save_method ectx_method;
 static __sz ectx_size;
 static __sz ectx_align = 0x0;
+static __u64 ectx_xcomp_bv;	/* XCOMP_BV for compacted formats, 0 otherwise */
+static int ectx_has_xinuse;	/* XGETBV with ECX=1 returns XINUSE */
+
+/* Extended context in initial configuration. Only the legacy region and
+ * the XSAVE header are needed because XSTATE_BV is 0.
+ */
+static __u8 ectx_initial[X86_ECTX_HDR_END] __align64;
+
+static inline __u64 _xgetbv(__u32 idx)
+{
+	__u32 lo, hi;
+
+	asm volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(idx));
+	return ((__u64) hi << 32) | lo;
+}
+
+static inline __u32 _stmxcsr(void)
+{
+	__u32 mxcsr;
+
+	asm volatile("stmxcsr %0" : "=m"(mxcsr));
+	return mxcsr;
+}
 
 static void _init_ectx_store(void)
 {
@@ -68,15 +105,38 @@ static void _init_ectx_store(void)
 	ukarch_x86_cpuid(1, 0, &eax, &ebx, &ecx, &edx);
 	if (ecx & X86_CPUID1_ECX_OSXSAVE) {
 		ukarch_x86_cpuid(0xd, 1, &eax, &ebx, &ecx, &edx);
-		if (eax & X86_CPUIDD1_EAX_XSAVEOPT) {
-			ectx_method = X86_SAVE_XSAVEOPT;
-			uk_pr_debug("Load/store of extended CPU state: XSAVEOPT\n");
+		ectx_has_xinuse = !!(eax & X86_CPUIDD1_EAX_XGETBV1);
+
+		/* The compacted formats (XSAVES, XSAVEC) only store state
+		 * components that are enabled and not in their initial
+		 * configuration. XSAVES additionally skips components that
+		 * were not modified since the last XRSTORS. We only use
+		 * XSAVES together with XSAVEC (see `ukarch_ectx_init()`).
+		 */
+		if (eax & X86_CPUIDD1_EAX_XSAVEC) {
+			if (eax & X86_CPUIDD1_EAX_XSAVES) {
+				ectx_method = X86_SAVE_XSAVES;
+				uk_pr_debug("Load/store of extended CPU state: XSAVES\n");
+			} else {
+				ectx_method = X86_SAVE_XSAVEC;
+				uk_pr_debug("Load/store of extended CPU state: XSAVEC\n");
+			}
+			/* EBX: size for all components enabled in XCR0|XSS.
+			 * We do not enable any supervisor state (XSS=0).
+			 */
+			ectx_size = ebx;
+			ectx_xcomp_bv = X86_XCOMP_BV_COMPACTED | _xgetbv(0);
 		} else {
-			ectx_method = X86_SAVE_XSAVE;
-			uk_pr_debug("Load/store of extended CPU state: XSAVE\n");
+			if (eax & X86_CPUIDD1_EAX_XSAVEOPT) {
+				ectx_method = X86_SAVE_XSAVEOPT;
+				uk_pr_debug("Load/store of extended CPU state: XSAVEOPT\n");
+			} else {
+				ectx_method = X86_SAVE_XSAVE;
+				uk_pr_debug("Load/store of extended CPU state: XSAVE\n");
+			}
+			ukarch_x86_cpuid(0xd, 0, &eax, &ebx, &ecx, &edx);
+			ectx_size = ebx;
 		}
-		ukarch_x86_cpuid(0xd, 0, &eax, &ebx, &ecx, &edx);
-		ectx_size = ebx;
 		ectx_align = 64;
 	} else if (edx & X86_CPUID1_EDX_FXSR) {
 		ectx_method = X86_SAVE_FXSAVE;
@@ -90,6 +150,10 @@ static void _init_ectx_store(void)
 		uk_pr_debug("Load/store of extended CPU state: FSAVE\n");
 	}
 
+	*(__u16 *) &ectx_initial[X86_ECTX_FCW_OFFSET] = X86_FCW_DEFAULT;
+	*(__u32 *) &ectx_initial[X86_ECTX_MXCSR_OFFSET] = X86_MXCSR_DEFAULT;
+	((__u64 *) ectx_initial)[X86_ECTX_XCOMP_BV] = ectx_xcomp_bv;
+
 	/* NOTE: In case a condition is added here that disables extregs
 	 *       (size=0), please make sure that align is still set to 1
 	 *       so that we can detect if _init_ectx_store() was called.
@@ -120,12 +184,15 @@ void ukarch_ectx_sanitize(struct ukarch_ectx *state)
 	switch (ectx_method) {
 	case X86_SAVE_XSAVE:
 	case X86_SAVE_XSAVEOPT:
+	case X86_SAVE_XSAVEC:
+	case X86_SAVE_XSAVES:
 		/* XSAVE* & XRSTOR rely on sane values in the XSAVE header
 		 * (64 bytes starting at offset 512 from the base address)
 		 * and will raise #GP on garbage data. We must zero them out.
+		 * XRSTORS additionally requires the compacted format bit.
 		 */
 		((__u64 *)state)[64] = 0;
-		((__u64 *)state)[65] = 0;
+		((__u64 *)state)[65] = ectx_xcomp_bv;
 		((__u64 *)state)[66] = 0;
 		((__u64 *)state)[67] = 0;
 		((__u64 *)state)[68] = 0;
@@ -148,7 +215,25 @@ void ukarch_ectx_init(struct ukarch_ectx *state)
 	 * Zero out and then save a valid layout to it.
 	 */
 	memset_isr(state, 0, ectx_size);
-	ukarch_ectx_store(state);
+
+	/* The modified optimization of XSAVEOPT and XSAVES must not be used
+	 * here: The area was just overwritten, but it could be the one that
+	 * was loaded last (e.g., a reused stack buffer), so that unmodified
+	 * components would be skipped.
+	 */
+	switch (ectx_method) {
+	case X86_SAVE_XSAVEOPT:
+		asm volatile("xsave (%0)" :: "r"(state),
+			     "a"(0xffffffff), "d"(0xffffffff) : "memory");
+		break;
+	case X86_SAVE_XSAVES:
+		asm volatile("xsavec (%0)" :: "r"(state),
+			     "a"(0xffffffff), "d"(0xffffffff) : "memory");
+		break;
+	default:
+		ukarch_ectx_store(state);
+		break;
+	}
 }
 
 void ukarch_ectx_store(struct ukarch_ectx *state)
@@ -175,6 +260,14 @@ void ukarch_ectx_store(struct ukarch_ectx *state)
 		asm volatile("xsaveopt (%0)" :: "r"(state),
 			     "a"(0xffffffff), "d"(0xffffffff) : "memory");
 		break;
+	case X86_SAVE_XSAVEC:
+		asm volatile("xsavec (%0)" :: "r"(state),
+			     "a"(0xffffffff), "d"(0xffffffff) : "memory");
+		break;
+	case X86_SAVE_XSAVES:
+		asm volatile("xsaves (%0)" :: "r"(state),
+			     "a"(0xffffffff), "d"(0xffffffff) : "memory");
+		break;
 	}
 }
 
@@ -196,9 +289,45 @@ void ukarch_ectx_load(struct ukarch_ectx *state)
 		break;
 	case X86_SAVE_XSAVE:
 	case X86_SAVE_XSAVEOPT:
+	case X86_SAVE_XSAVEC:
 		asm volatile("xrstor (%0)" :: "r"(state),
 			     "a"(0xffffffff), "d"(0xffffffff));
 		break;
+	case X86_SAVE_XSAVES:
+		asm volatile("xrstors (%0)" :: "r"(state),
+			     "a"(0xffffffff), "d"(0xffffffff));
+		break;
+	}
+}
+
+int ukarch_ectx_is_initial(void)
+{
+	UK_ASSERT(ectx_align); /* Do not call when not yet initialized */
+
+	if (!ectx_has_xinuse)
+		return 0;
+
+	/* XINUSE does not cover MXCSR, which is always stored */
+	return (_xgetbv(1) == 0) && (_stmxcsr() == X86_MXCSR_DEFAULT);
+}
+
+void ukarch_ectx_load_initial(void)
+{
+	UK_ASSERT(ectx_align); /* Do not call when not yet initialized */
+
+	switch (ectx_method) {
+	case X86_SAVE_NONE:
+		/* nothing to do */
+		break;
+	case X86_SAVE_FSAVE:
+		asm volatile("fninit");
+		break;
+	default:
+		/* XSTATE_BV is 0: XRSTOR* puts all components into their
+		 * initial configuration without reading them from memory
+		 */
+		ukarch_ectx_load((struct ukarch_ectx *) ectx_initial);
+		break;
 	}
 }
 
@@ -175,6 +175,9 @@ static inline void ukarch_spinwait(void)
 #define X86_CPUID7_EBX_RDSEED		(1 << 18)
 /* CPUID feature bits when EAX=0xd, ECX=1 */
 #define X86_CPUIDD1_EAX_XSAVEOPT (1<<0)
+#define X86_CPUIDD1_EAX_XSAVEC   (1<<1)
+#define X86_CPUIDD1_EAX_XGETBV1  (1<<2)
+#define X86_CPUIDD1_EAX_XSAVES   (1<<3)
 /* CPUID 80000001H:EDX feature list */
 #define X86_CPUID81_NX			(1 << 20)
 #define X86_CPUID81_PAGE1GB		(1 << 26)
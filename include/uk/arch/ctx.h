@@ -515,6 +515,23 @@ void ukarch_ectx_store(struct ukarch_ectx *state);
  */
 void ukarch_ectx_load(struct ukarch_ectx *state);
 
+/**
+ * Checks if the extended context of the currently executing CPU is in its
+ * initial configuration, like after a reset. Such a context does not need
+ * to be stored: It can be recreated with `ukarch_ectx_load_initial()`.
+ *
+ * @return
+ *   Non-zero if the extended context is in its initial configuration,
+ *   0 if it is not or if the architecture cannot detect it
+ */
+int ukarch_ectx_is_initial(void);
+
+/**
+ * Puts the extended context of the currently executing CPU into its
+ * initial configuration.
+ */
+void ukarch_ectx_load_initial(void);
+
 /**
  * Loads a given execution environment on the currently executing CPU.
  *
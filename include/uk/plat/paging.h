@@ -64,6 +64,7 @@ struct uk_pagetable {
 	unsigned long nr_lx_pages[PT_LEVELS];
 	unsigned long nr_lx_splits[PT_LEVELS];
 	unsigned long nr_pt_pages[PT_LEVELS];
+	unsigned long nr_tlb_flushes;
 #endif /* CONFIG_PAGING_STATS */
 };
 
@@ -353,6 +354,9 @@ int ukplat_page_mapx(struct uk_pagetable *pt, __vaddr_t vaddr,
  *
  *   If PAGE_FLAG_KEEP_PTES is specified, the page table hierarchy will stay
  *   intact. PTEs will only be invalidated (e.g., unsetting the present bit).
+ *
+ *   The TLB is flushed once for the whole range. Use
+ *   ukplat_page_unmap_gather() to flush once for multiple ranges.
  * @return
  *   0 on success, a non-zero value otherwise. May fail if:
  *   - the virtual address is not aligned to the page size
@@ -386,6 +390,9 @@ int ukplat_page_unmap(struct uk_pagetable *pt, __vaddr_t vaddr,
  *   PAGE_FLAG_FORCE_SIZE is not specified, the range is split into pages of
  *   the largest sizes that satisfy the requested operation.
  *
+ *   The TLB is flushed once for the whole range. Use
+ *   ukplat_page_set_attr_gather() to flush once for multiple ranges.
+ *
  * @return
  *   0 on success, a non-zero value otherwise. May fail if:
  *   - the virtual address is not aligned to the page size
@@ -395,6 +402,98 @@ int ukplat_page_set_attr(struct uk_pagetable *pt, __vaddr_t vaddr,
 			 unsigned long pages, unsigned long new_attr,
 			 unsigned long flags);
 
+/* Number of frames that a TLB flush gather records without allocating */
+#define UKPLAT_TLB_GATHER_FRAMES	16
+
+/**
+ * State of a TLB flush gather. Changes to a page table that are made with
+ * ukplat_page_unmap_gather() and ukplat_page_set_attr_gather() are not
+ * flushed from the TLB for every changed page. Instead, the changed address
+ * range is accumulated and flushed once when the gather ends, either page by
+ * page or, for large ranges, by flushing the whole TLB. Frames and page tables
+ * that are released by unmapping are only freed after the flush so that they
+ * cannot be accessed through stale TLB entries after they have been reused.
+ * If other LCPUs are online, the flush is also performed on them (TLB
+ * shootdown).
+ *
+ * A gather belongs to the caller that started it and is typically allocated
+ * on its stack. Concurrent callers use separate gathers.
+ *
+ * The fields are private to the paging implementation.
+ */
+struct ukplat_tlb_gather {
+	/* Page table to which the changes apply */
+	struct uk_pagetable *pt;
+	/* Virtual address range to flush [start, end) */
+	__vaddr_t start;
+	__vaddr_t end;
+	/* Smallest page level in the range */
+	unsigned int level;
+	/* Non-zero if the whole TLB must be flushed */
+	int flush_all;
+	/* Frames to free after the flush. Further frames are recorded in
+	 * frames that are allocated from the frame allocator of the page table
+	 */
+	unsigned int nr_frames;
+	__paddr_t frames[UKPLAT_TLB_GATHER_FRAMES];
+	__paddr_t batch;
+};
+
+/**
+ * Starts gathering TLB flushes for the given page table. Must be followed by
+ * a call to ukplat_tlb_gather_end().
+ *
+ * Until the gather is flushed, changed mappings may still be accessible
+ * through stale TLB entries. The caller must flush the gather before it maps
+ * new pages into a range that it has unmapped.
+ *
+ * @param pt
+ *   The page table instance on which to operate
+ * @param tlb
+ *   The gather object. Must stay valid until ukplat_tlb_gather_end()
+ */
+void ukplat_tlb_gather_begin(struct uk_pagetable *pt,
+			     struct ukplat_tlb_gather *tlb);
+
+/**
+ * Flushes the address range gathered so far on all LCPUs and frees the
+ * gathered frames. The gather stays active.
+ *
+ * @param tlb
+ *   The gather object
+ */
+void ukplat_tlb_gather_flush(struct ukplat_tlb_gather *tlb);
+
+/**
+ * Ends a gather started with ukplat_tlb_gather_begin(). Flushes the gathered
+ * address range on all LCPUs and frees the gathered frames.
+ *
+ * @param tlb
+ *   The gather object
+ */
+void ukplat_tlb_gather_end(struct ukplat_tlb_gather *tlb);
+
+/**
+ * Like ukplat_page_unmap(), but the TLB flush and freeing the frames are
+ * deferred until the gather is flushed or ends.
+ *
+ * @param tlb
+ *   The active gather of the page table on which to operate
+ */
+int ukplat_page_unmap_gather(struct ukplat_tlb_gather *tlb, __vaddr_t vaddr,
+			     unsigned long pages, unsigned long flags);
+
+/**
+ * Like ukplat_page_set_attr(), but the TLB flush is deferred until the gather
+ * is flushed or ends.
+ *
+ * @param tlb
+ *   The active gather of the page table on which to operate
+ */
+int ukplat_page_set_attr_gather(struct ukplat_tlb_gather *tlb,
+				__vaddr_t vaddr, unsigned long pages,
+				unsigned long new_attr, unsigned long flags);
+
 /**
  * Creates a temporary writable virtual mapping of the given physical address
  * range for kernel use.
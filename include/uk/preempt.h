@@ -34,7 +34,28 @@
 #ifndef __UK_PREEMPT_H__
 #define __UK_PREEMPT_H__
 
+#include <uk/config.h>
+#include <uk/essentials.h>
+
+#if CONFIG_LIBUKSCHEDPREEMPT
+/* Nesting level of sections that must not be preempted. The preemptive
+ * scheduler defers preemption while the count is non-zero.
+ */
+extern unsigned int uk_preempt_count;
+
+#define uk_preempt_disable()			\
+	do {					\
+		uk_preempt_count++;		\
+		barrier();			\
+	} while (0)
+#define uk_preempt_enable()			\
+	do {					\
+		barrier();			\
+		uk_preempt_count--;		\
+	} while (0)
+#else /* !CONFIG_LIBUKSCHEDPREEMPT */
 #define uk_preempt_disable()  barrier()
 #define uk_preempt_enable()   barrier()
+#endif /* !CONFIG_LIBUKSCHEDPREEMPT */
 
 #endif /* __UK_PREEMPT_H__ */
@@ -61,48 +61,185 @@
 #include <uk/spinlock.h>
 #include <uk/plat/lcpu.h>
 #include <uk/plat/time.h>
+#include <uk/arch/lcpu.h>
+#include <uk/essentials.h>
+#include <uk/init.h>
 
 /** @struct uk_futex
  *  @brief Futex structure.
  */
 struct uk_futex {
 	uint32_t *uaddr; /** The futex address. */
+	uint32_t bitset; /** Waiter bitset, matched against wake bitsets. */
 	struct uk_thread *thread; /** The thread waiting on the futex. */
-	struct uk_list_head list_node; /** The list containing all the futexes
-					 * on which the threads are waiting.
+	struct futex_bucket *bucket; /** The bucket the futex is queued in,
+				       * NULL after the thread was woken up.
+				       */
+	struct uk_list_head list_node; /** The list of the futexes in the
+					 * bucket on which the threads are
+					 * waiting.
 					 */
 };
 
-static UK_LIST_HEAD(futex_list);
-static uk_spinlock futex_list_lock = UK_SPINLOCK_INITIALIZER();
+/** @struct futex_bucket
+ *  @brief Hash bucket of waiting futexes.
+ */
+struct futex_bucket {
+	uk_spinlock lock; /** Protects the list. */
+	unsigned long waiters; /** Number of threads that are queued or about
+				 * to be queued. Allows wakers to skip empty
+				 * buckets without taking the lock.
+				 */
+	struct uk_list_head list;
+} __align(CACHE_LINE_SIZE);
+
+#define FUTEX_HASH_SIZE		(1UL << CONFIG_LIBPOSIX_FUTEX_HASH_BITS)
+#define FUTEX_BITSET_MATCH_ANY	UINT32_MAX
+
+static struct futex_bucket futex_hash[FUTEX_HASH_SIZE];
+
+#if CONFIG_LIBPOSIX_PROCESS_CLONE
+/* Futex the thread is waiting on, for removal at thread exit */
+static __uk_tls struct uk_futex *futex_waiting;
+#endif /* CONFIG_LIBPOSIX_PROCESS_CLONE */
+
+/*
+ * Unikraft has a single address space, so private and shared futexes are
+ * both identified by their address. No mapping needs to be resolved to
+ * find the bucket.
+ */
+static struct futex_bucket *futex_bucket(uint32_t *uaddr)
+{
+	__u64 h = ((__uptr) uaddr >> 2) * 0x9e3779b97f4a7c15ULL;
+
+	return &futex_hash[h >> (64 - CONFIG_LIBPOSIX_FUTEX_HASH_BITS)];
+}
+
+static inline void futex_bucket_lock(struct futex_bucket *b,
+				     unsigned long *irqf)
+{
+	*irqf = ukplat_lcpu_save_irqf();
+	uk_spin_lock(&b->lock);
+}
+
+static inline void futex_bucket_unlock(struct futex_bucket *b,
+				       unsigned long irqf)
+{
+	uk_spin_unlock(&b->lock);
+	ukplat_lcpu_restore_irqf(irqf);
+}
+
+/* Locks two buckets in a fixed order to avoid deadlocks */
+static void futex_bucket_lock2(struct futex_bucket *b1,
+			       struct futex_bucket *b2, unsigned long *irqf)
+{
+	*irqf = ukplat_lcpu_save_irqf();
+	if (b1 > b2) {
+		uk_spin_lock(&b2->lock);
+		uk_spin_lock(&b1->lock);
+	} else {
+		uk_spin_lock(&b1->lock);
+		if (b1 != b2)
+			uk_spin_lock(&b2->lock);
+	}
+}
+
+static void futex_bucket_unlock2(struct futex_bucket *b1,
+				 struct futex_bucket *b2, unsigned long irqf)
+{
+	if (b1 != b2)
+		uk_spin_unlock(&b2->lock);
+	uk_spin_unlock(&b1->lock);
+	ukplat_lcpu_restore_irqf(irqf);
+}
+
+/* Removes a futex from its bucket. The bucket lock must be held. */
+static void futex_unqueue(struct uk_futex *f)
+{
+	uk_list_del(&f->list_node);
+	uk_dec(&f->bucket->waiters);
+	UK_WRITE_ONCE(f->bucket, NULL);
+}
+
+/* Wakes up the thread of a futex. The bucket lock must be held. */
+static void futex_wake_one(struct uk_futex *f)
+{
+	/* The waiter may return as soon as `f->bucket` is cleared */
+	struct uk_thread *thread = f->thread;
+
+	futex_unqueue(f);
+
+	/* TODO: Replace with uk_thread_wakeup when the new
+	 * scheduler API is ready
+	 */
+	uk_thread_wake(thread);
+}
+
+/**
+ * Removes a futex from the bucket it is queued in, if any.
+ *
+ * @return
+ *	1: the futex was still queued;
+ *	0: the thread was woken up already
+ */
+static int futex_dequeue(struct uk_futex *f)
+{
+	struct futex_bucket *b;
+	unsigned long irqf;
+
+	/* The futex can be requeued to another bucket while we lock */
+	while ((b = UK_READ_ONCE(f->bucket))) {
+		futex_bucket_lock(b, &irqf);
+		if (f->bucket == b) {
+			futex_unqueue(f);
+			futex_bucket_unlock(b, irqf);
+			return 1;
+		}
+		futex_bucket_unlock(b, irqf);
+	}
+	return 0;
+}
 
 /**
  * Prepare to wait on a futex.
  *
  * Get the futex value atomically and compare it with the expected value. Add
- * the thread to the wait list and then block it if the value is equal to the
- * expected one. If the futex was not removed from the list when the thread was
+ * the thread to the wait list of the futex bucket and then block it if the
+ * value is equal to the expected one. The value is compared with the bucket
+ * locked, so that a wake-up cannot get lost between the comparison and the
+ * queueing. If the futex was not removed from the list when the thread was
  * unblocked, then it means that it timed out.
  *
  * @param uaddr		The futex userspace address
  * @param val		The expected value
  * @param timeout	The deadline until the function will block at most.
  * 			If it is NULL, the thread will wait indefinitely.
+ * @param bitset	The bitset that wake-ups must match
  *
  * @return
  *	0: uaddr contains val and the thread finished waiting;
  *	<1: -EAGAIN (uaddr does not contain val) or -ETIMEDOUT (the futex timed
  *       out)
  */
-static int futex_wait(uint32_t *uaddr, uint32_t val, const __nsec *timeout)
+static int futex_wait(uint32_t *uaddr, uint32_t val, const __nsec *timeout,
+		      uint32_t bitset)
 {
 	unsigned long irqf;
-	struct uk_list_head *itr, *tmp;
-	struct uk_futex *f_tmp;
 	struct uk_thread *current = uk_thread_current();
-	struct uk_futex f = {.uaddr = uaddr, .thread = current};
+	struct futex_bucket *b = futex_bucket(uaddr);
+	struct uk_futex f = {.uaddr = uaddr, .bitset = bitset,
+			     .thread = current};
+
+	/* Announce the waiter before the value is read. This pairs with the
+	 * barrier in futex_wake(): either the waker sees the waiter or we see
+	 * the new value.
+	 */
+	uk_inc(&b->waiters);
+	futex_bucket_lock(b, &irqf);
 
 	if (uk_load_n(uaddr) != val) {
+		futex_bucket_unlock(b, irqf);
+		uk_dec(&b->waiters);
 		uk_pr_debug("FUTEX_WAIT: Condition not met (*uaddr != %"PRIu32", uaddr: %p)\n",
 			    val, uaddr);
 		return -EAGAIN;
@@ -113,11 +250,11 @@ static int futex_wait(uint32_t *uaddr, uint32_t val, const __nsec *timeout)
 			val, uaddr);
 
 	/* Enqueue thread to wait list */
-	irqf = ukplat_lcpu_save_irqf();
-	uk_spin_lock(&futex_list_lock);
-	uk_list_add_tail(&f.list_node, &futex_list);
-	uk_spin_unlock(&futex_list_lock);
-	ukplat_lcpu_restore_irqf(irqf);
+	f.bucket = b;
+	uk_list_add_tail(&f.list_node, &b->list);
+#if CONFIG_LIBPOSIX_PROCESS_CLONE
+	futex_waiting = &f;
+#endif /* CONFIG_LIBPOSIX_PROCESS_CLONE */
 
 	if (timeout) {
 		/* Block at most until `timeout` nanosecs */
@@ -129,28 +266,19 @@ static int futex_wait(uint32_t *uaddr, uint32_t val, const __nsec *timeout)
 		uk_pr_debug("FUTEX_WAIT: Wait indefinitely for wake-up\n");
 		uk_thread_block(current);
 	}
+	futex_bucket_unlock(b, irqf);
 	uk_sched_yield();
 
 	uk_pr_debug("FUTEX_WAIT: Woke up (uaddr: %p)\n", uaddr);
-	irqf = ukplat_lcpu_save_irqf();
-	uk_spin_lock(&futex_list_lock);
+#if CONFIG_LIBPOSIX_PROCESS_CLONE
+	futex_waiting = NULL;
+#endif /* CONFIG_LIBPOSIX_PROCESS_CLONE */
 
 	/* If the futex is still in the wait list, then it timed out */
-	uk_list_for_each_safe(itr, tmp, &futex_list) {
-		f_tmp = uk_list_entry(itr, struct uk_futex, list_node);
-
-		if (f_tmp->uaddr == uaddr && f_tmp->thread == current) {
-			/* Remove the thread from the futex list */
-			uk_list_del(&f_tmp->list_node);
-			uk_spin_unlock(&futex_list_lock);
-			ukplat_lcpu_restore_irqf(irqf);
-
-			uk_pr_debug("FUTEX_WAIT: Woke up because of timeout\n");
-			return -ETIMEDOUT;
-		}
+	if (futex_dequeue(&f)) {
+		uk_pr_debug("FUTEX_WAIT: Woke up because of timeout\n");
+		return -ETIMEDOUT;
 	}
-	uk_spin_unlock(&futex_list_lock);
-	ukplat_lcpu_restore_irqf(irqf);
 
 	return 0;
 }
@@ -158,37 +286,40 @@ static int futex_wait(uint32_t *uaddr, uint32_t val, const __nsec *timeout)
 /**
  * Wake up threads waiting on a futex.
  *
- * Find val threads in the wait list for the futex, remove the futexes from the
- * list and wake up the threads.
+ * Find val threads in the wait list for the futex whose bitset intersects
+ * with the given one, remove the futexes from the list and wake up the
+ * threads.
  *
  * @param uaddr	The futex userspace address
  * @param val	The number of threads waiting on the futex to be woken up
+ * @param bitset	The bitset to match against the waiters' bitsets
  *
  * @return
  *	0: no threads were woken up;
  *	>0: the number of threads woken up
  */
-static int futex_wake(uint32_t *uaddr, uint32_t val)
+static int futex_wake(uint32_t *uaddr, uint32_t val, uint32_t bitset)
 {
 	unsigned long irqf;
 	struct uk_list_head *itr, *tmp;
+	struct futex_bucket *b = futex_bucket(uaddr);
 	struct uk_futex *f;
 	uint32_t count = 0;
 
-	irqf = ukplat_lcpu_save_irqf();
-	uk_spin_lock(&futex_list_lock);
+	/* Order the caller's update of the futex word before the check for
+	 * waiters, see futex_wait().
+	 */
+	mb();
+	if (!UK_READ_ONCE(b->waiters))
+		return 0;
 
-	uk_list_for_each_safe(itr, tmp, &futex_list) {
-		f = uk_list_entry(itr, struct uk_futex, list_node);
+	futex_bucket_lock(b, &irqf);
 
-		if (f->uaddr == uaddr) {
-			/* Remove the thread from the futex list */
-			uk_list_del(&f->list_node);
+	uk_list_for_each_safe(itr, tmp, &b->list) {
+		f = uk_list_entry(itr, struct uk_futex, list_node);
 
-			/* TODO: Replace with uk_thread_wakeup when the new
-			 * scheduler API is ready
-			 */
-			uk_thread_wake(f->thread);
+		if (f->uaddr == uaddr && (f->bitset & bitset)) {
+			futex_wake_one(f);
 
 			/* Wake at most val threads */
 			if (++count >= val)
@@ -196,8 +327,7 @@ static int futex_wake(uint32_t *uaddr, uint32_t val)
 		}
 	}
 
-	uk_spin_unlock(&futex_list_lock);
-	ukplat_lcpu_restore_irqf(irqf);
+	futex_bucket_unlock(b, irqf);
 
 	return (int) count;
 }
@@ -210,7 +340,8 @@ static int futex_wake(uint32_t *uaddr, uint32_t val)
  * the remaining waiters are removed from the wait queue of the source futex at
  * uaddr and added to the wait queue of the target futex at uaddr2. The val2
  * argument specifies an upper limit on the number of waiters that are requeued
- * to the futex at uaddr2.
+ * to the futex at uaddr2. The value at uaddr is compared with both buckets
+ * locked.
  *
  * @param uaddr		Source futex user address
  * @param val		Number of waiters to wake
@@ -227,42 +358,51 @@ static int futex_cmp_requeue(uint32_t *uaddr, uint32_t val, uint32_t val2,
 {
 	unsigned long irqf;
 	struct uk_list_head *itr, *tmp;
+	struct futex_bucket *b1 = futex_bucket(uaddr);
+	struct futex_bucket *b2 = futex_bucket(uaddr2);
 	struct uk_futex *f;
-	int woken_uaddr1;
+	uint32_t woken_uaddr1 = 0;
 	uint32_t waiters_uaddr2 = 0;
 
-	if (!((uint32_t)val3 == uk_load_n(uaddr)))
+	futex_bucket_lock2(b1, b2, &irqf);
+
+	if (!((uint32_t)val3 == uk_load_n(uaddr))) {
+		futex_bucket_unlock2(b1, b2, irqf);
 		return -EAGAIN;
+	}
 
-	/* Wake up val waiters on uaddr */
-	woken_uaddr1 = futex_wake(uaddr, val);
+	uk_list_for_each_safe(itr, tmp, &b1->list) {
+		f = uk_list_entry(itr, struct uk_futex, list_node);
 
-	if (!val2)
-		return woken_uaddr1;
+		if (f->uaddr != uaddr)
+			continue;
 
-	irqf = ukplat_lcpu_save_irqf();
-	uk_spin_lock(&futex_list_lock);
+		/* Wake up val waiters on uaddr */
+		if (woken_uaddr1 < val) {
+			futex_wake_one(f);
+			woken_uaddr1++;
+			continue;
+		}
 
-	/* Requeue val2 waiters on uaddr2 */
-	uk_list_for_each_safe(itr, tmp, &futex_list) {
-		f = uk_list_entry(itr, struct uk_futex, list_node);
+		/* Requeue at most val2 threads */
+		if (waiters_uaddr2 >= val2)
+			break;
 
-		if (f->uaddr == uaddr) {
-			/* Requeue thread to uaddr2 */
+		/* Requeue thread to uaddr2 */
+		f->uaddr = uaddr2;
+		if (b1 != b2) {
 			uk_list_del(&f->list_node);
-			f->uaddr = uaddr2;
-			uk_list_add_tail(&f->list_node, &futex_list);
-
-			/* Requeue at most val2 threads */
-			if (++waiters_uaddr2 >= val2)
-				break;
+			uk_dec(&b1->waiters);
+			uk_inc(&b2->waiters);
+			uk_list_add_tail(&f->list_node, &b2->list);
+			UK_WRITE_ONCE(f->bucket, b2);
 		}
+		waiters_uaddr2++;
 	}
 
-	uk_spin_unlock(&futex_list_lock);
-	ukplat_lcpu_restore_irqf(irqf);
+	futex_bucket_unlock2(b1, b2, irqf);
 
-	return woken_uaddr1 + waiters_uaddr2;
+	return (int) (woken_uaddr1 + waiters_uaddr2);
 }
 
 /**
@@ -311,25 +451,32 @@ UK_LLSYSCALL_R_DEFINE(int, futex, uint32_t *, uaddr, int, futex_op,
 			timeout_ns = ukplat_monotonic_clock() +
 				     ukarch_time_sec_to_nsec(timeout->tv_sec) +
 				     timeout->tv_nsec;
-		return futex_wait(uaddr, val, timeout ? &timeout_ns : NULL);
+		return futex_wait(uaddr, val, timeout ? &timeout_ns : NULL,
+				  FUTEX_BITSET_MATCH_ANY);
 
 	case FUTEX_WAIT_BITSET:
 		/*
-		 * Special case implementation for cases where the val3/mask has
-		 * all bits set. Some applications do this to use the absolute
-		 * timeout mode. We return ENOSYS for all non-supported calls.
+		 * The waiter is only woken up by FUTEX_WAKE_BITSET calls whose
+		 * bitset intersects with val3. `timeout` is absolute.
 		 */
-		if (val3 != UINT32_MAX)
-			return -ENOSYS;
+		if (!val3)
+			return -EINVAL;
 
 		if (timeout)
 			timeout_ns = ukarch_time_sec_to_nsec(timeout->tv_sec)
 				     + timeout->tv_nsec;
 
-		return futex_wait(uaddr, val, timeout ? &timeout_ns : NULL);
+		return futex_wait(uaddr, val, timeout ? &timeout_ns : NULL,
+				  val3);
 
 	case FUTEX_WAKE:
-		return futex_wake(uaddr, val);
+		return futex_wake(uaddr, val, FUTEX_BITSET_MATCH_ANY);
+
+	case FUTEX_WAKE_BITSET:
+		if (!val3)
+			return -EINVAL;
+
+		return futex_wake(uaddr, val, val3);
 
 	case FUTEX_FD:
 	case FUTEX_REQUEUE:
@@ -345,6 +492,19 @@ UK_LLSYSCALL_R_DEFINE(int, futex, uint32_t *, uaddr, int, futex_op,
 	}
 }
 
+static int futex_init(struct uk_init_ctx *ictx __unused)
+{
+	unsigned long i;
+
+	for (i = 0; i < FUTEX_HASH_SIZE; i++) {
+		uk_spin_init(&futex_hash[i].lock);
+		UK_INIT_LIST_HEAD(&futex_hash[i].list);
+	}
+	return 0;
+}
+
+uk_early_initcall(futex_init, 0x0);
+
 #if CONFIG_LIBPOSIX_PROCESS_CLONE
 /*
  * Reference to child TID that should be cleared on thread exit
@@ -382,27 +542,22 @@ UK_LLSYSCALL_R_DEFINE(pid_t, set_tid_address, pid_t *, tid_ref)
 	return self_tid;
 }
 
-static void thread_exit_handler(struct uk_thread *child)
+static void thread_exit_handler(struct uk_thread *child __unused)
 {
-	struct uk_list_head *itr, *tmp;
-	struct uk_futex *f;
-
 	/* Clear child TID at the stored reference */
 	if (child_tid_clear_ref != NULL) {
 		*((pid_t *) child_tid_clear_ref) = 0;
-		futex_wake((uint32_t *) child_tid_clear_ref, 0);
+		futex_wake((uint32_t *) child_tid_clear_ref, 0,
+			   FUTEX_BITSET_MATCH_ANY);
 	}
 
-	/* Clear this thread's entries from the list */
-	uk_spin_lock(&futex_list_lock);
-	uk_list_for_each_safe(itr, tmp, &futex_list) {
-		f = uk_list_entry(itr, struct uk_futex, list_node);
-		if (f->thread == child) {
-			uk_list_del(&f->list_node);
-			break; /* a thread can wait on one futex */
-		}
+	/* Clear this thread's entry from its bucket (a thread can wait on
+	 * one futex)
+	 */
+	if (futex_waiting) {
+		futex_dequeue(futex_waiting);
+		futex_waiting = NULL;
 	}
-	uk_spin_unlock(&futex_list_lock);
 }
 
 UK_THREAD_INIT_PRIO(0x0, thread_exit_handler, UK_PRIO_EARLIEST);
@@ -38,8 +38,10 @@
 #include <time.h>
 
 #include <linux/futex.h>
+#include <uk/print.h>
 #include <uk/syscall.h>
 #include <uk/sched.h>
+#include <uk/plat/time.h>
 
 #if defined(__X86_32__) || defined(__x86_64__)
 #define NR_FUTEX	202
@@ -47,6 +49,10 @@
 #define NR_FUTEX	240
 #endif
 
+#define pr_info(fmt, ...)						\
+	_uk_printk(KLVL_INFO, uk_libid_self(), __NULL, 0x0, fmt,	\
+		   ##__VA_ARGS__)
+
 struct test_args {
 	uint32_t num_iterations;
 	uint32_t val;
@@ -442,4 +448,166 @@ UK_TESTCASE(posix_futex_testsuite, test_cmp_requeue_two_waiters_one_waker)
 	UK_TEST_EXPECT_SNUM_EQ(var_to_change, 3);
 }
 
+/* Attempts to wake up a waiter that announced it is about to wait */
+#define BITSET_WAKE_RETRIES	1000
+
+struct bitset_args {
+	uint32_t *futex_val;
+	uint32_t bitset;
+	int waiting;
+	int woken;
+	int ret;
+};
+
+static __noreturn void bitset_waiter_func(void *arg)
+{
+	struct bitset_args *args = (struct bitset_args *)arg;
+
+	UK_WRITE_ONCE(args->waiting, 1);
+	args->ret = futex(args->futex_val, FUTEX_WAIT_BITSET_PRIVATE, 0, NULL,
+			  NULL, args->bitset);
+	UK_WRITE_ONCE(args->woken, 1);
+	uk_sched_thread_exit();
+}
+
+UK_TESTCASE(posix_futex_testsuite, test_wake_bitset)
+{
+	uint32_t i;
+	uint32_t futex_val = 0;
+	uint32_t num_threads = 2;
+	struct uk_thread *threads[num_threads];
+	struct bitset_args args[num_threads];
+	int ret;
+
+	for (i = 0; i < num_threads; ++i) {
+		args[i] = (struct bitset_args){
+			.futex_val = &futex_val,
+			.bitset = 1U << i,
+			.waiting = 0,
+			.woken = 0,
+			.ret = -1,
+		};
+		threads[i] = uk_sched_thread_create(uk_sched_current(),
+				bitset_waiter_func, args + i, "Bitset waiter");
+		UK_TEST_ASSERT(threads[i] != NULL);
+	}
+
+	/* Wait until both waiters are about to block */
+	for (i = 0; i < num_threads; ++i)
+		while (!UK_READ_ONCE(args[i].waiting))
+			uk_sched_yield();
+
+	/* A zero bitset is invalid */
+	ret = futex(&futex_val, FUTEX_WAKE_BITSET_PRIVATE, 2, NULL, NULL, 0);
+	UK_TEST_EXPECT_SNUM_EQ(ret, -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, EINVAL);
+
+	/* Only the waiter with a matching bitset is woken up. The waiter may
+	 * not have blocked yet, so retry until it is released.
+	 */
+	for (i = 0; i < BITSET_WAKE_RETRIES; ++i) {
+		ret = futex(&futex_val, FUTEX_WAKE_BITSET_PRIVATE, 2, NULL,
+			    NULL, 2);
+		if (ret != 0)
+			break;
+		uk_sched_yield();
+	}
+	UK_TEST_EXPECT_SNUM_EQ(ret, 1);
+	if (ret == 1)
+		while (!UK_READ_ONCE(args[1].woken))
+			uk_sched_yield();
+	UK_TEST_EXPECT_ZERO(args[1].ret);
+	UK_TEST_EXPECT_ZERO(UK_READ_ONCE(args[0].woken));
+
+	/* FUTEX_WAKE matches all bitsets */
+	for (i = 0; i < BITSET_WAKE_RETRIES; ++i) {
+		ret = futex(&futex_val, FUTEX_WAKE_PRIVATE, 2, NULL, NULL, 0);
+		if (ret != 0)
+			break;
+		uk_sched_yield();
+	}
+	UK_TEST_EXPECT_SNUM_EQ(ret, 1);
+	if (ret == 1)
+		while (!UK_READ_ONCE(args[0].woken))
+			uk_sched_yield();
+	UK_TEST_EXPECT_ZERO(args[0].ret);
+}
+
+#define BENCH_PARKED		256
+#define BENCH_ROUNDS		10000
+
+struct parked_args {
+	uint32_t futex_val;
+	int parked;
+	int ret;
+};
+
+static __noreturn void parked_func(void *arg)
+{
+	struct parked_args *args = (struct parked_args *)arg;
+
+	UK_WRITE_ONCE(args->parked, 1);
+	args->ret = futex(&args->futex_val, FUTEX_WAIT_PRIVATE, 0, NULL,
+			  NULL, 0);
+	uk_sched_thread_exit();
+}
+
+/**
+ * Wake latency benchmark: Threads are parked on distinct futexes, like the
+ * idle workers of a thread pool. Measure FUTEX_WAKE on a futex without
+ * waiters, which is what an uncontended unlock or signal costs, and the
+ * wake-up of each parked thread. Both only depend on the waiters that hash
+ * to the same bucket, not on all parked threads.
+ */
+UK_TESTCASE(posix_futex_testsuite, test_wake_latency_parked)
+{
+	static struct parked_args args[BENCH_PARKED];
+	struct uk_thread *threads[BENCH_PARKED];
+	uint32_t futex_val = 0;
+	__nsec start, end;
+	int woken = 0;
+	uint32_t i;
+	int ret;
+
+	for (i = 0; i < BENCH_PARKED; ++i) {
+		args[i] = (struct parked_args){
+			.futex_val = 0,
+			.parked = 0,
+			.ret = -1,
+		};
+		threads[i] = uk_sched_thread_create(uk_sched_current(),
+				parked_func, args + i, "Parked");
+		UK_TEST_ASSERT(threads[i] != NULL);
+	}
+	for (i = 0; i < BENCH_PARKED; ++i)
+		while (!UK_READ_ONCE(args[i].parked))
+			uk_sched_yield();
+
+	start = ukplat_monotonic_clock();
+	for (i = 0; i < BENCH_ROUNDS; ++i)
+		woken += futex(&futex_val, FUTEX_WAKE_PRIVATE, 1, NULL, NULL,
+			       0);
+	end = ukplat_monotonic_clock();
+	UK_TEST_EXPECT_ZERO(woken);
+	pr_info("FUTEX_WAKE without waiters, %d parked: %"__PRInsec" ns/op\n",
+		BENCH_PARKED, (end - start) / BENCH_ROUNDS);
+
+	start = ukplat_monotonic_clock();
+	for (i = 0; i < BENCH_PARKED; ++i) {
+		/* The thread may not have reached the wait queue yet */
+		while (!(ret = futex(&args[i].futex_val, FUTEX_WAKE_PRIVATE,
+				     1, NULL, NULL, 0)))
+			uk_sched_yield();
+		UK_TEST_EXPECT_SNUM_EQ(ret, 1);
+	}
+	end = ukplat_monotonic_clock();
+	pr_info("FUTEX_WAKE of %d parked threads: %"__PRInsec" ns/op\n",
+		BENCH_PARKED, (end - start) / BENCH_PARKED);
+
+	for (i = 0; i < BENCH_PARKED; ++i) {
+		wait_thread(threads[i]);
+		UK_TEST_EXPECT_ZERO(args[i].ret);
+	}
+}
+
 uk_testsuite_register(posix_futex_testsuite, NULL);
@@ -254,6 +254,15 @@ UK_SYSCALL_R_DEFINE(int, madvise, void *, addr, size_t, len, int, advice)
 	case MADV_DONTNEED:
 		vadvice |= UK_VMA_ADV_DONTNEED;
 		break;
+	case MADV_NORMAL:
+		vadvice |= UK_VMA_ADV_NORMAL;
+		break;
+	case MADV_RANDOM:
+		vadvice |= UK_VMA_ADV_RANDOM;
+		break;
+	case MADV_SEQUENTIAL:
+		vadvice |= UK_VMA_ADV_SEQUENTIAL;
+		break;
 	default:
 		/* Just ignore unsupported advices for now. The call to
 		 * uk_vma_advise() does not have an effect but will validate
@@ -276,9 +285,37 @@ UK_SYSCALL_R_DEFINE(int, madvise, void *, addr, size_t, len, int, advice)
 
 UK_SYSCALL_R_DEFINE(int, msync, void*, addr, size_t, length, int, flags)
 {
-	/* Since writing mmap memory back to file is not supported,
-	 * this doesn't make sense.
+	struct uk_vas *vas = uk_vas_get_active();
+	unsigned long vadvice = 0;
+	__vaddr_t vaddr = (__vaddr_t)addr;
+	int rc;
+
+	if (unlikely(!PAGE_ALIGNED(vaddr)))
+		return -EINVAL;
+
+	if (unlikely(flags & ~(MS_ASYNC | MS_SYNC | MS_INVALIDATE)))
+		return -EINVAL;
+
+	if (unlikely((flags & MS_ASYNC) && (flags & MS_SYNC)))
+		return -EINVAL;
+
+#ifdef CONFIG_LIBVFSCORE
+	/* Shared file mappings are always written back synchronously. There
+	 * is nothing to invalidate since they map the pages of the page cache.
+	 * Other VMAs ignore the advice.
 	 */
+	vadvice |= UK_VMA_FILE_ADV_SYNC;
+#endif /* CONFIG_LIBVFSCORE */
+
+	rc = uk_vma_advise(vas, vaddr, PAGE_ALIGN_UP(length), vadvice,
+			   UK_VMA_FLAG_STRICT_VMA_CHECK);
+	if (unlikely(rc)) {
+		if (rc == -ENOENT)
+			return -ENOMEM;
+
+		return rc;
+	}
+
 	return 0;
 }
 
@@ -42,6 +42,7 @@
 #include <uk/arch/limits.h>
 #include <uk/arch/lcpu.h>
 #include <uk/arch/paging.h>
+#include <uk/plat/spinlock.h>
 
 #if CONFIG_HAVE_MEMTAG
 #include <uk/arch/memtag.h>
@@ -53,23 +54,51 @@
 
 struct uk_alloc *_uk_alloc_head;
 
+/* Serializes modifications of the allocator list */
+static __spinlock uk_alloc_list_lock = UKARCH_SPINLOCK_INITIALIZER();
+
 int uk_alloc_register(struct uk_alloc *a)
 {
-	struct uk_alloc *this = _uk_alloc_head;
+	struct uk_alloc *this;
+	unsigned long flags;
+
+	a->next = __NULL;
 
+	ukplat_spin_lock_irqsave(&uk_alloc_list_lock, flags);
+	this = _uk_alloc_head;
 	if (!_uk_alloc_head) {
 		_uk_alloc_head = a;
-		a->next = __NULL;
+		ukplat_spin_unlock_irqrestore(&uk_alloc_list_lock, flags);
 		return 0;
 	}
 
 	while (this && this->next)
 		this = this->next;
 	this->next = a;
-	a->next = __NULL;
+	ukplat_spin_unlock_irqrestore(&uk_alloc_list_lock, flags);
 	return 0;
 }
 
+int uk_alloc_unregister(struct uk_alloc *a)
+{
+	struct uk_alloc **this;
+	unsigned long flags;
+
+	ukplat_spin_lock_irqsave(&uk_alloc_list_lock, flags);
+	for (this = &_uk_alloc_head; *this; this = &(*this)->next) {
+		if (*this == a) {
+			*this = a->next;
+			a->next = __NULL;
+			ukplat_spin_unlock_irqrestore(&uk_alloc_list_lock,
+						      flags);
+			uk_alloc_stats_release(a);
+			return 0;
+		}
+	}
+	ukplat_spin_unlock_irqrestore(&uk_alloc_list_lock, flags);
+	return -ENOENT;
+}
+
 #ifdef CONFIG_HAVE_MEMTAG
 #define __align_metadata_ifpages __align(MEMTAG_GRANULE)
 #else
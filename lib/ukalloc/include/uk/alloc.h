@@ -85,6 +85,20 @@ struct uk_alloc_stats {
 
 	__u64 nb_enomem; /* number of times failing allocation requests */
 };
+
+/* Statistics are counted in per-LCPU slots so that allocations on different
+ * LCPUs do not write to the same cache lines. The slots are not part of the
+ * allocator but live in a per-LCPU table, an allocator is assigned a table
+ * index with its first counted operation. The slots are folded together when
+ * the statistics are read (see uk_alloc_stats_get()).
+ */
+struct uk_alloc_stats_set {
+	unsigned int slot; /* index in the per-LCPU table, 0 if unassigned */
+
+	/* High-water marks of the folded slots */
+	__s64 max_nb_allocs;
+	__ssz max_mem_use;
+};
 #endif /* CONFIG_LIBUKALLOC_IFSTATS */
 
 struct uk_alloc {
@@ -113,7 +127,7 @@ struct uk_alloc {
 	uk_alloc_addmem_func_t addmem;
 
 #if CONFIG_LIBUKALLOC_IFSTATS
-	struct uk_alloc_stats _stats;
+	struct uk_alloc_stats_set _stats;
 #endif
 
 	/* internal */
@@ -310,6 +324,10 @@ unsigned long uk_alloc_pavailmem_total(void);
 #if CONFIG_LIBUKALLOC_IFSTATS
 /*
  * Memory allocation statistics
+ *
+ * The per-LCPU slots are summed up. The high-water marks `max_nb_allocs` and
+ * `max_mem_use` are exact if all operations were counted on one LCPU.
+ * Otherwise, they are sampled from the sums whenever statistics are read.
  */
 void uk_alloc_stats_get(struct uk_alloc *a, struct uk_alloc_stats *dst);
 
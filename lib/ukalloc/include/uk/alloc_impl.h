@@ -47,6 +47,17 @@ extern "C" {
 
 int uk_alloc_register(struct uk_alloc *a);
 
+/* Removes an allocator from the list of registered allocators. If it was the
+ * default allocator, the next registered allocator becomes the default.
+ * The statistics slot of the allocator is released.
+ *
+ * NOTE: The allocator must be quiescent: No operation on it may be in
+ * progress on any LCPU or follow. The slot can be handed out to another
+ * allocator right away, so late operations would be counted for that
+ * allocator.
+ */
+int uk_alloc_unregister(struct uk_alloc *a);
+
 /**
  * Compatibility functions that can be used by allocator implementations to
  * fill out callback functions in `struct uk_alloc` when just a subset of the
@@ -84,9 +95,11 @@ long uk_alloc_pmaxalloc_compat(struct uk_alloc *a);
 #if CONFIG_LIBUKALLOC_IFSTATS
 #include <string.h>
 #include <uk/preempt.h>
+#include <uk/plat/lcpu.h>
+#include <uk/arch/lcpu.h>
 
 #if CONFIG_LIBUKALLOC_IFSTATS_GLOBAL
-extern struct uk_alloc_stats _uk_alloc_stats_global;
+extern struct uk_alloc_stats_set _uk_alloc_stats_global;
 #endif /* CONFIG_LIBUKALLOC_IFSTATS_GLOBAL */
 
 /* NOTE: Please do not use this function directly */
@@ -110,12 +123,43 @@ static inline void _uk_alloc_stats_refresh_minmax(struct uk_alloc_stats *stats)
 	}
 }
 
+/* Per-LCPU table of statistics slots. Index 0 is not assigned to any
+ * allocator: It takes the counts of allocators that did not get a slot
+ * because the table is exhausted.
+ */
+struct uk_alloc_stats_slots {
+	struct uk_alloc_stats slot[CONFIG_LIBUKALLOC_IFSTATS_SLOTS];
+} __align(CACHE_LINE_SIZE);
+
+extern UKPLAT_PER_LCPU_DEFINE(struct uk_alloc_stats_slots,
+			      _uk_alloc_stats_slots);
+
+/* NOTE: Please do not use these functions directly */
+unsigned int _uk_alloc_stats_slot_assign(struct uk_alloc_stats_set *set);
+void _uk_alloc_stats_slot_release(struct uk_alloc_stats_set *set);
+
+/* NOTE: Please do not use this function directly
+ * Returns the slot of the current LCPU. Must be called with preemption
+ * disabled, so that the slot is only written by its LCPU.
+ */
+static inline struct uk_alloc_stats *
+_uk_alloc_stats_lcpu(struct uk_alloc_stats_set *set)
+{
+	unsigned int slot = __atomic_load_n(&set->slot, __ATOMIC_ACQUIRE);
+
+	if (unlikely(!slot))
+		slot = _uk_alloc_stats_slot_assign(set);
+	return &ukplat_per_lcpu_current(_uk_alloc_stats_slots).slot[slot];
+}
+
 /* NOTE: Please do not use this function directly */
-static inline void _uk_alloc_stats_count_alloc(struct uk_alloc_stats *stats,
+static inline void _uk_alloc_stats_count_alloc(struct uk_alloc_stats_set *set,
 					       void *ptr, __sz size)
 {
-	/* TODO: SMP safety */
+	struct uk_alloc_stats *stats;
+
 	uk_preempt_disable();
+	stats = _uk_alloc_stats_lcpu(set);
 	if (likely(ptr)) {
 		stats->tot_nb_allocs++;
 
@@ -130,11 +174,13 @@ static inline void _uk_alloc_stats_count_alloc(struct uk_alloc_stats *stats,
 }
 
 /* NOTE: Please do not use this function directly */
-static inline void _uk_alloc_stats_count_free(struct uk_alloc_stats *stats,
+static inline void _uk_alloc_stats_count_free(struct uk_alloc_stats_set *set,
 					      void *ptr, __sz size)
 {
-	/* TODO: SMP safety */
+	struct uk_alloc_stats *stats;
+
 	uk_preempt_disable();
+	stats = _uk_alloc_stats_lcpu(set);
 	if (likely(ptr)) {
 		stats->tot_nb_frees++;
 
@@ -145,16 +191,32 @@ static inline void _uk_alloc_stats_count_free(struct uk_alloc_stats *stats,
 	uk_preempt_enable();
 }
 
+/* NOTE: Please do not use this function directly */
+static inline void _uk_alloc_stats_count_release(struct uk_alloc_stats_set *set,
+						 __sz size)
+{
+	struct uk_alloc_stats *stats;
+
+	uk_preempt_disable();
+	stats = _uk_alloc_stats_lcpu(set);
+	stats->cur_mem_use -= size;
+	uk_preempt_enable();
+}
+
 #if CONFIG_LIBUKALLOC_IFSTATS_GLOBAL
 #define _uk_alloc_stats_global_count_alloc(ptr, size) \
 	_uk_alloc_stats_count_alloc(&_uk_alloc_stats_global, (ptr), (size))
 #define _uk_alloc_stats_global_count_free(ptr, freed_size) \
 	_uk_alloc_stats_count_free(&_uk_alloc_stats_global, (ptr), (freed_size))
+#define _uk_alloc_stats_global_count_release(size) \
+	_uk_alloc_stats_count_release(&_uk_alloc_stats_global, (size))
 #else /* !CONFIG_LIBUKALLOC_IFSTATS_GLOBAL */
 #define _uk_alloc_stats_global_count_alloc(ptr, size) \
 	do {} while (0)
 #define _uk_alloc_stats_global_count_free(ptr, freed_size) \
 	do {} while (0)
+#define _uk_alloc_stats_global_count_release(size) \
+	do {} while (0)
 #endif /* !CONFIG_LIBUKALLOC_IFSTATS_GLOBAL */
 
 /*
@@ -189,9 +251,28 @@ static inline void _uk_alloc_stats_count_free(struct uk_alloc_stats *stats,
 	uk_alloc_stats_count_free((a), (ptr),				\
 				  ((__sz) (num_pages)) << __PAGE_SHIFT)
 
+/* Accounts memory that is released without individual free operations,
+ * e.g., by rewinding a region
+ */
+#define uk_alloc_stats_count_release(a, size)				\
+	do {								\
+		_uk_alloc_stats_count_release(&((a)->_stats), (size));	\
+		_uk_alloc_stats_global_count_release((size));		\
+	} while (0)
+
+/* NOTE: Only for initializing an allocator, a slot that is still assigned
+ * is not released (see uk_alloc_stats_release())
+ */
 #define uk_alloc_stats_reset(a)						\
 	memset(&(a)->_stats, 0, sizeof((a)->_stats))
 
+/* Releases the statistics slot of an allocator that is not used anymore.
+ * This is done by uk_alloc_unregister() for registered allocators. The same
+ * quiescence requirements apply.
+ */
+#define uk_alloc_stats_release(a)					\
+	_uk_alloc_stats_slot_release(&(a)->_stats)
+
 #else /* !CONFIG_LIBUKALLOC_IFSTATS */
 #define uk_alloc_stats_count_alloc(a, ptr, size) do {} while (0)
 #define uk_alloc_stats_count_palloc(a, ptr, num_pages) do {} while (0)
@@ -199,15 +280,18 @@ static inline void _uk_alloc_stats_count_free(struct uk_alloc_stats *stats,
 #define uk_alloc_stats_count_penomem(a, num_pages) do {} while (0)
 #define uk_alloc_stats_count_free(a, ptr, freed_size) do {} while (0)
 #define uk_alloc_stats_count_pfree(a, ptr, num_pages) do {} while (0)
+#define uk_alloc_stats_count_release(a, size) do {} while (0)
 #define uk_alloc_stats_reset(a) do {} while (0)
+#define uk_alloc_stats_release(a) do {} while (0)
 #endif /* !CONFIG_LIBUKALLOC_IFSTATS */
 
-/* Shortcut for doing a registration of an allocator that does not implement
- * palloc() or pfree()
+/* Shortcut for setting up an allocator that does not implement palloc() or
+ * pfree(), without registering it. Such an allocator is only reachable
+ * through its handle (e.g., a region carved from another allocator).
  */
-#define uk_alloc_init_malloc(a, malloc_f, calloc_f, realloc_f, free_f,	\
-			     posix_memalign_f, memalign_f, maxalloc_f,	\
-			     availmem_f, addmem_f)			\
+#define uk_alloc_setup_malloc(a, malloc_f, calloc_f, realloc_f, free_f,	\
+			      posix_memalign_f, memalign_f, maxalloc_f,	\
+			      availmem_f, addmem_f)			\
 	do {								\
 		(a)->malloc         = (malloc_f);			\
 		(a)->calloc         = (calloc_f);			\
@@ -226,6 +310,20 @@ static inline void _uk_alloc_stats_count_free(struct uk_alloc_stats *stats,
 		(a)->addmem         = (addmem_f);			\
 									\
 		uk_alloc_stats_reset((a));				\
+	} while (0)
+
+/* Shortcut for doing a registration of an allocator that does not implement
+ * palloc() or pfree()
+ */
+#define uk_alloc_init_malloc(a, malloc_f, calloc_f, realloc_f, free_f,	\
+			     posix_memalign_f, memalign_f, maxalloc_f,	\
+			     availmem_f, addmem_f)			\
+	do {								\
+		uk_alloc_setup_malloc((a), (malloc_f), (calloc_f),	\
+				      (realloc_f), (free_f),		\
+				      (posix_memalign_f), (memalign_f),	\
+				      (maxalloc_f), (availmem_f),	\
+				      (addmem_f));			\
 		uk_alloc_register((a));					\
 	} while (0)
 
@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UK_ALLOC_PROFILE_H__
+#define __UK_ALLOC_PROFILE_H__
+
+#include <uk/alloc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Sampling heap profiler
+ * ----------------------
+ * Allocations are sampled by the number of bytes that were allocated on an
+ * LCPU: On average, one allocation is sampled every `interval` bytes. The
+ * stack of each sampled allocation is recorded until the object is freed.
+ * The default allocator is profiled from the early initcalls on.
+ */
+
+struct uk_alloc_profile_stats {
+	__u64 nr_live;     /* number of sampled objects that are allocated */
+	__u64 bytes_live;  /* size of the sampled objects that are allocated */
+	__u64 nr_dropped;  /* samples that did not fit into the sample table */
+};
+
+/**
+ * Profiles the allocations of an allocator by hooking its operations.
+ * Only one allocator can be profiled.
+ *
+ * @param a
+ *   Allocator to profile
+ * @return
+ *   - 0: Success
+ *   - (-EBUSY): Another allocator is already profiled
+ */
+int uk_alloc_profile_attach(struct uk_alloc *a);
+
+/**
+ * Sets the average sampling interval. The new interval applies to the next
+ * allocation on each LCPU.
+ *
+ * @param interval
+ *   Interval in bytes, 0 disables sampling. Sampled objects that are still
+ *   allocated remain recorded until they are freed.
+ */
+void uk_alloc_profile_set_interval(__sz interval);
+
+__sz uk_alloc_profile_get_interval(void);
+
+void uk_alloc_profile_stats_get(struct uk_alloc_profile_stats *dst);
+
+/**
+ * Prints the live samples as heap profile in the legacy gperftools text
+ * format (`heap_v2`). The profile can be read with
+ * `pprof <debug image> <profile>`, which symbolizes the addresses and
+ * scales the samples to estimate the total heap usage per call stack.
+ * Message prefixes that are added by the console have to be removed first.
+ *
+ * @param klvl
+ *   Kernel message level to print with
+ */
+void uk_alloc_profile_dumpk(int klvl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UK_ALLOC_PROFILE_H__ */
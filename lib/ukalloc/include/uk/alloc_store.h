@@ -19,4 +19,11 @@
 #define UK_ALLOC_STATS_MAX_MEM_USE		0x0a
 #define UK_ALLOC_STATS_NUM_ENOMEM		0x0b
 
+/* heap profiler entry IDs (`CONFIG_LIBUKALLOC_PROFILE`) */
+#define UK_ALLOC_PROFILE_INTERVAL		0x0c
+#define UK_ALLOC_PROFILE_LIVE_SAMPLES		0x0d
+#define UK_ALLOC_PROFILE_LIVE_BYTES		0x0e
+#define UK_ALLOC_PROFILE_DROPPED		0x0f
+#define UK_ALLOC_PROFILE_DUMP			0x10
+
 #endif /* __UK_ALLOC_STORE_H__ */
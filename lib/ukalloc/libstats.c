@@ -58,16 +58,18 @@ static inline struct uk_alloc *_uk_alloc_get_actual_default(void)
 	__sz _before_nb_allocs;						\
 	__sz _before_tot_nb_allocs;					\
 	__sz _before_nb_enomem;						\
+	struct uk_alloc_stats *_stats;					\
 									\
 	uk_preempt_disable();						\
-	_before_mem_use       = (p)->_stats.cur_mem_use;		\
-	_before_nb_allocs     = (p)->_stats.cur_nb_allocs;		\
-	_before_tot_nb_allocs = (p)->_stats.tot_nb_allocs;		\
-	_before_nb_enomem     = (p)->_stats.nb_enomem;
+	_stats = _uk_alloc_stats_lcpu(&(p)->_stats);			\
+	_before_mem_use       = _stats->cur_mem_use;			\
+	_before_nb_allocs     = _stats->cur_nb_allocs;			\
+	_before_tot_nb_allocs = _stats->tot_nb_allocs;			\
+	_before_nb_enomem     = _stats->nb_enomem;
 
 #define WATCH_STATS_END(p, nb_allocs_diff, nb_enomem_diff,		\
 			mem_use_diff, alloc_size)			\
-	__sz _nb_allocs = (p)->_stats.tot_nb_allocs			\
+	__sz _nb_allocs = _stats->tot_nb_allocs				\
 			  - _before_tot_nb_allocs;			\
 									\
 	/* NOTE: We assume that an allocator call does at
@@ -76,25 +78,28 @@ static inline struct uk_alloc *_uk_alloc_get_actual_default(void)
 	 */								\
 	UK_ASSERT(_nb_allocs <= 1);					\
 									\
-	*(mem_use_diff)   = (p)->_stats.cur_mem_use			\
+	*(mem_use_diff)   = _stats->cur_mem_use				\
 			    - _before_mem_use;				\
-	*(nb_allocs_diff) = (__ssz) (p)->_stats.cur_nb_allocs		\
+	*(nb_allocs_diff) = (__ssz) _stats->cur_nb_allocs		\
 			    - _before_nb_allocs;			\
-	*(nb_enomem_diff) = (__ssz) (p)->_stats.nb_enomem		\
+	*(nb_enomem_diff) = (__ssz) _stats->nb_enomem			\
 			    - _before_nb_enomem;			\
 	if (_nb_allocs > 0)						\
-		*(alloc_size) = (p)->_stats.last_alloc_size;		\
+		*(alloc_size) = _stats->last_alloc_size;		\
 	else								\
 		*(alloc_size) = 0; /* there was no new allocation */	\
 	uk_preempt_enable();
 
-static inline void update_stats(struct uk_alloc_stats *stats,
+static inline void update_stats(struct uk_alloc_stats_set *set,
 				__ssz nb_allocs_diff,
 				__ssz nb_enomem_diff,
 				__ssz mem_use_diff,
 				__sz last_alloc_size)
 {
+	struct uk_alloc_stats *stats;
+
 	uk_preempt_disable();
+	stats = _uk_alloc_stats_lcpu(set);
 	if (nb_allocs_diff >= 0)
 		stats->tot_nb_allocs += nb_allocs_diff;
 	else
@@ -322,8 +327,6 @@ static struct uk_alloc _uk_alloc_lib_default = {
 	.availmem       = wrapper_availmem,
 	.pavailmem      = uk_alloc_pavailmem_compat,
 	.addmem         = wrapper_addmem,
-
-	._stats         = { 0 },
 };
 
 static __used __section(".uk_alloc_libstats") __align(8)
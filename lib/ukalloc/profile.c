@@ -0,0 +1,503 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#include <errno.h>
+#include <string.h>
+#include <uk/alloc_impl.h>
+#include <uk/alloc_profile.h>
+#include <uk/arch/spinlock.h>
+#include <uk/assert.h>
+#include <uk/atomic.h>
+#include <uk/essentials.h>
+#include <uk/init.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/spinlock.h>
+#include <uk/print.h>
+#if CONFIG_LIBUKSTORE
+#include <uk/alloc_store.h>
+#include <uk/store.h>
+#endif /* CONFIG_LIBUKSTORE */
+
+#define PROFILE_SAMPLES		CONFIG_LIBUKALLOC_PROFILE_SAMPLES
+#define PROFILE_DEPTH		CONFIG_LIBUKALLOC_PROFILE_DEPTH
+#define PROFILE_HASH_SIZE	(2 * PROFILE_SAMPLES)
+
+/* A frame pointer that moves further than this is considered garbage and
+ * ends the stack walk.
+ */
+#define PROFILE_FRAME_MAX	(4 * __PAGE_SIZE)
+
+struct profile_sample {
+	struct profile_sample *next; /* hash chain or free list */
+	void *ptr;
+	__sz size;
+	unsigned int depth;
+	__uptr stack[PROFILE_DEPTH];
+};
+
+/* Samples are taken from a static table, so that sampling does not
+ * allocate from the allocator that is profiled.
+ */
+static struct profile_sample profile_samples[PROFILE_SAMPLES];
+static struct profile_sample *profile_free_samples;
+static struct profile_sample *profile_hash[PROFILE_HASH_SIZE];
+static __u64 profile_nr_live;
+static __u64 profile_bytes_live;
+static __u64 profile_nr_dropped;
+
+/* Protects the sample table */
+static __spinlock profile_lock = UKARCH_SPINLOCK_INITIALIZER();
+
+static __sz profile_interval = CONFIG_LIBUKALLOC_PROFILE_INTERVAL;
+
+/* Bytes until the next sample on each LCPU */
+struct profile_lcpu {
+	__sz left;
+	__u32 rnd;
+};
+
+static UKPLAT_PER_LCPU_DEFINE(struct profile_lcpu, profile_lcpu);
+
+/* Operations of the profiled allocator */
+static struct uk_alloc *profile_a;
+static uk_alloc_malloc_func_t profile_orig_malloc;
+static uk_alloc_calloc_func_t profile_orig_calloc;
+static uk_alloc_realloc_func_t profile_orig_realloc;
+static uk_alloc_posix_memalign_func_t profile_orig_posix_memalign;
+static uk_alloc_memalign_func_t profile_orig_memalign;
+static uk_alloc_free_func_t profile_orig_free;
+
+static inline unsigned int profile_hash_ptr(const void *ptr)
+{
+	return (unsigned int)((((__uptr)ptr >> 4) * 0x9e3779b97f4a7c15ULL)
+			      >> 32) % PROFILE_HASH_SIZE;
+}
+
+/* The distance to the next sample is drawn uniformly from
+ * [interval / 2, interval * 3 / 2), so that allocation patterns that repeat
+ * with the interval are not sampled at the same call site only.
+ */
+static __sz profile_next(struct profile_lcpu *pl, __sz interval)
+{
+	__u32 x = pl->rnd;
+
+	/* xorshift32 */
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	pl->rnd = x;
+
+	return interval / 2 + x % interval;
+}
+
+static int profile_should_sample(__sz size)
+{
+	struct profile_lcpu *pl;
+	unsigned long flags;
+	__sz interval;
+	int ret = 0;
+
+	interval = UK_READ_ONCE(profile_interval);
+	if (!interval)
+		return 0;
+
+	flags = ukplat_lcpu_save_irqf();
+	pl = &ukplat_per_lcpu_current(profile_lcpu);
+
+	/* The countdown may still be drawn from a larger interval that was set
+	 * before. Clamp it, so that a smaller interval takes effect right away
+	 * on every LCPU.
+	 */
+	if (unlikely(pl->left >= interval + interval / 2))
+		pl->left = profile_next(pl, interval);
+
+	if (size < pl->left) {
+		pl->left -= size;
+	} else {
+		pl->left = profile_next(pl, interval);
+		ret = 1;
+	}
+	ukplat_lcpu_restore_irqf(flags);
+	return ret;
+}
+
+/* Records the caller of the allocator operation and, with frame pointers,
+ * its callers. `fp` is the frame address of the operation.
+ */
+static unsigned int profile_backtrace(__uptr fp, __uptr caller,
+				      __uptr *stack)
+{
+	unsigned int depth = 0;
+
+	stack[depth++] = caller;
+#ifndef __OMIT_FRAMEPOINTER__
+	{
+		__uptr next, ret;
+
+		while (depth < PROFILE_DEPTH) {
+			next = ((__uptr *)fp)[0];
+			if (next <= fp || next - fp > PROFILE_FRAME_MAX ||
+			    (next & (sizeof(__uptr) - 1)))
+				break;
+			fp = next;
+			ret = ((__uptr *)fp)[1];
+			if (!ret)
+				break;
+			stack[depth++] = ret;
+		}
+	}
+#else /* __OMIT_FRAMEPOINTER__ */
+	(void)fp;
+#endif /* __OMIT_FRAMEPOINTER__ */
+	return depth;
+}
+
+static void profile_track(void *ptr, __sz size, __uptr fp, __uptr caller)
+{
+	struct profile_sample *s;
+	__uptr stack[PROFILE_DEPTH];
+	unsigned long flags;
+	unsigned int depth;
+	unsigned int h;
+
+	depth = profile_backtrace(fp, caller, stack);
+	h = profile_hash_ptr(ptr);
+
+	ukplat_spin_lock_irqsave(&profile_lock, flags);
+	s = profile_free_samples;
+	if (unlikely(!s)) {
+		profile_nr_dropped++;
+		ukplat_spin_unlock_irqrestore(&profile_lock, flags);
+		return;
+	}
+	profile_free_samples = s->next;
+
+	s->ptr = ptr;
+	s->size = size;
+	s->depth = depth;
+	memcpy(s->stack, stack, depth * sizeof(stack[0]));
+	s->next = profile_hash[h];
+	UK_WRITE_ONCE(profile_hash[h], s);
+	profile_nr_live++;
+	profile_bytes_live += size;
+	ukplat_spin_unlock_irqrestore(&profile_lock, flags);
+}
+
+/* Removes the sample of `ptr` from the table and returns it. The sample has
+ * to be released with `profile_release()` or put back with
+ * `profile_retrack()`.
+ */
+static struct profile_sample *profile_untrack(void *ptr)
+{
+	struct profile_sample **sp, *s;
+	unsigned long flags;
+	unsigned int h;
+
+	/* Most objects are not sampled, so most chains are empty */
+	h = profile_hash_ptr(ptr);
+	if (!UK_READ_ONCE(profile_hash[h]))
+		return __NULL;
+
+	ukplat_spin_lock_irqsave(&profile_lock, flags);
+	for (sp = &profile_hash[h]; (s = *sp); sp = &s->next) {
+		if (s->ptr == ptr) {
+			*sp = s->next;
+			profile_nr_live--;
+			profile_bytes_live -= s->size;
+			break;
+		}
+	}
+	ukplat_spin_unlock_irqrestore(&profile_lock, flags);
+	return s;
+}
+
+static void profile_retrack(struct profile_sample *s)
+{
+	unsigned long flags;
+	unsigned int h;
+
+	h = profile_hash_ptr(s->ptr);
+	ukplat_spin_lock_irqsave(&profile_lock, flags);
+	s->next = profile_hash[h];
+	UK_WRITE_ONCE(profile_hash[h], s);
+	profile_nr_live++;
+	profile_bytes_live += s->size;
+	ukplat_spin_unlock_irqrestore(&profile_lock, flags);
+}
+
+static void profile_release(struct profile_sample *s)
+{
+	unsigned long flags;
+
+	ukplat_spin_lock_irqsave(&profile_lock, flags);
+	s->next = profile_free_samples;
+	profile_free_samples = s;
+	ukplat_spin_unlock_irqrestore(&profile_lock, flags);
+}
+
+/* The hooks take the stack from their own frame: The first return address
+ * is the caller of the allocator operation.
+ */
+#define PROFILE_SAMPLE(ptr, size)					\
+	do {								\
+		if ((ptr) && profile_should_sample(size))		\
+			profile_track((ptr), (size), __frame_addr(0),	\
+				      __return_addr(0));		\
+	} while (0)
+
+static void *profile_malloc(struct uk_alloc *a, __sz size)
+{
+	void *ptr;
+
+	ptr = profile_orig_malloc(a, size);
+	PROFILE_SAMPLE(ptr, size);
+	return ptr;
+}
+
+static void *profile_calloc(struct uk_alloc *a, __sz nmemb, __sz size)
+{
+	void *ptr;
+
+	/* The multiplication does not overflow if the allocation succeeded */
+	ptr = profile_orig_calloc(a, nmemb, size);
+	PROFILE_SAMPLE(ptr, nmemb * size);
+	return ptr;
+}
+
+static int profile_posix_memalign(struct uk_alloc *a, void **memptr,
+				  __sz align, __sz size)
+{
+	int rc;
+
+	rc = profile_orig_posix_memalign(a, memptr, align, size);
+	if (rc == 0)
+		PROFILE_SAMPLE(*memptr, size);
+	return rc;
+}
+
+static void *profile_memalign(struct uk_alloc *a, __sz align, __sz size)
+{
+	void *ptr;
+
+	ptr = profile_orig_memalign(a, align, size);
+	PROFILE_SAMPLE(ptr, size);
+	return ptr;
+}
+
+static void *profile_realloc(struct uk_alloc *a, void *ptr, __sz size)
+{
+	struct profile_sample *s = __NULL;
+	void *ret;
+
+	/* The sample is removed before the object can be freed. Otherwise,
+	 * another LCPU could allocate and sample the same address meanwhile.
+	 */
+	if (ptr)
+		s = profile_untrack(ptr);
+	ret = profile_orig_realloc(a, ptr, size);
+	if (s) {
+		/* The object is unchanged if the reallocation failed */
+		if (!ret && size)
+			profile_retrack(s);
+		else
+			profile_release(s);
+	}
+	PROFILE_SAMPLE(ret, size);
+	return ret;
+}
+
+static void profile_free(struct uk_alloc *a, void *ptr)
+{
+	struct profile_sample *s;
+
+	if (ptr && (s = profile_untrack(ptr)))
+		profile_release(s);
+	profile_orig_free(a, ptr);
+}
+
+int uk_alloc_profile_attach(struct uk_alloc *a)
+{
+	__lcpuidx idx;
+	unsigned int i;
+
+	UK_ASSERT(a);
+
+	if (profile_a)
+		return -EBUSY;
+	profile_a = a;
+
+	for (i = 0; i < PROFILE_SAMPLES; i++) {
+		profile_samples[i].next = profile_free_samples;
+		profile_free_samples = &profile_samples[i];
+	}
+	for (idx = 0; idx < CONFIG_UKPLAT_LCPU_MAXCOUNT; idx++) {
+		ukplat_per_lcpu(profile_lcpu, idx).rnd = 0x9e3779b9 + idx;
+		ukplat_per_lcpu(profile_lcpu, idx).left =
+			profile_next(&ukplat_per_lcpu(profile_lcpu, idx),
+				     profile_interval ? profile_interval : 1);
+	}
+
+	/* Compatibility operations are implemented with `malloc`,
+	 * `posix_memalign`, and `free`. Their allocations are sampled by
+	 * these operations already.
+	 */
+	profile_orig_malloc = a->malloc;
+	a->malloc = profile_malloc;
+	if (a->calloc != uk_calloc_compat) {
+		profile_orig_calloc = a->calloc;
+		a->calloc = profile_calloc;
+	}
+	if (a->realloc != uk_realloc_compat) {
+		profile_orig_realloc = a->realloc;
+		a->realloc = profile_realloc;
+	}
+	profile_orig_posix_memalign = a->posix_memalign;
+	a->posix_memalign = profile_posix_memalign;
+	if (a->memalign != uk_memalign_compat) {
+		profile_orig_memalign = a->memalign;
+		a->memalign = profile_memalign;
+	}
+	profile_orig_free = a->free;
+	a->free = profile_free;
+	return 0;
+}
+
+void uk_alloc_profile_set_interval(__sz interval)
+{
+	UK_WRITE_ONCE(profile_interval, interval);
+}
+
+__sz uk_alloc_profile_get_interval(void)
+{
+	return UK_READ_ONCE(profile_interval);
+}
+
+void uk_alloc_profile_stats_get(struct uk_alloc_profile_stats *dst)
+{
+	unsigned long flags;
+
+	UK_ASSERT(dst);
+
+	ukplat_spin_lock_irqsave(&profile_lock, flags);
+	dst->nr_live = profile_nr_live;
+	dst->bytes_live = profile_bytes_live;
+	dst->nr_dropped = profile_nr_dropped;
+	ukplat_spin_unlock_irqrestore(&profile_lock, flags);
+}
+
+/* Copies a sample under the lock, so that it can be printed without
+ * holding the lock. Returns 0 if there is no further sample.
+ */
+static int profile_sample_read(unsigned int *h, unsigned int *pos,
+			       struct profile_sample *dst)
+{
+	struct profile_sample *s;
+	unsigned long flags;
+	unsigned int i;
+	int ret = 0;
+
+	ukplat_spin_lock_irqsave(&profile_lock, flags);
+	for (; *h < PROFILE_HASH_SIZE; (*h)++, *pos = 0) {
+		s = profile_hash[*h];
+		for (i = 0; s && i < *pos; i++)
+			s = s->next;
+		if (s) {
+			*dst = *s;
+			(*pos)++;
+			ret = 1;
+			break;
+		}
+	}
+	ukplat_spin_unlock_irqrestore(&profile_lock, flags);
+	return ret;
+}
+
+void uk_alloc_profile_dumpk(int klvl)
+{
+	struct uk_alloc_profile_stats stats;
+	struct profile_sample s;
+	unsigned int h = 0, pos = 0;
+	unsigned int i;
+
+	uk_alloc_profile_stats_get(&stats);
+	uk_printk(klvl, "heap profile: %6"__PRIu64": %8"__PRIu64
+		  " [%6"__PRIu64": %8"__PRIu64"] @ heap_v2/%"__PRIsz"\n",
+		  stats.nr_live, stats.bytes_live,
+		  stats.nr_live, stats.bytes_live,
+		  uk_alloc_profile_get_interval());
+
+	/* Every sample is printed on its own, pprof merges equal stacks */
+	while (profile_sample_read(&h, &pos, &s)) {
+		uk_printk(klvl, "%6u: %8"__PRIsz" [%6u: %8"__PRIsz"] @",
+			  1, s.size, 1, s.size);
+		for (i = 0; i < s.depth; i++)
+			uk_printk(klvl, " 0x%"__PRIx64, (__u64)s.stack[i]);
+		uk_printk(klvl, "\n");
+	}
+
+	if (stats.nr_dropped)
+		uk_printk(klvl, "# %"__PRIu64" samples dropped\n",
+			  stats.nr_dropped);
+}
+
+static int profile_init(struct uk_init_ctx *ictx __unused)
+{
+	struct uk_alloc *a = _uk_alloc_head;
+
+	if (unlikely(!a)) {
+		uk_pr_warn("No allocator to profile\n");
+		return 0;
+	}
+	return uk_alloc_profile_attach(a);
+}
+
+uk_early_initcall(profile_init, 0x0);
+
+#if CONFIG_LIBUKSTORE
+static int get_profile_interval(void *cookie __unused, __u64 *out)
+{
+	*out = (__u64)uk_alloc_profile_get_interval();
+	return 0;
+}
+
+static int set_profile_interval(void *cookie __unused, __u64 val)
+{
+	uk_alloc_profile_set_interval((__sz)val);
+	return 0;
+}
+
+#define PROFILE_STATS_GETTER(field)					\
+	static int get_profile_##field(void *cookie __unused, __u64 *out) \
+	{								\
+		struct uk_alloc_profile_stats stats;			\
+									\
+		uk_alloc_profile_stats_get(&stats);			\
+		*out = stats.field;					\
+		return 0;						\
+	}
+
+/* Writing the entry prints the profile with the written kernel message
+ * level
+ */
+static int set_profile_dump(void *cookie __unused, __u64 val)
+{
+	uk_alloc_profile_dumpk((int)val);
+	return 0;
+}
+
+UK_STORE_STATIC_ENTRY(UK_ALLOC_PROFILE_INTERVAL, profile_interval, u64,
+		      get_profile_interval, set_profile_interval);
+PROFILE_STATS_GETTER(nr_live)
+UK_STORE_STATIC_ENTRY(UK_ALLOC_PROFILE_LIVE_SAMPLES, profile_live_samples,
+		      u64, get_profile_nr_live, NULL);
+PROFILE_STATS_GETTER(bytes_live)
+UK_STORE_STATIC_ENTRY(UK_ALLOC_PROFILE_LIVE_BYTES, profile_live_bytes, u64,
+		      get_profile_bytes_live, NULL);
+PROFILE_STATS_GETTER(nr_dropped)
+UK_STORE_STATIC_ENTRY(UK_ALLOC_PROFILE_DROPPED, profile_dropped, u64,
+		      get_profile_nr_dropped, NULL);
+UK_STORE_STATIC_ENTRY(UK_ALLOC_PROFILE_DUMP, profile_dump, u64,
+		      NULL, set_profile_dump);
+#endif /* CONFIG_LIBUKSTORE */
@@ -31,14 +31,180 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <uk/print.h>
 #include <uk/store.h>
 #include <uk/alloc_impl.h>
 #include <uk/alloc_store.h>
 
 #if CONFIG_LIBUKALLOC_IFSTATS_GLOBAL
-struct uk_alloc_stats _uk_alloc_stats_global = { 0 };
+struct uk_alloc_stats_set _uk_alloc_stats_global = { 0 };
 #endif
 
+UKPLAT_PER_LCPU_DEFINE(struct uk_alloc_stats_slots, _uk_alloc_stats_slots);
+
+#define SLOT_MAP_BITS		(sizeof(unsigned long) * 8)
+#define SLOT_MAP_LEN		DIV_ROUND_UP(CONFIG_LIBUKALLOC_IFSTATS_SLOTS, \
+					     SLOT_MAP_BITS)
+
+/* Assigned slots, slot 0 is the overflow slot and never handed out */
+static unsigned long slot_map[SLOT_MAP_LEN] = { 1UL };
+
+static unsigned int slot_map_get(void)
+{
+	unsigned long word, bit;
+	unsigned int i, slot;
+
+	for (i = 0; i < SLOT_MAP_LEN; i++) {
+		word = __atomic_load_n(&slot_map[i], __ATOMIC_RELAXED);
+		while (~word) {
+			bit = __builtin_ctzl(~word);
+			slot = i * SLOT_MAP_BITS + bit;
+			if (slot >= CONFIG_LIBUKALLOC_IFSTATS_SLOTS)
+				return 0;
+			if (__atomic_compare_exchange_n(&slot_map[i], &word,
+							word | (1UL << bit),
+							0, __ATOMIC_ACQ_REL,
+							__ATOMIC_RELAXED))
+				return slot;
+		}
+	}
+	return 0;
+}
+
+static void slot_map_put(unsigned int slot)
+{
+	UK_ASSERT(slot && slot < CONFIG_LIBUKALLOC_IFSTATS_SLOTS);
+
+	__atomic_fetch_and(&slot_map[slot / SLOT_MAP_BITS],
+			   ~(1UL << (slot % SLOT_MAP_BITS)), __ATOMIC_RELEASE);
+}
+
+/* Called with the first counted operation of an allocator. Returns the
+ * overflow slot if the table is exhausted, the assignment is retried with
+ * the next operation then.
+ */
+unsigned int _uk_alloc_stats_slot_assign(struct uk_alloc_stats_set *set)
+{
+	static int warned;
+	unsigned int slot, cur = 0;
+	unsigned int i;
+
+	slot = slot_map_get();
+	if (unlikely(!slot)) {
+		if (!__atomic_exchange_n(&warned, 1, __ATOMIC_RELAXED))
+			uk_pr_warn("Out of allocator statistics slots, "
+				   "increase CONFIG_LIBUKALLOC_IFSTATS_SLOTS\n");
+		return 0;
+	}
+
+	for (i = 0; i < CONFIG_UKPLAT_LCPU_MAXCOUNT; i++)
+		memset(&ukplat_per_lcpu(_uk_alloc_stats_slots, i).slot[slot],
+		       0, sizeof(struct uk_alloc_stats));
+
+	/* Another LCPU may have assigned a slot concurrently */
+	if (!__atomic_compare_exchange_n(&set->slot, &cur, slot, 0,
+					 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		slot_map_put(slot);
+		return cur;
+	}
+	return slot;
+}
+
+void _uk_alloc_stats_slot_release(struct uk_alloc_stats_set *set)
+{
+	unsigned int slot;
+
+	slot = __atomic_exchange_n(&set->slot, 0, __ATOMIC_ACQ_REL);
+	if (slot)
+		slot_map_put(slot);
+}
+
+/* Raises a high-water mark of a set to at least val and returns the mark.
+ * Readers of the same allocator may fold its statistics concurrently.
+ */
+#define STATS_MARK_RAISE(mark, val)					\
+	({								\
+		__typeof__(*(mark)) __val = (val);			\
+		__typeof__(*(mark)) __cur =				\
+			__atomic_load_n((mark), __ATOMIC_RELAXED);	\
+									\
+		while (__cur < __val &&					\
+		       !__atomic_compare_exchange_n((mark), &__cur,	\
+						    __val, 0,		\
+						    __ATOMIC_RELAXED,	\
+						    __ATOMIC_RELAXED))	\
+			;						\
+		MAX(__cur, __val);					\
+	})
+
+/* Sums up the per-LCPU slots. Slots of other LCPUs may be updated
+ * concurrently, so the result is a snapshot of individually read counters.
+ *
+ * The high-water marks of a slot only describe the sum as long as no other
+ * slot was ever used. Once an allocator has been used on more than one LCPU,
+ * its high-water marks are sampled from the folded counters whenever the
+ * statistics are read. Peaks between two reads are missed then, so the marks
+ * are lower bounds. Tracking them exactly would require shared counters that
+ * are written by every operation, which the per-LCPU slots avoid.
+ */
+static void uk_alloc_stats_fold(struct uk_alloc_stats_set *set,
+				struct uk_alloc_stats *dst)
+{
+	struct uk_alloc_stats *stats, *active = __NULL;
+	unsigned int i, slot, nr_active = 0;
+	__s64 max_nb_allocs;
+	__ssz max_mem_use;
+
+	memset(dst, 0, sizeof(*dst));
+
+	slot = __atomic_load_n(&set->slot, __ATOMIC_ACQUIRE);
+	if (!slot)
+		return; /* nothing counted yet */
+
+	for (i = 0; i < CONFIG_UKPLAT_LCPU_MAXCOUNT; i++) {
+		stats = &ukplat_per_lcpu(_uk_alloc_stats_slots, i).slot[slot];
+		if (!stats->tot_nb_allocs && !stats->tot_nb_frees &&
+		    !stats->nb_enomem)
+			continue;
+
+		dst->tot_nb_allocs += stats->tot_nb_allocs;
+		dst->tot_nb_frees  += stats->tot_nb_frees;
+		dst->cur_nb_allocs += stats->cur_nb_allocs;
+		dst->cur_mem_use   += stats->cur_mem_use;
+		dst->nb_enomem     += stats->nb_enomem;
+
+		if (stats->max_alloc_size > dst->max_alloc_size)
+			dst->max_alloc_size = stats->max_alloc_size;
+		if (stats->min_alloc_size &&
+		    (!dst->min_alloc_size ||
+		     stats->min_alloc_size < dst->min_alloc_size))
+			dst->min_alloc_size = stats->min_alloc_size;
+
+		active = stats;
+		nr_active++;
+	}
+
+	if (nr_active == 1) {
+		dst->last_alloc_size = active->last_alloc_size;
+		max_nb_allocs = active->max_nb_allocs;
+		max_mem_use   = active->max_mem_use;
+	} else {
+		stats = &ukplat_per_lcpu_current(_uk_alloc_stats_slots)
+			.slot[slot];
+		dst->last_alloc_size = stats->last_alloc_size;
+		max_nb_allocs = dst->cur_nb_allocs;
+		max_mem_use   = dst->cur_mem_use;
+	}
+
+	/* Keep the marks of the set monotonic, they carry the marks of a
+	 * single slot over to the time the allocator is used on more LCPUs
+	 */
+	dst->max_nb_allocs = STATS_MARK_RAISE(&set->max_nb_allocs,
+					      max_nb_allocs);
+	dst->max_mem_use   = STATS_MARK_RAISE(&set->max_mem_use,
+					      max_mem_use);
+}
+
 void uk_alloc_stats_get(struct uk_alloc *a,
 			struct uk_alloc_stats *dst)
 {
@@ -46,7 +212,7 @@ void uk_alloc_stats_get(struct uk_alloc *a,
 	UK_ASSERT(dst);
 
 	uk_preempt_disable();
-	memcpy(dst, &a->_stats, sizeof(*dst));
+	uk_alloc_stats_fold(&a->_stats, dst);
 	uk_preempt_enable();
 }
 
@@ -64,87 +230,57 @@ void uk_alloc_stats_get_global(struct uk_alloc_stats *dst)
 	UK_ASSERT(dst);
 
 	uk_preempt_disable();
-	memcpy(dst, &_uk_alloc_stats_global, sizeof(*dst));
+	uk_alloc_stats_fold(&_uk_alloc_stats_global, dst);
 	uk_preempt_enable();
 }
 
-static int get_last_alloc_size(void *cookie __unused, __u64 *out)
-{
-	*out = (__u64) _uk_alloc_stats_global.last_alloc_size;
-	return 0;
-}
+#define STATS_GLOBAL_GETTER(field, type)				\
+	static int get_##field(void *cookie __unused, type *out)	\
+	{								\
+		struct uk_alloc_stats stats;				\
+									\
+		uk_alloc_stats_get_global(&stats);			\
+		*out = (type) stats.field;				\
+		return 0;						\
+	}
+
+STATS_GLOBAL_GETTER(last_alloc_size, __u64)
 UK_STORE_STATIC_ENTRY(UK_ALLOC_STATS_LAST_ALLOC_SIZE, last_alloc_size, u64,
 		      get_last_alloc_size, NULL);
 
-static int get_max_alloc_size(void *cookie __unused, __u64 *out)
-{
-	*out = (__u64) _uk_alloc_stats_global.max_alloc_size;
-	return 0;
-}
+STATS_GLOBAL_GETTER(max_alloc_size, __u64)
 UK_STORE_STATIC_ENTRY(UK_ALLOC_STATS_MAX_ALLOC_SIZE, max_alloc_size, u64,
 		      get_max_alloc_size, NULL);
 
-static int get_min_alloc_size(void *cookie __unused, __u64 *out)
-{
-	*out = (__u64) _uk_alloc_stats_global.min_alloc_size;
-	return 0;
-}
+STATS_GLOBAL_GETTER(min_alloc_size, __u64)
 UK_STORE_STATIC_ENTRY(UK_ALLOC_STATS_MIN_ALLOC_SIZE, min_alloc_size, u64,
 		      get_min_alloc_size, NULL);
 
-static int get_tot_nb_allocs(void *cookie __unused, __u64 *out)
-{
-	*out = (__u64) _uk_alloc_stats_global.tot_nb_allocs;
-	return 0;
-}
+STATS_GLOBAL_GETTER(tot_nb_allocs, __u64)
 UK_STORE_STATIC_ENTRY(UK_ALLOC_STATS_TOTAL_NUM_ALLOCS, tot_nb_allocs, u64,
 		      get_tot_nb_allocs, NULL);
 
-static int get_tot_nb_frees(void *cookie __unused, __u64 *out)
-{
-	*out = (__u64) _uk_alloc_stats_global.tot_nb_frees;
-	return 0;
-}
+STATS_GLOBAL_GETTER(tot_nb_frees, __u64)
 UK_STORE_STATIC_ENTRY(UK_ALLOC_STATS_TOTAL_NUM_FREES, tot_nb_frees, u64,
 		      get_tot_nb_frees, NULL);
 
-static int get_cur_nb_allocs(void *cookie __unused, __s64 *out)
-{
-	*out = (__s64) _uk_alloc_stats_global.cur_nb_allocs;
-	return 0;
-}
+STATS_GLOBAL_GETTER(cur_nb_allocs, __s64)
 UK_STORE_STATIC_ENTRY(UK_ALLOC_STATS_CUR_NUM_ALLOCS, cur_nb_allocs, s64,
 		      get_cur_nb_allocs, NULL);
 
-static int get_max_nb_allocs(void *cookie __unused, __s64 *out)
-{
-	*out = (__s64) _uk_alloc_stats_global.max_nb_allocs;
-	return 0;
-}
+STATS_GLOBAL_GETTER(max_nb_allocs, __s64)
 UK_STORE_STATIC_ENTRY(UK_ALLOC_STATS_MAX_NUM_ALLOCS, max_nb_allocs, s64,
 		      get_max_nb_allocs, NULL);
 
-static int get_cur_mem_use(void *cookie __unused, __s64 *out)
-{
-	*out = (__s64) _uk_alloc_stats_global.cur_mem_use;
-	return 0;
-}
+STATS_GLOBAL_GETTER(cur_mem_use, __s64)
 UK_STORE_STATIC_ENTRY(UK_ALLOC_STATS_CUR_MEM_USE, cur_mem_use, s64,
 		      get_cur_mem_use, NULL);
 
-static int get_max_mem_use(void *cookie __unused, __s64 *out)
-{
-	*out = (__s64) _uk_alloc_stats_global.max_mem_use;
-	return 0;
-}
+STATS_GLOBAL_GETTER(max_mem_use, __s64)
 UK_STORE_STATIC_ENTRY(UK_ALLOC_STATS_MAX_MEM_USE, max_mem_use, s64,
 		      get_max_mem_use, NULL);
 
-static int get_nb_enomem(void *cookie __unused, __u64 *out)
-{
-	*out = (__u64) _uk_alloc_stats_global.nb_enomem;
-	return 0;
-}
+STATS_GLOBAL_GETTER(nb_enomem, __u64)
 UK_STORE_STATIC_ENTRY(UK_ALLOC_STATS_NUM_ENOMEM, nb_enomem, u64,
 		      get_nb_enomem, NULL);
 
@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <uk/test.h>
+#include <uk/alloc.h>
+#include <uk/alloc_profile.h>
+#include <uk/print.h>
+
+#define TEST_OBJS		16
+#define TEST_OBJ_LEN		64
+
+/* With an interval of one byte, every allocation is sampled */
+UK_TESTCASE(ukalloc, test_profile_live)
+{
+	struct uk_alloc_profile_stats before, stats;
+	struct uk_alloc *a = uk_alloc_get_default();
+	void *objs[TEST_OBJS];
+	__sz interval;
+	unsigned int i;
+	void *p;
+
+	interval = uk_alloc_profile_get_interval();
+	uk_alloc_profile_stats_get(&before);
+	uk_alloc_profile_set_interval(1);
+
+	for (i = 0; i < TEST_OBJS; i++) {
+		objs[i] = uk_malloc(a, TEST_OBJ_LEN);
+		UK_TEST_ASSERT(objs[i] != NULL);
+	}
+	uk_alloc_profile_stats_get(&stats);
+	UK_TEST_EXPECT_SNUM_EQ(stats.nr_live + stats.nr_dropped,
+			       before.nr_live + before.nr_dropped + TEST_OBJS);
+
+	/* A reallocated object keeps exactly one sample */
+	p = uk_realloc(a, objs[0], 2 * TEST_OBJ_LEN);
+	UK_TEST_ASSERT(p != NULL);
+	objs[0] = p;
+	uk_alloc_profile_stats_get(&stats);
+	UK_TEST_EXPECT_SNUM_EQ(stats.nr_live + stats.nr_dropped,
+			       before.nr_live + before.nr_dropped + TEST_OBJS);
+
+	uk_alloc_profile_dumpk(KLVL_INFO);
+
+	for (i = 0; i < TEST_OBJS; i++)
+		uk_free(a, objs[i]);
+	uk_alloc_profile_set_interval(interval);
+
+	/* Sampled objects are not tracked anymore after they are freed */
+	uk_alloc_profile_stats_get(&stats);
+	UK_TEST_EXPECT_SNUM_EQ(stats.nr_live, before.nr_live);
+}
+
+uk_testsuite_register(ukalloc, NULL);
@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <uk/test.h>
+#include <uk/alloc_impl.h>
+
+#define TEST_OBJS		16
+#define TEST_OBJ_LEN		64
+
+/* The folded per-LCPU slots account every operation exactly once */
+UK_TESTCASE(ukalloc_stats, test_stats_fold)
+{
+	struct uk_alloc_stats before, stats;
+	struct uk_alloc *a = uk_alloc_get_default();
+	void *objs[TEST_OBJS];
+	unsigned int i;
+
+	uk_alloc_stats_get(a, &before);
+
+	for (i = 0; i < TEST_OBJS; i++) {
+		objs[i] = uk_malloc(a, TEST_OBJ_LEN);
+		UK_TEST_ASSERT(objs[i] != NULL);
+	}
+	uk_alloc_stats_get(a, &stats);
+	UK_TEST_EXPECT_SNUM_EQ(stats.tot_nb_allocs,
+			       before.tot_nb_allocs + TEST_OBJS);
+	UK_TEST_EXPECT_SNUM_EQ(stats.cur_nb_allocs,
+			       before.cur_nb_allocs + TEST_OBJS);
+	UK_TEST_EXPECT(stats.cur_mem_use >=
+		       before.cur_mem_use + TEST_OBJS * TEST_OBJ_LEN);
+	UK_TEST_EXPECT(stats.max_nb_allocs >= stats.cur_nb_allocs);
+	UK_TEST_EXPECT(stats.max_mem_use >= stats.cur_mem_use);
+
+	for (i = 0; i < TEST_OBJS; i++)
+		uk_free(a, objs[i]);
+
+	uk_alloc_stats_get(a, &stats);
+	UK_TEST_EXPECT_SNUM_EQ(stats.tot_nb_frees,
+			       before.tot_nb_frees + TEST_OBJS);
+	UK_TEST_EXPECT_SNUM_EQ(stats.cur_nb_allocs, before.cur_nb_allocs);
+	UK_TEST_EXPECT_SNUM_EQ(stats.cur_mem_use, before.cur_mem_use);
+	UK_TEST_EXPECT(stats.max_nb_allocs >=
+		       before.cur_nb_allocs + TEST_OBJS);
+}
+
+/* A released slot does not report the counts of its previous owner */
+UK_TESTCASE(ukalloc_stats, test_stats_slot_release)
+{
+	struct uk_alloc a = { 0 };
+	struct uk_alloc_stats stats;
+	int obj;
+
+	uk_alloc_stats_get(&a, &stats);
+	UK_TEST_EXPECT_SNUM_EQ(stats.tot_nb_allocs, 0);
+
+	_uk_alloc_stats_count_alloc(&a._stats, &obj, TEST_OBJ_LEN);
+	UK_TEST_EXPECT(a._stats.slot != 0);
+	uk_alloc_stats_get(&a, &stats);
+	UK_TEST_EXPECT_SNUM_EQ(stats.tot_nb_allocs, 1);
+	UK_TEST_EXPECT_SNUM_EQ(stats.cur_mem_use, TEST_OBJ_LEN);
+
+	_uk_alloc_stats_slot_release(&a._stats);
+	UK_TEST_EXPECT_SNUM_EQ(a._stats.slot, 0);
+	uk_alloc_stats_get(&a, &stats);
+	UK_TEST_EXPECT_SNUM_EQ(stats.tot_nb_allocs, 0);
+	UK_TEST_EXPECT_SNUM_EQ(stats.cur_mem_use, 0);
+}
+
+uk_testsuite_register(ukalloc_stats, NULL);
@@ -50,6 +50,7 @@
 #include <uk/print.h>
 #include <uk/assert.h>
 #include <uk/page.h>
+#include <uk/plat/spinlock.h>
 
 typedef struct chunk_head_st chunk_head_t;
 typedef struct chunk_tail_st chunk_tail_t;
@@ -70,9 +71,14 @@ struct chunk_tail_st {
 #define FREELIST_ALIGNED(ptr, lvl) \
 	!((uintptr_t)(ptr) & ((1ULL << ((lvl) + __PAGE_SHIFT)) - 1))
 
+/* Number of memory regions that are indexed within the allocator
+ * descriptor. The descriptor still fits into a single page. A larger index
+ * is allocated from the allocator itself.
+ */
+#define MEMR_INLINE 128
+
 /* keep a bitmap for each memory region separately */
 struct uk_bbpalloc_memr {
-	struct uk_bbpalloc_memr *next;
 	unsigned long first_page;
 	unsigned long nr_pages;
 	unsigned long mm_alloc_bitmap_size;
@@ -81,11 +87,21 @@ struct uk_bbpalloc_memr {
 
 struct uk_bbpalloc {
 	unsigned long nr_free_pages;
+	/* Bit i is set if the free list of order i is not empty */
+	unsigned long free_orders;
 	chunk_head_t *free_head[FREELIST_SIZE];
 	chunk_head_t free_tail[FREELIST_SIZE];
-	struct uk_bbpalloc_memr *memr_head;
+	/* Memory regions sorted by address */
+	struct uk_bbpalloc_memr **memr;
+	unsigned long nr_memr;
+	unsigned long max_memr;
+	struct uk_bbpalloc_memr *memr_inline[MEMR_INLINE];
+	/* Protects the allocator state against concurrent LCPUs */
+	__spinlock lock;
 };
 
+UK_CTASSERT(FREELIST_SIZE <= sizeof(unsigned long) * 8);
+
 #if CONFIG_LIBUKALLOCBBUDDY_FREELIST_SANITY
 /* Provide sanity checking of freelists, walking their length and checking
  * for consistency. Useful when suspecting memory corruption.
@@ -157,20 +173,34 @@ for (size_t i = 0; i < FREELIST_SIZE; i++) { \
 #define BYTES_PER_MAPWORD   (sizeof(unsigned long))
 #define PAGES_PER_MAPWORD   (BYTES_PER_MAPWORD * BITS_PER_BYTE)
 
+static inline int memr_contains(struct uk_bbpalloc_memr *memr,
+				unsigned long page_va)
+{
+	return (page_va >= memr->first_page)
+		&& (page_va < (memr->first_page +
+			       (memr->nr_pages << __PAGE_SHIFT)));
+}
+
 static inline struct uk_bbpalloc_memr *map_get_memr(struct uk_bbpalloc *b,
 						    unsigned long page_va)
 {
-	struct uk_bbpalloc_memr *memr = NULL;
+	struct uk_bbpalloc_memr *memr;
+	unsigned long lo, hi, mid;
 
 	/*
-	 * Find bitmap of according memory region
-	 * This is a linear search but it is expected that we have only a few
-	 * of them. It should be just one region in most cases
+	 * Find bitmap of according memory region with a binary search.
+	 * Firmware memory maps can be fragmented into many regions.
 	 */
-	for (memr = b->memr_head; memr != NULL; memr = memr->next) {
-		if ((page_va >= memr->first_page)
-		    && (page_va < (memr->first_page +
-		    (memr->nr_pages << __PAGE_SHIFT))))
+	lo = 0;
+	hi = b->nr_memr;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		memr = b->memr[mid];
+		if (page_va < memr->first_page)
+			hi = mid;
+		else if (!memr_contains(memr, page_va))
+			lo = mid + 1;
+		else
 			return memr;
 	}
 
@@ -180,15 +210,16 @@ static inline struct uk_bbpalloc_memr *map_get_memr(struct uk_bbpalloc *b,
 	return NULL;
 }
 
-static inline unsigned long allocated_in_map(struct uk_bbpalloc *b,
-				   unsigned long page_va)
+static inline unsigned long allocated_in_map(struct uk_bbpalloc_memr *memr,
+					     unsigned long page_va)
 {
-	struct uk_bbpalloc_memr *memr = map_get_memr(b, page_va);
 	unsigned long page_idx;
 	unsigned long bm_idx, bm_off;
 
-	/* treat pages outside of region as allocated */
-	if (!memr)
+	/* treat pages outside of region as allocated. Chunks never span
+	 * regions, so a buddy in another region cannot be merged anyway.
+	 */
+	if (!memr_contains(memr, page_va))
 		return 1;
 
 	page_idx = (page_va - memr->first_page) >> __PAGE_SHIFT;
@@ -198,10 +229,9 @@ static inline unsigned long allocated_in_map(struct uk_bbpalloc *b,
 	return ((memr)->mm_alloc_bitmap[bm_idx] & (1UL << bm_off));
 }
 
-static void map_alloc(struct uk_bbpalloc *b, uintptr_t first_page,
-		      unsigned long nr_pages)
+static void map_alloc(struct uk_bbpalloc *b, struct uk_bbpalloc_memr *memr,
+		      uintptr_t first_page, unsigned long nr_pages)
 {
-	struct uk_bbpalloc_memr *memr;
 	unsigned long first_page_idx, end_page_idx;
 	unsigned long start_off, end_off, curr_idx, end_idx;
 
@@ -210,7 +240,6 @@ static void map_alloc(struct uk_bbpalloc *b, uintptr_t first_page,
 	 * is in a really bad state. It means that the specified page
 	 * region is not covered by our allocator.
 	 */
-	memr = map_get_memr(b, first_page);
 	UK_ASSERT(memr != NULL);
 	UK_ASSERT((first_page + (nr_pages << __PAGE_SHIFT))
 		  <= (memr->first_page + (memr->nr_pages << __PAGE_SHIFT)));
@@ -236,10 +265,9 @@ static void map_alloc(struct uk_bbpalloc *b, uintptr_t first_page,
 	b->nr_free_pages -= nr_pages;
 }
 
-static void map_free(struct uk_bbpalloc *b, uintptr_t first_page,
-		     unsigned long nr_pages)
+static void map_free(struct uk_bbpalloc *b, struct uk_bbpalloc_memr *memr,
+		     uintptr_t first_page, unsigned long nr_pages)
 {
-	struct uk_bbpalloc_memr *memr;
 	unsigned long first_page_idx, end_page_idx;
 	unsigned long start_off, end_off, curr_idx, end_idx;
 
@@ -248,7 +276,6 @@ static void map_free(struct uk_bbpalloc *b, uintptr_t first_page,
 	 * is in a really bad state. It means that the specified page
 	 * region is not covered by our allocator.
 	 */
-	memr = map_get_memr(b, first_page);
 	UK_ASSERT(memr != NULL);
 	UK_ASSERT((first_page + (nr_pages << __PAGE_SHIFT))
 		  <= (memr->first_page + (memr->nr_pages << __PAGE_SHIFT)));
@@ -291,15 +318,45 @@ static inline unsigned long num_pages_to_order(unsigned long num_pages)
 	return uk_flsl(num_pages - 1) + 1;
 }
 
+/*********************
+ * FREE LISTS
+ *  `free_orders` mirrors which free lists are not empty, so that the
+ *  smallest order that can satisfy a request is found with a single bit scan.
+ */
+static inline void freelist_link(struct uk_bbpalloc *b, chunk_head_t *ch,
+				 size_t level)
+{
+	chunk_tail_t *ct;
+
+	ct = (chunk_tail_t *)((char *)ch + (1UL << (level + __PAGE_SHIFT))) - 1;
+	ch->level = level;
+	ch->next = b->free_head[level];
+	ch->pprev = &b->free_head[level];
+	ct->level = level;
+
+	ch->next->pprev = &ch->next;
+	b->free_head[level] = ch;
+	b->free_orders |= 1UL << level;
+}
+
+static inline void freelist_unlink(struct uk_bbpalloc *b, chunk_head_t *ch,
+				   size_t level)
+{
+	*(ch->pprev) = ch->next;
+	ch->next->pprev = ch->pprev;
+	if (FREELIST_EMPTY(b->free_head[level]))
+		b->free_orders &= ~(1UL << level);
+}
+
 /*********************
  * BINARY BUDDY PAGE ALLOCATOR
  */
-static void *bbuddy_palloc(struct uk_alloc *a, unsigned long num_pages)
+static void *__bbuddy_palloc(struct uk_alloc *a, unsigned long num_pages)
 {
 	struct uk_bbpalloc *b;
 	size_t i;
+	unsigned long orders;
 	chunk_head_t *alloc_ch, *spare_ch;
-	chunk_tail_t *spare_ct;
 
 	UK_ASSERT(a != NULL);
 	b = (struct uk_bbpalloc *)&a->priv;
@@ -309,39 +366,28 @@ static void *bbuddy_palloc(struct uk_alloc *a, unsigned long num_pages)
 	size_t order = (size_t)num_pages_to_order(num_pages);
 
 	/* Find smallest order which can satisfy the request. */
-	for (i = order; i < FREELIST_SIZE; i++) {
-		if (!FREELIST_EMPTY(b->free_head[i]))
-			break;
-	}
-	if (i >= FREELIST_SIZE)
+	if (unlikely(order >= FREELIST_SIZE))
+		goto no_memory;
+	orders = b->free_orders >> order;
+	if (!orders)
 		goto no_memory;
+	i = order + uk_ffsl(orders);
 
 	/* Unlink a chunk. */
 	alloc_ch = b->free_head[i];
-	b->free_head[i] = alloc_ch->next;
-	alloc_ch->next->pprev = alloc_ch->pprev;
+	freelist_unlink(b, alloc_ch, i);
 
 	/* We may have to break the chunk a number of times. */
 	while (i != order) {
-		/* Split into two equal parts. */
+		/* Split into two equal parts and link in the spare one. */
 		i--;
 		spare_ch = (chunk_head_t *)((char *)alloc_ch
 					    + (1UL << (i + __PAGE_SHIFT)));
-		spare_ct = (chunk_tail_t *)((char *)spare_ch
-					    + (1UL << (i + __PAGE_SHIFT))) - 1;
-
-		/* Create new header for spare chunk. */
-		spare_ch->level = i;
-		spare_ch->next = b->free_head[i];
-		spare_ch->pprev = &b->free_head[i];
-		spare_ct->level = i;
-
-		/* Link in the spare chunk. */
-		spare_ch->next->pprev = &spare_ch->next;
-		b->free_head[i] = spare_ch;
+		freelist_link(b, spare_ch, i);
 	}
 	UK_ASSERT(FREELIST_ALIGNED(alloc_ch, order));
-	map_alloc(b, (uintptr_t)alloc_ch, 1UL << order);
+	map_alloc(b, map_get_memr(b, (uintptr_t)alloc_ch),
+		  (uintptr_t)alloc_ch, 1UL << order);
 
 	uk_alloc_stats_count_palloc(a, (void *) alloc_ch, num_pages);
 	freelist_sanitycheck(b->free_head);
@@ -356,11 +402,12 @@ no_memory:
 	return NULL;
 }
 
-static void bbuddy_pfree(struct uk_alloc *a, void *obj, unsigned long num_pages)
+static void __bbuddy_pfree(struct uk_alloc *a, void *obj,
+			   unsigned long num_pages)
 {
 	struct uk_bbpalloc *b;
+	struct uk_bbpalloc_memr *memr;
 	chunk_head_t *freed_ch, *to_merge_ch;
-	chunk_tail_t *freed_ct;
 	unsigned long mask;
 
 	UK_ASSERT(a != NULL);
@@ -375,73 +422,81 @@ static void bbuddy_pfree(struct uk_alloc *a, void *obj, unsigned long num_pages)
 	/* if the object is not page aligned it was clearly not from us */
 	UK_ASSERT((((uintptr_t)obj) & (__PAGE_SIZE - 1)) == 0);
 
-	/* First free the chunk */
-	map_free(b, (uintptr_t)obj, 1UL << order);
+	/* First free the chunk. Buddies are always in the same region, so
+	 * it is looked up only once.
+	 */
+	memr = map_get_memr(b, (uintptr_t)obj);
+	map_free(b, memr, (uintptr_t)obj, 1UL << order);
 
 	/* Create free chunk */
 	freed_ch = (chunk_head_t *)obj;
-	freed_ct = (chunk_tail_t *)((char *)obj
-				    + (1UL << (order + __PAGE_SHIFT))) - 1;
 
 	/* Now, possibly we can conseal chunks together */
-	while (order < FREELIST_SIZE) {
+	while (order < FREELIST_SIZE - 1) {
 		mask = 1UL << (order + __PAGE_SHIFT);
-		if ((unsigned long)freed_ch & mask) {
-			to_merge_ch = (chunk_head_t *)((char *)freed_ch - mask);
-			if (allocated_in_map(b, (uintptr_t)to_merge_ch)
-			    || to_merge_ch->level != order)
-				break;
-
-			/* Merge with predecessor */
-			freed_ch = to_merge_ch;
-		} else {
-			to_merge_ch = (chunk_head_t *)((char *)freed_ch + mask);
-			if (allocated_in_map(b, (uintptr_t)to_merge_ch)
-			    || to_merge_ch->level != order)
-				break;
-
-			/* Merge with successor */
-			freed_ct =
-			    (chunk_tail_t *)((char *)to_merge_ch + mask) - 1;
-		}
+		to_merge_ch = (chunk_head_t *)((uintptr_t)freed_ch ^ mask);
+		if (allocated_in_map(memr, (uintptr_t)to_merge_ch)
+		    || to_merge_ch->level != order)
+			break;
 
 		/* We are commited to merging, unlink the chunk */
-		*(to_merge_ch->pprev) = to_merge_ch->next;
-		to_merge_ch->next->pprev = to_merge_ch->pprev;
+		freelist_unlink(b, to_merge_ch, order);
+
+		/* Merge with predecessor */
+		if (to_merge_ch < freed_ch)
+			freed_ch = to_merge_ch;
 
 		order++;
 	}
 
 	/* Link the new chunk */
-	freed_ch->level = order;
-	freed_ch->next = b->free_head[order];
-	freed_ch->pprev = &b->free_head[order];
-	freed_ct->level = order;
-
-	freed_ch->next->pprev = &freed_ch->next;
-	b->free_head[order] = freed_ch;
+	freelist_link(b, freed_ch, order);
 
 	freelist_sanitycheck(b->free_head);
 }
 
+static void *bbuddy_palloc(struct uk_alloc *a, unsigned long num_pages)
+{
+	struct uk_bbpalloc *b;
+	unsigned long flags;
+	void *obj;
+
+	UK_ASSERT(a != NULL);
+	b = (struct uk_bbpalloc *)&a->priv;
+
+	ukplat_spin_lock_irqsave(&b->lock, flags);
+	obj = __bbuddy_palloc(a, num_pages);
+	ukplat_spin_unlock_irqrestore(&b->lock, flags);
+	return obj;
+}
+
+static void bbuddy_pfree(struct uk_alloc *a, void *obj, unsigned long num_pages)
+{
+	struct uk_bbpalloc *b;
+	unsigned long flags;
+
+	UK_ASSERT(a != NULL);
+	b = (struct uk_bbpalloc *)&a->priv;
+
+	ukplat_spin_lock_irqsave(&b->lock, flags);
+	__bbuddy_pfree(a, obj, num_pages);
+	ukplat_spin_unlock_irqrestore(&b->lock, flags);
+}
+
 static long bbuddy_pmaxalloc(struct uk_alloc *a)
 {
 	struct uk_bbpalloc *b;
-	size_t i, order;
+	unsigned long orders;
 
 	UK_ASSERT(a != NULL);
 	b = (struct uk_bbpalloc *)&a->priv;
 
 	/* Find biggest order that has still elements available */
-	order = FREELIST_SIZE;
-	for (i = 0; i < FREELIST_SIZE; i++) {
-		if (!FREELIST_EMPTY(b->free_head[i]))
-			order = i;
-	}
-	if (order == FREELIST_SIZE)
+	orders = UK_READ_ONCE(b->free_orders);
+	if (!orders)
 		return 0; /* no memory left */
 
-	return (long) (1 << order);
+	return 1L << uk_flsl(orders);
 }
 
 static long bbuddy_pavailmem(struct uk_alloc *a)
@@ -451,17 +506,37 @@ static long bbuddy_pavailmem(struct uk_alloc *a)
 	UK_ASSERT(a != NULL);
 	b = (struct uk_bbpalloc *)&a->priv;
 
-	return (long) b->nr_free_pages;
+	return (long)UK_READ_ONCE(b->nr_free_pages);
 }
 
-static int bbuddy_addmem(struct uk_alloc *a, void *base, size_t len)
+/* Doubles the capacity of the region index */
+static int bbuddy_memr_grow(struct uk_alloc *a)
+{
+	struct uk_bbpalloc *b = (struct uk_bbpalloc *)&a->priv;
+	struct uk_bbpalloc_memr **memr;
+	unsigned long num_pages;
+
+	num_pages = DIV_ROUND_UP(2 * b->max_memr * sizeof(*memr), __PAGE_SIZE);
+	memr = __bbuddy_palloc(a, num_pages);
+	if (!memr)
+		return -ENOMEM;
+
+	memcpy(memr, b->memr, b->nr_memr * sizeof(*memr));
+	if (b->memr != b->memr_inline)
+		__bbuddy_pfree(a, b->memr,
+			     DIV_ROUND_UP(b->max_memr * sizeof(*memr),
+					  __PAGE_SIZE));
+	b->memr = memr;
+	b->max_memr = 2 * b->max_memr;
+	return 0;
+}
+
+static int __bbuddy_addmem(struct uk_alloc *a, void *base, size_t len)
 {
 	struct uk_bbpalloc *b;
 	struct uk_bbpalloc_memr *memr;
 	size_t memr_size;
-	unsigned long i;
-	chunk_head_t *ch;
-	chunk_tail_t *ct;
+	unsigned long i, pos;
 	uintptr_t min, max, range;
 
 	UK_ASSERT(a != NULL);
@@ -492,6 +567,13 @@ static int bbuddy_addmem(struct uk_alloc *a, void *base, size_t len)
 		return -EINVAL;
 	}
 
+	if (b->nr_memr == b->max_memr && bbuddy_memr_grow(a) < 0) {
+		uk_pr_err("%"__PRIuptr": Failed to add memory region %"__PRIuptr"-%"__PRIuptr": Cannot grow region index\n",
+			  (uintptr_t) a, (uintptr_t) base,
+			  (uintptr_t) base + (uintptr_t) len);
+		return -ENOMEM;
+	}
+
 	memr = (struct uk_bbpalloc_memr *)min;
 
 	/*
@@ -516,16 +598,21 @@ static int bbuddy_addmem(struct uk_alloc *a, void *base, size_t len)
 	 * Initialize region's bitmap
 	 */
 	memr->first_page = min;
-	/* add to list */
-	memr->next = b->memr_head;
-	b->memr_head = memr;
+	/* add to index */
+	for (pos = b->nr_memr; pos > 0; pos--) {
+		if (b->memr[pos - 1]->first_page < min)
+			break;
+		b->memr[pos] = b->memr[pos - 1];
+	}
+	b->memr[pos] = memr;
+	b->nr_memr++;
 
 	/* All allocated by default. */
 	memset(memr->mm_alloc_bitmap, (unsigned char) ~0,
 			memr->mm_alloc_bitmap_size);
 
 	/* free up the memory we've been given to play with */
-	map_free(b, min, memr->nr_pages);
+	map_free(b, memr, min, memr->nr_pages);
 
 	while (range != 0) {
 		/*
@@ -540,17 +627,9 @@ static int bbuddy_addmem(struct uk_alloc *a, void *base, size_t len)
 			    (uintptr_t)a, min, (uintptr_t)(min + (1UL << i)),
 			    (i - __PAGE_SHIFT));
 
-		ch = (chunk_head_t *)min;
+		freelist_link(b, (chunk_head_t *)min, i - __PAGE_SHIFT);
 		min += 1UL << i;
 		range -= 1UL << i;
-		ct = (chunk_tail_t *)min - 1;
-		i -= __PAGE_SHIFT;
-		ch->level = i;
-		ch->next = b->free_head[i];
-		ch->pprev = &b->free_head[i];
-		ch->next->pprev = &ch->next;
-		b->free_head[i] = ch;
-		ct->level = i;
 	}
 
 	freelist_sanitycheck(b->free_head);
@@ -558,6 +637,21 @@ static int bbuddy_addmem(struct uk_alloc *a, void *base, size_t len)
 	return 0;
 }
 
+static int bbuddy_addmem(struct uk_alloc *a, void *base, size_t len)
+{
+	struct uk_bbpalloc *b;
+	unsigned long flags;
+	int rc;
+
+	UK_ASSERT(a != NULL);
+	b = (struct uk_bbpalloc *)&a->priv;
+
+	ukplat_spin_lock_irqsave(&b->lock, flags);
+	rc = __bbuddy_addmem(a, base, len);
+	ukplat_spin_unlock_irqrestore(&b->lock, flags);
+	return rc;
+}
+
 struct uk_alloc *uk_allocbbuddy_init(void *base, size_t len)
 {
 	struct uk_alloc *a;
@@ -592,7 +686,11 @@ struct uk_alloc *uk_allocbbuddy_init(void *base, size_t len)
 		b->free_tail[i].pprev = &b->free_head[i];
 		b->free_tail[i].next = NULL;
 	}
-	b->memr_head = NULL;
+	b->free_orders = 0;
+	b->memr = b->memr_inline;
+	b->nr_memr = 0;
+	b->max_memr = MEMR_INLINE;
+	ukarch_spin_init(&b->lock);
 
 	/* initialize and register allocator interface */
 	uk_alloc_init_palloc(a, bbuddy_palloc, bbuddy_pfree,
@@ -0,0 +1,149 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <uk/test.h>
+#include <uk/alloc_impl.h>
+#include <uk/allocbbuddy.h>
+#include <uk/print.h>
+#include <uk/plat/time.h>
+
+#define pr_info(fmt, ...)						\
+	_uk_printk(KLVL_INFO, uk_libid_self(), __NULL, 0x0, fmt,	\
+		   ##__VA_ARGS__)
+
+/* The test heap is split into many small memory regions with a gap of one
+ * page in between, like a fragmented firmware memory map. There are enough
+ * regions to outgrow the index that is embedded in the allocator descriptor
+ * (128 entries) twice.
+ */
+#define TEST_HEAP_PAGES		2048
+#define TEST_FIRST_PAGES	64
+#define TEST_MEMR_PAGES		3
+#define TEST_MEMR_INLINE	128
+#define BENCH_OBJS		128
+#define BENCH_ROUNDS		100
+
+struct test_heap {
+	void *mem;
+	struct uk_alloc *a;
+	unsigned int nr_memr;
+};
+
+static int test_heap_init(struct test_heap *h)
+{
+	__uptr base;
+	__sz off;
+
+	h->mem = uk_palloc(uk_alloc_get_default(), TEST_HEAP_PAGES);
+	if (!h->mem)
+		return -1;
+	base = (__uptr)h->mem;
+
+	h->a = uk_allocbbuddy_init(h->mem, TEST_FIRST_PAGES << __PAGE_SHIFT);
+	if (!h->a) {
+		uk_pfree(uk_alloc_get_default(), h->mem, TEST_HEAP_PAGES);
+		return -1;
+	}
+
+	h->nr_memr = 1;
+	for (off = TEST_FIRST_PAGES + 1;
+	     off + TEST_MEMR_PAGES <= TEST_HEAP_PAGES;
+	     off += TEST_MEMR_PAGES + 1) {
+		if (uk_alloc_addmem(h->a, (void *)(base + (off << __PAGE_SHIFT)),
+				    TEST_MEMR_PAGES << __PAGE_SHIFT) == 0)
+			h->nr_memr++;
+	}
+	return 0;
+}
+
+static void test_heap_fini(struct test_heap *h)
+{
+	uk_alloc_unregister(h->a);
+	uk_pfree(uk_alloc_get_default(), h->mem, TEST_HEAP_PAGES);
+}
+
+static int test_in_heap(struct test_heap *h, void *p, unsigned long pages)
+{
+	return (__uptr)p >= (__uptr)h->mem &&
+	       (__uptr)p + (pages << __PAGE_SHIFT) <=
+	       (__uptr)h->mem + (TEST_HEAP_PAGES << __PAGE_SHIFT);
+}
+
+/* Exhausts the heap page by page and frees the pages again, so that all
+ * buddies are merged back.
+ */
+UK_TESTCASE(ukallocbbuddy, test_bbuddy_regions)
+{
+	static void *pages[TEST_HEAP_PAGES];
+	struct test_heap h;
+	long avail, maxalloc;
+	unsigned int i, n;
+
+	UK_TEST_ASSERT(test_heap_init(&h) == 0);
+	UK_TEST_EXPECT(h.nr_memr > 2 * TEST_MEMR_INLINE);
+
+	avail = uk_alloc_pavailmem(h.a);
+	maxalloc = uk_alloc_pmaxalloc(h.a);
+	UK_TEST_EXPECT(avail > 0);
+
+	for (n = 0; (pages[n] = uk_palloc(h.a, 1)); n++)
+		UK_TEST_EXPECT(test_in_heap(&h, pages[n], 1));
+	UK_TEST_EXPECT_SNUM_EQ(n, avail);
+	UK_TEST_EXPECT_ZERO(uk_alloc_pavailmem(h.a));
+	UK_TEST_EXPECT_ZERO(uk_alloc_pmaxalloc(h.a));
+
+	/* Free in two passes so that buddies are merged in both directions */
+	for (i = 0; i < n; i += 2)
+		uk_pfree(h.a, pages[i], 1);
+	for (i = 1; i < n; i += 2)
+		uk_pfree(h.a, pages[i], 1);
+	UK_TEST_EXPECT_SNUM_EQ(uk_alloc_pavailmem(h.a), avail);
+	UK_TEST_EXPECT_SNUM_EQ(uk_alloc_pmaxalloc(h.a), maxalloc);
+
+	/* Chunks are aligned to their size */
+	for (i = 0; i < 4; i++) {
+		pages[i] = uk_palloc(h.a, 1UL << i);
+		UK_TEST_ASSERT(pages[i] != NULL);
+		UK_TEST_EXPECT_ZERO((__uptr)pages[i] &
+				    ((1UL << (i + __PAGE_SHIFT)) - 1));
+	}
+	for (i = 0; i < 4; i++)
+		uk_pfree(h.a, pages[i], 1UL << i);
+	UK_TEST_EXPECT_SNUM_EQ(uk_alloc_pavailmem(h.a), avail);
+
+	test_heap_fini(&h);
+}
+
+/* Page allocation throughput microbenchmark */
+UK_TESTCASE(ukallocbbuddy, test_bbuddy_bench)
+{
+	static void *pages[BENCH_OBJS];
+	struct test_heap h;
+	unsigned int i, round;
+	__nsec start, end;
+	unsigned long ops;
+
+	UK_TEST_ASSERT(test_heap_init(&h) == 0);
+
+	start = ukplat_monotonic_clock();
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		for (i = 0; i < BENCH_OBJS; i++)
+			pages[i] = uk_palloc(h.a, 1UL << (i & 1));
+		for (i = 0; i < BENCH_OBJS; i++) {
+			if (pages[i])
+				uk_pfree(h.a, pages[i], 1UL << (i & 1));
+		}
+	}
+	end = ukplat_monotonic_clock();
+
+	ops = BENCH_OBJS * BENCH_ROUNDS;
+	pr_info("bbuddy: %u regions, %lu palloc/pfree pairs, %"__PRInsec
+		" ns/op\n", h.nr_memr, ops, (end - start) / ops);
+
+	test_heap_fini(&h);
+}
+
+uk_testsuite_register(ukallocbbuddy, NULL);
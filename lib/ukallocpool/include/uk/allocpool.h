@@ -124,6 +124,8 @@ struct uk_alloc *uk_allocpool2ukalloc(struct uk_allocpool *p);
 
 /**
  * Return the number of current available (free) objects.
+ * With LIBUKALLOCPOOL_CONCURRENT, objects that are cached by other LCPUs
+ * are included and the number is a snapshot only.
  *
  * @param p
  *  Pointer to memory pool.
@@ -40,6 +40,11 @@
 #include <uk/list.h>
 #include <string.h>
 #include <errno.h>
+#if CONFIG_LIBUKALLOCPOOL_CONCURRENT
+#include <uk/arch/lcpu.h>
+#include <uk/arch/spinlock.h>
+#include <uk/plat/lcpu.h>
+#endif /* CONFIG_LIBUKALLOCPOOL_CONCURRENT */
 
 /*
  * POOL: MEMORY LAYOUT
@@ -58,11 +63,30 @@
  *          +=======================+
  *          |         ...           |
  *          v                       v
+ *
+ * POOL: CONCURRENCY
+ *
+ * With LIBUKALLOCPOOL_CONCURRENT, the free object list is protected by a
+ * spinlock. In front of it, each LCPU caches free objects in a small array
+ * that only the LCPU accesses with interrupts disabled. Objects that are
+ * taken on one LCPU can be returned on another one. Only if a cache runs
+ * empty or full, half of it is exchanged with the free object list, so
+ * that most takes and returns do not touch shared memory.
  */
 
 #define MIN_OBJ_ALIGN sizeof(void *)
 #define MIN_OBJ_LEN   sizeof(struct uk_list_head)
 
+#if CONFIG_LIBUKALLOCPOOL_CONCURRENT
+#define POOL_CACHE_SIZE  CONFIG_LIBUKALLOCPOOL_LCPU_CACHE_SIZE
+#define POOL_CACHE_BATCH (POOL_CACHE_SIZE / 2)
+
+struct pool_cache {
+	unsigned int count;
+	void *obj[POOL_CACHE_SIZE];
+} __align(CACHE_LINE_SIZE);
+#endif /* CONFIG_LIBUKALLOCPOOL_CONCURRENT */
+
 struct uk_allocpool {
 	struct uk_alloc self;
 
@@ -75,8 +99,16 @@ struct uk_allocpool {
 
 	struct uk_alloc *parent;
 	void *base;
+
+#if CONFIG_LIBUKALLOCPOOL_CONCURRENT
+	/* Protects `free_obj` and `free_obj_count` */
+	__spinlock lock;
+	struct pool_cache cache[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+#endif /* CONFIG_LIBUKALLOCPOOL_CONCURRENT */
 };
 
+#define POOL_ALIGN __alignof__(struct uk_allocpool)
+
 struct free_obj {
 	struct uk_list_head list;
 };
@@ -123,12 +155,86 @@ static inline void *_take_free_obj(struct uk_allocpool *p)
 	return (void *) obj;
 }
 
+static inline unsigned int _take_free_objs(struct uk_allocpool *p,
+					   void *obj[], unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count && p->free_obj_count; ++i)
+		obj[i] = _take_free_obj(p);
+	return i;
+}
+
+static inline void _prepend_free_objs(struct uk_allocpool *p,
+				      void *obj[], unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; ++i)
+		_prepend_free_obj(p, obj[i]);
+}
+
+#if CONFIG_LIBUKALLOCPOOL_CONCURRENT
+/* Takes up to `count` objects, preferably from the cache of this LCPU */
+static unsigned int pool_get(struct uk_allocpool *p,
+			     void *obj[], unsigned int count)
+{
+	struct pool_cache *c;
+	unsigned long flags;
+	unsigned int n = 0;
+
+	flags = ukplat_lcpu_save_irqf();
+	c = &p->cache[ukplat_lcpu_idx()];
+	while (n < count && c->count)
+		obj[n++] = c->obj[--c->count];
+
+	if (n < count) {
+		ukarch_spin_lock(&p->lock);
+		n += _take_free_objs(p, &obj[n], count - n);
+		c->count = _take_free_objs(p, c->obj, POOL_CACHE_BATCH);
+		ukarch_spin_unlock(&p->lock);
+	}
+	ukplat_lcpu_restore_irqf(flags);
+	return n;
+}
+
+/* Returns objects, preferably to the cache of this LCPU */
+static void pool_put(struct uk_allocpool *p,
+		     void *obj[], unsigned int count)
+{
+	struct pool_cache *c;
+	unsigned long flags;
+	unsigned int n = 0;
+
+	flags = ukplat_lcpu_save_irqf();
+	c = &p->cache[ukplat_lcpu_idx()];
+	while (n < count && c->count < POOL_CACHE_SIZE)
+		c->obj[c->count++] = obj[n++];
+
+	if (n < count) {
+		ukarch_spin_lock(&p->lock);
+		_prepend_free_objs(p, &obj[n], count - n);
+		/* Make room by handing back the oldest cached objects */
+		_prepend_free_objs(p, c->obj, POOL_CACHE_BATCH);
+		ukarch_spin_unlock(&p->lock);
+
+		c->count -= POOL_CACHE_BATCH;
+		memmove(&c->obj[0], &c->obj[POOL_CACHE_BATCH],
+			c->count * sizeof(void *));
+	}
+	ukplat_lcpu_restore_irqf(flags);
+}
+#else /* !CONFIG_LIBUKALLOCPOOL_CONCURRENT */
+#define pool_get(p, obj, count)	_take_free_objs((p), (obj), (count))
+#define pool_put(p, obj, count)	_prepend_free_objs((p), (obj), (count))
+#endif /* !CONFIG_LIBUKALLOCPOOL_CONCURRENT */
+
 static void pool_free(struct uk_alloc *a, void *ptr)
 {
 	struct uk_allocpool *p = ukalloc2pool(a);
 
 	if (likely(ptr)) {
-		_prepend_free_obj(p, ptr);
+		pool_put(p, &ptr, 1);
 		uk_alloc_stats_count_free(a, ptr, p->obj_len);
 	}
 }
@@ -139,13 +245,12 @@ static void *pool_malloc(struct uk_alloc *a, __sz size)
 	void *obj;
 
 	if (unlikely((size > p->obj_len)
-		     || uk_list_empty(&p->free_obj))) {
+		     || !pool_get(p, &obj, 1))) {
 		uk_alloc_stats_count_enomem(a, p->obj_len);
 		errno = ENOMEM;
 		return NULL;
 	}
 
-	obj = _take_free_obj(p);
 	uk_alloc_stats_count_alloc(a, obj, p->obj_len);
 	return obj;
 }
@@ -157,12 +262,11 @@ static int pool_posix_memalign(struct uk_alloc *a, void **memptr, __sz align,
 
 	if (unlikely((size > p->obj_len)
 		     || (align > p->obj_align)
-		     || uk_list_empty(&p->free_obj))) {
+		     || !pool_get(p, memptr, 1))) {
 		uk_alloc_stats_count_enomem(a, p->obj_len);
 		return ENOMEM;
 	}
 
-	*memptr = _take_free_obj(p);
 	uk_alloc_stats_count_alloc(a, *memptr, p->obj_len);
 	return 0;
 }
@@ -173,13 +277,12 @@ void *uk_allocpool_take(struct uk_allocpool *p)
 
 	UK_ASSERT(p);
 
-	if (unlikely(uk_list_empty(&p->free_obj))) {
+	if (unlikely(!pool_get(p, &obj, 1))) {
 		uk_alloc_stats_count_enomem(allocpool2ukalloc(p),
 					    p->obj_len);
 		return NULL;
 	}
 
-	obj = _take_free_obj(p);
 	uk_alloc_stats_count_alloc(allocpool2ukalloc(p),
 				   obj, p->obj_len);
 	return obj;
@@ -188,18 +291,15 @@ void *uk_allocpool_take(struct uk_allocpool *p)
 unsigned int uk_allocpool_take_batch(struct uk_allocpool *p,
 				     void *obj[], unsigned int count)
 {
-	unsigned int i;
+	unsigned int i, n;
 
 	UK_ASSERT(p);
 	UK_ASSERT(obj);
 
-	for (i = 0; i < count; ++i) {
-		if (unlikely(uk_list_empty(&p->free_obj)))
-			break;
-		obj[i] = _take_free_obj(p);
+	n = pool_get(p, obj, count);
+	for (i = 0; i < n; ++i)
 		uk_alloc_stats_count_alloc(allocpool2ukalloc(p),
 					   obj[i], p->obj_len);
-	}
 
 	if (unlikely(i == 0))
 		uk_alloc_stats_count_enomem(allocpool2ukalloc(p),
@@ -212,7 +312,7 @@ void uk_allocpool_return(struct uk_allocpool *p, void *obj)
 {
 	UK_ASSERT(p);
 
-	_prepend_free_obj(p, obj);
+	pool_put(p, &obj, 1);
 	uk_alloc_stats_count_free(allocpool2ukalloc(p),
 				  obj, p->obj_len);
 }
@@ -225,18 +325,17 @@ void uk_allocpool_return_batch(struct uk_allocpool *p,
 	UK_ASSERT(p);
 	UK_ASSERT(obj);
 
-	for (i = 0; i < count; ++i) {
-		_prepend_free_obj(p, obj[i]);
+	pool_put(p, obj, count);
+	for (i = 0; i < count; ++i)
 		uk_alloc_stats_count_free(allocpool2ukalloc(p),
 					  obj[i], p->obj_len);
-	}
 }
 
 static __ssz pool_availmem(struct uk_alloc *a)
 {
 	struct uk_allocpool *p = ukalloc2pool(a);
 
-	return (__ssz) (p->free_obj_count * p->obj_len);
+	return (__ssz) (uk_allocpool_availcount(p) * p->obj_len);
 }
 
 static __ssz pool_maxalloc(struct uk_alloc *a)
@@ -257,13 +356,22 @@ __sz uk_allocpool_reqmem(unsigned int obj_count, __sz obj_len,
 	obj_align = MAX(obj_align, MIN_OBJ_ALIGN);
 	obj_alen  = ALIGN_UP(obj_len, obj_align);
 	return (sizeof(struct uk_allocpool)
+		+ POOL_ALIGN - 1
 		+ obj_align
 		+ ((__sz) obj_count * obj_alen));
 }
 
 unsigned int uk_allocpool_availcount(struct uk_allocpool *p)
 {
-	return p->free_obj_count;
+	unsigned int count = UK_READ_ONCE(p->free_obj_count);
+#if CONFIG_LIBUKALLOCPOOL_CONCURRENT
+	unsigned int i;
+
+	for (i = 0; i < CONFIG_UKPLAT_LCPU_MAXCOUNT; ++i)
+		count += UK_READ_ONCE(p->cache[i].count);
+#endif /* CONFIG_LIBUKALLOCPOOL_CONCURRENT */
+
+	return count;
 }
 
 __sz uk_allocpool_objlen(struct uk_allocpool *p)
@@ -282,7 +390,8 @@ struct uk_allocpool *uk_allocpool_init(void *base, __sz len,
 
 	UK_ASSERT(POWER_OF_2(obj_align));
 
-	if (!base || sizeof(struct uk_allocpool) > len) {
+	p = (struct uk_allocpool *) ALIGN_UP((__uptr) base, POOL_ALIGN);
+	if (!base || (__uptr) p + sizeof(*p) > (__uptr) base + len) {
 		errno = ENOSPC;
 		return NULL;
 	}
@@ -291,12 +400,15 @@ struct uk_allocpool *uk_allocpool_init(void *base, __sz len,
 	obj_len   = MAX(obj_len, MIN_OBJ_LEN);
 	obj_align = MAX(obj_align, MIN_OBJ_ALIGN);
 
-	p = (struct uk_allocpool *) base;
 	memset(p, 0, sizeof(*p));
 	a = allocpool2ukalloc(p);
+	UK_INIT_LIST_HEAD(&p->free_obj);
+#if CONFIG_LIBUKALLOCPOOL_CONCURRENT
+	ukarch_spin_init(&p->lock);
+#endif /* CONFIG_LIBUKALLOCPOOL_CONCURRENT */
 
 	obj_alen = ALIGN_UP(obj_len, obj_align);
-	obj_ptr = (void *) ALIGN_UP((__uptr) base + sizeof(*p),
+	obj_ptr = (void *) ALIGN_UP((__uptr) p + sizeof(*p),
 				    obj_align);
 	if ((__uptr) obj_ptr > (__uptr) base + len) {
 		uk_pr_debug("%p: Empty pool: Not enough space for allocating objects\n",
@@ -308,7 +420,6 @@ struct uk_allocpool *uk_allocpool_init(void *base, __sz len,
 
 	p->obj_count = 0;
 	p->free_obj_count = 0;
-	UK_INIT_LIST_HEAD(&p->free_obj);
 	while (left >= obj_alen) {
 		++p->obj_count;
 		_prepend_free_obj(p, obj_ptr);
@@ -372,11 +483,8 @@ void uk_allocpool_free(struct uk_allocpool *p)
 	UK_ASSERT(p->parent);
 
 	/* Make sure we got all objects back */
-	UK_ASSERT(p->free_obj_count == p->obj_count);
-
-	/* FIXME: Unregister `ukalloc` interface from `lib/ukalloc` */
-	/* TODO: Provide unregistration interface at `lib/ukalloc` */
-	UK_CRASH("Unregistering from `lib/ukalloc` not implemented.\n");
+	UK_ASSERT(uk_allocpool_availcount(p) == p->obj_count);
 
+	uk_alloc_unregister(allocpool2ukalloc(p));
 	uk_free(p->parent, p->base);
 }
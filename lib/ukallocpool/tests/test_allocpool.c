@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <uk/test.h>
+#include <uk/config.h>
+#include <uk/allocpool.h>
+#if CONFIG_LIBUKSCHED
+#include <uk/sched.h>
+#include <uk/thread.h>
+#endif /* CONFIG_LIBUKSCHED */
+
+#define TEST_OBJS		64
+#define TEST_OBJ_LEN		100
+#define TEST_BATCH		40
+
+UK_TESTCASE(ukallocpool, test_pool_batch)
+{
+	void *objs[TEST_OBJS];
+	struct uk_allocpool *p;
+	struct uk_alloc *a;
+	unsigned int n;
+	void *obj;
+
+	p = uk_allocpool_alloc(uk_alloc_get_default(), TEST_OBJS,
+			       TEST_OBJ_LEN, 16);
+	UK_TEST_ASSERT(p != NULL);
+	UK_TEST_EXPECT_SNUM_EQ(uk_allocpool_availcount(p), TEST_OBJS);
+
+	n = uk_allocpool_take_batch(p, objs, TEST_BATCH);
+	UK_TEST_EXPECT_SNUM_EQ(n, TEST_BATCH);
+	UK_TEST_EXPECT_SNUM_EQ(uk_allocpool_availcount(p),
+			       TEST_OBJS - TEST_BATCH);
+	uk_allocpool_return_batch(p, objs, n);
+	UK_TEST_EXPECT_SNUM_EQ(uk_allocpool_availcount(p), TEST_OBJS);
+
+	/* Drain the pool object by object */
+	for (n = 0; (obj = uk_allocpool_take(p)); n++) {
+		UK_TEST_EXPECT_ZERO((__uptr)obj & 15);
+		objs[n] = obj;
+	}
+	UK_TEST_EXPECT_SNUM_EQ(n, TEST_OBJS);
+	UK_TEST_EXPECT_ZERO(uk_allocpool_availcount(p));
+	while (n)
+		uk_allocpool_return(p, objs[--n]);
+
+	/* The ukalloc adapter hands out objects of the pool */
+	a = uk_allocpool2ukalloc(p);
+	UK_TEST_EXPECT_NULL(uk_malloc(a, TEST_OBJ_LEN + 1));
+	obj = uk_malloc(a, TEST_OBJ_LEN);
+	UK_TEST_ASSERT(obj != NULL);
+	UK_TEST_EXPECT_SNUM_EQ(uk_allocpool_availcount(p), TEST_OBJS - 1);
+	uk_free(a, obj);
+
+	uk_allocpool_free(p);
+}
+
+#if CONFIG_LIBUKSCHED
+#define TEST_THREADS		4
+#define TEST_ROUNDS		1000
+
+struct pool_args {
+	struct uk_allocpool *p;
+	unsigned int id;
+	unsigned int errors;
+	int done;
+};
+
+/* Every thread tags the objects it holds. Another thread must not get an
+ * object while it is held.
+ */
+static __noreturn void pool_thread_func(void *arg)
+{
+	struct pool_args *args = (struct pool_args *)arg;
+	void *objs[TEST_BATCH / TEST_THREADS];
+	unsigned int i, n, round;
+
+	for (round = 0; round < TEST_ROUNDS; round++) {
+		n = uk_allocpool_take_batch(args->p, objs, ARRAY_SIZE(objs));
+		for (i = 0; i < n; i++)
+			*(unsigned int *)objs[i] = args->id;
+		uk_sched_yield();
+		for (i = 0; i < n; i++) {
+			if (*(unsigned int *)objs[i] != args->id)
+				args->errors++;
+		}
+		if (round & 1) {
+			uk_allocpool_return_batch(args->p, objs, n);
+		} else {
+			for (i = 0; i < n; i++)
+				uk_allocpool_return(args->p, objs[i]);
+		}
+	}
+	UK_WRITE_ONCE(args->done, 1);
+	uk_sched_thread_exit();
+}
+
+UK_TESTCASE(ukallocpool, test_pool_threads)
+{
+	struct pool_args args[TEST_THREADS];
+	struct uk_thread *t[TEST_THREADS];
+	struct uk_allocpool *p;
+	unsigned int i;
+
+	p = uk_allocpool_alloc(uk_alloc_get_default(), TEST_OBJS,
+			       sizeof(unsigned int), sizeof(unsigned int));
+	UK_TEST_ASSERT(p != NULL);
+
+	for (i = 0; i < TEST_THREADS; i++) {
+		args[i].p = p;
+		args[i].id = i;
+		args[i].errors = 0;
+		args[i].done = 0;
+		t[i] = uk_sched_thread_create(uk_sched_current(),
+					      pool_thread_func, &args[i],
+					      "pool-test");
+		UK_TEST_ASSERT(t[i] != NULL);
+	}
+	for (i = 0; i < TEST_THREADS; i++) {
+		while (!UK_READ_ONCE(args[i].done))
+			uk_sched_yield();
+		UK_TEST_EXPECT_ZERO(args[i].errors);
+	}
+
+	UK_TEST_EXPECT_SNUM_EQ(uk_allocpool_availcount(p), TEST_OBJS);
+	uk_allocpool_free(p);
+}
+#endif /* CONFIG_LIBUKSCHED */
+
+uk_testsuite_register(ukallocpool, NULL);
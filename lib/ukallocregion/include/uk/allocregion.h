@@ -40,9 +40,46 @@
 extern "C" {
 #endif
 
+/* Position in a region, see `uk_allocregion_mark()` */
+typedef __uptr uk_allocregion_mark_t;
+
 /* allocator initialization */
 struct uk_alloc *uk_allocregion_init(void *base, size_t len);
 
+/**
+ * Creates a region that is carved from a parent allocator. The region is not
+ * registered in the list of allocators, it is only reachable through the
+ * returned handle.
+ *
+ * @param parent
+ *   Allocator that provides the memory of the region
+ * @param len
+ *   Size of the region in bytes, including the allocator metadata
+ * @return
+ *   - (NULL): Not enough memory
+ *   - pointer to the region allocator
+ */
+struct uk_alloc *uk_allocregion_create(struct uk_alloc *parent, size_t len);
+
+/**
+ * Returns the memory of a region that was created with
+ * `uk_allocregion_create()` to the parent allocator.
+ */
+void uk_allocregion_destroy(struct uk_alloc *a);
+
+/**
+ * Returns the current position of a region. All memory that is allocated
+ * afterwards is released in O(1) by rewinding to the mark, so that a region
+ * can be reused as scratch arena (e.g., per request). Marks can be nested.
+ */
+uk_allocregion_mark_t uk_allocregion_mark(struct uk_alloc *a);
+
+/**
+ * Releases all memory that was allocated from a region since `mark` was
+ * taken. Marks that were taken after `mark` become invalid.
+ */
+void uk_allocregion_rewind(struct uk_alloc *a, uk_allocregion_mark_t mark);
+
 #ifdef __cplusplus
 }
 #endif
@@ -33,9 +33,13 @@
 
 /* ukallocregion is a minimalist region implementation.
  *
- * Note that deallocation is not supported. This makes sense because regions
- * only allow for deallocation at region-granularity. In our case, this would
- * imply the freeing of the entire heap, which is generally not possible.
+ * Note that deallocation of single objects is not supported. This makes sense
+ * because regions only allow for deallocation at region-granularity. For the
+ * heap region, this would imply the freeing of the entire heap, which is
+ * generally not possible. Instead, a position in the region can be marked
+ * and all memory that was allocated after the mark is released at once by
+ * rewinding to it. Regions that are carved from a parent allocator can be
+ * destroyed as a whole.
  *
  * Obviously, the lack of deallocation support makes ukallocregion a fairly bad
  * general-purpose allocator. This allocator is interesting in that it offers
@@ -57,6 +61,8 @@
 struct uk_allocregion {
 	void *heap_top;
 	void *heap_base;
+	void *heap_start;	/* first byte after the metadata */
+	struct uk_alloc *parent; /* allocator the region is carved from */
 };
 
 static void *uk_allocregion_malloc(struct uk_alloc *a, size_t size)
@@ -84,9 +90,12 @@ static void *uk_allocregion_malloc(struct uk_alloc *a, size_t size)
 	if (newbase <= (uintptr_t) b->heap_base)
 		goto enomem;
 
+	/* The alignment padding is accounted to the allocation, so that
+	 * rewinding releases exactly the accounted memory
+	 */
+	uk_alloc_stats_count_alloc(a, (void *) intptr,
+				   newbase - (uintptr_t) b->heap_base);
 	b->heap_base = (void *)(newbase);
-
-	uk_alloc_stats_count_alloc(a, (void *) intptr, size);
 	return (void *) intptr;
 
 enomem:
@@ -128,9 +137,9 @@ static int uk_allocregion_posix_memalign(struct uk_alloc *a, void **memptr,
 		goto enomem;
 
 	*memptr = (void *)intptr;
+	uk_alloc_stats_count_alloc(a, (void *) intptr,
+				   newbase - (uintptr_t) b->heap_base);
 	b->heap_base = (void *)(newbase);
-
-	uk_alloc_stats_count_alloc(a, (void *) intptr, size);
 	return 0;
 
 enomem:
@@ -174,19 +183,38 @@ static int uk_allocregion_addmem(struct uk_alloc *a __unused,
 	return 0;
 }
 
-struct uk_alloc *uk_allocregion_init(void *base, size_t len)
+uk_allocregion_mark_t uk_allocregion_mark(struct uk_alloc *a)
+{
+	struct uk_allocregion *b;
+
+	UK_ASSERT(a != NULL);
+
+	b = (struct uk_allocregion *)&a->priv;
+	return (uk_allocregion_mark_t) b->heap_base;
+}
+
+void uk_allocregion_rewind(struct uk_alloc *a, uk_allocregion_mark_t mark)
+{
+	struct uk_allocregion *b;
+
+	UK_ASSERT(a != NULL);
+
+	b = (struct uk_allocregion *)&a->priv;
+
+	/* Marks are only valid until the region is rewound past them */
+	UK_ASSERT(mark >= (uk_allocregion_mark_t) b->heap_start);
+	UK_ASSERT(mark <= (uk_allocregion_mark_t) b->heap_base);
+
+	uk_alloc_stats_count_release(a, (__uptr) b->heap_base - mark);
+	b->heap_base = (void *) mark;
+}
+
+static struct uk_alloc *uk_allocregion_setup(void *base, size_t len)
 {
 	struct uk_alloc *a;
 	struct uk_allocregion *b;
 	size_t metalen = sizeof(*a) + sizeof(*b);
 
-	/* TODO: ukallocregion does not support multiple memory regions yet.
-	 * Because of the multiboot layout, the first region might be a single
-	 * page, so we simply ignore it.
-	 */
-	if (len <= __PAGE_SIZE)
-		return NULL;
-
 	/* enough space for allocator available? */
 	if (metalen > len) {
 		uk_pr_err("Not enough space for allocator: %"__PRIsz
@@ -199,21 +227,76 @@ struct uk_alloc *uk_allocregion_init(void *base, size_t len)
 	a = (struct uk_alloc *)base;
 	b = (struct uk_allocregion *)&a->priv;
 
-	uk_pr_info("Initialize allocregion allocator @ 0x%"
-		   __PRIuptr ", len %"__PRIsz"\n", (uintptr_t)a, len);
-
-	b->heap_top  = (void *)((uintptr_t) base + len);
-	b->heap_base = (void *)((uintptr_t) base + metalen);
+	b->heap_top   = (void *)((uintptr_t) base + len);
+	b->heap_base  = (void *)((uintptr_t) base + metalen);
+	b->heap_start = b->heap_base;
+	b->parent     = NULL;
 
 	/* use exclusively "compat" wrappers for calloc, realloc, memalign,
 	 * palloc and pfree as those do not add additional metadata.
 	 */
-	uk_alloc_init_malloc(a, uk_allocregion_malloc, uk_calloc_compat,
-				uk_realloc_compat, uk_allocregion_free,
-				uk_allocregion_posix_memalign,
-				uk_memalign_compat, uk_allocregion_leftspace,
-				uk_allocregion_leftspace,
-				uk_allocregion_addmem);
+	uk_alloc_setup_malloc(a, uk_allocregion_malloc, uk_calloc_compat,
+			      uk_realloc_compat, uk_allocregion_free,
+			      uk_allocregion_posix_memalign,
+			      uk_memalign_compat, uk_allocregion_leftspace,
+			      uk_allocregion_leftspace,
+			      uk_allocregion_addmem);
+
+	return a;
+}
+
+struct uk_alloc *uk_allocregion_create(struct uk_alloc *parent, size_t len)
+{
+	struct uk_alloc *a;
+	void *base;
+
+	UK_ASSERT(parent != NULL);
+
+	base = uk_malloc(parent, len);
+	if (!base)
+		return NULL;
+
+	a = uk_allocregion_setup(base, len);
+	if (!a) {
+		uk_free(parent, base);
+		return NULL;
+	}
+
+	((struct uk_allocregion *)&a->priv)->parent = parent;
+	return a;
+}
+
+void uk_allocregion_destroy(struct uk_alloc *a)
+{
+	struct uk_allocregion *b;
+
+	UK_ASSERT(a != NULL);
+
+	b = (struct uk_allocregion *)&a->priv;
+
+	/* The heap region cannot be returned */
+	UK_ASSERT(b->parent != NULL);
+
+	uk_alloc_stats_release(a);
+	uk_free(b->parent, a);
+}
+
+struct uk_alloc *uk_allocregion_init(void *base, size_t len)
+{
+	struct uk_alloc *a;
+
+	/* TODO: ukallocregion does not support multiple memory regions yet.
+	 * Because of the multiboot layout, the first region might be a single
+	 * page, so we simply ignore it.
+	 */
+	if (len <= __PAGE_SIZE)
+		return NULL;
+
+	uk_pr_info("Initialize allocregion allocator @ 0x%"
+		   __PRIuptr ", len %"__PRIsz"\n", (uintptr_t)base, len);
 
+	a = uk_allocregion_setup(base, len);
+	if (a)
+		uk_alloc_register(a);
 	return a;
 }
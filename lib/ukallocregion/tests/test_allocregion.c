@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <uk/test.h>
+#include <uk/allocregion.h>
+
+#define TEST_REGION_LEN		(4 * __PAGE_SIZE)
+#define TEST_OBJ_LEN		100
+
+UK_TESTCASE(ukallocregion, test_region_rewind)
+{
+	uk_allocregion_mark_t outer, inner;
+	struct uk_alloc *a;
+	__ssz avail;
+	void *p, *q;
+
+	a = uk_allocregion_create(uk_alloc_get_default(), TEST_REGION_LEN);
+	UK_TEST_ASSERT(a != NULL);
+	avail = uk_alloc_availmem(a);
+	UK_TEST_EXPECT(avail > 0 && avail < (__ssz)TEST_REGION_LEN);
+
+	outer = uk_allocregion_mark(a);
+	p = uk_malloc(a, TEST_OBJ_LEN);
+	UK_TEST_ASSERT(p != NULL);
+
+	/* Nested scope */
+	inner = uk_allocregion_mark(a);
+	q = uk_malloc(a, TEST_OBJ_LEN);
+	UK_TEST_ASSERT(q != NULL);
+	uk_allocregion_rewind(a, inner);
+	UK_TEST_EXPECT_PTR_EQ(uk_malloc(a, TEST_OBJ_LEN), q);
+
+	uk_allocregion_rewind(a, outer);
+	UK_TEST_EXPECT_SNUM_EQ(uk_alloc_availmem(a), avail);
+	UK_TEST_EXPECT_PTR_EQ(uk_malloc(a, TEST_OBJ_LEN), p);
+
+	/* The region runs out of memory but can be reused after a rewind */
+	UK_TEST_EXPECT_NULL(uk_malloc(a, TEST_REGION_LEN));
+	uk_allocregion_rewind(a, outer);
+	UK_TEST_EXPECT_NOT_NULL(uk_malloc(a, avail));
+
+	uk_allocregion_destroy(a);
+}
+
+uk_testsuite_register(ukallocregion, NULL);
@@ -0,0 +1,49 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UKALLOCSLAB_H__
+#define __UKALLOCSLAB_H__
+
+#include <uk/alloc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Creates a slab allocator that takes its pages from a page allocator.
+ * The page allocator is used by the slab allocator exclusively from now on:
+ * It is unregistered from `lib/ukalloc` and must not be used directly
+ * anymore.
+ *
+ * @param backend
+ *  Page allocator (e.g., binary buddy) that provides slabs and serves
+ *  requests larger than the biggest size class.
+ * @return
+ *  - (NULL): Not enough memory for the allocator descriptor.
+ *  - pointer to the registered slab allocator.
+ */
+struct uk_alloc *uk_allocslab_create(struct uk_alloc *backend);
+
+/**
+ * Initializes a slab allocator on a given memory range. A binary buddy
+ * allocator is set up on the range as page allocator.
+ *
+ * @param base
+ *  Base address of memory range.
+ * @param len
+ *  Length of memory range (bytes).
+ * @return
+ *  - (NULL): Not enough memory for the allocator.
+ *  - pointer to the registered slab allocator.
+ */
+struct uk_alloc *uk_allocslab_init(void *base, __sz len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UKALLOCSLAB_H__ */
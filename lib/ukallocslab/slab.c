@@ -0,0 +1,586 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+
+#include <uk/allocslab.h>
+#include <uk/allocbbuddy.h>
+#include <uk/alloc_impl.h>
+#include <uk/arch/lcpu.h>
+#include <uk/arch/spinlock.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/list.h>
+#include <uk/page.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/spinlock.h>
+#include <uk/print.h>
+
+/*
+ * SLAB: MEMORY LAYOUT
+ *
+ * Every range of pages that is taken from the page allocator starts with a
+ * header. A slab is a single page that is divided into objects of one size
+ * class:
+ *
+ *          ++---------------------++  <- page boundary
+ *          ||   struct slab_hdr   ||
+ *          ++---------------------++
+ *          |    // padding //      |
+ *          +=======================+  <- SLAB_HDR_SIZE
+ *          |       OBJECT 1        |
+ *          +=======================+
+ *          |       OBJECT 2        |
+ *          +=======================+
+ *          |         ...           |
+ *          v                       v
+ *
+ * Requests that exceed the biggest size class get their own range of pages.
+ * The object follows the header, or if it is page-aligned, starts at the
+ * page after the header. Because no object starts at a page boundary, the
+ * header of an object is found in O(1) by aligning its address down.
+ *
+ * Each LCPU caches free objects of every size class in a magazine. Only if
+ * a magazine runs empty or full, half of it is exchanged with the slabs of
+ * the size class under the lock of the class.
+ */
+
+#define SLAB_MAGIC		0x51ab
+#define SLAB_HDR_SIZE		64
+#define SLAB_CLASS_LARGE	0xffff
+#define SLAB_NR_CLASSES		16
+#define SLAB_MAX_SIZE		512
+/* Sizes of classes that are multiples of the alignment keep it */
+#define SLAB_MAX_ALIGN		SLAB_HDR_SIZE
+
+#define SLAB_MAG_SIZE		CONFIG_LIBUKALLOCSLAB_MAGAZINE_SIZE
+#define SLAB_MAG_BATCH		(SLAB_MAG_SIZE / 2)
+
+#define size_to_num_pages(size) \
+	(round_pgup((unsigned long)(size)) / __PAGE_SIZE)
+
+struct slab_hdr {
+	__u16 magic;
+	__u16 cls;			/* size class or SLAB_CLASS_LARGE */
+	union {
+		/* slab */
+		struct {
+			struct uk_list_head list; /* on partial list */
+			void *free;		/* free objects */
+			unsigned int nr_free;
+		};
+		/* large allocation */
+		struct {
+			void *base;		/* start of page range */
+			unsigned long num_pages;
+		};
+	};
+};
+
+UK_CTASSERT(sizeof(struct slab_hdr) <= SLAB_HDR_SIZE);
+UK_CTASSERT(SLAB_HDR_SIZE % __alignof__(max_align_t) == 0);
+
+struct slab_free_obj {
+	struct slab_free_obj *next;
+};
+
+struct slab_cache {
+	__spinlock lock;
+	/* slabs with free objects */
+	struct uk_list_head partial;
+	/* slabs without allocated objects, we keep one of them */
+	unsigned int nr_empty;
+	unsigned int size;
+	unsigned int nr_objs;
+} __align(CACHE_LINE_SIZE);
+
+struct slab_magazine {
+	unsigned int count;
+	void *objs[SLAB_MAG_SIZE];
+};
+
+struct slab_lcpu {
+	struct slab_magazine mag[SLAB_NR_CLASSES];
+};
+
+struct uk_allocslab {
+	struct uk_alloc self;
+
+	/* The page allocator is not SMP-safe on its own */
+	struct uk_alloc *backend;
+	__spinlock backend_lock;
+
+	struct slab_cache cache[SLAB_NR_CLASSES];
+	struct slab_lcpu *lcpu[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+};
+
+static const __u16 slab_sizes[SLAB_NR_CLASSES] = {
+	16, 32, 48, 64, 80, 96, 112, 128,
+	160, 192, 224, 256, 320, 384, 448, 512
+};
+
+#define ukalloc2slab(a) \
+	(__containerof((a), struct uk_allocslab, self))
+
+static inline unsigned int slab_class(__sz size)
+{
+	UK_ASSERT(size > 0 && size <= SLAB_MAX_SIZE);
+
+	if (size <= 128)
+		return (size - 1) >> 4;
+	if (size <= 256)
+		return 8 + ((size - 129) >> 5);
+	return 12 + ((size - 257) >> 6);
+}
+
+static inline struct slab_hdr *slab_hdr(const void *ptr)
+{
+	__uptr hdr = round_pgdown((__uptr)ptr);
+
+	/* Only large allocations can be page-aligned */
+	if (hdr == (__uptr)ptr)
+		hdr -= __PAGE_SIZE;
+
+	UK_ASSERT(((struct slab_hdr *)hdr)->magic == SLAB_MAGIC);
+	return (struct slab_hdr *)hdr;
+}
+
+static void *slab_backend_palloc(struct uk_allocslab *s,
+				 unsigned long num_pages)
+{
+	unsigned long flags;
+	void *pages;
+
+	ukplat_spin_lock_irqsave(&s->backend_lock, flags);
+	pages = uk_palloc(s->backend, num_pages);
+	ukplat_spin_unlock_irqrestore(&s->backend_lock, flags);
+	return pages;
+}
+
+static void slab_backend_pfree(struct uk_allocslab *s, void *pages,
+			       unsigned long num_pages)
+{
+	unsigned long flags;
+
+	ukplat_spin_lock_irqsave(&s->backend_lock, flags);
+	uk_pfree(s->backend, pages, num_pages);
+	ukplat_spin_unlock_irqrestore(&s->backend_lock, flags);
+}
+
+/* Called with the lock of the cache held */
+static struct slab_hdr *slab_new(struct uk_allocslab *s, unsigned int cls)
+{
+	struct slab_cache *c = &s->cache[cls];
+	struct slab_free_obj *obj;
+	struct slab_hdr *slab;
+	unsigned int i;
+
+	slab = slab_backend_palloc(s, 1);
+	if (unlikely(!slab))
+		return __NULL;
+
+	slab->magic = SLAB_MAGIC;
+	slab->cls = cls;
+	slab->free = __NULL;
+	slab->nr_free = c->nr_objs;
+
+	for (i = c->nr_objs; i > 0; i--) {
+		obj = (struct slab_free_obj *)((__uptr)slab + SLAB_HDR_SIZE +
+					       (i - 1) * c->size);
+		obj->next = slab->free;
+		slab->free = obj;
+	}
+
+	uk_list_add(&slab->list, &c->partial);
+	c->nr_empty++;
+	return slab;
+}
+
+/* Takes up to `count` objects from the slabs of a class */
+static unsigned int slab_get_objs(struct uk_allocslab *s, unsigned int cls,
+				  void **objs, unsigned int count)
+{
+	struct slab_cache *c = &s->cache[cls];
+	struct slab_free_obj *obj;
+	struct slab_hdr *slab;
+	unsigned int n = 0;
+
+	ukarch_spin_lock(&c->lock);
+	while (n < count) {
+		if (uk_list_empty(&c->partial)) {
+			if (unlikely(!slab_new(s, cls)))
+				break;
+		}
+		slab = uk_list_first_entry(&c->partial, struct slab_hdr, list);
+		if (slab->nr_free == c->nr_objs)
+			c->nr_empty--;
+
+		while (n < count && slab->nr_free) {
+			obj = slab->free;
+			slab->free = obj->next;
+			slab->nr_free--;
+			objs[n++] = obj;
+		}
+		if (!slab->nr_free)
+			uk_list_del(&slab->list);
+	}
+	ukarch_spin_unlock(&c->lock);
+	return n;
+}
+
+/* Returns objects to their slabs */
+static void slab_put_objs(struct uk_allocslab *s, unsigned int cls,
+			  void **objs, unsigned int count)
+{
+	struct slab_cache *c = &s->cache[cls];
+	struct slab_free_obj *obj;
+	struct slab_hdr *slab;
+	unsigned int i;
+
+	ukarch_spin_lock(&c->lock);
+	for (i = 0; i < count; i++) {
+		obj = (struct slab_free_obj *)objs[i];
+		slab = slab_hdr(obj);
+		UK_ASSERT(slab->cls == cls);
+		UK_ASSERT(slab->nr_free < c->nr_objs);
+
+		obj->next = slab->free;
+		slab->free = obj;
+		if (slab->nr_free++ == 0)
+			uk_list_add_tail(&slab->list, &c->partial);
+
+		if (slab->nr_free == c->nr_objs) {
+			if (c->nr_empty) {
+				uk_list_del(&slab->list);
+				slab_backend_pfree(s, slab, 1);
+			} else {
+				c->nr_empty++;
+			}
+		}
+	}
+	ukarch_spin_unlock(&c->lock);
+}
+
+/* Must be called with interrupts disabled. The magazines of an LCPU are
+ * allocated on its first use of the allocator, so that the allocator can
+ * be initialized on a small memory range.
+ */
+static struct slab_lcpu *slab_lcpu_get(struct uk_allocslab *s)
+{
+	__lcpuidx idx = ukplat_lcpu_idx();
+	struct slab_lcpu *l = s->lcpu[idx];
+
+	if (unlikely(!l)) {
+		l = slab_backend_palloc(s, size_to_num_pages(sizeof(*l)));
+		if (unlikely(!l))
+			return __NULL;
+
+		memset(l, 0, sizeof(*l));
+		s->lcpu[idx] = l;
+	}
+	return l;
+}
+
+static void *slab_alloc_obj(struct uk_allocslab *s, unsigned int cls)
+{
+	struct slab_magazine *m;
+	struct slab_lcpu *l;
+	unsigned long flags;
+	void *obj = __NULL;
+
+	/* Disabling interrupts keeps us on this LCPU's magazine */
+	flags = ukplat_lcpu_save_irqf();
+	l = slab_lcpu_get(s);
+	if (unlikely(!l)) {
+		slab_get_objs(s, cls, &obj, 1);
+		goto out;
+	}
+
+	m = &l->mag[cls];
+	if (unlikely(!m->count))
+		m->count = slab_get_objs(s, cls, m->objs, SLAB_MAG_BATCH);
+	if (likely(m->count))
+		obj = m->objs[--m->count];
+out:
+	ukplat_lcpu_restore_irqf(flags);
+	return obj;
+}
+
+static void slab_free_obj(struct uk_allocslab *s, unsigned int cls,
+			  void *obj)
+{
+	struct slab_magazine *m;
+	struct slab_lcpu *l;
+	unsigned long flags;
+
+	flags = ukplat_lcpu_save_irqf();
+	l = slab_lcpu_get(s);
+	if (unlikely(!l)) {
+		slab_put_objs(s, cls, &obj, 1);
+		goto out;
+	}
+
+	m = &l->mag[cls];
+	if (unlikely(m->count == SLAB_MAG_SIZE)) {
+		/* Return the oldest objects, they are least likely cached */
+		slab_put_objs(s, cls, m->objs, SLAB_MAG_BATCH);
+		m->count -= SLAB_MAG_BATCH;
+		memmove(&m->objs[0], &m->objs[SLAB_MAG_BATCH],
+			m->count * sizeof(void *));
+	}
+	m->objs[m->count++] = obj;
+out:
+	ukplat_lcpu_restore_irqf(flags);
+}
+
+static void *slab_alloc_large(struct uk_allocslab *s, __sz align, __sz size)
+{
+	struct slab_hdr *hdr;
+	unsigned long num_pages;
+	__uptr base, ptr;
+	__sz realsize;
+
+	/* Page-aligned objects need a page for the header in front */
+	realsize = size + (align >= __PAGE_SIZE ? align : SLAB_HDR_SIZE + align);
+	if (realsize < size)
+		return __NULL;
+
+	num_pages = size_to_num_pages(realsize);
+	base = (__uptr)slab_backend_palloc(s, num_pages);
+	if (unlikely(!base))
+		return __NULL;
+
+	ptr = ALIGN_UP(base + SLAB_HDR_SIZE, (__uptr)align);
+	hdr = (struct slab_hdr *)round_pgdown(ptr);
+	if ((__uptr)hdr == ptr)
+		hdr = (struct slab_hdr *)(ptr - __PAGE_SIZE);
+	UK_ASSERT((__uptr)hdr >= base);
+
+	hdr->magic = SLAB_MAGIC;
+	hdr->cls = SLAB_CLASS_LARGE;
+	hdr->base = (void *)base;
+	hdr->num_pages = num_pages;
+	return (void *)ptr;
+}
+
+static __sz slab_usable_size(struct slab_hdr *hdr, const void *ptr)
+{
+	if (hdr->cls != SLAB_CLASS_LARGE)
+		return slab_sizes[hdr->cls];
+
+	return (__uptr)hdr->base + (hdr->num_pages << __PAGE_SHIFT) -
+	       (__uptr)ptr;
+}
+
+static void *slab_memalign_internal(struct uk_allocslab *s, __sz align,
+				    __sz size)
+{
+	unsigned int cls;
+	void *obj;
+
+	if (size <= SLAB_MAX_SIZE && align <= SLAB_MAX_ALIGN) {
+		cls = slab_class(ALIGN_UP(size, align));
+		UK_ASSERT(slab_sizes[cls] % align == 0);
+		obj = slab_alloc_obj(s, cls);
+		size = slab_sizes[cls];
+	} else {
+		obj = slab_alloc_large(s, align, size);
+		if (likely(obj))
+			size = slab_usable_size(slab_hdr(obj), obj);
+	}
+
+	uk_alloc_stats_count_alloc(&s->self, obj, size);
+	return obj;
+}
+
+static void *slab_malloc(struct uk_alloc *a, __sz size)
+{
+	struct uk_allocslab *s = ukalloc2slab(a);
+	void *obj;
+
+	if (unlikely(!size))
+		return __NULL;
+
+	obj = slab_memalign_internal(s, __alignof__(max_align_t), size);
+	if (unlikely(!obj))
+		errno = ENOMEM;
+	return obj;
+}
+
+static void slab_free(struct uk_alloc *a, void *ptr)
+{
+	struct uk_allocslab *s = ukalloc2slab(a);
+	struct slab_hdr *hdr;
+
+	if (!ptr)
+		return;
+
+	hdr = slab_hdr(ptr);
+	uk_alloc_stats_count_free(a, ptr, slab_usable_size(hdr, ptr));
+
+	if (hdr->cls != SLAB_CLASS_LARGE)
+		slab_free_obj(s, hdr->cls, ptr);
+	else
+		slab_backend_pfree(s, hdr->base, hdr->num_pages);
+}
+
+static int slab_posix_memalign(struct uk_alloc *a, void **memptr,
+			       __sz align, __sz size)
+{
+	struct uk_allocslab *s = ukalloc2slab(a);
+	void *obj;
+
+	if (((align - 1) & align) != 0 || (align % sizeof(void *)) != 0)
+		return EINVAL;
+	if (!size)
+		return EINVAL;
+
+	if (align < __alignof__(max_align_t))
+		align = __alignof__(max_align_t);
+
+	obj = slab_memalign_internal(s, align, size);
+	if (unlikely(!obj))
+		return ENOMEM;
+
+	*memptr = obj;
+	return 0;
+}
+
+static void *slab_realloc(struct uk_alloc *a, void *ptr, __sz size)
+{
+	struct slab_hdr *hdr;
+	__sz usable;
+	void *obj;
+
+	if (!ptr)
+		return slab_malloc(a, size);
+
+	if (!size) {
+		slab_free(a, ptr);
+		return __NULL;
+	}
+
+	hdr = slab_hdr(ptr);
+	usable = slab_usable_size(hdr, ptr);
+
+	/* Shrink in place unless the object would fit a smaller class */
+	if (size <= usable && (hdr->cls == SLAB_CLASS_LARGE ||
+			       hdr->cls == 0 ||
+			       size > slab_sizes[hdr->cls - 1]))
+		return ptr;
+
+	obj = slab_malloc(a, size);
+	if (unlikely(!obj))
+		return __NULL;
+
+	memcpy(obj, ptr, MIN(size, usable));
+	slab_free(a, ptr);
+	return obj;
+}
+
+static void *slab_palloc(struct uk_alloc *a, unsigned long num_pages)
+{
+	struct uk_allocslab *s = ukalloc2slab(a);
+	void *pages;
+
+	pages = slab_backend_palloc(s, num_pages);
+	uk_alloc_stats_count_palloc(a, pages, num_pages);
+	return pages;
+}
+
+static void slab_pfree(struct uk_alloc *a, void *ptr, unsigned long num_pages)
+{
+	struct uk_allocslab *s = ukalloc2slab(a);
+
+	uk_alloc_stats_count_pfree(a, ptr, num_pages);
+	slab_backend_pfree(s, ptr, num_pages);
+}
+
+static long slab_pavailmem(struct uk_alloc *a)
+{
+	return uk_alloc_pavailmem(ukalloc2slab(a)->backend);
+}
+
+static long slab_pmaxalloc(struct uk_alloc *a)
+{
+	return uk_alloc_pmaxalloc(ukalloc2slab(a)->backend);
+}
+
+static int slab_addmem(struct uk_alloc *a, void *base, __sz len)
+{
+	struct uk_allocslab *s = ukalloc2slab(a);
+	unsigned long flags;
+	int rc;
+
+	ukplat_spin_lock_irqsave(&s->backend_lock, flags);
+	rc = uk_alloc_addmem(s->backend, base, len);
+	ukplat_spin_unlock_irqrestore(&s->backend_lock, flags);
+	return rc;
+}
+
+struct uk_alloc *uk_allocslab_create(struct uk_alloc *backend)
+{
+	struct uk_allocslab *s;
+	struct uk_alloc *a;
+	unsigned int i;
+
+	UK_ASSERT(backend);
+	UK_ASSERT(backend->palloc && backend->pfree);
+
+	s = uk_palloc(backend, size_to_num_pages(sizeof(*s)));
+	if (unlikely(!s)) {
+		uk_pr_err("Not enough space for slab allocator\n");
+		return __NULL;
+	}
+
+	uk_pr_info("Initialize slab allocator %p on %p\n", s, backend);
+	memset(s, 0, sizeof(*s));
+	s->backend = backend;
+	ukarch_spin_init(&s->backend_lock);
+
+	for (i = 0; i < SLAB_NR_CLASSES; i++) {
+		ukarch_spin_init(&s->cache[i].lock);
+		UK_INIT_LIST_HEAD(&s->cache[i].partial);
+		s->cache[i].size = slab_sizes[i];
+		s->cache[i].nr_objs = (__PAGE_SIZE - SLAB_HDR_SIZE) /
+				      slab_sizes[i];
+	}
+
+	/* We serialize all accesses to the page allocator from now on */
+	uk_alloc_unregister(backend);
+
+	a = &s->self;
+	a->malloc         = slab_malloc;
+	a->calloc         = uk_calloc_compat;
+	a->realloc        = slab_realloc;
+	a->posix_memalign = slab_posix_memalign;
+	a->memalign       = uk_memalign_compat;
+	a->free           = slab_free;
+	a->palloc         = slab_palloc;
+	a->pfree          = slab_pfree;
+	a->pavailmem      = slab_pavailmem;
+	a->availmem       = uk_alloc_availmem_ifpages;
+	a->pmaxalloc      = slab_pmaxalloc;
+	a->maxalloc       = uk_alloc_maxalloc_ifpages;
+	a->addmem         = slab_addmem;
+
+	uk_alloc_stats_reset(a);
+	uk_alloc_register(a);
+	return a;
+}
+
+struct uk_alloc *uk_allocslab_init(void *base, __sz len)
+{
+	struct uk_alloc *backend;
+
+	backend = uk_allocbbuddy_init(base, len);
+	if (unlikely(!backend))
+		return __NULL;
+
+	return uk_allocslab_create(backend);
+}
@@ -0,0 +1,241 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <uk/test.h>
+#include <uk/alloc_impl.h>
+#include <uk/allocbbuddy.h>
+#include <uk/allocslab.h>
+#include <uk/print.h>
+#include <uk/plat/time.h>
+
+#define pr_info(fmt, ...)						\
+	_uk_printk(KLVL_INFO, uk_libid_self(), __NULL, 0x0, fmt,	\
+		   ##__VA_ARGS__)
+
+/* Every test runs on a private heap that is taken from the default
+ * allocator and returned afterwards.
+ */
+#define TEST_HEAP_PAGES		512
+#define TEST_MANY_OBJS		2000
+#define BENCH_OBJS		256
+#define BENCH_ROUNDS		100
+
+static const __sz test_sizes[] = {
+	1, 8, 16, 17, 33, 64, 100, 128, 129, 255, 256, 257, 511, 512,
+	513, 4096, 10000
+};
+
+struct test_heap {
+	void *mem;
+	struct uk_alloc *a;
+};
+
+static int test_heap_init(struct test_heap *h,
+			  struct uk_alloc *(*init)(void *base, __sz len))
+{
+	h->mem = uk_palloc(uk_alloc_get_default(), TEST_HEAP_PAGES);
+	if (!h->mem)
+		return -1;
+
+	h->a = init(h->mem, TEST_HEAP_PAGES << __PAGE_SHIFT);
+	if (!h->a) {
+		uk_pfree(uk_alloc_get_default(), h->mem, TEST_HEAP_PAGES);
+		return -1;
+	}
+	return 0;
+}
+
+static void test_heap_fini(struct test_heap *h)
+{
+	uk_alloc_unregister(h->a);
+	uk_pfree(uk_alloc_get_default(), h->mem, TEST_HEAP_PAGES);
+}
+
+UK_TESTCASE(ukallocslab, test_slab_sizes)
+{
+	void *objs[ARRAY_SIZE(test_sizes)];
+	struct test_heap h;
+	unsigned int i;
+	__sz j;
+
+	UK_TEST_ASSERT(test_heap_init(&h, uk_allocslab_init) == 0);
+
+	for (i = 0; i < ARRAY_SIZE(test_sizes); i++) {
+		objs[i] = uk_malloc(h.a, test_sizes[i]);
+		UK_TEST_ASSERT(objs[i] != NULL);
+		UK_TEST_EXPECT_ZERO((__uptr)objs[i] &
+				    (__alignof__(max_align_t) - 1));
+		memset(objs[i], i + 1, test_sizes[i]);
+	}
+
+	/* Objects must not overlap */
+	for (i = 0; i < ARRAY_SIZE(test_sizes); i++) {
+		for (j = 0; j < test_sizes[i]; j++) {
+			if (((unsigned char *)objs[i])[j] != i + 1)
+				break;
+		}
+		UK_TEST_EXPECT_SNUM_EQ(j, test_sizes[i]);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(test_sizes); i++)
+		uk_free(h.a, objs[i]);
+
+	UK_TEST_EXPECT_NULL(uk_malloc(h.a, 0));
+	test_heap_fini(&h);
+}
+
+/* Freed objects are reused from the LCPU's magazine */
+UK_TESTCASE(ukallocslab, test_slab_reuse)
+{
+	struct test_heap h;
+	void *p, *q;
+
+	UK_TEST_ASSERT(test_heap_init(&h, uk_allocslab_init) == 0);
+
+	p = uk_malloc(h.a, 64);
+	UK_TEST_ASSERT(p != NULL);
+	uk_free(h.a, p);
+	q = uk_malloc(h.a, 60);
+	UK_TEST_EXPECT_PTR_EQ(q, p);
+	uk_free(h.a, q);
+
+	test_heap_fini(&h);
+}
+
+UK_TESTCASE(ukallocslab, test_slab_memalign)
+{
+	static const __sz aligns[] = { 32, 64, 128, 4096, 8192 };
+	void *objs[ARRAY_SIZE(aligns)];
+	struct test_heap h;
+	unsigned int i;
+	int rc;
+
+	UK_TEST_ASSERT(test_heap_init(&h, uk_allocslab_init) == 0);
+
+	for (i = 0; i < ARRAY_SIZE(aligns); i++) {
+		rc = uk_posix_memalign(h.a, &objs[i], aligns[i], 40);
+		UK_TEST_ASSERT(rc == 0);
+		UK_TEST_EXPECT_ZERO((__uptr)objs[i] & (aligns[i] - 1));
+		memset(objs[i], 0xff, 40);
+	}
+	for (i = 0; i < ARRAY_SIZE(aligns); i++)
+		uk_free(h.a, objs[i]);
+
+	UK_TEST_EXPECT_SNUM_EQ(uk_posix_memalign(h.a, &objs[0], 24, 40),
+			       EINVAL);
+
+	test_heap_fini(&h);
+}
+
+UK_TESTCASE(ukallocslab, test_slab_realloc)
+{
+	static const __sz sizes[] = { 200, 5000, 16 };
+	struct test_heap h;
+	unsigned int i;
+	__sz j, len;
+	char *p;
+
+	UK_TEST_ASSERT(test_heap_init(&h, uk_allocslab_init) == 0);
+
+	p = uk_malloc(h.a, 24);
+	UK_TEST_ASSERT(p != NULL);
+	len = 24;
+	for (j = 0; j < len; j++)
+		p[j] = (char)j;
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		p = uk_realloc(h.a, p, sizes[i]);
+		UK_TEST_ASSERT(p != NULL);
+		len = MIN(len, sizes[i]);
+		for (j = 0; j < len; j++) {
+			if (p[j] != (char)j)
+				break;
+		}
+		UK_TEST_EXPECT_SNUM_EQ(j, len);
+	}
+	uk_free(h.a, p);
+
+	test_heap_fini(&h);
+}
+
+/* Exceed the magazines so that objects go back and forth to the slabs */
+UK_TESTCASE(ukallocslab, test_slab_many)
+{
+	static void *objs[TEST_MANY_OBJS];
+	struct test_heap h;
+	unsigned int i, round;
+	long pages;
+
+	UK_TEST_ASSERT(test_heap_init(&h, uk_allocslab_init) == 0);
+
+	pages = uk_alloc_pavailmem(h.a);
+	for (round = 0; round < 2; round++) {
+		for (i = 0; i < TEST_MANY_OBJS; i++) {
+			objs[i] = uk_malloc(h.a, 48);
+			UK_TEST_ASSERT(objs[i] != NULL);
+			*(unsigned int *)objs[i] = i;
+		}
+		/* Free every other object first to fragment the slabs */
+		for (i = 0; i < TEST_MANY_OBJS; i += 2) {
+			UK_TEST_EXPECT_SNUM_EQ(*(unsigned int *)objs[i], i);
+			uk_free(h.a, objs[i]);
+		}
+		for (i = 1; i < TEST_MANY_OBJS; i += 2) {
+			UK_TEST_EXPECT_SNUM_EQ(*(unsigned int *)objs[i], i);
+			uk_free(h.a, objs[i]);
+		}
+	}
+
+	/* Empty slabs are returned to the page allocator */
+	UK_TEST_EXPECT(pages - uk_alloc_pavailmem(h.a) <
+		       TEST_MANY_OBJS / 4);
+
+	test_heap_fini(&h);
+}
+
+/* Allocation throughput microbenchmark: Allocates objects of typical small
+ * sizes and frees them again, once with the slab allocator and once with
+ * the binary buddy allocator.
+ */
+static void test_slab_bench_run(const char *name,
+				struct uk_alloc *(*init)(void *base, __sz len))
+{
+	static const __sz sizes[] = { 32, 64, 128, 256, 512 };
+	static void *objs[BENCH_OBJS];
+	struct test_heap h;
+	unsigned int i, round;
+	__nsec start, end;
+	unsigned long ops;
+
+	UK_ASSERT(test_heap_init(&h, init) == 0);
+
+	start = ukplat_monotonic_clock();
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		for (i = 0; i < BENCH_OBJS; i++) {
+			objs[i] = uk_malloc(h.a, sizes[i % ARRAY_SIZE(sizes)]);
+			UK_ASSERT(objs[i] != NULL);
+		}
+		for (i = 0; i < BENCH_OBJS; i++)
+			uk_free(h.a, objs[i]);
+	}
+	end = ukplat_monotonic_clock();
+
+	ops = BENCH_OBJS * BENCH_ROUNDS;
+	pr_info("%s: %lu malloc/free pairs, %"__PRInsec" ns/op\n",
+		name, ops, (end - start) / ops);
+
+	test_heap_fini(&h);
+}
+
+UK_TESTCASE(ukallocslab, test_slab_bench)
+{
+	test_slab_bench_run("slab", uk_allocslab_init);
+	test_slab_bench_run("bbuddy", uk_allocbbuddy_init);
+}
+
+uk_testsuite_register(ukallocslab, NULL);
@@ -55,6 +55,9 @@
 #elif CONFIG_LIBUKBOOT_INITREGION
 #include <uk/allocregion.h>
 #define uk_alloc_init uk_allocregion_init
+#elif CONFIG_LIBUKBOOT_INITSLAB
+#include <uk/allocslab.h>
+#define uk_alloc_init uk_allocslab_init
 #elif CONFIG_LIBUKBOOT_INITMIMALLOC
 #include <uk/mimalloc.h>
 #define uk_alloc_init uk_mimalloc_init
@@ -78,6 +81,12 @@
 #if CONFIG_LIBUKBOOT_INITSCHEDCOOP
 #include <uk/schedcoop.h>
 #endif /* CONFIG_LIBUKBOOT_INITSCHEDCOOP */
+#if CONFIG_LIBUKBOOT_INITSCHEDSMP
+#include <uk/schedsmp.h>
+#endif /* CONFIG_LIBUKBOOT_INITSCHEDSMP */
+#if CONFIG_LIBUKBOOT_INITSCHEDPREEMPT
+#include <uk/schedpreempt.h>
+#endif /* CONFIG_LIBUKBOOT_INITSCHEDPREEMPT */
 #include <uk/arch/lcpu.h>
 #include <uk/plat/bootstrap.h>
 #include <uk/plat/common/lcpu.h>
@@ -355,6 +364,10 @@ void uk_boot_entry(void)
 	uk_pr_info("Initialize scheduling...\n");
 #if CONFIG_LIBUKBOOT_INITSCHEDCOOP
 	s = uk_schedcoop_create(a, sa, auxsa, a);
+#elif CONFIG_LIBUKBOOT_INITSCHEDSMP
+	s = uk_schedsmp_create(a, sa, auxsa, a);
+#elif CONFIG_LIBUKBOOT_INITSCHEDPREEMPT
+	s = uk_schedpreempt_create(a, sa, auxsa, a);
 #endif
 	if (unlikely(!s))
 		UK_CRASH("Failed to initialize scheduling\n");
@@ -46,6 +46,7 @@ extern "C" {
 struct uk_falloc {
 
 #define FALLOC_FLAG_ALIGNED		0x01 /* align allocation to its size */
+#define FALLOC_FLAG_ZEROED		0x02 /* zero-fill allocated frames */
 
 	/**
 	 * Allocates physical memory
@@ -60,7 +61,8 @@ struct uk_falloc {
 	 * @param flags allocation flags (FALLOC_FLAG_*)
 	 * @param frames the number of frames to allocate (i.e., PAGE_SIZE)
 	 *
-	 * @return 0 on success, a non-zero error otherwise
+	 * @return 0 on success, a non-zero error otherwise. Allocators that
+	 *    cannot zero frames fail with -ENOTSUP for FALLOC_FLAG_ZEROED
 	 */
 	int (*falloc)(struct uk_falloc *fa, __paddr_t *paddr,
 		      unsigned long frames, unsigned long flags);
@@ -41,6 +41,12 @@
 #include <uk/atomic.h>
 #include <uk/list.h>
 #include <uk/print.h>
+#include <uk/isr/string.h>
+#if CONFIG_LIBUKFALLOCBUDDY_ZERO_POOL
+#include <uk/plat/lcpu.h>
+#include <uk/plat/spinlock.h>
+#include <uk/sched_idlework.h>
+#endif /* CONFIG_LIBUKFALLOCBUDDY_ZERO_POOL */
 
 #include <string.h>
 #include <errno.h>
@@ -149,6 +155,20 @@ struct bfa_memblock {
 	unsigned int level;
 };
 
+#if CONFIG_LIBUKFALLOCBUDDY_ZERO_POOL
+#define BFA_ZERO_POOL_FRAMES	CONFIG_LIBUKFALLOCBUDDY_ZERO_POOL_FRAMES
+
+/* Frames that the idle thread of an LCPU allocated and zeroed in advance.
+ * Single-frame allocations with FALLOC_FLAG_ZEROED are served from the pool
+ * of the current LCPU without zeroing the frame on the allocation path. The
+ * frames cannot be linked through their memory, as this would dirty them.
+ */
+struct bfa_zero_pool {
+	unsigned int count;
+	__paddr_t frames[BFA_ZERO_POOL_FRAMES];
+};
+#endif /* CONFIG_LIBUKFALLOCBUDDY_ZERO_POOL */
+
 /* The buddy allocator keeps track of all free memory across all zones in the
  * shared free lists so that a single check is enough to see if an allocation
  * of a certain size can directly be satisfied. If no element in the correct
@@ -165,8 +185,28 @@ struct buddy_framealloc {
 
 	struct uk_list_head free_list[BFA_LEVELS];
 	unsigned int free_list_map;
+
+#if CONFIG_LIBUKFALLOCBUDDY_ZERO_POOL
+	/* Idle threads refill the pools concurrently to the allocator's
+	 * users. The lock serializes all accesses to the free lists, the
+	 * zones, and the pools.
+	 */
+	__spinlock lock;
+	struct uk_sched_idlework idlework;
+	struct bfa_zero_pool zero_pool[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+#endif /* CONFIG_LIBUKFALLOCBUDDY_ZERO_POOL */
 };
 
+#if CONFIG_LIBUKFALLOCBUDDY_ZERO_POOL
+#define bfa_lock(bfa, irqf)					\
+	ukplat_spin_lock_irqsave(&(bfa)->lock, irqf)
+#define bfa_unlock(bfa, irqf)					\
+	ukplat_spin_unlock_irqrestore(&(bfa)->lock, irqf)
+#else /* !CONFIG_LIBUKFALLOCBUDDY_ZERO_POOL */
+#define bfa_lock(bfa, irqf)	do { (void)(bfa); (irqf) = 0; } while (0)
+#define bfa_unlock(bfa, irqf)	do { (void)(bfa); (void)(irqf); } while (0)
+#endif /* !CONFIG_LIBUKFALLOCBUDDY_ZERO_POOL */
+
 /* Forward declarations */
 static inline int bfa_largest_level(__paddr_t paddr, __sz len);
 static int bfa_do_free(struct buddy_framealloc *bfa, __paddr_t paddr, __sz len);
@@ -1193,27 +1233,198 @@ static int bfa_do_alloc_any(struct buddy_framealloc *bfa, __paddr_t *paddr,
 	return 0;
 }
 
+#ifdef BFA_DIRECT_MAPPED
+/* Zeroes physical memory through the direct-mapped area. The memory may span
+ * multiple consecutive zones.
+ */
+static void bfa_zero(struct buddy_framealloc *bfa, __paddr_t paddr, __sz len)
+{
+	struct bfa_zone *zone;
+	__sz zlen;
+
+	while (len > 0) {
+		zone = bfa_paddr_to_zone(bfa, paddr);
+		UK_ASSERT(zone);
+
+		zlen = MIN(len, zone->end - paddr);
+		memset_isr(bfa_paddr_to_mb(zone, paddr), 0, zlen);
+
+		paddr += zlen;
+		len -= zlen;
+	}
+}
+#endif /* BFA_DIRECT_MAPPED */
+
+#if CONFIG_LIBUKFALLOCBUDDY_ZERO_POOL
+/* Zeroes a frame with non-temporal stores so that zeroing frames in advance
+ * does not evict the working set of the LCPU from the caches.
+ */
+static void bfa_zero_frame_nt(void *frame)
+{
+#if CONFIG_ARCH_X86_64
+	unsigned long *p = (unsigned long *)frame;
+	unsigned long *end = p + PAGE_SIZE / sizeof(*p);
+
+	for (; p < end; p += 4)
+		__asm__ __volatile__("movnti %1, 0(%0)\n"
+				     "movnti %1, 8(%0)\n"
+				     "movnti %1, 16(%0)\n"
+				     "movnti %1, 24(%0)\n"
+				     : : "r"(p), "r"(0UL) : "memory");
+
+	/* Non-temporal stores are weakly ordered */
+	__asm__ __volatile__("sfence" : : : "memory");
+#elif CONFIG_ARCH_ARM_64
+	unsigned long *p = (unsigned long *)frame;
+	unsigned long *end = p + PAGE_SIZE / sizeof(*p);
+
+	for (; p < end; p += 2)
+		__asm__ __volatile__("stnp xzr, xzr, [%0]"
+				     : : "r"(p) : "memory");
+
+	__asm__ __volatile__("dmb ishst" : : : "memory");
+#else /* !CONFIG_ARCH_X86_64 && !CONFIG_ARCH_ARM_64 */
+	memset_isr(frame, 0, PAGE_SIZE);
+#endif /* !CONFIG_ARCH_X86_64 && !CONFIG_ARCH_ARM_64 */
+}
+
+/* Takes a zeroed frame from the pool of the current LCPU. Must be called
+ * with the allocator locked.
+ */
+static int bfa_zero_pool_pop(struct buddy_framealloc *bfa, __paddr_t *paddr)
+{
+	struct bfa_zero_pool *pool;
+
+	pool = &bfa->zero_pool[ukplat_lcpu_idx()];
+	if (pool->count == 0)
+		return -ENOMEM;
+
+	*paddr = pool->frames[--pool->count];
+	return 0;
+}
+
+/* Returns the frames in the pools of all LCPUs to the free lists. Must be
+ * called with the allocator locked. Returns the number of frames that were
+ * returned.
+ */
+static unsigned int bfa_zero_pool_drain(struct buddy_framealloc *bfa)
+{
+	struct bfa_zero_pool *pool;
+	unsigned int drained = 0;
+	unsigned int i;
+
+	for (i = 0; i < CONFIG_UKPLAT_LCPU_MAXCOUNT; i++) {
+		pool = &bfa->zero_pool[i];
+		drained += pool->count;
+		while (pool->count > 0)
+			bfa_do_free(bfa, pool->frames[--pool->count],
+				    PAGE_SIZE);
+	}
+
+	return drained;
+}
+
+/* Idle work: Allocates a free frame, zeroes it, and adds it to the pool of
+ * the current LCPU. The allocator is only locked while the free lists and the
+ * pool are modified, but not while the frame is zeroed.
+ */
+static int bfa_zero_pool_refill(void *arg)
+{
+	struct buddy_framealloc *bfa = (struct buddy_framealloc *)arg;
+	struct bfa_zero_pool *pool;
+	struct bfa_zone *zone;
+	unsigned long irqf;
+	__paddr_t paddr;
+	int more = 0;
+	int rc;
+
+	bfa_lock(bfa, irqf);
+	pool = &bfa->zero_pool[ukplat_lcpu_idx()];
+
+	/* Leave memory that is getting scarce to regular allocations */
+	if (pool->count == BFA_ZERO_POOL_FRAMES ||
+	    bfa->fa.free_memory <= ((__sz)BFA_ZERO_POOL_FRAMES << PAGE_SHIFT)) {
+		bfa_unlock(bfa, irqf);
+		return 0;
+	}
+
+	rc = bfa_do_alloc_any(bfa, &paddr, PAGE_SIZE);
+	bfa_unlock(bfa, irqf);
+	if (unlikely(rc))
+		return 0;
+
+	/* Zones are never removed, so the zone stays valid */
+	zone = bfa_paddr_to_zone(bfa, paddr);
+	UK_ASSERT(zone);
+	bfa_zero_frame_nt(bfa_paddr_to_mb(zone, paddr));
+
+	/* The idle thread is pinned, so the pool still belongs to this LCPU */
+	bfa_lock(bfa, irqf);
+	if (pool->count < BFA_ZERO_POOL_FRAMES) {
+		pool->frames[pool->count++] = paddr;
+		more = (pool->count < BFA_ZERO_POOL_FRAMES);
+	} else {
+		bfa_do_free(bfa, paddr, PAGE_SIZE);
+	}
+	bfa_unlock(bfa, irqf);
+
+	return more;
+}
+#else /* CONFIG_LIBUKFALLOCBUDDY_ZERO_POOL */
+#define bfa_zero_pool_drain(bfa)	0
+#endif /* !CONFIG_LIBUKFALLOCBUDDY_ZERO_POOL */
+
 static int bfa_alloc(struct uk_falloc *fa, __paddr_t *paddr,
-		     unsigned long frames, unsigned long flags __unused)
+		     unsigned long frames, unsigned long flags)
 {
 	struct buddy_framealloc *bfa = (struct buddy_framealloc *)fa;
+	unsigned long irqf;
 	__sz len;
+	int rc;
 
 	UK_ASSERT(frames > 0);
 	UK_ASSERT(frames <= (__SZ_MAX / PAGE_SIZE));
 
 	len = frames * PAGE_SIZE;
 
-	/* There is only FALLOC_FLAG_ALIGNED which we implicitly fulfill */
-	UK_ASSERT((flags == 0) || (flags == FALLOC_FLAG_ALIGNED));
+	/* FALLOC_FLAG_ALIGNED is implicitly fulfilled */
+	UK_ASSERT(!(flags & ~(FALLOC_FLAG_ALIGNED | FALLOC_FLAG_ZEROED)));
+
+#ifndef BFA_DIRECT_MAPPED
+	/* We cannot zero frames that we do not have access to */
+	if (flags & FALLOC_FLAG_ZEROED)
+		return -ENOTSUP;
+#endif /* !BFA_DIRECT_MAPPED */
+
+	bfa_lock(bfa, irqf);
+#if CONFIG_LIBUKFALLOCBUDDY_ZERO_POOL
+	if ((flags & FALLOC_FLAG_ZEROED) && frames == 1 &&
+	    *paddr == __PADDR_ANY && bfa_zero_pool_pop(bfa, paddr) == 0) {
+		bfa_unlock(bfa, irqf);
+		return 0;
+	}
+#endif /* CONFIG_LIBUKFALLOCBUDDY_ZERO_POOL */
 
 	/* If a physical address is given, the caller wants to allocate this
 	 * exact memory range. Otherwise, just take a free one from the list.
+	 * If memory is short, the frames in the zero pools are given back.
 	 */
-	if (*paddr == __PADDR_ANY)
-		return bfa_do_alloc_any(bfa, paddr, len);
-	else
-		return bfa_do_alloc(bfa, *paddr, len);
+	do {
+		if (*paddr == __PADDR_ANY)
+			rc = bfa_do_alloc_any(bfa, paddr, len);
+		else
+			rc = bfa_do_alloc(bfa, *paddr, len);
+	} while (unlikely(rc == -ENOMEM) && bfa_zero_pool_drain(bfa) > 0);
+	bfa_unlock(bfa, irqf);
+	if (unlikely(rc))
+		return rc;
+
+#ifdef BFA_DIRECT_MAPPED
+	if (flags & FALLOC_FLAG_ZEROED)
+		bfa_zero(bfa, *paddr, len);
+#endif /* BFA_DIRECT_MAPPED */
+
+	return 0;
 }
 
 static int bfa_do_alloc_any_in_range(struct buddy_framealloc *bfa,
@@ -1269,24 +1480,44 @@ static int bfa_do_alloc_any_in_range(struct buddy_framealloc *bfa,
 }
 
 static int bfa_alloc_from_range(struct uk_falloc *fa, __paddr_t *paddr,
-				unsigned long frames,
-				unsigned long flags __maybe_unused,
+				unsigned long frames, unsigned long flags,
 				__paddr_t min, __paddr_t max)
 {
 	struct buddy_framealloc *bfa = (struct buddy_framealloc *)fa;
+	unsigned long irqf;
 	__sz len;
+	int rc;
 
 	UK_ASSERT(frames > 0);
 	UK_ASSERT(frames <= (__SZ_MAX / PAGE_SIZE));
 
 	len = frames * PAGE_SIZE;
 
-	/* There is only FALLOC_FLAG_ALIGNED which we implicitly fulfill */
-	UK_ASSERT((flags == 0) || (flags == FALLOC_FLAG_ALIGNED));
+	/* FALLOC_FLAG_ALIGNED is implicitly fulfilled */
+	UK_ASSERT(!(flags & ~(FALLOC_FLAG_ALIGNED | FALLOC_FLAG_ZEROED)));
 
 	UK_ASSERT(min <= max);
 
-	return bfa_do_alloc_any_in_range(bfa, paddr, len, min, max);
+#ifndef BFA_DIRECT_MAPPED
+	/* We cannot zero frames that we do not have access to */
+	if (flags & FALLOC_FLAG_ZEROED)
+		return -ENOTSUP;
+#endif /* !BFA_DIRECT_MAPPED */
+
+	bfa_lock(bfa, irqf);
+	do {
+		rc = bfa_do_alloc_any_in_range(bfa, paddr, len, min, max);
+	} while (unlikely(rc == -ENOMEM) && bfa_zero_pool_drain(bfa) > 0);
+	bfa_unlock(bfa, irqf);
+	if (unlikely(rc))
+		return rc;
+
+#ifdef BFA_DIRECT_MAPPED
+	if (flags & FALLOC_FLAG_ZEROED)
+		bfa_zero(bfa, *paddr, len);
+#endif /* BFA_DIRECT_MAPPED */
+
+	return 0;
 }
 
 static struct bfa_memblock *bfa_try_merge(struct buddy_framealloc *bfa,
@@ -1420,7 +1651,9 @@ static int bfa_free(struct uk_falloc *fa, __paddr_t paddr,
 		    unsigned long frames)
 {
 	struct buddy_framealloc *bfa = (struct buddy_framealloc *)fa;
+	unsigned long irqf;
 	__sz len;
+	int rc;
 
 	if (unlikely(frames == 0))
 		return 0;
@@ -1429,7 +1662,11 @@ static int bfa_free(struct uk_falloc *fa, __paddr_t paddr,
 
 	len = frames * PAGE_SIZE;
 
-	return bfa_do_free(bfa, paddr, len);
+	bfa_lock(bfa, irqf);
+	rc = bfa_do_free(bfa, paddr, len);
+	bfa_unlock(bfa, irqf);
+
+	return rc;
 }
 
 static int bfa_do_addmem(struct buddy_framealloc *bfa, void *metadata,
@@ -1460,7 +1697,9 @@ static int bfa_addmem(struct uk_falloc *fa, void *metadata, __paddr_t paddr,
 		      unsigned long frames, __vaddr_t dm_off)
 {
 	struct buddy_framealloc *bfa = (struct buddy_framealloc *)fa;
+	unsigned long irqf;
 	__sz len;
+	int rc;
 
 	if (unlikely(frames == 0))
 		return 0;
@@ -1469,7 +1708,11 @@ static int bfa_addmem(struct uk_falloc *fa, void *metadata, __paddr_t paddr,
 
 	len = frames * PAGE_SIZE;
 
-	return bfa_do_addmem(bfa, metadata, paddr, len, dm_off);
+	bfa_lock(bfa, irqf);
+	rc = bfa_do_addmem(bfa, metadata, paddr, len, dm_off);
+	bfa_unlock(bfa, irqf);
+
+	return rc;
 }
 
 int uk_fallocbuddy_init(struct uk_falloc *fa)
@@ -1492,6 +1735,16 @@ int uk_fallocbuddy_init(struct uk_falloc *fa)
 
 	bfa->zones = __NULL;
 
+#if CONFIG_LIBUKFALLOCBUDDY_ZERO_POOL
+	ukarch_spin_init(&bfa->lock);
+	for (i = 0; i < CONFIG_UKPLAT_LCPU_MAXCOUNT; i++)
+		bfa->zero_pool[i].count = 0;
+
+	bfa->idlework.work = bfa_zero_pool_refill;
+	bfa->idlework.arg = bfa;
+	uk_sched_idlework_register(&bfa->idlework);
+#endif /* CONFIG_LIBUKFALLOCBUDDY_ZERO_POOL */
+
 	return 0;
 }
 
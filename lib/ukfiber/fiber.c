@@ -0,0 +1,340 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#include <errno.h>
+#include <string.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/fiber.h>
+#include <uk/print.h>
+#include <uk/sched.h>
+
+/* Each pool object is the stack of a fiber with the fiber descriptor on top:
+ *
+ *   +------------------------------------+----------------+
+ *   | stack (grows down)              <- | struct uk_fiber|
+ *   +------------------------------------+----------------+
+ *   ^ object                            ^ initial sp
+ */
+#define FIBER_DESC_SIZE	ALIGN_UP(sizeof(struct uk_fiber), UKARCH_SP_ALIGN)
+
+/* Executor that runs on the current thread. Fibers share the TLS of the
+ * executing thread, so this is also valid from within a fiber.
+ */
+static __uk_tls struct uk_fiber_exec *fiber_exec;
+
+static inline struct uk_fiber *fiber_from_obj(struct uk_fiber_exec *x,
+					      void *obj)
+{
+	return (struct uk_fiber *)((__uptr) obj + x->stack_size
+				   - FIBER_DESC_SIZE);
+}
+
+static inline void *fiber_to_obj(struct uk_fiber_exec *x, struct uk_fiber *f)
+{
+	return (void *)((__uptr) f + FIBER_DESC_SIZE - x->stack_size);
+}
+
+static void fiber_waitq_wake(struct uk_waitq_entry *entry)
+{
+	uk_fiber_wake(__containerof(entry, struct uk_fiber, wait));
+}
+
+static __noreturn void fiber_entry(long arg)
+{
+	struct uk_fiber *f = (struct uk_fiber *) arg;
+
+	f->fn(f->arg);
+	uk_fiber_exit();
+}
+
+int uk_fiber_exec_init(struct uk_fiber_exec *x, struct uk_alloc *a,
+		       unsigned int max_fibers, __sz stack_size)
+{
+	UK_ASSERT(x);
+
+	if (!stack_size)
+		stack_size = CONFIG_LIBUKFIBER_STACK_SIZE;
+	stack_size = ALIGN_UP(stack_size, UKARCH_SP_ALIGN);
+	if (unlikely(!a || !max_fibers || stack_size <= FIBER_DESC_SIZE))
+		return -EINVAL;
+
+	memset(x, 0, sizeof(*x));
+	x->pool = uk_allocpool_alloc(a, max_fibers, stack_size,
+				     UKARCH_SP_ALIGN);
+	if (unlikely(!x->pool))
+		return -ENOMEM;
+
+	x->stack_size = stack_size;
+	ukarch_spin_init(&x->lock);
+	UK_TAILQ_INIT(&x->ready);
+	return 0;
+}
+
+void uk_fiber_exec_fini(struct uk_fiber_exec *x)
+{
+	UK_ASSERT(x);
+	UK_ASSERT(!x->nr_fibers);
+	UK_ASSERT(!x->thread);
+
+	uk_allocpool_free(x->pool);
+	x->pool = NULL;
+}
+
+struct uk_fiber *uk_fiber_create(struct uk_fiber_exec *x,
+				 uk_fiber_fn_t fn, void *arg)
+{
+	struct uk_thread *idle_thread = NULL;
+	struct uk_fiber *f;
+	unsigned long flags;
+	void *obj;
+
+	UK_ASSERT(x);
+	UK_ASSERT(fn);
+
+	ukplat_spin_lock_irqsave(&x->lock, flags);
+	obj = uk_allocpool_take(x->pool);
+	if (unlikely(!obj)) {
+		ukplat_spin_unlock_irqrestore(&x->lock, flags);
+		return NULL;
+	}
+	x->nr_fibers++;
+	ukplat_spin_unlock_irqrestore(&x->lock, flags);
+
+	f = fiber_from_obj(x, obj);
+	f->exec = x;
+	f->fn = fn;
+	f->arg = arg;
+	f->state = UK_FIBER_RUNNABLE;
+	uk_waitq_entry_init(&f->wait, NULL);
+	f->wait.wake = fiber_waitq_wake;
+	ukarch_ctx_init_entry1(&f->ctx,
+			       ukarch_gen_sp(obj, x->stack_size
+					     - FIBER_DESC_SIZE),
+			       0, fiber_entry, (long) f);
+
+	ukplat_spin_lock_irqsave(&x->lock, flags);
+	UK_TAILQ_INSERT_TAIL(&x->ready, f, ready_list);
+	if (x->idle) {
+		x->idle = false;
+		idle_thread = x->thread;
+	}
+	ukplat_spin_unlock_irqrestore(&x->lock, flags);
+
+	if (idle_thread)
+		uk_thread_wake(idle_thread);
+
+	uk_pr_debug("fiber %p created on executor %p\n", f, x);
+	return f;
+}
+
+static struct uk_fiber *fiber_ready_pop(struct uk_fiber_exec *x)
+{
+	struct uk_fiber *f;
+	unsigned long flags;
+
+	ukplat_spin_lock_irqsave(&x->lock, flags);
+	f = UK_TAILQ_FIRST(&x->ready);
+	if (f)
+		UK_TAILQ_REMOVE(&x->ready, f, ready_list);
+	ukplat_spin_unlock_irqrestore(&x->lock, flags);
+	return f;
+}
+
+/* Switches from the current fiber `prev` directly to the next runnable one,
+ * so that passing control between fibers does not detour via the executor
+ * loop. Falls back to the executor if no fiber is runnable.
+ */
+static void fiber_schedule(struct uk_fiber_exec *x, struct uk_fiber *prev)
+{
+	struct uk_fiber *next;
+
+	next = fiber_ready_pop(x);
+	if (next == prev)
+		return;
+	if (!next) {
+		ukarch_ctx_switch(&prev->ctx, &x->ctx);
+		return;
+	}
+
+	x->current = next;
+	ukarch_ctx_switch(&prev->ctx, &next->ctx);
+}
+
+void uk_fiber_exec_run(struct uk_fiber_exec *x)
+{
+	struct uk_fiber *f;
+	unsigned long flags;
+
+	UK_ASSERT(x);
+	UK_ASSERT(!fiber_exec);
+
+	fiber_exec = x;
+	x->thread = uk_thread_current();
+
+	for (;;) {
+		ukplat_spin_lock_irqsave(&x->lock, flags);
+		f = UK_TAILQ_FIRST(&x->ready);
+		if (f) {
+			UK_TAILQ_REMOVE(&x->ready, f, ready_list);
+		} else if (x->nr_fibers) {
+			/* Sleep until a fiber is created or woken up */
+			x->idle = true;
+			uk_thread_block(x->thread);
+		} else {
+			ukplat_spin_unlock_irqrestore(&x->lock, flags);
+			break;
+		}
+		ukplat_spin_unlock_irqrestore(&x->lock, flags);
+
+		if (!f) {
+			uk_sched_yield();
+			continue;
+		}
+
+		x->current = f;
+		ukarch_ctx_switch(&x->ctx, &f->ctx);
+
+		/* We are back because the current fiber exited or because no
+		 * fiber is runnable anymore.
+		 */
+		f = x->current;
+		x->current = NULL;
+		if (f->state == UK_FIBER_EXITED) {
+			ukplat_spin_lock_irqsave(&x->lock, flags);
+			uk_allocpool_return(x->pool, fiber_to_obj(x, f));
+			x->nr_fibers--;
+			ukplat_spin_unlock_irqrestore(&x->lock, flags);
+		}
+	}
+
+	x->thread = NULL;
+	fiber_exec = NULL;
+}
+
+struct uk_fiber *uk_fiber_current(void)
+{
+	struct uk_fiber_exec *x = fiber_exec;
+
+	return x ? x->current : NULL;
+}
+
+void uk_fiber_yield(void)
+{
+	struct uk_fiber *f = uk_fiber_current();
+	struct uk_fiber_exec *x;
+	unsigned long flags;
+
+	UK_ASSERT(f);
+
+	x = f->exec;
+	ukplat_spin_lock_irqsave(&x->lock, flags);
+	UK_TAILQ_INSERT_TAIL(&x->ready, f, ready_list);
+	ukplat_spin_unlock_irqrestore(&x->lock, flags);
+
+	fiber_schedule(x, f);
+}
+
+void uk_fiber_exit(void)
+{
+	struct uk_fiber *f = uk_fiber_current();
+	struct uk_fiber_exec *x;
+
+	UK_ASSERT(f);
+
+	/* The executor releases the stack we are running on */
+	x = f->exec;
+	f->state = UK_FIBER_EXITED;
+	ukarch_ctx_switch(&f->ctx, &x->ctx);
+	UK_CRASH("Exited fiber %p was resumed\n", f);
+}
+
+void uk_fiber_set_waiting(struct uk_fiber *f)
+{
+	struct uk_fiber_exec *x;
+	unsigned long flags;
+
+	UK_ASSERT(f);
+	UK_ASSERT(f == uk_fiber_current());
+
+	x = f->exec;
+	ukplat_spin_lock_irqsave(&x->lock, flags);
+	f->state = UK_FIBER_WAITING;
+	ukplat_spin_unlock_irqrestore(&x->lock, flags);
+}
+
+void uk_fiber_block(void)
+{
+	struct uk_fiber *f = uk_fiber_current();
+	struct uk_fiber_exec *x;
+	unsigned long flags;
+	bool woken;
+
+	UK_ASSERT(f);
+
+	x = f->exec;
+	ukplat_spin_lock_irqsave(&x->lock, flags);
+	woken = (f->state == UK_FIBER_RUNNABLE);
+	if (woken) {
+		/* Woken up before we suspended: take us out of the ready
+		 * queue again and continue.
+		 */
+		UK_TAILQ_REMOVE(&x->ready, f, ready_list);
+	}
+	ukplat_spin_unlock_irqrestore(&x->lock, flags);
+
+	/* A wake-up that happens from here on puts us into the ready queue,
+	 * where `fiber_schedule()` finds us again.
+	 */
+	if (!woken)
+		fiber_schedule(x, f);
+}
+
+#if CONFIG_LIBUKFILE
+static void fiber_clear_waiting(struct uk_fiber *f)
+{
+	struct uk_fiber_exec *x = f->exec;
+	unsigned long flags;
+
+	ukplat_spin_lock_irqsave(&x->lock, flags);
+	if (f->state == UK_FIBER_RUNNABLE)
+		UK_TAILQ_REMOVE(&x->ready, f, ready_list);
+	f->state = UK_FIBER_RUNNABLE;
+	ukplat_spin_unlock_irqrestore(&x->lock, flags);
+}
+
+static void fiber_pollq_callback(uk_pollevent ev __unused,
+				 enum uk_poll_chain_op op,
+				 struct uk_poll_chain *tick)
+{
+	if (op == UK_POLL_CHAINOP_SET)
+		uk_fiber_wake((struct uk_fiber *) tick->arg);
+}
+
+uk_pollevent uk_fiber_pollq_poll(struct uk_pollq *q, uk_pollevent req)
+{
+	struct uk_fiber *f = uk_fiber_current();
+	struct uk_poll_chain tick;
+	uk_pollevent ev;
+
+	UK_ASSERT(f);
+
+	tick = UK_POLL_CHAIN_CALLBACK(req, fiber_pollq_callback, f);
+	for (;;) {
+		if ((ev = uk_pollq_poll_immediate(q, req)))
+			return ev;
+
+		/* The ticket is only registered if no event is set */
+		uk_fiber_set_waiting(f);
+		ev = uk_pollq_poll_register(q, &tick, 0);
+		if (ev) {
+			fiber_clear_waiting(f);
+			return ev;
+		}
+		uk_fiber_block();
+		uk_pollq_unregister(q, &tick);
+	}
+}
+#endif /* CONFIG_LIBUKFILE */
@@ -0,0 +1,206 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UK_FIBER_H__
+#define __UK_FIBER_H__
+
+#include <uk/config.h>
+#include <uk/alloc.h>
+#include <uk/allocpool.h>
+#include <uk/arch/ctx.h>
+#include <uk/list.h>
+#include <uk/plat/spinlock.h>
+#include <uk/thread.h>
+#include <uk/wait.h>
+#if CONFIG_LIBUKFILE
+#include <uk/file/pollqueue.h>
+#endif /* CONFIG_LIBUKFILE */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Fibers are cooperative tasks that are multiplexed onto the thread that
+ * runs their executor (`uk_fiber_exec_run()`). A fiber only owns a small
+ * stack taken from a memory pool of the executor. Switching between fibers
+ * saves and restores the callee-saved registers and the stack pointer with
+ * `ukarch_ctx_switch()`: TLS, extended context and the auxiliary stack are
+ * shared with the executing thread. Consequently, a fiber that blocks the
+ * thread (e.g., with `uk_waitq_wait_event()` or a blocking system call)
+ * stalls all fibers of its executor. Use the fiber-aware wait primitives
+ * below instead.
+ */
+
+struct uk_fiber_exec;
+
+typedef void (*uk_fiber_fn_t)(void *arg);
+
+#define UK_FIBER_RUNNABLE	0
+#define UK_FIBER_WAITING	1
+#define UK_FIBER_EXITED		2
+
+struct uk_fiber {
+	struct ukarch_ctx ctx;
+	struct uk_fiber_exec *exec;
+	uk_fiber_fn_t fn;
+	void *arg;
+	unsigned int state;		/**< UK_FIBER_* */
+	struct uk_waitq_entry wait;	/**< Entry for waiting on a waitq */
+	UK_TAILQ_ENTRY(struct uk_fiber) ready_list;
+};
+
+UK_TAILQ_HEAD(uk_fiber_list, struct uk_fiber);
+
+struct uk_fiber_exec {
+	struct ukarch_ctx ctx;		/**< Context of the executor loop */
+	struct uk_thread *thread;	/**< Thread running the executor */
+	struct uk_fiber *current;	/**< Currently executing fiber */
+	struct uk_allocpool *pool;	/**< Fiber stacks with descriptors */
+	__sz stack_size;
+
+	/* Fibers can be created and woken up from other threads and from
+	 * interrupt context, so the following fields are protected by `lock`.
+	 */
+	__spinlock lock;
+	struct uk_fiber_list ready;	/**< Runnable fibers (FIFO) */
+	unsigned int nr_fibers;		/**< Fibers that did not exit yet */
+	bool idle;			/**< `thread` is blocked for wake-ups */
+};
+
+/**
+ * Initializes an executor and allocates the stacks for its fibers.
+ *
+ * @param x
+ *   Executor to initialize
+ * @param a
+ *   Allocator for the stack pool
+ * @param max_fibers
+ *   Maximum number of fibers that exist at the same time
+ * @param stack_size
+ *   Stack size of each fiber, including the fiber descriptor.
+ *   If 0, `CONFIG_LIBUKFIBER_STACK_SIZE` is used.
+ * @return
+ *   - (0): Success
+ *   - (-EINVAL): Invalid parameters
+ *   - (-ENOMEM): Could not allocate the stack pool
+ */
+int uk_fiber_exec_init(struct uk_fiber_exec *x, struct uk_alloc *a,
+		       unsigned int max_fibers, __sz stack_size);
+
+/**
+ * Releases the stack pool of an executor. All fibers must have exited.
+ */
+void uk_fiber_exec_fini(struct uk_fiber_exec *x);
+
+/**
+ * Runs the fibers of an executor on the calling thread. The thread is
+ * blocked while no fiber is runnable. The function returns as soon as all
+ * fibers exited.
+ */
+void uk_fiber_exec_run(struct uk_fiber_exec *x);
+
+/**
+ * Creates a runnable fiber. This function can be called from any thread
+ * and also from a fiber of the same executor.
+ *
+ * @param x
+ *   Executor that runs the fiber
+ * @param fn
+ *   Entry function of the fiber
+ * @param arg
+ *   Argument passed to `fn`
+ * @return
+ *   - (NULL): The stack pool of the executor is exhausted
+ *   - Reference to the new fiber, valid until the fiber exited
+ */
+struct uk_fiber *uk_fiber_create(struct uk_fiber_exec *x,
+				 uk_fiber_fn_t fn, void *arg);
+
+/**
+ * Returns the calling fiber or NULL if not called from a fiber
+ */
+struct uk_fiber *uk_fiber_current(void);
+
+/**
+ * Gives up the CPU in favor of the other runnable fibers of the executor
+ */
+void uk_fiber_yield(void);
+
+/**
+ * Terminates the calling fiber. Returning from the entry function has the
+ * same effect.
+ */
+void uk_fiber_exit(void) __noreturn;
+
+/**
+ * Marks a fiber as waiting. The fiber keeps executing until it calls
+ * `uk_fiber_block()`. A wake-up in between makes `uk_fiber_block()` return
+ * immediately, so a fiber is marked as waiting before it registers for the
+ * wake-up.
+ */
+void uk_fiber_set_waiting(struct uk_fiber *f);
+
+/**
+ * Suspends the calling fiber until it is woken up with `uk_fiber_wake()`,
+ * unless this happened already since `uk_fiber_set_waiting()`.
+ */
+void uk_fiber_block(void);
+
+/**
+ * Makes a waiting fiber runnable again. This function is ISR-safe and can
+ * be called from any thread.
+ */
+void uk_fiber_wake(struct uk_fiber *f);
+
+/**
+ * Suspends the calling fiber until `condition` is true. The fiber is
+ * re-evaluated each time `wq` is woken up. In contrast to
+ * `uk_waitq_wait_event()`, only the fiber is suspended and not the thread
+ * that runs the executor.
+ *
+ * @param wq
+ *   Wait queue
+ * @param condition
+ *   Wake-up condition
+ */
+#define uk_fiber_waitq_wait_event(wq, condition)			\
+	do {								\
+		struct uk_fiber *__f = uk_fiber_current();		\
+		unsigned long __flags;					\
+									\
+		UK_ASSERT(__f);						\
+		while (!(condition)) {					\
+			ukplat_spin_lock_irqsave(&((wq)->sl), __flags);	\
+			if (condition) {				\
+				ukplat_spin_unlock_irqrestore(&((wq)->sl), \
+							      __flags);	\
+				break;					\
+			}						\
+			uk_fiber_set_waiting(__f);			\
+			uk_waitq_add(wq, &__f->wait);			\
+			ukplat_spin_unlock_irqrestore(&((wq)->sl), __flags); \
+			uk_fiber_block();				\
+			uk_waitq_remove_waiter(wq, &__f->wait);		\
+		}							\
+	} while (0)
+
+#if CONFIG_LIBUKFILE
+/**
+ * Fiber variant of `uk_pollq_poll()`: Suspends the calling fiber until one
+ * of the events in `req` is set on `q`.
+ *
+ * @return
+ *   Bitwise AND between `req` and the events set in `q`
+ */
+uk_pollevent uk_fiber_pollq_poll(struct uk_pollq *q, uk_pollevent req);
+#endif /* CONFIG_LIBUKFILE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UK_FIBER_H__ */
@@ -0,0 +1,164 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <uk/test.h>
+#include <uk/alloc.h>
+#include <uk/fiber.h>
+#include <uk/sched.h>
+#include <uk/wait.h>
+#include <uk/arch/time.h>
+
+#define TEST_FIBERS		64
+#define TEST_ROUNDS		16
+#define TEST_STACK_SIZE		4096
+
+struct round_args {
+	unsigned int id;
+	unsigned int *pos;
+	unsigned int *trace;
+};
+
+static void round_func(void *arg)
+{
+	struct round_args *args = (struct round_args *) arg;
+	unsigned int i;
+
+	for (i = 0; i < TEST_ROUNDS; i++) {
+		args->trace[(*args->pos)++] = args->id;
+		uk_fiber_yield();
+	}
+}
+
+/* Yielding fibers are executed round robin and their stacks are returned to
+ * the pool when they exit.
+ */
+UK_TESTCASE(ukfiber, test_fiber_round_robin)
+{
+	static unsigned int trace[TEST_FIBERS * TEST_ROUNDS];
+	struct round_args args[TEST_FIBERS];
+	struct uk_fiber_exec x;
+	struct uk_fiber *f;
+	unsigned int pos = 0;
+	unsigned int i;
+	int rc;
+
+	rc = uk_fiber_exec_init(&x, uk_alloc_get_default(), TEST_FIBERS,
+				TEST_STACK_SIZE);
+	UK_TEST_ASSERT(rc == 0);
+
+	for (i = 0; i < TEST_FIBERS; i++) {
+		args[i].id = i;
+		args[i].pos = &pos;
+		args[i].trace = trace;
+		f = uk_fiber_create(&x, round_func, &args[i]);
+		UK_TEST_ASSERT(f != NULL);
+	}
+	/* The pool is exhausted */
+	UK_TEST_EXPECT_NULL(uk_fiber_create(&x, round_func, &args[0]));
+
+	uk_fiber_exec_run(&x);
+
+	UK_TEST_EXPECT_SNUM_EQ(pos, TEST_FIBERS * TEST_ROUNDS);
+	for (i = 0; i < pos; i++)
+		UK_TEST_EXPECT_SNUM_EQ(trace[i], i % TEST_FIBERS);
+	UK_TEST_EXPECT_SNUM_EQ(x.nr_fibers, 0);
+	UK_TEST_EXPECT_NULL(uk_fiber_current());
+
+	uk_fiber_exec_fini(&x);
+}
+
+struct wait_args {
+	struct uk_waitq wq;
+	int value;
+	unsigned int woken;
+	int done; /* set by a notifier thread as its last action */
+};
+
+static void waiter_func(void *arg)
+{
+	struct wait_args *args = (struct wait_args *) arg;
+
+	uk_fiber_waitq_wait_event(&args->wq, args->value > 0);
+	args->woken++;
+}
+
+static void notifier_func(void *arg)
+{
+	struct wait_args *args = (struct wait_args *) arg;
+
+	args->value = 1;
+	uk_waitq_wake_up(&args->wq);
+}
+
+/* Fibers waiting on a wait queue are suspended without blocking the
+ * executor thread and resumed by a wake-up from another fiber.
+ */
+UK_TESTCASE(ukfiber, test_fiber_waitq_fiber)
+{
+	struct wait_args args = { .value = 0, .woken = 0 };
+	struct uk_fiber_exec x;
+	struct uk_fiber *f;
+	unsigned int i;
+	int rc;
+
+	uk_waitq_init(&args.wq);
+	rc = uk_fiber_exec_init(&x, uk_alloc_get_default(), TEST_FIBERS, 0);
+	UK_TEST_ASSERT(rc == 0);
+
+	for (i = 0; i < TEST_FIBERS - 1; i++) {
+		f = uk_fiber_create(&x, waiter_func, &args);
+		UK_TEST_ASSERT(f != NULL);
+	}
+	f = uk_fiber_create(&x, notifier_func, &args);
+	UK_TEST_ASSERT(f != NULL);
+
+	uk_fiber_exec_run(&x);
+
+	UK_TEST_EXPECT_SNUM_EQ(args.woken, TEST_FIBERS - 1);
+	UK_TEST_EXPECT(uk_waitq_empty(&args.wq));
+	uk_fiber_exec_fini(&x);
+}
+
+static __noreturn void notifier_thread(void *arg)
+{
+	struct wait_args *args = (struct wait_args *) arg;
+
+	uk_sched_thread_sleep(ukarch_time_msec_to_nsec(5));
+	notifier_func(args);
+	__atomic_store_n(&args->done, 1, __ATOMIC_RELEASE);
+	uk_sched_thread_exit();
+}
+
+/* The executor thread blocks while all its fibers wait and is woken up by
+ * a wake-up from another thread.
+ */
+UK_TESTCASE(ukfiber, test_fiber_waitq_thread)
+{
+	struct wait_args args = { .value = 0, .woken = 0 };
+	struct uk_fiber_exec x;
+	struct uk_thread *t;
+	int rc;
+
+	uk_waitq_init(&args.wq);
+	rc = uk_fiber_exec_init(&x, uk_alloc_get_default(), 1, 0);
+	UK_TEST_ASSERT(rc == 0);
+	UK_TEST_ASSERT(uk_fiber_create(&x, waiter_func, &args) != NULL);
+
+	t = uk_sched_thread_create(uk_sched_current(), notifier_thread, &args,
+				   "fiber-notifier");
+	UK_TEST_ASSERT(t != NULL);
+
+	uk_fiber_exec_run(&x);
+
+	UK_TEST_EXPECT_SNUM_EQ(args.woken, 1);
+
+	/* The exited thread may already be released, do not access it */
+	while (!__atomic_load_n(&args.done, __ATOMIC_ACQUIRE))
+		uk_sched_yield();
+	uk_fiber_exec_fini(&x);
+}
+
+uk_testsuite_register(ukfiber, NULL);
@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#include <uk/fiber.h>
+#include <uk/isr/thread.h>
+
+void uk_fiber_wake(struct uk_fiber *f)
+{
+	struct uk_fiber_exec *x = f->exec;
+	struct uk_thread *idle_thread = NULL;
+	unsigned long flags;
+
+	ukplat_spin_lock_irqsave(&x->lock, flags);
+	if (f->state == UK_FIBER_WAITING) {
+		f->state = UK_FIBER_RUNNABLE;
+		UK_TAILQ_INSERT_TAIL(&x->ready, f, ready_list);
+
+		/* Only wake up the executor if it ran out of fibers */
+		if (x->idle) {
+			x->idle = false;
+			idle_thread = x->thread;
+		}
+	}
+	ukplat_spin_unlock_irqrestore(&x->lock, flags);
+
+	/* The ISR variant is safe in any context */
+	if (idle_thread)
+		uk_thread_wake_isr(idle_thread);
+}
@@ -0,0 +1,117 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#include <stddef.h>
+#include <uk/arch/lcpu.h>
+#include <uk/arch/x86_64/qspinlock.h>
+#include <uk/assert.h>
+#include <uk/plat/lcpu.h>
+
+#ifdef CONFIG_HAVE_SMP
+/* An LCPU queues for at most one lock per context: thread, interrupt and
+ * nested exceptions.
+ */
+#define QSPIN_NODES		4
+#define QSPIN_NODE_BITS		2
+
+struct qspin_node {
+	struct qspin_node *next;	/**< Successor in the queue */
+	int head;			/**< Set when we became queue head */
+} __align(CACHE_LINE_SIZE);
+
+struct qspin_lcpu {
+	struct qspin_node node[QSPIN_NODES];
+	unsigned int count;		/**< Nodes in use */
+};
+
+static UKPLAT_PER_LCPU_DEFINE(struct qspin_lcpu, qspin_lcpu);
+
+UK_CTASSERT(CONFIG_UKPLAT_LCPU_MAXCOUNT <
+	    (1 << (16 - QSPIN_NODE_BITS)));
+
+static inline __u32 qspin_encode_tail(unsigned int lcpu_idx, unsigned int idx)
+{
+	return (((lcpu_idx + 1) << QSPIN_NODE_BITS) | idx)
+		<< UKARCH_QSPIN_TAIL_SHIFT;
+}
+
+static inline struct qspin_node *qspin_decode_tail(__u32 val)
+{
+	__u32 tail = (val & UKARCH_QSPIN_TAIL_MASK) >> UKARCH_QSPIN_TAIL_SHIFT;
+	unsigned int lcpu_idx = (tail >> QSPIN_NODE_BITS) - 1;
+	unsigned int idx = tail & (QSPIN_NODES - 1);
+
+	return &ukplat_per_lcpu(qspin_lcpu, lcpu_idx).node[idx];
+}
+
+void _ukarch_qspin_lock_slowpath(struct __qspinlock *lock)
+{
+	struct qspin_lcpu *l = &ukplat_per_lcpu_current(qspin_lcpu);
+	struct qspin_node *node, *next;
+	__u32 tail, val;
+	unsigned int idx;
+
+	/* Interrupts that queue up in between use the next node and release
+	 * it before they return.
+	 */
+	idx = l->count++;
+	UK_ASSERT(idx < QSPIN_NODES);
+
+	node = &l->node[idx];
+	node->next = NULL;
+	node->head = 0;
+	tail = qspin_encode_tail(ukplat_lcpu_idx(), idx);
+
+	/* Replace the queue tail, unless the lock became free in between */
+	val = UK_READ_ONCE(lock->val);
+	for (;;) {
+		if (!val) {
+			if (uk_compare_exchange_n(&lock->val, &val, 1U))
+				goto out;
+			continue;
+		}
+		if (uk_compare_exchange_n(&lock->val, &val,
+					  (val & UKARCH_QSPIN_LOCKED) | tail))
+			break;
+	}
+
+	/* Wait until our predecessor hands the queue head over to us */
+	if (val & UKARCH_QSPIN_TAIL_MASK) {
+		UK_WRITE_ONCE(qspin_decode_tail(val)->next, node);
+		while (!UK_READ_ONCE(node->head))
+			ukarch_spinwait();
+	}
+
+	/* As queue head, we are the only one that waits for the lock word.
+	 * Newcomers see a non-zero lock word and queue up behind us.
+	 */
+	for (;;) {
+		val = UK_READ_ONCE(lock->val);
+		if (val & UKARCH_QSPIN_LOCKED) {
+			ukarch_spinwait();
+			continue;
+		}
+
+		/* Last in the queue: take the lock and clear the tail */
+		if ((val & UKARCH_QSPIN_TAIL_MASK) == tail) {
+			if (uk_compare_exchange_n(&lock->val, &val, 1U))
+				goto out;
+			continue;
+		}
+
+		/* There are successors, leave the tail untouched */
+		uk_or(&lock->val, 1U);
+		break;
+	}
+
+	/* Our successor may still be linking itself in */
+	while (!(next = UK_READ_ONCE(node->next)))
+		ukarch_spinwait();
+	UK_WRITE_ONCE(next->head, 1);
+
+out:
+	l->count--;
+}
+#endif /* CONFIG_HAVE_SMP */
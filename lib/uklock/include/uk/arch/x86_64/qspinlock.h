@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UKARCH_QSPINLOCK_H__
+#define __UKARCH_QSPINLOCK_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <uk/arch/lcpu.h>
+#include <uk/essentials.h>
+
+#ifdef CONFIG_HAVE_SMP
+#include <uk/atomic.h>
+
+/*
+ * Queued spinlock: An uncontended lock operation is a single
+ * compare-exchange, unlocking is a byte store. Contending LCPUs line up in
+ * an MCS queue and spin on their own per-LCPU queue node instead of the
+ * shared lock word. The lock is thus handed over in FIFO order and a release
+ * only touches the cache line of the next waiter.
+ *
+ * Since the queue nodes belong to the LCPU, a waiter must neither be
+ * preempted nor migrated: With a preemptive scheduler, take the lock with
+ * interrupts disabled (e.g., `uk_spin_lock_irqsave()`).
+ *
+ * Lock word:
+ *   bits  0- 7: locked byte
+ *   bits 16-31: queue tail, ((LCPU index + 1) << 2) | node index
+ *               (0 if no LCPU is queued)
+ */
+
+/* Unless you know what you are doing, use struct uk_spinlock instead. */
+typedef struct __qspinlock __qspinlock;
+
+struct __qspinlock {
+	union {
+		__u32 val;
+		struct {
+			__u8 locked;
+			__u8 __pad;
+			__u16 tail;
+		};
+	};
+};
+
+#define UKARCH_QSPIN_LOCKED		0x000000ffU
+#define UKARCH_QSPIN_TAIL_MASK		0xffff0000U
+#define UKARCH_QSPIN_TAIL_SHIFT		16
+
+/* Initialize a queued spinlock to unlocked state */
+#define UKARCH_QSPINLOCK_INITIALIZER()	{ { 0 } }
+
+/* Queues up the calling LCPU, see qspinlock.c */
+void _ukarch_qspin_lock_slowpath(struct __qspinlock *lock);
+
+static inline void ukarch_qspin_init(struct __qspinlock *lock)
+{
+	lock->val = 0;
+}
+
+static inline int ukarch_qspin_trylock(struct __qspinlock *lock)
+{
+	__u32 val = UK_READ_ONCE(lock->val);
+
+	return !val && uk_compare_exchange_n(&lock->val, &val, 1U);
+}
+
+static inline void ukarch_qspin_lock(struct __qspinlock *lock)
+{
+	__u32 val = 0;
+
+	if (likely(uk_compare_exchange_n(&lock->val, &val, 1U)))
+		return;
+	_ukarch_qspin_lock_slowpath(lock);
+}
+
+static inline void ukarch_qspin_unlock(struct __qspinlock *lock)
+{
+	__atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+}
+
+static inline int ukarch_qspin_is_locked(struct __qspinlock *lock)
+{
+	return UK_READ_ONCE(lock->val) != 0;
+}
+
+#else /* CONFIG_HAVE_SMP */
+
+typedef struct __qspinlock {
+	/* empty */
+} __qspinlock;
+
+#define UKARCH_QSPINLOCK_INITIALIZER()	{}
+#define ukarch_qspin_init(lock)		(void)(lock)
+#define ukarch_qspin_lock(lock)		\
+	do { barrier(); (void)(lock); } while (0)
+#define ukarch_qspin_unlock(lock)	\
+	do { barrier(); (void)(lock); } while (0)
+#define ukarch_qspin_trylock(lock)	({ barrier(); (void)(lock); 1; })
+#define ukarch_qspin_is_locked(lock)	({ barrier(); (void)(lock); 0; })
+
+#endif /* CONFIG_HAVE_SMP */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UKARCH_QSPINLOCK_H__ */
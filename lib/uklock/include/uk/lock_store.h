@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#ifndef __UK_LOCK_STORE_H__
+#define __UK_LOCK_STORE_H__
+
+/* mutex metrics entry IDs (`CONFIG_LIBUKLOCK_MUTEX_METRICS`) */
+#define UK_LOCK_STATS_MUTEX_ACTIVE_LOCKED		0x01
+#define UK_LOCK_STATS_MUTEX_ACTIVE_UNLOCKED		0x02
+#define UK_LOCK_STATS_MUTEX_TOTAL_LOCKS			0x03
+#define UK_LOCK_STATS_MUTEX_TOTAL_OK_TRYLOCKS		0x04
+#define UK_LOCK_STATS_MUTEX_TOTAL_FAILED_TRYLOCKS	0x05
+#define UK_LOCK_STATS_MUTEX_TOTAL_UNLOCKS		0x06
+
+/* lockstat entry IDs (`CONFIG_LIBUKLOCK_LOCKSTAT`) */
+#define UK_LOCK_STATS_LOCKSTAT_CLASSES			0x07
+#define UK_LOCK_STATS_LOCKSTAT_ACQUIRED			0x08
+#define UK_LOCK_STATS_LOCKSTAT_CONTENDED		0x09
+#define UK_LOCK_STATS_LOCKSTAT_WAIT_NS			0x0a
+#define UK_LOCK_STATS_LOCKSTAT_HOLD_NS			0x0b
+#define UK_LOCK_STATS_LOCKSTAT_RESET			0x0c
+
+/* lockstat class object entry IDs, one object per class */
+#define UK_LOCK_STATS_LOCKSTAT_CLASS_ACQUIRED		0x01
+#define UK_LOCK_STATS_LOCKSTAT_CLASS_CONTENDED		0x02
+#define UK_LOCK_STATS_LOCKSTAT_CLASS_WAIT_NS		0x03
+#define UK_LOCK_STATS_LOCKSTAT_CLASS_WAIT_MAX_NS	0x04
+#define UK_LOCK_STATS_LOCKSTAT_CLASS_HOLD_NS		0x05
+#define UK_LOCK_STATS_LOCKSTAT_CLASS_HOLD_MAX_NS	0x06
+
+#endif /* __UK_LOCK_STORE_H__ */
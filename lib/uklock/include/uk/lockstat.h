@@ -0,0 +1,181 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+/*
+ * Lock contention statistics (`CONFIG_LIBUKLOCK_LOCKSTAT`)
+ *
+ * Locks are grouped into classes by the site where they are initialized:
+ * the line of the `uk_*_init*()` call or of the static initializer. All
+ * locks of a class, e.g., the `v_lock` of every vnode, share one set of
+ * counters. A lock is assigned to its class on its first acquisition.
+ *
+ * An uncontended acquisition costs a clock read and an atomic increment,
+ * a release a clock read for the hold time. Wait times are only measured
+ * for acquisitions that found the lock taken.
+ */
+#ifndef __UK_LOCKSTAT_H__
+#define __UK_LOCKSTAT_H__
+
+#include <uk/config.h>
+
+#if CONFIG_LIBUKLOCK_LOCKSTAT
+#include <uk/arch/time.h>
+#include <uk/arch/types.h>
+#include <uk/atomic.h>
+#include <uk/essentials.h>
+#include <uk/plat/time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Counters of a lock class */
+struct uk_lockstat_class {
+	const char *site;	/**< Init site of the locks ("file:line") */
+	__u64 nr_acquired;	/**< Successful acquisitions */
+	__u64 nr_contended;	/**< Acquisitions that had to wait */
+	__nsec wait_total;	/**< Time spent waiting for the locks */
+	__nsec wait_max;
+	__nsec hold_total;	/**< Time the locks were held exclusively */
+	__nsec hold_max;
+};
+
+/* Per-lock state, embedded into the lock objects */
+struct uk_lockstat {
+	const char *site;
+	struct uk_lockstat_class *cls;
+	__nsec acquired;	/**< Last exclusive acquisition */
+};
+
+#ifdef __BASENAME__
+#define UK_LOCKSTAT_SITE						\
+	STRINGIFY(__BASENAME__) ":" STRINGIFY(__LINE__)
+#else /* !__BASENAME__ */
+#define UK_LOCKSTAT_SITE	__FILE__ ":" STRINGIFY(__LINE__)
+#endif /* !__BASENAME__ */
+
+#define UK_LOCKSTAT_INITIALIZER()					\
+	{ .site = UK_LOCKSTAT_SITE, .cls = __NULL, .acquired = 0 }
+
+/* Helpers for embedding the state into lock objects */
+#define UK_LOCKSTAT_MEMBER		struct uk_lockstat lockstat;
+#define UK_LOCKSTAT_MEMBER_INITIALIZER					\
+	.lockstat = UK_LOCKSTAT_INITIALIZER(),
+
+static inline void uk_lockstat_init(struct uk_lockstat *ls, const char *site)
+{
+	ls->site = site;
+	ls->cls = __NULL;
+	ls->acquired = 0;
+}
+
+/* Looks up or allocates the class of `ls`, see lockstat.c */
+struct uk_lockstat_class *_uk_lockstat_class_get(struct uk_lockstat *ls);
+
+static inline struct uk_lockstat_class *
+_uk_lockstat_class(struct uk_lockstat *ls)
+{
+	struct uk_lockstat_class *cls = UK_READ_ONCE(ls->cls);
+
+	if (unlikely(!cls))
+		cls = _uk_lockstat_class_get(ls);
+	return cls;
+}
+
+static inline void _uk_lockstat_max(__nsec *max, __nsec val)
+{
+	__nsec cur = UK_READ_ONCE(*max);
+
+	while (val > cur && !uk_compare_exchange_n(max, &cur, val))
+		;
+}
+
+/**
+ * Returns the start time of a wait for a lock that is taken
+ */
+static inline __nsec uk_lockstat_wait_start(void)
+{
+	return ukplat_monotonic_clock();
+}
+
+/**
+ * Records an acquisition
+ *
+ * @param ls
+ *   Lockstat state of the lock
+ * @param wait_start
+ *   Return value of `uk_lockstat_wait_start()` if the caller had to wait,
+ *   0 otherwise
+ * @param exclusive
+ *   The lock is held exclusively, its hold time is recorded on release
+ */
+static inline void uk_lockstat_acquired(struct uk_lockstat *ls,
+					__nsec wait_start, int exclusive)
+{
+	struct uk_lockstat_class *cls = _uk_lockstat_class(ls);
+	__nsec now = 0;
+
+	if (exclusive || wait_start)
+		now = ukplat_monotonic_clock();
+
+	uk_inc(&cls->nr_acquired);
+	if (unlikely(wait_start)) {
+		uk_inc(&cls->nr_contended);
+		uk_fetch_add(&cls->wait_total, now - wait_start);
+		_uk_lockstat_max(&cls->wait_max, now - wait_start);
+	}
+	if (exclusive)
+		ls->acquired = now;
+}
+
+/**
+ * Records the release of an exclusively held lock
+ */
+static inline void uk_lockstat_released(struct uk_lockstat *ls)
+{
+	struct uk_lockstat_class *cls = _uk_lockstat_class(ls);
+	__nsec held = ukplat_monotonic_clock() - ls->acquired;
+
+	uk_fetch_add(&cls->hold_total, held);
+	_uk_lockstat_max(&cls->hold_max, held);
+}
+
+/**
+ * Copies the counters of a class
+ *
+ * @param idx
+ *   Class index, starting from 0
+ * @param dst
+ *   Destination for the counters
+ * @return
+ *   - (0): Success
+ *   - (-ENOENT): There is no class with the index
+ */
+int uk_lockstat_class_read(unsigned int idx, struct uk_lockstat_class *dst);
+
+/**
+ * Resets the counters of all classes
+ */
+void uk_lockstat_reset(void);
+
+/**
+ * Prints the classes with at least one acquisition to the kernel console
+ *
+ * @param klvl
+ *   Kernel message level
+ */
+void uk_lockstat_dumpk(int klvl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#else /* !CONFIG_LIBUKLOCK_LOCKSTAT */
+
+#define UK_LOCKSTAT_MEMBER
+#define UK_LOCKSTAT_MEMBER_INITIALIZER
+
+#endif /* !CONFIG_LIBUKLOCK_LOCKSTAT */
+#endif /* __UK_LOCKSTAT_H__ */
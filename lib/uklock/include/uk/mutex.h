@@ -38,6 +38,7 @@
 
 #if CONFIG_LIBUKLOCK_MUTEX
 #include <uk/assert.h>
+#include <uk/lockstat.h>
 #include <uk/plat/lcpu.h>
 #include <uk/thread.h>
 #include <uk/wait.h>
@@ -45,10 +46,15 @@
 #include <uk/plat/time.h>
 
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
-#include <uk/plat/spinlock.h>
-#include <string.h>
+#include <uk/arch/lcpu.h>
+#include <uk/atomic.h>
 #endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
 
+#ifdef CONFIG_LIBUKLOCK_MUTEX_ADAPTIVE
+#include <uk/arch/lcpu.h>
+#include <uk/atomic.h>
+#endif /* CONFIG_LIBUKLOCK_MUTEX_ADAPTIVE */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -64,6 +70,7 @@ struct uk_mutex {
 	unsigned int flags;
 	struct uk_thread *owner;
 	struct uk_waitq wait;
+	UK_LOCKSTAT_MEMBER
 };
 
 static inline int uk_mutex_is_recursive(const struct uk_mutex *m)
@@ -92,27 +99,86 @@ struct uk_mutex_metrics {
 
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
 /*
- * Metric storage (see mutex.c).
+ * Metric storage (see mutex.c). Each LCPU counts in its own slot so that
+ * lock operations on different LCPUs do not contend on a shared cache line.
+ * The slots are summed up by `uk_mutex_get_metrics()` only. Since a thread
+ * can migrate between reading its LCPU index and updating the counter, the
+ * updates are still atomic. The `active_*` fields are deltas: a mutex can
+ * be locked on one LCPU and unlocked on another one.
  */
-extern struct uk_mutex_metrics _uk_mutex_metrics;
-extern __spinlock              _uk_mutex_metrics_lock;
+struct uk_mutex_metrics_lcpu {
+	long active_locked;
+	long active_unlocked;
+	size_t total_locks;
+	size_t total_ok_trylocks;
+	size_t total_failed_trylocks;
+	size_t total_unlocks;
+} __align(CACHE_LINE_SIZE);
+
+extern UKPLAT_PER_LCPU_DEFINE(struct uk_mutex_metrics_lcpu,
+			      _uk_mutex_metrics);
+
+#define _uk_mutex_metrics_add(field, val)				\
+	((void)uk_fetch_add(						\
+		&ukplat_per_lcpu_current(_uk_mutex_metrics).field, (val)))
 #endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
 
 #define	UK_MUTEX_INITIALIZER(name)				\
-	{ 0, 0, NULL, __WAIT_QUEUE_INITIALIZER((name).wait) }
+	{ .lock_count = 0, .flags = 0, .owner = NULL,		\
+	  .wait = __WAIT_QUEUE_INITIALIZER((name).wait),	\
+	  UK_LOCKSTAT_MEMBER_INITIALIZER }
 
 #define	UK_MUTEX_INITIALIZER_RECURSIVE(name)			\
-	{ 0, UK_MUTEX_CONFIG_RECURSE, 0,			\
-	__WAIT_QUEUE_INITIALIZER((name).wait) }
+	{ .lock_count = 0, .flags = UK_MUTEX_CONFIG_RECURSE,	\
+	  .owner = NULL,					\
+	  .wait = __WAIT_QUEUE_INITIALIZER((name).wait),	\
+	  UK_LOCKSTAT_MEMBER_INITIALIZER }
+
+#ifdef CONFIG_LIBUKLOCK_MUTEX_ADAPTIVE
+/*
+ * Spins as long as the owner of the mutex is executing on another LCPU,
+ * expecting that it releases the mutex soon. Blocking on the wait queue only
+ * pays off if the owner is descheduled or holds the mutex for long, so the
+ * spinning is bounded by `CONFIG_LIBUKLOCK_MUTEX_ADAPTIVE_SPINS`.
+ */
+static inline void _uk_mutex_spin_on_owner(struct uk_mutex *m)
+{
+	unsigned int spins = CONFIG_LIBUKLOCK_MUTEX_ADAPTIVE_SPINS;
+	struct uk_thread *owner;
+
+	while ((owner = UK_READ_ONCE(m->owner)) && spins--) {
+		if (!UK_READ_ONCE(owner->on_lcpu))
+			break;
+		ukarch_spinwait();
+	}
+}
+#endif /* CONFIG_LIBUKLOCK_MUTEX_ADAPTIVE */
 
 void uk_mutex_init_config(struct uk_mutex *m, unsigned int flags);
 void uk_mutex_get_metrics(struct uk_mutex_metrics *dst);
 
+#if CONFIG_LIBUKLOCK_LOCKSTAT
+/* Records the caller as init site, i.e., as lock class */
+static inline void _uk_mutex_init_config_site(struct uk_mutex *m,
+					      unsigned int flags,
+					      const char *site)
+{
+	(uk_mutex_init_config)(m, flags);
+	uk_lockstat_init(&m->lockstat, site);
+}
+
+#define uk_mutex_init_config(m, flags)					\
+	_uk_mutex_init_config_site(m, flags, UK_LOCKSTAT_SITE)
+#endif /* CONFIG_LIBUKLOCK_LOCKSTAT */
+
 #define uk_mutex_init(m) uk_mutex_init_config(m, 0)
 
 static inline void uk_mutex_lock(struct uk_mutex *m)
 {
 	struct uk_thread *cur;
+#if CONFIG_LIBUKLOCK_LOCKSTAT
+	__nsec wait_start = 0;
+#endif /* CONFIG_LIBUKLOCK_LOCKSTAT */
 
 	UK_ASSERT(m);
 
@@ -127,7 +193,15 @@ static inline void uk_mutex_lock(struct uk_mutex *m)
 
 	UK_ASSERT(m->owner != cur);
 
+#if CONFIG_LIBUKLOCK_LOCKSTAT
+	if (m->owner)
+		wait_start = uk_lockstat_wait_start();
+#endif /* CONFIG_LIBUKLOCK_LOCKSTAT */
+
 	for (;;) {
+#ifdef CONFIG_LIBUKLOCK_MUTEX_ADAPTIVE
+		_uk_mutex_spin_on_owner(m);
+#endif /* CONFIG_LIBUKLOCK_MUTEX_ADAPTIVE */
 		uk_waitq_wait_event(&m->wait, m->owner == NULL);
 
 		/* If there is no owner, we can acquire the lock */
@@ -138,12 +212,16 @@ static inline void uk_mutex_lock(struct uk_mutex *m)
 		}
 	}
 
+#if CONFIG_LIBUKLOCK_LOCKSTAT
+	uk_lockstat_acquired(&m->lockstat, wait_start, 1);
+#endif /* CONFIG_LIBUKLOCK_LOCKSTAT */
+
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
-	ukarch_spin_lock(&_uk_mutex_metrics_lock);
-	_uk_mutex_metrics.active_locked   += (m->lock_count == 1);
-	_uk_mutex_metrics.active_unlocked -= (m->lock_count == 1);
-	_uk_mutex_metrics.total_locks++;
-	ukarch_spin_unlock(&_uk_mutex_metrics_lock);
+	if (m->lock_count == 1) {
+		_uk_mutex_metrics_add(active_locked, 1);
+		_uk_mutex_metrics_add(active_unlocked, -1);
+	}
+	_uk_mutex_metrics_add(total_locks, 1);
 #endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
 }
 
@@ -161,9 +239,7 @@ static inline int uk_mutex_trylock(struct uk_mutex *m)
 		m->lock_count++;
 
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
-		ukarch_spin_lock(&_uk_mutex_metrics_lock);
-		_uk_mutex_metrics.total_ok_trylocks++;
-		ukarch_spin_unlock(&_uk_mutex_metrics_lock);
+		_uk_mutex_metrics_add(total_ok_trylocks, 1);
 #endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
 
 		return 1;
@@ -176,12 +252,14 @@ static inline int uk_mutex_trylock(struct uk_mutex *m)
 			UK_ASSERT(m->lock_count == 0);
 			m->lock_count = 1;
 
+#if CONFIG_LIBUKLOCK_LOCKSTAT
+			uk_lockstat_acquired(&m->lockstat, 0, 1);
+#endif /* CONFIG_LIBUKLOCK_LOCKSTAT */
+
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
-			ukarch_spin_lock(&_uk_mutex_metrics_lock);
-			_uk_mutex_metrics.active_locked++;
-			_uk_mutex_metrics.active_unlocked--;
-			_uk_mutex_metrics.total_ok_trylocks++;
-			ukarch_spin_unlock(&_uk_mutex_metrics_lock);
+			_uk_mutex_metrics_add(active_locked, 1);
+			_uk_mutex_metrics_add(active_unlocked, -1);
+			_uk_mutex_metrics_add(total_ok_trylocks, 1);
 #endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
 
 			return 1;
@@ -189,9 +267,7 @@ static inline int uk_mutex_trylock(struct uk_mutex *m)
 	}
 
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
-	ukarch_spin_lock(&_uk_mutex_metrics_lock);
-	_uk_mutex_metrics.total_failed_trylocks++;
-	ukarch_spin_unlock(&_uk_mutex_metrics_lock);
+	_uk_mutex_metrics_add(total_failed_trylocks, 1);
 #endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
 
 	return 0;
@@ -210,6 +286,10 @@ static inline void uk_mutex_unlock(struct uk_mutex *m)
 	UK_ASSERT(m->owner == uk_thread_current());
 
 	if (--m->lock_count == 0) {
+#if CONFIG_LIBUKLOCK_LOCKSTAT
+		uk_lockstat_released(&m->lockstat);
+#endif /* CONFIG_LIBUKLOCK_LOCKSTAT */
+
 		/* Make sure lock_count is visible before resetting the
 		 * owner. The lock can be acquired afterwards.
 		 */
@@ -219,11 +299,11 @@ static inline void uk_mutex_unlock(struct uk_mutex *m)
 	}
 
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
-	ukarch_spin_lock(&_uk_mutex_metrics_lock);
-	_uk_mutex_metrics.active_locked   -= (m->lock_count == 0);
-	_uk_mutex_metrics.active_unlocked += (m->lock_count == 0);
-	_uk_mutex_metrics.total_unlocks++;
-	ukarch_spin_unlock(&_uk_mutex_metrics_lock);
+	if (m->lock_count == 0) {
+		_uk_mutex_metrics_add(active_locked, -1);
+		_uk_mutex_metrics_add(active_unlocked, 1);
+	}
+	_uk_mutex_metrics_add(total_unlocks, 1);
 #endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
 }
 
@@ -11,6 +11,7 @@
 
 #if CONFIG_LIBUKLOCK_RWLOCK
 #include <uk/essentials.h>
+#include <uk/lockstat.h>
 #include <uk/spinlock.h>
 #include <uk/wait.h>
 
@@ -35,6 +36,7 @@ struct __align(8) uk_rwlock {
 	struct uk_waitq shared;
 	/** Wait queue for writers */
 	struct uk_waitq exclusive;
+	UK_LOCKSTAT_MEMBER
 };
 
 static inline int uk_rwlock_is_write_recursive(const struct uk_rwlock *rwl)
@@ -52,6 +54,20 @@ static inline int uk_rwlock_is_write_recursive(const struct uk_rwlock *rwl)
  */
 void uk_rwlock_init_config(struct uk_rwlock *rwl, unsigned int config_flags);
 
+#if CONFIG_LIBUKLOCK_LOCKSTAT
+/* Records the caller as init site, i.e., as lock class */
+static inline void _uk_rwlock_init_config_site(struct uk_rwlock *rwl,
+					       unsigned int config_flags,
+					       const char *site)
+{
+	(uk_rwlock_init_config)(rwl, config_flags);
+	uk_lockstat_init(&rwl->lockstat, site);
+}
+
+#define uk_rwlock_init_config(rwl, config_flags)			\
+	_uk_rwlock_init_config_site(rwl, config_flags, UK_LOCKSTAT_SITE)
+#endif /* CONFIG_LIBUKLOCK_LOCKSTAT */
+
 #define uk_rwlock_init(rwl) uk_rwlock_init_config(rwl, 0)
 
 #define UK_RWLOCK_INITIALIZER(name, flags) \
@@ -63,6 +79,7 @@ void uk_rwlock_init_config(struct uk_rwlock *rwl, unsigned int config_flags);
 		.sl = UK_SPINLOCK_INITIALIZER(), \
 		.shared = UK_WAIT_QUEUE_INITIALIZER((name).shared), \
 		.exclusive = UK_WAIT_QUEUE_INITIALIZER((name).exclusive), \
+		UK_LOCKSTAT_MEMBER_INITIALIZER \
 	})
 
 /**
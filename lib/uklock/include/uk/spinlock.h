@@ -33,8 +33,10 @@
 #ifndef __UK_SPINLOCK_H__
 #define __UK_SPINLOCK_H__
 
+#include <uk/config.h>
 #include <uk/plat/lcpu.h>
 #include <uk/essentials.h>
+#include <uk/lockstat.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -42,40 +44,116 @@ extern "C" {
 
 /* See uk/arch/spinlock.h for the interface documentation */
 
-#ifndef CONFIG_LIBUKLOCK_TICKETLOCK
-
 #ifndef uk_spinlock
-#include <uk/arch/spinlock.h>
 
-#define uk_spinlock __spinlock
+#if defined(CONFIG_LIBUKLOCK_TICKETLOCK)
 
-#define UK_SPINLOCK_INITIALIZER()  UKARCH_SPINLOCK_INITIALIZER()
-#define uk_spin_init(lock)         ukarch_spin_init(lock)
-#define uk_spin_lock(lock)         ukarch_spin_lock(lock)
-#define uk_spin_unlock(lock)       ukarch_spin_unlock(lock)
-#define uk_spin_trylock(lock)      ukarch_spin_trylock(lock)
-#define uk_spin_is_locked(lock)    ukarch_spin_is_locked(lock)
-#endif /* uk_spinlock */
+#ifdef CONFIG_ARCH_ARM_64
+#include <uk/arch/arm64/ticketlock.h>
+#endif
 
-#else	/* CONFIG_LIBUKLOCK_TICKETLOCK */
+#define __uk_spinlock_raw                 __ticketlock
+#define __UK_SPINLOCK_RAW_INITIALIZER()   UKARCH_TICKETLOCK_INITIALIZER()
+#define __uk_spin_raw_init(lock)          ukarch_ticket_init(lock)
+#define __uk_spin_raw_lock(lock)          ukarch_ticket_lock(lock)
+#define __uk_spin_raw_unlock(lock)        ukarch_ticket_unlock(lock)
+#define __uk_spin_raw_trylock(lock)       ukarch_ticket_trylock(lock)
+#define __uk_spin_raw_is_locked(lock)     ukarch_ticket_is_locked(lock)
 
-#ifndef uk_spinlock
+#elif defined(CONFIG_LIBUKLOCK_QSPINLOCK)
 
-#ifdef CONFIG_ARCH_ARM_64
-#include <uk/arch/arm64/ticketlock.h>
+#ifdef CONFIG_ARCH_X86_64
+#include <uk/arch/x86_64/qspinlock.h>
 #endif
 
-#define uk_spinlock __ticketlock
+#define __uk_spinlock_raw                 __qspinlock
+#define __UK_SPINLOCK_RAW_INITIALIZER()   UKARCH_QSPINLOCK_INITIALIZER()
+#define __uk_spin_raw_init(lock)          ukarch_qspin_init(lock)
+#define __uk_spin_raw_lock(lock)          ukarch_qspin_lock(lock)
+#define __uk_spin_raw_unlock(lock)        ukarch_qspin_unlock(lock)
+#define __uk_spin_raw_trylock(lock)       ukarch_qspin_trylock(lock)
+#define __uk_spin_raw_is_locked(lock)     ukarch_qspin_is_locked(lock)
 
-#define UK_SPINLOCK_INITIALIZER()  UKARCH_TICKETLOCK_INITIALIZER()
-#define uk_spin_init(lock)         ukarch_ticket_init(lock)
-#define uk_spin_lock(lock)         ukarch_ticket_lock(lock)
-#define uk_spin_unlock(lock)       ukarch_ticket_unlock(lock)
-#define uk_spin_trylock(lock)      ukarch_ticket_trylock(lock)
-#define uk_spin_is_locked(lock)    ukarch_ticket_is_locked(lock)
-#endif /* uk_spinlock */
+#else	/* !CONFIG_LIBUKLOCK_TICKETLOCK && !CONFIG_LIBUKLOCK_QSPINLOCK */
+
+#include <uk/arch/spinlock.h>
 
-#endif	/* CONFIG_LIBUKLOCK_TICKETLOCK */
+#define __uk_spinlock_raw                 __spinlock
+#define __UK_SPINLOCK_RAW_INITIALIZER()   UKARCH_SPINLOCK_INITIALIZER()
+#define __uk_spin_raw_init(lock)          ukarch_spin_init(lock)
+#define __uk_spin_raw_lock(lock)          ukarch_spin_lock(lock)
+#define __uk_spin_raw_unlock(lock)        ukarch_spin_unlock(lock)
+#define __uk_spin_raw_trylock(lock)       ukarch_spin_trylock(lock)
+#define __uk_spin_raw_is_locked(lock)     ukarch_spin_is_locked(lock)
+
+#endif	/* !CONFIG_LIBUKLOCK_TICKETLOCK && !CONFIG_LIBUKLOCK_QSPINLOCK */
+
+#if CONFIG_LIBUKLOCK_LOCKSTAT
+/* Spinlock with contention statistics, see uk/lockstat.h */
+typedef struct __uk_lockstat_spinlock __uk_lockstat_spinlock;
+
+struct __uk_lockstat_spinlock {
+	__uk_spinlock_raw raw;
+	struct uk_lockstat lockstat;
+};
+
+static inline void __uk_lockstat_spin_init(struct __uk_lockstat_spinlock *lock,
+					   const char *site)
+{
+	__uk_spin_raw_init(&lock->raw);
+	uk_lockstat_init(&lock->lockstat, site);
+}
+
+static inline void __uk_lockstat_spin_lock(struct __uk_lockstat_spinlock *lock)
+{
+	__nsec wait_start = 0;
+
+	if (unlikely(!__uk_spin_raw_trylock(&lock->raw))) {
+		wait_start = uk_lockstat_wait_start();
+		__uk_spin_raw_lock(&lock->raw);
+	}
+	uk_lockstat_acquired(&lock->lockstat, wait_start, 1);
+}
+
+static inline void
+__uk_lockstat_spin_unlock(struct __uk_lockstat_spinlock *lock)
+{
+	uk_lockstat_released(&lock->lockstat);
+	__uk_spin_raw_unlock(&lock->raw);
+}
+
+static inline int
+__uk_lockstat_spin_trylock(struct __uk_lockstat_spinlock *lock)
+{
+	if (!__uk_spin_raw_trylock(&lock->raw))
+		return 0;
+	uk_lockstat_acquired(&lock->lockstat, 0, 1);
+	return 1;
+}
+
+#define uk_spinlock __uk_lockstat_spinlock
+
+#define UK_SPINLOCK_INITIALIZER()					\
+	{ .raw = __UK_SPINLOCK_RAW_INITIALIZER(),			\
+	  .lockstat = UK_LOCKSTAT_INITIALIZER() }
+#define uk_spin_init(lock)						\
+	__uk_lockstat_spin_init(lock, UK_LOCKSTAT_SITE)
+#define uk_spin_lock(lock)         __uk_lockstat_spin_lock(lock)
+#define uk_spin_unlock(lock)       __uk_lockstat_spin_unlock(lock)
+#define uk_spin_trylock(lock)      __uk_lockstat_spin_trylock(lock)
+#define uk_spin_is_locked(lock)    __uk_spin_raw_is_locked(&(lock)->raw)
+#else /* !CONFIG_LIBUKLOCK_LOCKSTAT */
+#define uk_spinlock __uk_spinlock_raw
+
+#define UK_SPINLOCK_INITIALIZER()  __UK_SPINLOCK_RAW_INITIALIZER()
+#define uk_spin_init(lock)         __uk_spin_raw_init(lock)
+#define uk_spin_lock(lock)         __uk_spin_raw_lock(lock)
+#define uk_spin_unlock(lock)       __uk_spin_raw_unlock(lock)
+#define uk_spin_trylock(lock)      __uk_spin_raw_trylock(lock)
+#define uk_spin_is_locked(lock)    __uk_spin_raw_is_locked(lock)
+#endif /* !CONFIG_LIBUKLOCK_LOCKSTAT */
+
+#endif /* uk_spinlock */
 
 #define uk_spin_lock_irq(lock)						\
 	do {								\
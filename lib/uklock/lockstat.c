@@ -0,0 +1,265 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#include <errno.h>
+#include <string.h>
+#include <uk/arch/spinlock.h>
+#include <uk/assert.h>
+#include <uk/lockstat.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/spinlock.h>
+#include <uk/print.h>
+#if CONFIG_LIBUKSTORE
+#include <uk/alloc.h>
+#include <uk/errptr.h>
+#include <uk/lock_store.h>
+#include <uk/mutex.h>
+#include <uk/store.h>
+#endif /* CONFIG_LIBUKSTORE */
+
+#define LOCKSTAT_CLASSES	CONFIG_LIBUKLOCK_LOCKSTAT_CLASSES
+#define LOCKSTAT_HASH_SIZE	(2 * LOCKSTAT_CLASSES)
+
+/* Classes are allocated in order from a static table, so that locks can be
+ * assigned to their class in any context, including interrupt handlers.
+ * The last entry collects the locks of all classes that do not fit into
+ * the table.
+ */
+static struct uk_lockstat_class lockstat_classes[LOCKSTAT_CLASSES];
+static unsigned int lockstat_nr_classes;
+
+/* Open addressing hash table over the class sites */
+static struct uk_lockstat_class *lockstat_hash[LOCKSTAT_HASH_SIZE];
+
+/* Protects class allocation. This is an architecture spinlock that is not
+ * instrumented itself.
+ */
+static __spinlock lockstat_lock = UKARCH_SPINLOCK_INITIALIZER();
+
+static unsigned int lockstat_site_hash(const char *site)
+{
+	unsigned int h = 5381;
+
+	while (*site)
+		h = h * 33 + (unsigned char) *site++;
+	return h % LOCKSTAT_HASH_SIZE;
+}
+
+static struct uk_lockstat_class *lockstat_class_lookup(const char *site)
+{
+	struct uk_lockstat_class *cls;
+	unsigned int h = lockstat_site_hash(site);
+
+	/* The table never fills up: it has twice as many slots as classes */
+	while ((cls = lockstat_hash[h])) {
+		if (!strcmp(cls->site, site))
+			return cls;
+		h = (h + 1) % LOCKSTAT_HASH_SIZE;
+	}
+
+	if (lockstat_nr_classes >= LOCKSTAT_CLASSES - 1) {
+		cls = &lockstat_classes[LOCKSTAT_CLASSES - 1];
+		if (!cls->site) {
+			cls->site = "<other>";
+			lockstat_nr_classes = LOCKSTAT_CLASSES;
+		}
+		return cls;
+	}
+
+	cls = &lockstat_classes[lockstat_nr_classes];
+	cls->site = site;
+	lockstat_hash[h] = cls;
+
+	/* Publish the class to readers of the table after it is set up */
+	UK_WRITE_ONCE(lockstat_nr_classes, lockstat_nr_classes + 1);
+	return cls;
+}
+
+struct uk_lockstat_class *_uk_lockstat_class_get(struct uk_lockstat *ls)
+{
+	struct uk_lockstat_class *cls;
+	unsigned long flags;
+
+	UK_ASSERT(ls);
+
+	/* Locks that are zeroed instead of initialized have no site */
+	if (unlikely(!ls->site))
+		ls->site = "<unknown>";
+
+	flags = ukplat_lcpu_save_irqf();
+	ukarch_spin_lock(&lockstat_lock);
+	cls = lockstat_class_lookup(ls->site);
+	ukarch_spin_unlock(&lockstat_lock);
+	ukplat_lcpu_restore_irqf(flags);
+
+	UK_WRITE_ONCE(ls->cls, cls);
+	return cls;
+}
+
+int uk_lockstat_class_read(unsigned int idx, struct uk_lockstat_class *dst)
+{
+	struct uk_lockstat_class *cls;
+
+	UK_ASSERT(dst);
+
+	if (idx >= UK_READ_ONCE(lockstat_nr_classes))
+		return -ENOENT;
+
+	cls = &lockstat_classes[idx];
+	dst->site = cls->site;
+	dst->nr_acquired = UK_READ_ONCE(cls->nr_acquired);
+	dst->nr_contended = UK_READ_ONCE(cls->nr_contended);
+	dst->wait_total = UK_READ_ONCE(cls->wait_total);
+	dst->wait_max = UK_READ_ONCE(cls->wait_max);
+	dst->hold_total = UK_READ_ONCE(cls->hold_total);
+	dst->hold_max = UK_READ_ONCE(cls->hold_max);
+	return 0;
+}
+
+void uk_lockstat_reset(void)
+{
+	struct uk_lockstat_class *cls;
+	unsigned int i;
+
+	for (i = 0; i < UK_READ_ONCE(lockstat_nr_classes); i++) {
+		cls = &lockstat_classes[i];
+		UK_WRITE_ONCE(cls->nr_acquired, 0);
+		UK_WRITE_ONCE(cls->nr_contended, 0);
+		UK_WRITE_ONCE(cls->wait_total, 0);
+		UK_WRITE_ONCE(cls->wait_max, 0);
+		UK_WRITE_ONCE(cls->hold_total, 0);
+		UK_WRITE_ONCE(cls->hold_max, 0);
+	}
+}
+
+void uk_lockstat_dumpk(int klvl)
+{
+	struct uk_lockstat_class c;
+	unsigned int i;
+
+	uk_printk(klvl, "lockstat: %u classes\n",
+		  UK_READ_ONCE(lockstat_nr_classes));
+	for (i = 0; uk_lockstat_class_read(i, &c) == 0; i++) {
+		if (!c.nr_acquired)
+			continue;
+
+		uk_printk(klvl,
+			  " + %s: acquired: %"__PRIu64", contended: %"__PRIu64
+			  ", wait: %"__PRInsec" ns (max %"__PRInsec" ns)"
+			  ", hold: %"__PRInsec" ns (max %"__PRInsec" ns)\n",
+			  c.site, c.nr_acquired, c.nr_contended,
+			  c.wait_total, c.wait_max, c.hold_total, c.hold_max);
+	}
+}
+
+#if CONFIG_LIBUKSTORE
+/* Totals over all classes */
+#define LOCKSTAT_TOTAL_GETTER(field)					\
+	static int get_lockstat_##field(void *cookie __unused, __u64 *out) \
+	{								\
+		struct uk_lockstat_class c;				\
+		unsigned int i;						\
+									\
+		*out = 0;						\
+		for (i = 0; uk_lockstat_class_read(i, &c) == 0; i++)	\
+			*out += (__u64) c.field;			\
+		return 0;						\
+	}
+
+/* Counters of a single class, the cookie of the object is the class */
+#define LOCKSTAT_CLASS_GETTER(field)					\
+	static int get_lockstat_class_##field(void *cookie, __u64 *out)	\
+	{								\
+		struct uk_lockstat_class *cls =				\
+			(struct uk_lockstat_class *) cookie;		\
+									\
+		*out = (__u64) UK_READ_ONCE(cls->field);		\
+		return 0;						\
+	}
+
+LOCKSTAT_CLASS_GETTER(nr_acquired)
+LOCKSTAT_CLASS_GETTER(nr_contended)
+LOCKSTAT_CLASS_GETTER(wait_total)
+LOCKSTAT_CLASS_GETTER(wait_max)
+LOCKSTAT_CLASS_GETTER(hold_total)
+LOCKSTAT_CLASS_GETTER(hold_max)
+
+static const struct uk_store_entry *lockstat_class_entries[] = {
+	UK_STORE_ENTRY(UK_LOCK_STATS_LOCKSTAT_CLASS_ACQUIRED, "acquired", u64,
+		       get_lockstat_class_nr_acquired, NULL),
+	UK_STORE_ENTRY(UK_LOCK_STATS_LOCKSTAT_CLASS_CONTENDED, "contended",
+		       u64, get_lockstat_class_nr_contended, NULL),
+	UK_STORE_ENTRY(UK_LOCK_STATS_LOCKSTAT_CLASS_WAIT_NS, "wait_ns", u64,
+		       get_lockstat_class_wait_total, NULL),
+	UK_STORE_ENTRY(UK_LOCK_STATS_LOCKSTAT_CLASS_WAIT_MAX_NS,
+		       "wait_max_ns", u64, get_lockstat_class_wait_max, NULL),
+	UK_STORE_ENTRY(UK_LOCK_STATS_LOCKSTAT_CLASS_HOLD_NS, "hold_ns", u64,
+		       get_lockstat_class_hold_total, NULL),
+	UK_STORE_ENTRY(UK_LOCK_STATS_LOCKSTAT_CLASS_HOLD_MAX_NS,
+		       "hold_max_ns", u64, get_lockstat_class_hold_max, NULL),
+	NULL
+};
+
+/* Classes are created in any context, including interrupt handlers, where
+ * no objects can be allocated. Instead, an object is added for each new
+ * class when the number of classes is read. The object ID is the index of
+ * the class, the object name its site.
+ */
+static unsigned int lockstat_nr_published;
+static struct uk_mutex lockstat_publish_lock =
+	UK_MUTEX_INITIALIZER(lockstat_publish_lock);
+
+static void lockstat_publish(unsigned int nr_classes)
+{
+	struct uk_lockstat_class *cls;
+	struct uk_store_object *obj;
+
+	uk_mutex_lock(&lockstat_publish_lock);
+	while (lockstat_nr_published < nr_classes) {
+		cls = &lockstat_classes[lockstat_nr_published];
+		obj = uk_store_obj_alloc(uk_alloc_get_default(),
+					 lockstat_nr_published, cls->site,
+					 lockstat_class_entries, cls);
+		if (unlikely(PTRISERR(obj)))
+			break;
+
+		uk_store_obj_add(obj);
+		lockstat_nr_published++;
+	}
+	uk_mutex_unlock(&lockstat_publish_lock);
+}
+
+static int get_lockstat_classes(void *cookie __unused, __u64 *out)
+{
+	unsigned int nr_classes = UK_READ_ONCE(lockstat_nr_classes);
+
+	lockstat_publish(nr_classes);
+	*out = nr_classes;
+	return 0;
+}
+
+static int set_lockstat_reset(void *cookie __unused, __u64 val __unused)
+{
+	uk_lockstat_reset();
+	return 0;
+}
+
+UK_STORE_STATIC_ENTRY(UK_LOCK_STATS_LOCKSTAT_CLASSES, lockstat_classes,
+		      u64, get_lockstat_classes, NULL);
+LOCKSTAT_TOTAL_GETTER(nr_acquired)
+UK_STORE_STATIC_ENTRY(UK_LOCK_STATS_LOCKSTAT_ACQUIRED, lockstat_acquired,
+		      u64, get_lockstat_nr_acquired, NULL);
+LOCKSTAT_TOTAL_GETTER(nr_contended)
+UK_STORE_STATIC_ENTRY(UK_LOCK_STATS_LOCKSTAT_CONTENDED, lockstat_contended,
+		      u64, get_lockstat_nr_contended, NULL);
+LOCKSTAT_TOTAL_GETTER(wait_total)
+UK_STORE_STATIC_ENTRY(UK_LOCK_STATS_LOCKSTAT_WAIT_NS, lockstat_wait_ns,
+		      u64, get_lockstat_wait_total, NULL);
+LOCKSTAT_TOTAL_GETTER(hold_total)
+UK_STORE_STATIC_ENTRY(UK_LOCK_STATS_LOCKSTAT_HOLD_NS, lockstat_hold_ns,
+		      u64, get_lockstat_hold_total, NULL);
+UK_STORE_STATIC_ENTRY(UK_LOCK_STATS_LOCKSTAT_RESET, lockstat_reset,
+		      u64, NULL, set_lockstat_reset);
+#endif /* CONFIG_LIBUKSTORE */
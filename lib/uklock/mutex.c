@@ -1,52 +1,91 @@
 #include <uk/mutex.h>
 
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
-#include <uk/init.h>
+#include <string.h>
 #include <uk/assert.h>
+#include <uk/lock_store.h>
+#include <uk/store.h>
 
-struct uk_mutex_metrics _uk_mutex_metrics = { 0 };
-__spinlock              _uk_mutex_metrics_lock;
+UKPLAT_PER_LCPU_DEFINE(struct uk_mutex_metrics_lcpu, _uk_mutex_metrics);
 #endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
 
-void uk_mutex_init_config(struct uk_mutex *m, unsigned int flags)
+void (uk_mutex_init_config)(struct uk_mutex *m, unsigned int flags)
 {
 	m->lock_count = 0;
 	m->flags = flags;
 	m->owner = NULL;
 	uk_waitq_init(&m->wait);
+#if CONFIG_LIBUKLOCK_LOCKSTAT
+	uk_lockstat_init(&m->lockstat, NULL);
+#endif /* CONFIG_LIBUKLOCK_LOCKSTAT */
 
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
-	ukarch_spin_lock(&_uk_mutex_metrics_lock);
-	_uk_mutex_metrics.active_unlocked++;
-	ukarch_spin_unlock(&_uk_mutex_metrics_lock);
+	_uk_mutex_metrics_add(active_unlocked, 1);
 #endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
 }
 
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
 /**
- * Initializes the mutex metric counters and its spinlock.
- * @return 0 on success.
- *
- * NOTE: this function is registered as a CTOR for this library.
- */
-static int mutex_metrics_ctor(void)
-{
-	ukarch_spin_init(&_uk_mutex_metrics_lock);
-
-	return 0;
-}
-uk_lib_initcall_prio(mutex_metrics_ctor, 0x0, 1);
-
-/**
- * Makes a copy of mutex metrics to avoid direct user access.
+ * Sums up the per-LCPU mutex metrics. The result is not an atomic snapshot:
+ * concurrent lock operations may or may not be included.
  * @dst : destination buffer (must have been already allocated)
  */
 void uk_mutex_get_metrics(struct uk_mutex_metrics *dst)
 {
+	struct uk_mutex_metrics_lcpu *l;
+	long active_locked = 0;
+	long active_unlocked = 0;
+	unsigned int i;
+
 	UK_ASSERT(dst);
 
-	ukarch_spin_lock(&_uk_mutex_metrics_lock);
-	memcpy(dst, &_uk_mutex_metrics, sizeof(*dst));
-	ukarch_spin_unlock(&_uk_mutex_metrics_lock);
+	memset(dst, 0, sizeof(*dst));
+	for (i = 0; i < CONFIG_UKPLAT_LCPU_MAXCOUNT; i++) {
+		l = &ukplat_per_lcpu(_uk_mutex_metrics, i);
+		active_locked += UK_READ_ONCE(l->active_locked);
+		active_unlocked += UK_READ_ONCE(l->active_unlocked);
+		dst->total_locks += UK_READ_ONCE(l->total_locks);
+		dst->total_ok_trylocks += UK_READ_ONCE(l->total_ok_trylocks);
+		dst->total_failed_trylocks +=
+			UK_READ_ONCE(l->total_failed_trylocks);
+		dst->total_unlocks += UK_READ_ONCE(l->total_unlocks);
+	}
+
+	/* Summing up racing deltas can transiently become negative */
+	dst->active_locked = (active_locked > 0) ? (size_t) active_locked : 0;
+	dst->active_unlocked = (active_unlocked > 0)
+			       ? (size_t) active_unlocked : 0;
 }
+
+#define MUTEX_METRICS_GETTER(field)					\
+	static int get_mutex_##field(void *cookie __unused, __u64 *out)	\
+	{								\
+		struct uk_mutex_metrics m;				\
+									\
+		uk_mutex_get_metrics(&m);				\
+		*out = (__u64) m.field;					\
+		return 0;						\
+	}
+
+MUTEX_METRICS_GETTER(active_locked)
+UK_STORE_STATIC_ENTRY(UK_LOCK_STATS_MUTEX_ACTIVE_LOCKED, mutex_active_locked,
+		      u64, get_mutex_active_locked, NULL);
+MUTEX_METRICS_GETTER(active_unlocked)
+UK_STORE_STATIC_ENTRY(UK_LOCK_STATS_MUTEX_ACTIVE_UNLOCKED,
+		      mutex_active_unlocked,
+		      u64, get_mutex_active_unlocked, NULL);
+MUTEX_METRICS_GETTER(total_locks)
+UK_STORE_STATIC_ENTRY(UK_LOCK_STATS_MUTEX_TOTAL_LOCKS, mutex_total_locks,
+		      u64, get_mutex_total_locks, NULL);
+MUTEX_METRICS_GETTER(total_ok_trylocks)
+UK_STORE_STATIC_ENTRY(UK_LOCK_STATS_MUTEX_TOTAL_OK_TRYLOCKS,
+		      mutex_total_ok_trylocks,
+		      u64, get_mutex_total_ok_trylocks, NULL);
+MUTEX_METRICS_GETTER(total_failed_trylocks)
+UK_STORE_STATIC_ENTRY(UK_LOCK_STATS_MUTEX_TOTAL_FAILED_TRYLOCKS,
+		      mutex_total_failed_trylocks,
+		      u64, get_mutex_total_failed_trylocks, NULL);
+MUTEX_METRICS_GETTER(total_unlocks)
+UK_STORE_STATIC_ENTRY(UK_LOCK_STATS_MUTEX_TOTAL_UNLOCKS, mutex_total_unlocks,
+		      u64, get_mutex_total_unlocks, NULL);
 #endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
@@ -10,7 +10,7 @@
 #include <uk/assert.h>
 #include <uk/config.h>
 
-void uk_rwlock_init_config(struct uk_rwlock *rwl, unsigned int config_flags)
+void (uk_rwlock_init_config)(struct uk_rwlock *rwl, unsigned int config_flags)
 {
 	UK_ASSERT(rwl);
 
@@ -25,15 +25,27 @@ void uk_rwlock_init_config(struct uk_rwlock *rwl, unsigned int config_flags)
 	uk_spin_init(&rwl->sl);
 	uk_waitq_init(&rwl->shared);
 	uk_waitq_init(&rwl->exclusive);
+#if CONFIG_LIBUKLOCK_LOCKSTAT
+	uk_lockstat_init(&rwl->lockstat, NULL);
+#endif /* CONFIG_LIBUKLOCK_LOCKSTAT */
 }
 
 void uk_rwlock_rlock(struct uk_rwlock *rwl)
 {
+#if CONFIG_LIBUKLOCK_LOCKSTAT
+	__nsec wait_start = 0;
+#endif /* CONFIG_LIBUKLOCK_LOCKSTAT */
+
 	UK_ASSERT(rwl);
 
 	uk_spin_lock(&rwl->sl);
 	rwl->npending_reads++;
 
+#if CONFIG_LIBUKLOCK_LOCKSTAT
+	if (rwl->npending_writes > 0 || rwl->nactive < 0)
+		wait_start = uk_lockstat_wait_start();
+#endif /* CONFIG_LIBUKLOCK_LOCKSTAT */
+
 	/* We let readers wait when there are writers pending. This is
 	 * necessary to avoid a situation where new readers continuously enter
 	 * the critical section while other readers are still in - thereby
@@ -62,15 +74,29 @@ void uk_rwlock_rlock(struct uk_rwlock *rwl)
 	rwl->nactive++;
 	rwl->npending_reads--;
 	uk_spin_unlock(&rwl->sl);
+
+#if CONFIG_LIBUKLOCK_LOCKSTAT
+	/* Readers share the lock, only writers account hold times */
+	uk_lockstat_acquired(&rwl->lockstat, wait_start, 0);
+#endif /* CONFIG_LIBUKLOCK_LOCKSTAT */
 }
 
 void uk_rwlock_wlock(struct uk_rwlock *rwl)
 {
+#if CONFIG_LIBUKLOCK_LOCKSTAT
+	__nsec wait_start = 0;
+#endif /* CONFIG_LIBUKLOCK_LOCKSTAT */
+
 	UK_ASSERT(rwl);
 
 	uk_spin_lock(&rwl->sl);
 	rwl->npending_writes++;
 
+#if CONFIG_LIBUKLOCK_LOCKSTAT
+	if (rwl->nactive != 0)
+		wait_start = uk_lockstat_wait_start();
+#endif /* CONFIG_LIBUKLOCK_LOCKSTAT */
+
 	/* Wait for all readers to have left the lock. New readers will
 	 * block in uk_rwlock_rlock while we are waiting.
 	 */
@@ -86,6 +112,10 @@ void uk_rwlock_wlock(struct uk_rwlock *rwl)
 	rwl->npending_writes--;
 	rwl->nactive = -1;
 	uk_spin_unlock(&rwl->sl);
+
+#if CONFIG_LIBUKLOCK_LOCKSTAT
+	uk_lockstat_acquired(&rwl->lockstat, wait_start, 1);
+#endif /* CONFIG_LIBUKLOCK_LOCKSTAT */
 }
 
 void uk_rwlock_runlock(struct uk_rwlock *rwl)
@@ -116,6 +146,10 @@ void uk_rwlock_wunlock(struct uk_rwlock *rwl)
 
 	UK_ASSERT(rwl);
 
+#if CONFIG_LIBUKLOCK_LOCKSTAT
+	uk_lockstat_released(&rwl->lockstat);
+#endif /* CONFIG_LIBUKLOCK_LOCKSTAT */
+
 	uk_spin_lock(&rwl->sl);
 	UK_ASSERT(rwl->nactive == -1);
 
@@ -0,0 +1,167 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <uk/test.h>
+#include <uk/config.h>
+#include <uk/print.h>
+#include <uk/sched.h>
+#include <uk/spinlock.h>
+#include <uk/thread.h>
+#include <uk/plat/time.h>
+#if CONFIG_LIBUKLOCK_MUTEX
+#include <uk/mutex.h>
+#endif /* CONFIG_LIBUKLOCK_MUTEX */
+
+#define pr_info(fmt, ...)						\
+	_uk_printk(KLVL_INFO, uk_libid_self(), __NULL, 0x0, fmt,	\
+		   ##__VA_ARGS__)
+
+#define CONTENTION_THREADS	8
+#define CONTENTION_ROUNDS	10000
+
+/* Contention microbenchmark: Threads increment a shared counter in a
+ * critical section and yield between the rounds, so that the lock changes
+ * hands frequently. On SMP configurations, threads running on different
+ * LCPUs contend for the lock.
+ */
+struct contention_args {
+	void (*lock)(void *l);
+	void (*unlock)(void *l);
+	void *l;
+	unsigned long *counter;
+	unsigned int *done; /* incremented by each thread before it exits */
+};
+
+static __noreturn void contention_func(void *arg)
+{
+	struct contention_args *args = (struct contention_args *)arg;
+	unsigned int i;
+
+	for (i = 0; i < CONTENTION_ROUNDS; i++) {
+		args->lock(args->l);
+		(*args->counter)++;
+		args->unlock(args->l);
+		uk_sched_yield();
+	}
+	__atomic_fetch_add(args->done, 1, __ATOMIC_RELEASE);
+	uk_sched_thread_exit();
+}
+
+static unsigned long contention_run(const char *name,
+				    void (*lock)(void *l),
+				    void (*unlock)(void *l),
+				    void *l)
+{
+	struct contention_args args;
+	struct uk_thread *t[CONTENTION_THREADS];
+	unsigned long counter = 0;
+	unsigned int done = 0;
+	unsigned long ops;
+	__nsec start, end;
+	unsigned int i;
+
+	args.lock = lock;
+	args.unlock = unlock;
+	args.l = l;
+	args.counter = &counter;
+	args.done = &done;
+
+	start = ukplat_monotonic_clock();
+	for (i = 0; i < CONTENTION_THREADS; i++) {
+		t[i] = uk_sched_thread_create(uk_sched_current(),
+					      contention_func, &args,
+					      "lock-contention");
+		UK_ASSERT(t[i]);
+	}
+	/* Exited threads may already be released, do not access them */
+	while (__atomic_load_n(&done, __ATOMIC_ACQUIRE) < CONTENTION_THREADS)
+		uk_sched_yield();
+	end = ukplat_monotonic_clock();
+
+	ops = CONTENTION_THREADS * CONTENTION_ROUNDS;
+	pr_info("%s: %lu lock/unlock pairs by %u threads, %"__PRInsec" ns/op\n",
+		name, ops, CONTENTION_THREADS, (end - start) / ops);
+	return counter;
+}
+
+static uk_spinlock contention_spinlock = UK_SPINLOCK_INITIALIZER();
+
+static void spin_lock_func(void *l)
+{
+	uk_spin_lock_irq((uk_spinlock *)l);
+}
+
+static void spin_unlock_func(void *l)
+{
+	uk_spin_unlock_irq((uk_spinlock *)l);
+}
+
+UK_TESTCASE(uklock, test_spinlock_contention)
+{
+	unsigned long counter;
+
+	counter = contention_run("spinlock", spin_lock_func, spin_unlock_func,
+				 &contention_spinlock);
+	UK_TEST_EXPECT_SNUM_EQ(counter,
+			       CONTENTION_THREADS * CONTENTION_ROUNDS);
+	UK_TEST_EXPECT_ZERO(uk_spin_is_locked(&contention_spinlock));
+}
+
+#if CONFIG_LIBUKLOCK_MUTEX
+static struct uk_mutex contention_mutex =
+	UK_MUTEX_INITIALIZER(contention_mutex);
+
+static void mutex_lock_func(void *l)
+{
+	uk_mutex_lock((struct uk_mutex *)l);
+}
+
+static void mutex_unlock_func(void *l)
+{
+	uk_mutex_unlock((struct uk_mutex *)l);
+}
+
+UK_TESTCASE(uklock, test_mutex_contention)
+{
+	unsigned long counter;
+
+	counter = contention_run("mutex", mutex_lock_func, mutex_unlock_func,
+				 &contention_mutex);
+	UK_TEST_EXPECT_SNUM_EQ(counter,
+			       CONTENTION_THREADS * CONTENTION_ROUNDS);
+	UK_TEST_EXPECT_NULL(contention_mutex.owner);
+}
+#endif /* CONFIG_LIBUKLOCK_MUTEX */
+
+#if CONFIG_LIBUKLOCK_LOCKSTAT
+#define LOCKSTAT_ROUNDS		100
+
+/* All acquisitions of a lock are accounted to the class of its init site */
+UK_TESTCASE(uklock, test_lockstat_class)
+{
+	struct uk_lockstat_class *cls;
+	uk_spinlock l;
+	unsigned int i;
+
+	uk_spin_init(&l);
+	for (i = 0; i < LOCKSTAT_ROUNDS; i++) {
+		uk_spin_lock(&l);
+		uk_spin_unlock(&l);
+	}
+	UK_TEST_EXPECT_NOT_ZERO(uk_spin_trylock(&l));
+	uk_spin_unlock(&l);
+
+	cls = l.lockstat.cls;
+	UK_TEST_ASSERT(cls != NULL);
+	UK_TEST_EXPECT_SNUM_EQ(cls->nr_acquired, LOCKSTAT_ROUNDS + 1);
+	UK_TEST_EXPECT_SNUM_EQ(cls->nr_contended, 0);
+	UK_TEST_EXPECT(cls->hold_max <= cls->hold_total);
+
+	uk_lockstat_dumpk(KLVL_INFO);
+}
+#endif /* CONFIG_LIBUKLOCK_LOCKSTAT */
+
+uk_testsuite_register(uklock, NULL);
@@ -6,12 +6,12 @@
 #define _GNU_SOURCE /* asprintf */
 #include <stdio.h>
 
+#include <uk/arch/spinlock.h>
 #include <uk/essentials.h>
 #include <uk/event.h>
 #include <uk/libid.h>
 #include <uk/netdev.h>
 #include <uk/netdev_store.h>
-#include <uk/spinlock.h>
 #include <uk/store.h>
 
 static int get_tx_bytes(void *cookie, __u64 *out)
@@ -20,9 +20,9 @@ static int get_tx_bytes(void *cookie, __u64 *out)
 
 	UK_ASSERT(dev);
 
-	uk_spin_lock(&dev->_stats_lock);
+	ukarch_spin_lock(&dev->_stats_lock);
 	*out = dev->_stats.tx_m.bytes;
-	uk_spin_unlock(&dev->_stats_lock);
+	ukarch_spin_unlock(&dev->_stats_lock);
 
 	return 0;
 }
@@ -33,9 +33,9 @@ static int get_tx_packets(void *cookie, __u64 *out)
 
 	UK_ASSERT(dev);
 
-	uk_spin_lock(&dev->_stats_lock);
+	ukarch_spin_lock(&dev->_stats_lock);
 	*out = dev->_stats.tx_m.packets;
-	uk_spin_unlock(&dev->_stats_lock);
+	ukarch_spin_unlock(&dev->_stats_lock);
 
 	return 0;
 }
@@ -46,9 +46,9 @@ static int get_tx_errors(void *cookie, __u64 *out)
 
 	UK_ASSERT(dev);
 
-	uk_spin_lock(&dev->_stats_lock);
+	ukarch_spin_lock(&dev->_stats_lock);
 	*out = dev->_stats.tx_m.errors;
-	uk_spin_unlock(&dev->_stats_lock);
+	ukarch_spin_unlock(&dev->_stats_lock);
 
 	return 0;
 }
@@ -59,9 +59,9 @@ static int get_tx_fifo(void *cookie, __u64 *out)
 
 	UK_ASSERT(dev);
 
-	uk_spin_lock(&dev->_stats_lock);
+	ukarch_spin_lock(&dev->_stats_lock);
 	*out = dev->_stats.tx_m.fifo;
-	uk_spin_unlock(&dev->_stats_lock);
+	ukarch_spin_unlock(&dev->_stats_lock);
 
 	return 0;
 }
@@ -72,9 +72,9 @@ static int get_rx_bytes(void *cookie, __u64 *out)
 
 	UK_ASSERT(dev);
 
-	uk_spin_lock(&dev->_stats_lock);
+	ukarch_spin_lock(&dev->_stats_lock);
 	*out = dev->_stats.rx_m.bytes;
-	uk_spin_unlock(&dev->_stats_lock);
+	ukarch_spin_unlock(&dev->_stats_lock);
 
 	return 0;
 }
@@ -85,9 +85,9 @@ static int get_rx_packets(void *cookie, __u64 *out)
 
 	UK_ASSERT(dev);
 
-	uk_spin_lock(&dev->_stats_lock);
+	ukarch_spin_lock(&dev->_stats_lock);
 	*out = dev->_stats.rx_m.packets;
-	uk_spin_unlock(&dev->_stats_lock);
+	ukarch_spin_unlock(&dev->_stats_lock);
 
 	return 0;
 }
@@ -98,9 +98,9 @@ static int get_rx_errors(void *cookie, __u64 *out)
 
 	UK_ASSERT(dev);
 
-	uk_spin_lock(&dev->_stats_lock);
+	ukarch_spin_lock(&dev->_stats_lock);
 	*out = dev->_stats.rx_m.errors;
-	uk_spin_unlock(&dev->_stats_lock);
+	ukarch_spin_unlock(&dev->_stats_lock);
 
 	return 0;
 }
@@ -111,9 +111,9 @@ static int get_rx_fifo(void *cookie, __u64 *out)
 
 	UK_ASSERT(dev);
 
-	uk_spin_lock(&dev->_stats_lock);
+	ukarch_spin_lock(&dev->_stats_lock);
 	*out = dev->_stats.rx_m.fifo;
-	uk_spin_unlock(&dev->_stats_lock);
+	ukarch_spin_unlock(&dev->_stats_lock);
 
 	return 0;
 }
@@ -0,0 +1,161 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+/*
+ * Read-copy-update (RCU)
+ *
+ * Readers access shared structures in read-side critical sections without
+ * taking locks or writing to shared memory: `uk_rcu_read_lock()` and
+ * `uk_rcu_read_unlock()` only update a nesting counter of the current
+ * thread. Updaters unlink objects and defer freeing them with
+ * `uk_call_rcu()` or `uk_synchronize_rcu()` until a grace period has
+ * elapsed, i.e., until every read-side critical section that could still
+ * see the objects has ended.
+ *
+ * Grace periods are detected from quiescent states of the scheduler: an
+ * LCPU that performed a context switch or that runs its idle thread cannot
+ * be in the middle of a critical section that started before. Threads that
+ * are switched out (e.g., preempted or blocked) inside a critical section
+ * are tracked and hold off grace periods until they leave the section.
+ * A kernel thread ("rcu") drives grace periods and invokes callbacks.
+ *
+ * Read-side critical sections may nest and may block, but must not call
+ * `uk_synchronize_rcu()`.
+ */
+#ifndef __UK_RCU_H__
+#define __UK_RCU_H__
+
+#include <uk/config.h>
+#include <uk/arch/lcpu.h>
+#include <uk/assert.h>
+#include <uk/atomic.h>
+#include <uk/essentials.h>
+#include <uk/plat/lcpu.h>
+#include <uk/thread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct uk_rcu_head;
+
+typedef void (*uk_rcu_callback_t)(struct uk_rcu_head *head);
+
+/* Embed into objects that are freed with `uk_call_rcu()` */
+struct uk_rcu_head {
+	struct uk_rcu_head *next;
+	uk_rcu_callback_t func;
+	unsigned long seq;	/**< Grace period that must complete */
+};
+
+/* Context switches per LCPU, maintained by the scheduler (internal!) */
+extern UKPLAT_PER_LCPU_DEFINE(unsigned long, _uk_rcu_nr_switches);
+
+/* Records a thread that is switched out in a critical section, see rcu.c */
+void _uk_rcu_block(struct uk_thread *t);
+
+/* Called when a recorded thread leaves its critical section, see rcu.c */
+void _uk_rcu_unblock(struct uk_thread *t);
+
+/**
+ * Notes a quiescent state of the current LCPU. Called by the scheduler
+ * before it switches from `prev` to another thread.
+ */
+static inline void _uk_rcu_note_switch(struct uk_thread *prev)
+{
+	unsigned long *nr = &ukplat_per_lcpu_current(_uk_rcu_nr_switches);
+
+	if (unlikely(prev->rcu_nesting && !prev->rcu_blocked))
+		_uk_rcu_block(prev);
+
+	/* The counter must only change after `prev` has been recorded */
+	barrier();
+	UK_WRITE_ONCE(*nr, *nr + 1);
+}
+
+/**
+ * Enters a read-side critical section. Sections may nest.
+ */
+static inline void uk_rcu_read_lock(void)
+{
+	struct uk_thread *t = uk_thread_current();
+
+	/* There are no updaters before the scheduler is started */
+	if (t)
+		t->rcu_nesting++;
+	barrier();
+}
+
+/**
+ * Leaves a read-side critical section
+ */
+static inline void uk_rcu_read_unlock(void)
+{
+	struct uk_thread *t = uk_thread_current();
+
+	barrier();
+	if (!t)
+		return;
+
+	UK_ASSERT(t->rcu_nesting > 0);
+	t->rcu_nesting--;
+	barrier();
+	if (unlikely(!t->rcu_nesting && t->rcu_blocked))
+		_uk_rcu_unblock(t);
+}
+
+/**
+ * Returns if the current thread is in a read-side critical section
+ */
+static inline int uk_rcu_read_lock_held(void)
+{
+	struct uk_thread *t = uk_thread_current();
+
+	return t && t->rcu_nesting;
+}
+
+/**
+ * Loads an RCU-protected pointer in a read-side critical section
+ */
+#define uk_rcu_dereference(p)	UK_READ_ONCE(p)
+
+/**
+ * Publishes an RCU-protected pointer. Initialization of the object that
+ * `v` points to is visible to readers that load the new pointer.
+ */
+#define uk_rcu_assign_pointer(p, v)					\
+	__atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+/**
+ * Calls `func` with `head` after a grace period, i.e., after all read-side
+ * critical sections that are in progress have ended. The callback is
+ * executed by the rcu thread and may block. Must not be called from
+ * interrupt context.
+ *
+ * @param head
+ *   RCU head, usually embedded into the object that is freed by `func`
+ * @param func
+ *   Callback
+ */
+void uk_call_rcu(struct uk_rcu_head *head, uk_rcu_callback_t func);
+
+/**
+ * Waits for a grace period. Must not be called from a read-side critical
+ * section or from interrupt context.
+ */
+void uk_synchronize_rcu(void);
+
+/**
+ * Waits until the callbacks that were queued with `uk_call_rcu()` before
+ * have been executed. Must not be called from a read-side critical section
+ * or from interrupt context.
+ */
+void uk_rcu_barrier(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UK_RCU_H__ */
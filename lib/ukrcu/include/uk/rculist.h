@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+/*
+ * RCU-protected lists
+ *
+ * Updaters serialize with a lock and use the `_rcu` variants to modify the
+ * lists. Readers traverse the lists with `*_for_each_entry_rcu()` in a
+ * read-side critical section, concurrently to updaters. Removed entries
+ * keep their forward link and must only be freed or reinserted after a
+ * grace period.
+ */
+#ifndef __UK_RCULIST_H__
+#define __UK_RCULIST_H__
+
+#include <uk/list.h>
+#include <uk/rcu.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static inline void
+uk_list_add_rcu(struct uk_list_head *new_entry, struct uk_list_head *head)
+{
+	struct uk_list_head *next = head->next;
+
+	new_entry->next = next;
+	new_entry->prev = head;
+	uk_rcu_assign_pointer(head->next, new_entry);
+	next->prev = new_entry;
+}
+
+static inline void
+uk_list_add_tail_rcu(struct uk_list_head *new_entry, struct uk_list_head *head)
+{
+	struct uk_list_head *prev = head->prev;
+
+	new_entry->next = head;
+	new_entry->prev = prev;
+	uk_rcu_assign_pointer(prev->next, new_entry);
+	head->prev = new_entry;
+}
+
+static inline void
+uk_list_del_rcu(struct uk_list_head *entry)
+{
+	/* `entry->next` stays valid for readers that are on the entry */
+	__uk_list_del(entry->prev, entry->next);
+	entry->prev = __NULL;
+}
+
+#define uk_list_for_each_entry_rcu(p, h, field)				\
+	for (p = uk_list_entry(uk_rcu_dereference((h)->next),		\
+			       __typeof(*p), field);			\
+	     &(p)->field != (h);					\
+	     p = uk_list_entry(uk_rcu_dereference((p)->field.next),	\
+			       __typeof(*p), field))
+
+static inline void
+uk_hlist_add_head_rcu(struct uk_hlist_node *n, struct uk_hlist_head *h)
+{
+	struct uk_hlist_node *first = h->first;
+
+	n->next = first;
+	n->pprev = &h->first;
+	uk_rcu_assign_pointer(h->first, n);
+	if (first != __NULL)
+		first->pprev = &n->next;
+}
+
+static inline void
+uk_hlist_del_rcu(struct uk_hlist_node *n)
+{
+	/* `n->next` stays valid for readers that are on the node */
+	uk_hlist_del(n);
+	n->pprev = __NULL;
+}
+
+#define uk_hlist_for_each_entry_rcu(p, h, field)			\
+	for (p = __uk_hlist_entry_rcu(uk_rcu_dereference((h)->first),	\
+				      __typeof(*p), field);		\
+	     p;								\
+	     p = __uk_hlist_entry_rcu(uk_rcu_dereference((p)->field.next), \
+				      __typeof(*p), field))
+
+#define __uk_hlist_entry_rcu(n, type, field)				\
+	({								\
+		struct uk_hlist_node *__n = (n);			\
+									\
+		__n ? uk_hlist_entry(__n, type, field) : __NULL;	\
+	})
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UK_RCULIST_H__ */
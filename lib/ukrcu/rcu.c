@@ -0,0 +1,312 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#include <errno.h>
+#include <uk/arch/spinlock.h>
+#include <uk/arch/time.h>
+#include <uk/assert.h>
+#include <uk/init.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/spinlock.h>
+#include <uk/plat/time.h>
+#include <uk/print.h>
+#include <uk/rcu.h>
+#include <uk/sched.h>
+#include <uk/sched_impl.h>
+#include <uk/semaphore.h>
+#include <uk/thread.h>
+#include <uk/wait.h>
+
+/* Interval in which the rcu thread polls other LCPUs for quiescent states */
+#define RCU_POLL_NS	ukarch_time_msec_to_nsec(1)
+
+UKPLAT_PER_LCPU_DEFINE(unsigned long, _uk_rcu_nr_switches);
+
+/* Value of `_uk_rcu_nr_switches` when the current grace period started */
+static UKPLAT_PER_LCPU_DEFINE(unsigned long, rcu_gp_snap);
+
+/* Grace periods are numbered from 1. Grace period `rcu_gp_completed + 1`
+ * is in progress if `rcu_gp_active` is set, otherwise it is the next one
+ * to start.
+ */
+static unsigned long rcu_gp_completed;
+static bool rcu_gp_active;
+
+/* Threads that were switched out in a critical section, by the parity of
+ * the first grace period that has to wait for them. A grace period waits
+ * for the threads that are recorded for it or for an earlier one. As the
+ * earlier grace period does not complete before its threads have left their
+ * sections, two counters suffice.
+ */
+static unsigned int rcu_blocked[2];
+
+/* Callbacks in the order of their grace periods */
+static struct uk_rcu_head *rcu_cbs;
+static struct uk_rcu_head **rcu_cbs_tail = &rcu_cbs;
+
+/* Protects the grace period state and the callback list */
+static __spinlock rcu_lock = UKARCH_SPINLOCK_INITIALIZER();
+
+/* The rcu thread waits here for callbacks and quiescent states */
+static struct uk_waitq rcu_wq = UK_WAIT_QUEUE_INITIALIZER(rcu_wq);
+static struct uk_thread *rcu_thread;
+
+void _uk_rcu_block(struct uk_thread *t)
+{
+	unsigned long flags;
+	unsigned long gp;
+	__lcpuidx idx;
+
+	UK_ASSERT(t);
+	UK_ASSERT(t->rcu_nesting);
+	UK_ASSERT(!t->rcu_blocked);
+
+	ukplat_spin_lock_irqsave(&rcu_lock, flags);
+	idx = ukplat_lcpu_idx();
+	gp = rcu_gp_completed + 1;
+
+	/* If the LCPU switched since the grace period started, `t` was
+	 * switched in afterwards and entered its section after the start, too.
+	 * Only the next grace period has to wait for it.
+	 */
+	if (rcu_gp_active && ukplat_per_lcpu(_uk_rcu_nr_switches, idx) !=
+			     ukplat_per_lcpu(rcu_gp_snap, idx))
+		gp++;
+
+	t->rcu_blocked = (gp & 1) + 1;
+	rcu_blocked[gp & 1]++;
+	ukplat_spin_unlock_irqrestore(&rcu_lock, flags);
+}
+
+void _uk_rcu_unblock(struct uk_thread *t)
+{
+	unsigned long flags;
+	unsigned int left;
+
+	UK_ASSERT(t);
+	UK_ASSERT(t->rcu_blocked);
+
+	ukplat_spin_lock_irqsave(&rcu_lock, flags);
+	left = --rcu_blocked[t->rcu_blocked - 1];
+	t->rcu_blocked = 0;
+	ukplat_spin_unlock_irqrestore(&rcu_lock, flags);
+
+	/* The rcu thread may wait for the last thread of its grace period */
+	if (!left && UK_READ_ONCE(rcu_gp_active))
+		uk_waitq_wake_up(&rcu_wq);
+}
+
+static int rcu_lcpu_is_idle(__lcpuidx idx)
+{
+	const struct uk_thread *cur, *idle;
+	struct uk_sched *s;
+	unsigned int i;
+
+	cur = UK_READ_ONCE(ukplat_per_lcpu(__uk_sched_thread_current, idx));
+	if (!cur)
+		return 1;
+
+	/* Idle threads are never freed, so only they are dereferenced */
+	for (s = uk_sched_head; s; s = s->next) {
+		for (i = 0; (idle = uk_sched_idle_thread(s, i)); i++) {
+			if (idle == cur)
+				return !UK_READ_ONCE(idle->rcu_nesting);
+		}
+	}
+	return 0;
+}
+
+#if CONFIG_LIBUKRCU_TEST
+/* Called by rcu_gp_done() between checking the LCPUs and the switched out
+ * threads, so that the unit tests can switch out a reader in between. The
+ * tests are linked into this library, so the hook is not exported.
+ */
+void (*_uk_rcu_test_gp_done_hook)(void);
+#endif /* CONFIG_LIBUKRCU_TEST */
+
+static int rcu_gp_done(void)
+{
+	__lcpuidx self = ukplat_lcpu_idx();
+	__lcpuidx idx;
+	unsigned long flags;
+	int blocked;
+
+	/* All other threads of our LCPU are switched out */
+	for (idx = 0; idx < ukplat_lcpu_count(); idx++) {
+		if (idx == self)
+			continue;
+		if (UK_READ_ONCE(ukplat_per_lcpu(_uk_rcu_nr_switches, idx)) !=
+		    ukplat_per_lcpu(rcu_gp_snap, idx))
+			continue;
+		if (!rcu_lcpu_is_idle(idx))
+			return 0;
+	}
+
+#if CONFIG_LIBUKRCU_TEST
+	if (_uk_rcu_test_gp_done_hook)
+		_uk_rcu_test_gp_done_hook();
+#endif /* CONFIG_LIBUKRCU_TEST */
+
+	/* A thread that was switched out in its section is recorded before
+	 * the switch counter of its LCPU changes. The threads that we skipped
+	 * above because of their switch must be checked afterwards.
+	 */
+	mb();
+	ukplat_spin_lock_irqsave(&rcu_lock, flags);
+	blocked = rcu_blocked[(rcu_gp_completed + 1) & 1];
+	ukplat_spin_unlock_irqrestore(&rcu_lock, flags);
+
+	return !blocked;
+}
+
+static void rcu_gp_start(void)
+{
+	unsigned long flags;
+	__lcpuidx idx;
+
+	ukplat_spin_lock_irqsave(&rcu_lock, flags);
+	UK_ASSERT(!rcu_gp_active);
+	rcu_gp_active = true;
+	for (idx = 0; idx < ukplat_lcpu_count(); idx++)
+		ukplat_per_lcpu(rcu_gp_snap, idx) =
+			UK_READ_ONCE(ukplat_per_lcpu(_uk_rcu_nr_switches, idx));
+	ukplat_spin_unlock_irqrestore(&rcu_lock, flags);
+}
+
+static void rcu_gp_complete(void)
+{
+	struct uk_rcu_head *done, *head;
+	struct uk_rcu_head **tail;
+	unsigned long flags;
+
+	ukplat_spin_lock_irqsave(&rcu_lock, flags);
+	rcu_gp_completed++;
+	rcu_gp_active = false;
+
+	/* Detach the callbacks that waited for this grace period */
+	done = rcu_cbs;
+	tail = &rcu_cbs;
+	while (*tail && (long)((*tail)->seq - rcu_gp_completed) <= 0)
+		tail = &(*tail)->next;
+	rcu_cbs = *tail;
+	*tail = __NULL;
+	if (!rcu_cbs)
+		rcu_cbs_tail = &rcu_cbs;
+	ukplat_spin_unlock_irqrestore(&rcu_lock, flags);
+
+	while ((head = done)) {
+		done = head->next;
+		head->func(head);
+	}
+}
+
+static int rcu_cbs_pending(void)
+{
+	return UK_READ_ONCE(rcu_cbs) != __NULL;
+}
+
+static __noreturn void rcu_thread_fn(void *arg __unused)
+{
+	for (;;) {
+		uk_waitq_wait_event(&rcu_wq, rcu_cbs_pending());
+
+		rcu_gp_start();
+		while (!rcu_gp_done()) {
+			/* Give the threads of our LCPU a chance to leave their
+			 * sections before we wait for the other LCPUs.
+			 */
+			uk_sched_yield();
+			if (rcu_gp_done())
+				break;
+			uk_waitq_wait_event_deadline(&rcu_wq, rcu_gp_done(),
+						     ukplat_monotonic_clock() +
+						     RCU_POLL_NS);
+		}
+		rcu_gp_complete();
+	}
+}
+
+void uk_call_rcu(struct uk_rcu_head *head, uk_rcu_callback_t func)
+{
+	unsigned long flags;
+
+	UK_ASSERT(head);
+	UK_ASSERT(func);
+
+	/* Before the rcu thread is started, there is only one thread and no
+	 * reader that has to be waited for.
+	 */
+	if (unlikely(!rcu_thread)) {
+		func(head);
+		return;
+	}
+
+	head->func = func;
+	head->next = __NULL;
+
+	ukplat_spin_lock_irqsave(&rcu_lock, flags);
+	/* A grace period in progress may have started before the caller
+	 * unpublished the object, so the callback has to wait for the next.
+	 */
+	head->seq = rcu_gp_completed + (rcu_gp_active ? 2 : 1);
+	*rcu_cbs_tail = head;
+	rcu_cbs_tail = &head->next;
+	ukplat_spin_unlock_irqrestore(&rcu_lock, flags);
+
+	uk_waitq_wake_up(&rcu_wq);
+}
+
+/* The semaphore is only released after the callback is done with it, so
+ * the waiter can return as soon as it acquired it.
+ */
+struct rcu_sync {
+	struct uk_rcu_head head;
+	struct uk_semaphore done;
+};
+
+static void rcu_sync_cb(struct uk_rcu_head *head)
+{
+	struct rcu_sync *sync = __containerof(head, struct rcu_sync, head);
+
+	uk_semaphore_up(&sync->done);
+}
+
+void uk_synchronize_rcu(void)
+{
+	struct rcu_sync sync;
+
+	UK_ASSERT(!uk_rcu_read_lock_held());
+	UK_ASSERT(!rcu_thread || uk_thread_current() != rcu_thread);
+
+	if (unlikely(!rcu_thread))
+		return;
+
+	uk_semaphore_init(&sync.done, 0);
+	uk_call_rcu(&sync.head, rcu_sync_cb);
+	uk_semaphore_down(&sync.done);
+}
+
+void uk_rcu_barrier(void)
+{
+	/* Callbacks are executed in the order they were queued */
+	uk_synchronize_rcu();
+}
+
+static int rcu_init(struct uk_init_ctx *ictx __unused)
+{
+	/* Without a scheduler, callbacks are executed immediately */
+	if (!uk_sched_current())
+		return 0;
+
+	rcu_thread = uk_sched_thread_create(uk_sched_current(), rcu_thread_fn,
+					    __NULL, "rcu");
+	if (unlikely(!rcu_thread)) {
+		uk_pr_err("Failed to create rcu thread\n");
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+uk_lib_initcall(rcu_init, 0x0);
@@ -0,0 +1,197 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <uk/test.h>
+#include <uk/alloc.h>
+#include <uk/rcu.h>
+#include <uk/rculist.h>
+#include <uk/sched.h>
+#include <uk/thread.h>
+#include <uk/arch/time.h>
+
+#define TEST_CALLBACKS		32
+#define TEST_NODES		16
+
+UK_TESTCASE(ukrcu, test_rcu_read_nesting)
+{
+	UK_TEST_EXPECT_ZERO(uk_rcu_read_lock_held());
+	uk_rcu_read_lock();
+	uk_rcu_read_lock();
+	UK_TEST_EXPECT(uk_rcu_read_lock_held());
+	uk_rcu_read_unlock();
+	UK_TEST_EXPECT(uk_rcu_read_lock_held());
+	uk_rcu_read_unlock();
+	UK_TEST_EXPECT_ZERO(uk_rcu_read_lock_held());
+}
+
+struct test_obj {
+	struct uk_rcu_head rcu;
+	unsigned int *freed;
+};
+
+static void test_obj_free(struct uk_rcu_head *head)
+{
+	struct test_obj *o = __containerof(head, struct test_obj, rcu);
+
+	(*o->freed)++;
+	uk_free(uk_alloc_get_default(), o);
+}
+
+/* All queued callbacks are executed by a barrier */
+UK_TESTCASE(ukrcu, test_rcu_call)
+{
+	struct test_obj *o;
+	unsigned int freed = 0;
+	unsigned int i;
+
+	for (i = 0; i < TEST_CALLBACKS; i++) {
+		o = uk_malloc(uk_alloc_get_default(), sizeof(*o));
+		UK_TEST_ASSERT(o != NULL);
+		o->freed = &freed;
+		uk_call_rcu(&o->rcu, test_obj_free);
+	}
+	uk_rcu_barrier();
+	UK_TEST_EXPECT_SNUM_EQ(freed, TEST_CALLBACKS);
+}
+
+struct reader_args {
+	int entered;
+	int left;
+	int done; /* set as the last action of the reader thread */
+};
+
+static __noreturn void reader_func(void *arg)
+{
+	struct reader_args *args = (struct reader_args *)arg;
+
+	uk_rcu_read_lock();
+	UK_WRITE_ONCE(args->entered, 1);
+	uk_sched_thread_sleep(ukarch_time_msec_to_nsec(10));
+	UK_WRITE_ONCE(args->left, 1);
+	uk_rcu_read_unlock();
+	UK_WRITE_ONCE(args->done, 1);
+	uk_sched_thread_exit();
+}
+
+/* A grace period waits for readers that block in their critical section */
+UK_TESTCASE(ukrcu, test_rcu_blocked_reader)
+{
+	struct reader_args args = { 0 };
+	struct uk_thread *t;
+
+	t = uk_sched_thread_create(uk_sched_current(), reader_func, &args,
+				   "rcu-reader");
+	UK_TEST_ASSERT(t != NULL);
+	while (!UK_READ_ONCE(args.entered))
+		uk_sched_yield();
+
+	uk_synchronize_rcu();
+	UK_TEST_EXPECT(UK_READ_ONCE(args.left));
+
+	/* The exited thread may already be released, do not access it */
+	while (!UK_READ_ONCE(args.done))
+		uk_sched_yield();
+}
+
+#if CONFIG_LIBUKRCU_TEST
+extern void (*_uk_rcu_test_gp_done_hook)(void);
+
+/* Reader on another LCPU, which only exists for the grace period check */
+static struct uk_thread test_remote_reader;
+static int test_remote_blocked;
+
+static void test_block_remote_reader(void)
+{
+	_uk_rcu_test_gp_done_hook = NULL;
+
+	/* The reader is switched out after the LCPUs have been checked */
+	test_remote_reader.rcu_nesting = 1;
+	_uk_rcu_block(&test_remote_reader);
+	UK_WRITE_ONCE(test_remote_blocked, 1);
+}
+
+static __noreturn void sync_func(void *arg)
+{
+	int *done = (int *)arg;
+
+	uk_synchronize_rcu();
+	UK_WRITE_ONCE(*done, 1);
+	uk_sched_thread_exit();
+}
+
+/* A grace period waits for a reader that is switched out while the rcu
+ * thread checks for quiescent states.
+ */
+UK_TESTCASE(ukrcu, test_rcu_reader_blocked_during_check)
+{
+	struct uk_thread *t;
+	int done = 0;
+
+	uk_rcu_barrier();
+	_uk_rcu_test_gp_done_hook = test_block_remote_reader;
+
+	t = uk_sched_thread_create(uk_sched_current(), sync_func, &done,
+				   "rcu-sync");
+	UK_TEST_ASSERT(t != NULL);
+	while (!UK_READ_ONCE(test_remote_blocked))
+		uk_sched_yield();
+
+	/* Let the rcu thread poll a few times */
+	uk_sched_thread_sleep(ukarch_time_msec_to_nsec(10));
+	UK_TEST_EXPECT_ZERO(UK_READ_ONCE(done));
+
+	test_remote_reader.rcu_nesting = 0;
+	_uk_rcu_unblock(&test_remote_reader);
+
+	/* `done` is the last write of the thread, it is not accessed after
+	 * it exited
+	 */
+	while (!UK_READ_ONCE(done))
+		uk_sched_yield();
+}
+#endif /* CONFIG_LIBUKRCU_TEST */
+
+struct test_node {
+	struct uk_hlist_node link;
+	unsigned int key;
+};
+
+/* Readers only see entries that are linked, removed entries are freed
+ * after a grace period.
+ */
+UK_TESTCASE(ukrcu, test_rcu_hlist)
+{
+	struct test_node nodes[TEST_NODES];
+	struct uk_hlist_head head;
+	struct test_node *n;
+	unsigned int sum, count;
+	unsigned int i;
+
+	UK_INIT_HLIST_HEAD(&head);
+	for (i = 0; i < TEST_NODES; i++) {
+		nodes[i].key = i;
+		uk_hlist_add_head_rcu(&nodes[i].link, &head);
+	}
+
+	/* Remove odd keys */
+	for (i = 1; i < TEST_NODES; i += 2)
+		uk_hlist_del_rcu(&nodes[i].link);
+	uk_synchronize_rcu();
+
+	sum = 0;
+	count = 0;
+	uk_rcu_read_lock();
+	uk_hlist_for_each_entry_rcu(n, &head, link) {
+		UK_TEST_EXPECT_ZERO(n->key & 1);
+		sum += n->key;
+		count++;
+	}
+	uk_rcu_read_unlock();
+	UK_TEST_EXPECT_SNUM_EQ(count, TEST_NODES / 2);
+	UK_TEST_EXPECT_SNUM_EQ(sum, (TEST_NODES / 2) * (TEST_NODES / 2 - 1));
+}
+
+uk_testsuite_register(ukrcu, NULL);
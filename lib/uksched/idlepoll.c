@@ -0,0 +1,118 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#include <uk/arch/lcpu.h>
+#include <uk/arch/time.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/spinlock.h>
+#include <uk/plat/time.h>
+#include <uk/sched_idlepoll.h>
+
+#define IDLEPOLL_WINDOW_MAX \
+	ukarch_time_usec_to_nsec((__nsec) CONFIG_LIBUKSCHED_IDLEPOLL_MAX_US)
+#define IDLEPOLL_WINDOW_START \
+	MIN(ukarch_time_usec_to_nsec((__nsec) 10), IDLEPOLL_WINDOW_MAX)
+
+static UK_TAILQ_HEAD(, struct uk_sched_idlepoll) idlepoll_pollers =
+	UK_TAILQ_HEAD_INITIALIZER(idlepoll_pollers);
+
+/* Serializes the pollers: Idle threads on different LCPUs do not call the
+ * same poller concurrently.
+ */
+static __spinlock idlepoll_lock = UKARCH_SPINLOCK_INITIALIZER();
+
+void uk_sched_idlepoll_register(struct uk_sched_idlepoll *p)
+{
+	unsigned long flags;
+
+	UK_ASSERT(p);
+	UK_ASSERT(p->poll);
+
+	ukplat_spin_lock_irqsave(&idlepoll_lock, flags);
+	UK_TAILQ_INSERT_TAIL(&idlepoll_pollers, p, poller_list);
+	ukplat_spin_unlock_irqrestore(&idlepoll_lock, flags);
+}
+
+void uk_sched_idlepoll_unregister(struct uk_sched_idlepoll *p)
+{
+	unsigned long flags;
+
+	UK_ASSERT(p);
+
+	ukplat_spin_lock_irqsave(&idlepoll_lock, flags);
+	UK_TAILQ_REMOVE(&idlepoll_pollers, p, poller_list);
+	ukplat_spin_unlock_irqrestore(&idlepoll_lock, flags);
+}
+
+static void idlepoll_call_pollers(void)
+{
+	struct uk_sched_idlepoll *p;
+
+	/* Another idle thread is polling already */
+	if (!ukarch_spin_trylock(&idlepoll_lock))
+		return;
+	UK_TAILQ_FOREACH(p, &idlepoll_pollers, poller_list)
+		p->poll(p->arg);
+	ukarch_spin_unlock(&idlepoll_lock);
+}
+
+int uk_sched_idlepoll(struct uk_sched_idlepoll_window *w, __nsec deadline,
+		      int (*ready)(void *arg), void *arg)
+{
+	__nsec now, end;
+
+	UK_ASSERT(w);
+	UK_ASSERT(ready);
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	now = ukplat_monotonic_clock();
+	w->idle_start = now;
+	if (!w->window)
+		return 0;
+
+	end = now + w->window;
+	if (deadline && deadline < end)
+		end = deadline;
+
+	ukplat_lcpu_enable_irq();
+	do {
+		if (ready(arg))
+			break;
+		idlepoll_call_pollers();
+		ukarch_spinwait();
+		now = ukplat_monotonic_clock();
+	} while (now < end);
+	ukplat_lcpu_disable_irq();
+
+	/* Threads that were woken up by interrupts while we re-disabled them
+	 * are also caught here.
+	 */
+	if (ready(arg)) {
+		w->nr_hits++;
+		return 1;
+	}
+	return 0;
+}
+
+void uk_sched_idlepoll_update(struct uk_sched_idlepoll_window *w)
+{
+	__nsec idle_ns;
+
+	UK_ASSERT(w);
+
+	w->nr_halts++;
+	idle_ns = ukplat_monotonic_clock() - w->idle_start;
+
+	if (idle_ns > IDLEPOLL_WINDOW_MAX) {
+		/* Long idle period: polling would not have helped */
+		w->window /= 2;
+	} else if (w->window < IDLEPOLL_WINDOW_MAX) {
+		/* We halted but were woken up shortly after: poll longer */
+		w->window = w->window ? MIN(w->window * 2, IDLEPOLL_WINDOW_MAX)
+				      : IDLEPOLL_WINDOW_START;
+	}
+}
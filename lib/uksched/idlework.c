@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#include <uk/arch/lcpu.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/spinlock.h>
+#include <uk/plat/time.h>
+#include <uk/sched_idlework.h>
+
+static UK_TAILQ_HEAD(, struct uk_sched_idlework) idlework_list =
+	UK_TAILQ_HEAD_INITIALIZER(idlework_list);
+
+/* Serializes the work functions: Idle threads on different LCPUs do not
+ * call the same work function concurrently.
+ */
+static __spinlock idlework_lock = UKARCH_SPINLOCK_INITIALIZER();
+
+void uk_sched_idlework_register(struct uk_sched_idlework *w)
+{
+	unsigned long flags;
+
+	UK_ASSERT(w);
+	UK_ASSERT(w->work);
+
+	ukplat_spin_lock_irqsave(&idlework_lock, flags);
+	UK_TAILQ_INSERT_TAIL(&idlework_list, w, work_list);
+	ukplat_spin_unlock_irqrestore(&idlework_lock, flags);
+}
+
+void uk_sched_idlework_unregister(struct uk_sched_idlework *w)
+{
+	unsigned long flags;
+
+	UK_ASSERT(w);
+
+	ukplat_spin_lock_irqsave(&idlework_lock, flags);
+	UK_TAILQ_REMOVE(&idlework_list, w, work_list);
+	ukplat_spin_unlock_irqrestore(&idlework_lock, flags);
+}
+
+/* Calls every work function once. Returns non-zero if any has work left */
+static int idlework_call_work(void)
+{
+	struct uk_sched_idlework *w;
+	int more = 0;
+
+	/* Another idle thread is working already. We do not wait for it but
+	 * try again in the next idle period.
+	 */
+	if (!ukarch_spin_trylock(&idlework_lock))
+		return 0;
+	UK_TAILQ_FOREACH(w, &idlework_list, work_list)
+		more |= w->work(w->arg);
+	ukarch_spin_unlock(&idlework_lock);
+
+	return more;
+}
+
+int uk_sched_idlework(__nsec deadline, int (*ready)(void *arg), void *arg)
+{
+	UK_ASSERT(ready);
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	ukplat_lcpu_enable_irq();
+	while (!ready(arg) && idlework_call_work()) {
+		/* Do not delay timed wakeups */
+		if (deadline && ukplat_monotonic_clock() >= deadline)
+			break;
+	}
+	ukplat_lcpu_disable_irq();
+
+	/* Threads that were woken up by interrupts while we re-disabled them
+	 * are also caught here.
+	 */
+	return ready(arg) ? 1 : 0;
+}
@@ -17,7 +17,10 @@ static inline void uk_waitq_wake_up_isr(struct uk_waitq *wq)
 
 	ukplat_spin_lock_irqsave(&wq->sl, flags);
 	UK_STAILQ_FOREACH_SAFE(curr, &wq->wait_list, thread_list, tmp)
-		uk_thread_wake_isr(curr->thread);
+		if (curr->wake)
+			curr->wake(curr);
+		else
+			uk_thread_wake_isr(curr->thread);
 	ukplat_spin_unlock_irqrestore(&wq->sl, flags);
 }
 
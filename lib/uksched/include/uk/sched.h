@@ -37,11 +37,13 @@
 #ifndef __UK_SCHED_H__
 #define __UK_SCHED_H__
 
+#include <uk/config.h>
 #include <uk/plat/tls.h>
 #include <uk/alloc.h>
 #include <uk/thread.h>
 #include <uk/assert.h>
 #include <uk/arch/types.h>
+#include <uk/arch/spinlock.h>
 #include <uk/essentials.h>
 #include <errno.h>
 
@@ -91,12 +93,22 @@ struct uk_sched {
 
 	/* internal */
 	bool is_started;
+	__spinlock tl_lock;       /**< protects thread_list, exited_threads */
 	struct uk_thread_list thread_list;
 	struct uk_thread_list exited_threads;
 	struct uk_alloc *a;       /**< default allocator for struct uk_thread */
 	struct uk_alloc *a_stack; /**< default allocator for stacks */
 	struct uk_alloc *a_auxstack; /**< default allocator for aux stacks */
 	struct uk_alloc *a_uktls; /**< default allocator for TLS+ectx */
+#if CONFIG_LIBUKSCHED_THREAD_CACHE
+	struct uk_thread_list thread_cache; /**< protected by tl_lock */
+	unsigned int thread_cache_len;
+	__u64 thread_cache_hits;
+	__u64 thread_cache_misses;
+#endif /* CONFIG_LIBUKSCHED_THREAD_CACHE */
+#if CONFIG_LIBUKSCHED_STATS
+	struct uk_sched_stats stats;
+#endif /* CONFIG_LIBUKSCHED_STATS */
 	struct uk_sched *next;
 };
 
@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+/*
+ * Adaptive idle polling (`CONFIG_LIBUKSCHED_IDLEPOLL`)
+ *
+ * Before an idle thread halts the CPU, it spins for a bounded window with
+ * interrupts enabled and calls the registered pollers (e.g., for device
+ * queues). A thread that becomes runnable during the window is scheduled
+ * without paying for the halt and its wakeup, which is a VM exit and entry
+ * on virtualized platforms.
+ *
+ * The window adapts to the observed idle periods, similar to KVM's halt
+ * polling: It grows if the CPU was woken up shortly after it halted, and it
+ * shrinks if idle periods are longer than the maximum window, i.e., when
+ * polling only wastes CPU time.
+ */
+#ifndef __UK_SCHED_IDLEPOLL_H__
+#define __UK_SCHED_IDLEPOLL_H__
+
+#include <uk/config.h>
+#include <uk/arch/time.h>
+#include <uk/list.h>
+
+#if CONFIG_LIBUKSCHED_IDLEPOLL
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Poll function called by idle threads. Pollers are called one after the
+ * other with interrupts enabled. They must not block and should wake up the
+ * threads that wait for the events they found.
+ *
+ * @param arg
+ *   Argument given at registration
+ * @return
+ *   Number of events that were handled
+ */
+typedef int (*uk_sched_idlepoll_func_t)(void *arg);
+
+struct uk_sched_idlepoll {
+	uk_sched_idlepoll_func_t poll;
+	void *arg;
+	UK_TAILQ_ENTRY(struct uk_sched_idlepoll) poller_list;
+};
+
+/* Polling state of one idle thread */
+struct uk_sched_idlepoll_window {
+	__nsec window;		/**< Current polling window */
+	__nsec idle_start;	/**< Start of the current idle period */
+	__u64 nr_hits;		/**< Idle periods that ended while polling */
+	__u64 nr_halts;		/**< Idle periods that ended with a halt */
+};
+
+/**
+ * Registers a poller for all idle threads. Must not be called from
+ * interrupt context.
+ */
+void uk_sched_idlepoll_register(struct uk_sched_idlepoll *p);
+
+/**
+ * Unregisters a poller. When this function returns, the poller is not
+ * executed anymore. Must not be called from interrupt context.
+ */
+void uk_sched_idlepoll_unregister(struct uk_sched_idlepoll *p);
+
+/**
+ * Spins for the current window of `w` or until `deadline` (if non-zero),
+ * whichever comes first, unless `ready()` reports runnable work. Must be
+ * called with interrupts disabled. Interrupts are enabled while spinning
+ * and disabled again before `ready()` is checked for the last time.
+ *
+ * @return
+ *   - (1): `ready()` reported runnable work
+ *   - (0): The window expired, the CPU should be halted
+ */
+int uk_sched_idlepoll(struct uk_sched_idlepoll_window *w, __nsec deadline,
+		      int (*ready)(void *arg), void *arg);
+
+/**
+ * Adapts the window after the idle thread returned from a halt that
+ * followed `uk_sched_idlepoll()`.
+ */
+void uk_sched_idlepoll_update(struct uk_sched_idlepoll_window *w);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONFIG_LIBUKSCHED_IDLEPOLL */
+#endif /* __UK_SCHED_IDLEPOLL_H__ */
@@ -0,0 +1,76 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+/*
+ * Background work in idle threads (`CONFIG_LIBUKSCHED_IDLEWORK`)
+ *
+ * Before an idle thread polls or halts the CPU, it runs the registered work
+ * functions with interrupts enabled until they report that no work is left
+ * or a thread becomes runnable. This moves deferrable work (e.g., zeroing of
+ * free memory) out of latency-critical paths into otherwise idle CPU time.
+ */
+#ifndef __UK_SCHED_IDLEWORK_H__
+#define __UK_SCHED_IDLEWORK_H__
+
+#include <uk/config.h>
+#include <uk/arch/time.h>
+#include <uk/list.h>
+
+#if CONFIG_LIBUKSCHED_IDLEWORK
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Work function called by idle threads. Each call should do a small, bounded
+ * step of work so that a thread that becomes runnable is not delayed for
+ * long. Work functions are called with interrupts enabled on the LCPU whose
+ * idle thread runs them. They must not block.
+ *
+ * @param arg
+ *   Argument given at registration
+ * @return
+ *   Non-zero if there is more work to do, 0 otherwise
+ */
+typedef int (*uk_sched_idlework_func_t)(void *arg);
+
+struct uk_sched_idlework {
+	uk_sched_idlework_func_t work;
+	void *arg;
+	UK_TAILQ_ENTRY(struct uk_sched_idlework) work_list;
+};
+
+/**
+ * Registers a work function for all idle threads. Must not be called from
+ * interrupt context.
+ */
+void uk_sched_idlework_register(struct uk_sched_idlework *w);
+
+/**
+ * Unregisters a work function. When this function returns, the function is
+ * not executed anymore. Must not be called from interrupt context.
+ */
+void uk_sched_idlework_unregister(struct uk_sched_idlework *w);
+
+/**
+ * Runs the registered work functions until none of them has work left,
+ * `ready()` reports runnable work or `deadline` (if non-zero) passed. Must
+ * be called with interrupts disabled.
+ * Interrupts are enabled while work functions run and disabled again before
+ * `ready()` is checked for the last time.
+ *
+ * @return
+ *   - (1): `ready()` reported runnable work
+ *   - (0): No work is left or the deadline passed, the CPU may be halted
+ */
+int uk_sched_idlework(__nsec deadline, int (*ready)(void *arg), void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONFIG_LIBUKSCHED_IDLEWORK */
+#endif /* __UK_SCHED_IDLEWORK_H__ */
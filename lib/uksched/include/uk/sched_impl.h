@@ -43,6 +43,9 @@
 #define __UK_SCHED_IMPL_H__
 
 #include <uk/sched.h>
+#if CONFIG_LIBUKRCU
+#include <uk/rcu.h>
+#endif /* CONFIG_LIBUKRCU */
 
 #ifdef __cplusplus
 extern "C" {
@@ -72,10 +75,35 @@ int uk_sched_register(struct uk_sched *s);
 		(s)->a_stack = (sched_a_stack); \
 		(s)->a_auxstack = (sched_a_auxstack); \
 		(s)->a_uktls = (sched_a_uktls); \
+		ukarch_spin_init(&(s)->tl_lock); \
 		UK_TAILQ_INIT(&(s)->thread_list); \
 		UK_TAILQ_INIT(&(s)->exited_threads); \
+		_uk_sched_thread_cache_init((s)); \
+		_uk_sched_stats_init((s)); \
 	} while (0)
 
+#if CONFIG_LIBUKSCHED_STATS
+#define _uk_sched_stats_init(s) \
+	__builtin_memset(&(s)->stats, 0, sizeof((s)->stats))
+
+/* Accounts a context switch from `prev` to `next` */
+void _uk_sched_stats_switch(struct uk_thread *prev, struct uk_thread *next);
+#else /* !CONFIG_LIBUKSCHED_STATS */
+#define _uk_sched_stats_init(s) do { } while (0)
+#endif /* !CONFIG_LIBUKSCHED_STATS */
+
+#if CONFIG_LIBUKSCHED_THREAD_CACHE
+#define _uk_sched_thread_cache_init(s) \
+	do { \
+		UK_TAILQ_INIT(&(s)->thread_cache); \
+		(s)->thread_cache_len = 0; \
+		(s)->thread_cache_hits = 0; \
+		(s)->thread_cache_misses = 0; \
+	} while (0)
+#else /* !CONFIG_LIBUKSCHED_THREAD_CACHE */
+#define _uk_sched_thread_cache_init(s) do { } while (0)
+#endif /* !CONFIG_LIBUKSCHED_THREAD_CACHE */
+
 /**
  * Releases self-exited threads (garbage collection)
  *
@@ -85,28 +113,99 @@ int uk_sched_register(struct uk_sched *s);
  */
 unsigned int uk_sched_thread_gc(struct uk_sched *sched);
 
+/**
+ * Releases an exited thread that was detached from the exited thread list.
+ * Threads that qualify for the thread cache are put into the cache instead.
+ * For schedulers that garbage collect exited threads on their own.
+ */
+void uk_sched_thread_release(struct uk_sched *sched, struct uk_thread *t);
+
+/*
+ * Timer-ordered sleep queue for scheduler implementations. Threads are kept
+ * sorted by `wakeup_time` so that expired threads can be found without
+ * scanning all sleepers. The thread with the earliest deadline is cached.
+ * Callers are responsible for serializing accesses (e.g., by disabling IRQs).
+ */
+UK_RB_HEAD(uk_sched_sleep_tree, uk_thread);
+
+struct uk_sched_sleepq {
+	struct uk_sched_sleep_tree tree;
+	struct uk_thread *first;	/**< Thread with earliest deadline */
+};
+
+static inline void uk_sched_sleepq_init(struct uk_sched_sleepq *q)
+{
+	UK_RB_INIT(&q->tree);
+	q->first = __NULL;
+}
+
+/**
+ * Inserts a thread into the sleep queue. `t->wakeup_time` must be set
+ * and must not be changed while `t` is queued.
+ */
+void uk_sched_sleepq_add(struct uk_sched_sleepq *q, struct uk_thread *t);
+
+/**
+ * Removes a thread from the sleep queue. `t` must be queued in `q`.
+ */
+void uk_sched_sleepq_remove(struct uk_sched_sleepq *q, struct uk_thread *t);
+
+/**
+ * Returns the thread with the earliest wakeup time, NULL if the queue is
+ * empty.
+ */
+static inline struct uk_thread *uk_sched_sleepq_first(struct uk_sched_sleepq *q)
+{
+	return q->first;
+}
+
 static inline
 void uk_sched_thread_switch(struct uk_thread *next)
 {
 	struct uk_thread *prev;
+	int initial;
 
 	prev = ukplat_per_lcpu_current(__uk_sched_thread_current);
 
 	UK_ASSERT(prev);
 
+#if CONFIG_LIBUKRCU
+	/* Must precede the update of the current thread, see rcu.c */
+	_uk_rcu_note_switch(prev);
+#endif /* CONFIG_LIBUKRCU */
+
 	ukplat_per_lcpu_current(__uk_sched_thread_current) = next;
+	prev->on_lcpu = false;
+	next->on_lcpu = true;
+
+#if CONFIG_LIBUKSCHED_STATS
+	_uk_sched_stats_switch(prev, next);
+#endif /* CONFIG_LIBUKSCHED_STATS */
+
+	/* Threads that do not use the FPU or vector units leave the extended
+	 * context in its initial configuration. There is no need to store it
+	 * and it only has to be restored if the CPU state is not initial.
+	 */
+	initial = ukarch_ectx_is_initial();
 
 	prev->tlsp = ukplat_tlsp_get();
-	if (prev->ectx)
-		ukarch_ectx_store(prev->ectx);
+	if (prev->ectx) {
+		prev->ectx_initial = !!initial;
+		if (!initial)
+			ukarch_ectx_store(prev->ectx);
+	}
 
 	/* Load next TLS and extended registers before context switch.
 	 * This avoids requiring special initialization code for newly
 	 * created threads to do the loading.
 	 */
 	ukplat_tlsp_set(next->tlsp);
-	if (next->ectx)
-		ukarch_ectx_load(next->ectx);
+	if (next->ectx) {
+		if (!next->ectx_initial)
+			ukarch_ectx_load(next->ectx);
+		else if (!initial)
+			ukarch_ectx_load_initial();
+	}
 
 	ukplat_lcpu_set_auxsp(next->auxsp);
 
@@ -0,0 +1,133 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+/*
+ * Scheduling latency statistics (`CONFIG_LIBUKSCHED_STATS`)
+ *
+ * The accounting is done by `uk_sched_thread_switch()` and the wakeup
+ * functions so that it works with any scheduler implementation:
+ *  - wait time: time a thread is runnable until it is switched in
+ *  - wakeup latency: wait time of threads that were woken up
+ *  - voluntary switches: the previous thread blocked, yielded, or exited
+ *  - involuntary switches: the previous thread was preempted
+ *  - idle time: time spent in the idle thread of the scheduler
+ */
+#ifndef __UK_SCHED_STATS_H__
+#define __UK_SCHED_STATS_H__
+
+#include <uk/config.h>
+#include <uk/arch/types.h>
+#include <uk/essentials.h>
+
+#if CONFIG_LIBUKSCHED_STATS
+#include <uk/plat/time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Latency histogram with power-of-two buckets: Bucket 0 counts latencies
+ * below 1024 ns, bucket i counts latencies in [2^(9+i), 2^(10+i)) ns. The
+ * last bucket also counts all longer latencies (>= ~2.1 s).
+ */
+#define UK_SCHED_HIST_BUCKETS		23
+#define UK_SCHED_HIST_SHIFT		10
+
+struct uk_sched_hist {
+	__u64 count[UK_SCHED_HIST_BUCKETS];
+};
+
+/* Lower bound of a histogram bucket in nanoseconds */
+#define uk_sched_hist_bucket_nsec(i)					\
+	((i) ? (__nsec) 1 << ((i) + UK_SCHED_HIST_SHIFT - 1) : (__nsec) 0)
+
+static inline unsigned int uk_sched_hist_bucket(__nsec lat)
+{
+	unsigned int i;
+
+	if (lat < ((__nsec) 1 << UK_SCHED_HIST_SHIFT))
+		return 0;
+	i = (sizeof(unsigned long long) * 8 - 1)
+	    - __builtin_clzll((unsigned long long) lat)
+	    - UK_SCHED_HIST_SHIFT + 1;
+	return MIN(i, UK_SCHED_HIST_BUCKETS - 1U);
+}
+
+struct uk_thread_stats {
+	__nsec ts_runnable;	/**< Time the thread became runnable */
+	__nsec ts_run;		/**< Time the thread was switched in */
+	bool woken;		/**< Became runnable by a wakeup */
+	bool preempted;		/**< Is being preempted */
+	__u64 nr_voluntary;	/**< Blocked or yielded */
+	__u64 nr_involuntary;	/**< Preempted */
+	__nsec wait_time;	/**< Total time runnable but not running */
+	__nsec wait_max;	/**< Longest wait */
+	__nsec wakeup_max;	/**< Longest wakeup-to-run latency */
+};
+
+struct uk_sched_stats {
+	__u64 nr_switches;
+	__u64 nr_voluntary;
+	__u64 nr_involuntary;
+	__nsec idle_time;
+	__nsec wait_max;
+	__nsec wakeup_max;
+	struct uk_sched_hist wait_hist;
+	struct uk_sched_hist wakeup_hist;
+};
+
+/* Marks a thread as runnable from now on */
+static inline void _uk_thread_stats_runnable(struct uk_thread_stats *st,
+					     bool woken)
+{
+	st->ts_runnable = ukplat_monotonic_clock();
+	st->woken = woken;
+}
+
+#define uk_thread_stats_woken(t)					\
+	_uk_thread_stats_runnable(&(t)->stats, true)
+#define uk_thread_stats_added(t)					\
+	_uk_thread_stats_runnable(&(t)->stats, false)
+
+/* Preemptive schedulers mark the switches that they force on a thread */
+#define uk_thread_stats_preempted(t, val)				\
+	do { (t)->stats.preempted = (val); } while (0)
+
+struct uk_sched;
+
+/**
+ * Returns the upper bound of the latency below which `permille` of the
+ * samples of a histogram fall, e.g., 990 for the 99th percentile.
+ * Returns 0 if the histogram is empty.
+ */
+__nsec uk_sched_hist_percentile(const struct uk_sched_hist *h,
+				unsigned int permille);
+
+/**
+ * Prints the latency statistics of a scheduler and its threads
+ *
+ * @param klvl
+ *   Kernel log level
+ * @param s
+ *   Scheduler instance
+ */
+void uk_sched_dumpk_stats(int klvl, struct uk_sched *s);
+
+/* Registers the ukstore object of a scheduler (internal) */
+int _uk_sched_stats_register(struct uk_sched *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#else /* !CONFIG_LIBUKSCHED_STATS */
+
+#define uk_thread_stats_woken(t) do { } while (0)
+#define uk_thread_stats_added(t) do { } while (0)
+#define uk_thread_stats_preempted(t, val) do { } while (0)
+
+#endif /* !CONFIG_LIBUKSCHED_STATS */
+
+#endif /* __UK_SCHED_STATS_H__ */
@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#ifndef __UK_SCHED_STORE_H__
+#define __UK_SCHED_STORE_H__
+
+/* stats entry IDs */
+#define UK_SCHED_STATS_THREAD_CACHE_HITS	0x01
+#define UK_SCHED_STATS_THREAD_CACHE_MISSES	0x02
+#define UK_SCHED_STATS_THREAD_CACHE_LEN		0x03
+
+/* per-scheduler latency stats entry IDs (objects `sched<N>`) */
+#define UK_SCHED_STATS_NR_SWITCHES		0x10
+#define UK_SCHED_STATS_NR_VOLUNTARY		0x11
+#define UK_SCHED_STATS_NR_INVOLUNTARY		0x12
+#define UK_SCHED_STATS_IDLE_TIME		0x13
+#define UK_SCHED_STATS_WAIT_MAX			0x14
+#define UK_SCHED_STATS_WAIT_P50			0x15
+#define UK_SCHED_STATS_WAIT_P99			0x16
+#define UK_SCHED_STATS_WAIT_P999		0x17
+#define UK_SCHED_STATS_WAKEUP_MAX		0x18
+#define UK_SCHED_STATS_WAKEUP_P50		0x19
+#define UK_SCHED_STATS_WAKEUP_P99		0x1a
+#define UK_SCHED_STATS_WAKEUP_P999		0x1b
+
+#endif /* __UK_SCHED_STORE_H__ */
@@ -38,7 +38,9 @@
 #include <uk/plat/tls.h>
 #include <uk/wait_types.h>
 #include <uk/list.h>
+#include <uk/tree.h>
 #include <uk/prio.h>
+#include <uk/sched_stats.h>
 #include <uk/essentials.h>
 
 #ifdef __cplusplus
@@ -46,6 +48,7 @@ extern "C" {
 #endif
 
 struct uk_sched;
+struct uk_thread_list;
 
 typedef void (*uk_thread_dtor_t)(struct uk_thread *);
 typedef void (*uk_thread_gc_t)(struct uk_thread *, void *);
@@ -57,14 +60,23 @@ typedef void (*uk_thread_fn2_t)(void *, void *) __noreturn;
 struct uk_thread {
 	struct ukarch_ctx    ctx;	/**< Architecture context */
 	struct ukarch_ectx *ectx;	/**< Extended context (FPU, VPU, ...) */
+	bool ectx_initial;		/**< `ectx` was not stored because it
+					 *   was in initial configuration
+					 */
 	uintptr_t           tlsp;	/**< Current active TLS pointer */
 	__uptr            uktlsp;	/**< Unikraft TLS pointer */
 	__uptr		   auxsp;	/**< Unikraft Auxiliary Stack Pointer */
 
 	UK_TAILQ_ENTRY(struct uk_thread) queue;
+	UK_RB_ENTRY(uk_thread) queue_link;	/**< Ordered queue entry */
 	uint32_t flags;
 	__snsec wakeup_time;
 	struct uk_sched *sched;
+	__lcpuidx lcpuidx;		/**< Assigned LCPU (scheduler-managed) */
+	bool on_lcpu;			/**< Thread is executing on an LCPU */
+	const void *queue_head;	/**< Queue that `t` is linked into */
+	unsigned int sched_class;	/**< Scheduling class */
+	__nsec sched_vtime;		/**< Fairness key (scheduler-managed) */
 
 	struct {
 		struct uk_alloc *t_a;
@@ -82,6 +94,13 @@ struct uk_thread {
 	void *priv;			/**< Private field, free for use */
 
 	__nsec exec_time;		/**< Time the thread was scheduled */
+#if CONFIG_LIBUKSCHED_STATS
+	struct uk_thread_stats stats;	/**< Scheduling latency statistics */
+#endif /* CONFIG_LIBUKSCHED_STATS */
+#if CONFIG_LIBUKRCU
+	unsigned int rcu_nesting;	/**< RCU read-side nesting depth */
+	unsigned int rcu_blocked;	/**< Switched out in RCU section */
+#endif /* CONFIG_LIBUKRCU */
 	const char *name;		/**< Reference to thread name */
 	UK_TAILQ_ENTRY(struct uk_thread) thread_list;
 };
@@ -155,6 +174,8 @@ struct uk_thread *uk_thread_current(void)
  *  present in the run queue.
  */
 #define UK_THREADF_QUEUEABLE  (0x020)
+/* Thread can be recycled by the scheduler's thread cache */
+#define UK_THREADF_CACHEABLE  (0x040)
 
 #define uk_thread_is_exited(t)   ((t)->flags & UK_THREADF_EXITED)
 #define uk_thread_is_runnable(t) (!uk_thread_is_exited(t) \
@@ -164,14 +185,21 @@ struct uk_thread *uk_thread_current(void)
 				  0x0)
 #define uk_thread_is_queueable(t) ((t)->flags & UK_THREADF_QUEUEABLE)
 
+/* State flags may be changed concurrently from other LCPUs (e.g., by a
+ * wake-up), so they are updated atomically.
+ */
 #define uk_thread_set_runnable(t) \
-	do { (t)->flags |= UK_THREADF_RUNNABLE; } while (0)
+	do { __atomic_fetch_or(&(t)->flags, UK_THREADF_RUNNABLE,	\
+			       __ATOMIC_SEQ_CST); } while (0)
 #define uk_thread_set_blocked(t) \
-	do { (t)->flags &= ~UK_THREADF_RUNNABLE; } while (0)
+	do { __atomic_fetch_and(&(t)->flags, ~UK_THREADF_RUNNABLE,	\
+				__ATOMIC_SEQ_CST); } while (0)
 #define uk_thread_set_queueable(t) \
-	do { (t)->flags |= UK_THREADF_QUEUEABLE; } while (0)
+	do { __atomic_fetch_or(&(t)->flags, UK_THREADF_QUEUEABLE,	\
+			       __ATOMIC_SEQ_CST); } while (0)
 #define uk_thread_clear_queueable(t) \
-	do { (t)->flags &= ~UK_THREADF_QUEUEABLE; } while (0)
+	do { __atomic_fetch_and(&(t)->flags, ~UK_THREADF_QUEUEABLE,	\
+				__ATOMIC_SEQ_CST); } while (0)
 /* NOTE: Setting a thread as EXITED cannot be undone. */
 /* NOTE: Never change the EXIT flag manually. Trnasition to exit state reqiures
  * the terminate funcrtiomns to be called.
@@ -48,9 +48,20 @@ void uk_waitq_entry_init(struct uk_waitq_entry *entry,
 		struct uk_thread *thread)
 {
 	entry->thread = thread;
+	entry->wake = NULL;
 	entry->waiting = 0;
 }
 
+/* Wakes up the waiter of an entry, must be called with `wq->sl` held */
+static inline
+void uk_waitq_entry_wake(struct uk_waitq_entry *entry)
+{
+	if (entry->wake)
+		entry->wake(entry);
+	else
+		uk_thread_wake(entry->thread);
+}
+
 static inline
 int uk_waitq_empty(struct uk_waitq *wq)
 {
@@ -201,7 +212,7 @@ void uk_waitq_wake_up(struct uk_waitq *wq)
 
 	ukplat_spin_lock_irqsave(&(wq->sl), flags);
 	UK_STAILQ_FOREACH_SAFE(curr, &(wq->wait_list), thread_list, tmp)
-		uk_thread_wake(curr->thread);
+		uk_waitq_entry_wake(curr);
 	ukplat_spin_unlock_irqrestore(&(wq->sl), flags);
 }
 
@@ -214,7 +225,7 @@ void uk_waitq_wake_up_one(struct uk_waitq *wq)
 	ukplat_spin_lock_irqsave(&(wq->sl), flags);
 	head = UK_STAILQ_FIRST(&wq->wait_list);
 	if (head)
-		uk_thread_wake(head->thread);
+		uk_waitq_entry_wake(head);
 	ukplat_spin_unlock_irqrestore(&(wq->sl), flags);
 }
 
@@ -33,9 +33,20 @@
 extern "C" {
 #endif
 
+struct uk_waitq_entry;
+
+/* Custom wake-up function of a wait queue entry. It is called with the
+ * spinlock of the wait queue held and must be ISR-safe because wake-ups can
+ * also be issued from interrupt context (see `uk_waitq_wake_up_isr()`).
+ */
+typedef void (*uk_waitq_wake_func_t)(struct uk_waitq_entry *entry);
+
 struct uk_waitq_entry {
 	int waiting;
 	struct uk_thread *thread;
+	uk_waitq_wake_func_t wake;	/**< If set, called instead of waking
+					 *   up `thread`
+					 */
 	UK_STAILQ_ENTRY(struct uk_waitq_entry) thread_list;
 };
 
@@ -59,6 +70,7 @@ struct uk_waitq {
 struct uk_waitq_entry name = { \
 	.waiting      = 0, \
 	.thread       = uk_thread_current(), \
+	.wake         = NULL, \
 	.thread_list  = { NULL } \
 }
 
@@ -42,6 +42,7 @@
 #include <uk/plat/lcpu.h>
 #include <uk/sched.h>
 #include <uk/syscall.h>
+#include "thread_cache.h"
 
 struct uk_sched *uk_sched_head;
 
@@ -64,6 +65,54 @@ int uk_sched_register(struct uk_sched *s)
 	return 0;
 }
 
+/* Takes a thread container from the thread cache or allocates a new one */
+static struct uk_thread *sched_thread_container(struct uk_sched *s,
+						size_t stack_len,
+						size_t auxstack_len,
+						bool no_uktls,
+						bool no_ectx,
+						const char *name,
+						void *priv,
+						uk_thread_dtor_t dtor)
+{
+	struct uk_thread *t;
+#if CONFIG_LIBUKSCHED_THREAD_CACHE
+	bool cacheable = uk_sched_thread_cacheable(stack_len, auxstack_len,
+						   no_uktls, no_ectx);
+
+	if (cacheable) {
+		t = uk_sched_thread_cache_get(s, name, priv, dtor);
+		if (t)
+			return t;
+	}
+#endif /* CONFIG_LIBUKSCHED_THREAD_CACHE */
+
+	t = uk_thread_create_container(s->a,
+				       s->a_stack, stack_len,
+				       s->a_auxstack, auxstack_len,
+				       no_uktls ? NULL : s->a_uktls,
+				       no_ectx,
+				       name,
+				       priv,
+				       dtor);
+#if CONFIG_LIBUKSCHED_THREAD_CACHE
+	if (t && cacheable)
+		t->flags |= UK_THREADF_CACHEABLE;
+#endif /* CONFIG_LIBUKSCHED_THREAD_CACHE */
+	return t;
+}
+
+/* Releases an exited thread or puts it into the thread cache */
+void uk_sched_thread_release(struct uk_sched *s __maybe_unused,
+			     struct uk_thread *t)
+{
+#if CONFIG_LIBUKSCHED_THREAD_CACHE
+	if (uk_sched_thread_cache_put(s, t) == 0)
+		return;
+#endif /* CONFIG_LIBUKSCHED_THREAD_CACHE */
+	uk_thread_release(t);
+}
+
 struct uk_thread *uk_sched_thread_create_fn0(struct uk_sched *s,
 					     uk_thread_fn0_t fn0,
 					     size_t stack_len,
@@ -80,21 +129,16 @@ struct uk_thread *uk_sched_thread_create_fn0(struct uk_sched *s,
 	UK_ASSERT(s);
 	UK_ASSERT(s->a_stack);
 	UK_ASSERT(s->a_auxstack);
+	UK_ASSERT(fn0);
 
 	if (!no_uktls && !s->a_uktls)
 		goto err_out;
 
-	t = uk_thread_create_fn0(s->a,
-				 fn0,
-				 s->a_stack, stack_len,
-				 s->a_auxstack, auxstack_len,
-				 no_uktls ? NULL : s->a_uktls,
-				 no_ectx,
-				 name,
-				 priv,
-				 dtor);
+	t = sched_thread_container(s, stack_len, auxstack_len,
+				   no_uktls, no_ectx, name, priv, dtor);
 	if (!t)
 		goto err_out;
+	uk_thread_container_init_fn0(t, fn0);
 
 	rc = uk_sched_thread_add(s, t);
 	if (rc < 0)
@@ -125,21 +169,16 @@ struct uk_thread *uk_sched_thread_create_fn1(struct uk_sched *s,
 	UK_ASSERT(s);
 	UK_ASSERT(s->a_stack);
 	UK_ASSERT(s->a_auxstack);
+	UK_ASSERT(fn1);
 
 	if (!no_uktls && !s->a_uktls)
 		goto err_out;
 
-	t = uk_thread_create_fn1(s->a,
-				 fn1, argp,
-				 s->a_stack, stack_len,
-				 s->a_auxstack, auxstack_len,
-				 no_uktls ? NULL : s->a_uktls,
-				 no_ectx,
-				 name,
-				 priv,
-				 dtor);
+	t = sched_thread_container(s, stack_len, auxstack_len,
+				   no_uktls, no_ectx, name, priv, dtor);
 	if (!t)
 		goto err_out;
+	uk_thread_container_init_fn1(t, fn1, argp);
 
 	rc = uk_sched_thread_add(s, t);
 	if (rc < 0)
@@ -170,21 +209,16 @@ struct uk_thread *uk_sched_thread_create_fn2(struct uk_sched *s,
 	UK_ASSERT(s);
 	UK_ASSERT(s->a_stack);
 	UK_ASSERT(s->a_auxstack);
+	UK_ASSERT(fn2);
 
 	if (!no_uktls && !s->a_uktls)
 		goto err_out;
 
-	t = uk_thread_create_fn2(s->a,
-				 fn2, argp0, argp1,
-				 s->a_stack, stack_len,
-				 s->a_auxstack, auxstack_len,
-				 no_uktls ? NULL : s->a_uktls,
-				 no_ectx,
-				 name,
-				 priv,
-				 dtor);
+	t = sched_thread_container(s, stack_len, auxstack_len,
+				   no_uktls, no_ectx, name, priv, dtor);
 	if (!t)
 		goto err_out;
+	uk_thread_container_init_fn2(t, fn2, argp0, argp1);
 
 	rc = uk_sched_thread_add(s, t);
 	if (rc < 0)
@@ -234,9 +268,12 @@ int uk_sched_start(struct uk_sched *s)
 
 	/* Set main_thread as current scheduled thread */
 	ukplat_per_lcpu_current(__uk_sched_thread_current) = main_thread;
+	main_thread->on_lcpu = true;
 
 	/* Add main to the scheduler's thread list */
+	ukarch_spin_lock(&s->tl_lock);
 	UK_TAILQ_INSERT_TAIL(&s->thread_list, main_thread, thread_list);
+	ukarch_spin_unlock(&s->tl_lock);
 
 	/* Enable scheduler, like time slicing, etc. and notify that `s`
 	 * has an (already) scheduled thread
@@ -245,10 +282,16 @@ int uk_sched_start(struct uk_sched *s)
 	if (ret < 0)
 		goto err_unset_thread_current;
 	s->is_started = true;
+
+#if CONFIG_LIBUKSCHED_STATS && CONFIG_LIBUKSTORE
+	if (_uk_sched_stats_register(s) < 0)
+		uk_pr_warn("%p: Failed to register scheduler statistics\n", s);
+#endif /* CONFIG_LIBUKSCHED_STATS && CONFIG_LIBUKSTORE */
 	return 0;
 
 err_unset_thread_current:
 	ukplat_per_lcpu_current(__uk_sched_thread_current) = NULL;
+	main_thread->on_lcpu = false;
 	uk_thread_release(main_thread);
 err_out:
 	return ret;
@@ -256,12 +299,26 @@ err_out:
 
 unsigned int uk_sched_thread_gc(struct uk_sched *sched)
 {
-	struct uk_thread *thread, *tmp;
+	struct uk_thread *thread;
+	unsigned long flags;
 	unsigned int num = 0;
 
-	/* Cleanup finished threads */
-	UK_TAILQ_FOREACH_SAFE(thread, &sched->exited_threads,
-			      thread_list, tmp) {
+	/* Cleanup finished threads. On SMP, other logical CPUs may add
+	 * exited threads concurrently, so we detach one thread at a time
+	 * and release it without holding the list lock.
+	 */
+	for (;;) {
+		flags = ukplat_lcpu_save_irqf();
+		ukarch_spin_lock(&sched->tl_lock);
+		thread = UK_TAILQ_FIRST(&sched->exited_threads);
+		if (thread)
+			UK_TAILQ_REMOVE(&sched->exited_threads, thread,
+					thread_list);
+		ukarch_spin_unlock(&sched->tl_lock);
+		ukplat_lcpu_restore_irqf(flags);
+		if (!thread)
+			break;
+
 		UK_ASSERT(thread != uk_thread_current());
 		UK_ASSERT(uk_thread_is_exited(thread));
 
@@ -269,10 +326,9 @@ unsigned int uk_sched_thread_gc(struct uk_sched *sched)
 			    sched, thread,
 			    thread->name ? thread->name : "<unnamed>");
 
-		UK_TAILQ_REMOVE(&sched->exited_threads, thread, thread_list);
 		if (thread->_gc_fn)
 			thread->_gc_fn(thread,  thread->_gc_argp);
-		uk_thread_release(thread);
+		uk_sched_thread_release(sched, thread);
 		++num;
 	}
 
@@ -282,6 +338,7 @@ unsigned int uk_sched_thread_gc(struct uk_sched *sched)
 void uk_sched_thread_terminate(struct uk_thread *thread)
 {
 	struct uk_sched *sched;
+	unsigned long flags;
 
 	UK_ASSERT(thread);
 	 /* NOTE: The following assertion can also fail on a double-termination.
@@ -307,15 +364,19 @@ void uk_sched_thread_terminate(struct uk_thread *thread)
 		uk_pr_debug("%p: thread %p (%s) on gc list\n",
 			    sched, thread, thread->name ?
 					   thread->name : "<unnamed>");
+		flags = ukplat_lcpu_save_irqf();
+		ukarch_spin_lock(&sched->tl_lock);
 		UK_TAILQ_INSERT_TAIL(&sched->exited_threads, thread,
 				     thread_list);
+		ukarch_spin_unlock(&sched->tl_lock);
+		ukplat_lcpu_restore_irqf(flags);
 
 		/* leave this thread */
 		sched->yield(sched); /* we won't return */
 		UK_CRASH("Unexpectedly returned to exited thread %p\n", thread);
 	} else {
 		/* free thread resources immediately */
-		uk_thread_release(thread);
+		uk_sched_thread_release(sched, thread);
 	}
 }
 
@@ -356,13 +417,24 @@ int uk_sched_thread_add(struct uk_sched *s, struct uk_thread *t)
 
 	flags = ukplat_lcpu_save_irqf();
 
-	rc = s->thread_add(s, t);
-	if (rc < 0)
-		goto out;
-
+	/* The thread must be fully set up before the scheduler queues it:
+	 * Another LCPU may pick it up right away and run it until it exits.
+	 */
 	t->sched = s;
+	ukarch_spin_lock(&s->tl_lock);
 	UK_TAILQ_INSERT_TAIL(&s->thread_list, t, thread_list);
-out:
+	ukarch_spin_unlock(&s->tl_lock);
+
+	if (uk_thread_is_runnable(t))
+		uk_thread_stats_added(t);
+	rc = s->thread_add(s, t);
+	if (rc < 0) {
+		ukarch_spin_lock(&s->tl_lock);
+		UK_TAILQ_REMOVE(&s->thread_list, t, thread_list);
+		ukarch_spin_unlock(&s->tl_lock);
+		t->sched = NULL;
+	}
+
 	ukplat_lcpu_restore_irqf(flags);
 	return rc;
 }
@@ -379,7 +451,9 @@ int uk_sched_thread_remove(struct uk_thread *t)
 	s = t->sched;
 	s->thread_remove(s, t);
 	t->sched = NULL;
+	ukarch_spin_lock(&s->tl_lock);
 	UK_TAILQ_REMOVE(&s->thread_list, t, thread_list);
+	ukarch_spin_unlock(&s->tl_lock);
 	ukplat_lcpu_restore_irqf(flags);
 	return 0;
 }
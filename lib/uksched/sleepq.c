@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#include <uk/sched_impl.h>
+
+/* Orders by deadline. Threads with the same deadline are ordered by their
+ * address so that every thread has a unique key in the tree.
+ */
+static inline int sleepq_cmp(struct uk_thread *a, struct uk_thread *b)
+{
+	if (a->wakeup_time != b->wakeup_time)
+		return (a->wakeup_time < b->wakeup_time) ? -1 : 1;
+	if (a != b)
+		return ((__uptr) a < (__uptr) b) ? -1 : 1;
+	return 0;
+}
+
+UK_RB_GENERATE_STATIC(uk_sched_sleep_tree, uk_thread, queue_link, sleepq_cmp);
+
+void uk_sched_sleepq_add(struct uk_sched_sleepq *q, struct uk_thread *t)
+{
+	struct uk_thread *dup __maybe_unused;
+
+	UK_ASSERT(q);
+	UK_ASSERT(t);
+	UK_ASSERT(t->wakeup_time > 0);
+
+	dup = UK_RB_INSERT(uk_sched_sleep_tree, &q->tree, t);
+	UK_ASSERT(!dup);
+
+	if (!q->first || sleepq_cmp(t, q->first) < 0)
+		q->first = t;
+}
+
+void uk_sched_sleepq_remove(struct uk_sched_sleepq *q, struct uk_thread *t)
+{
+	UK_ASSERT(q);
+	UK_ASSERT(t);
+	UK_ASSERT(q->first);
+
+	/* The successor of the earliest thread is found in amortized O(1) */
+	if (t == q->first)
+		q->first = UK_RB_NEXT(uk_sched_sleep_tree, &q->tree, t);
+	UK_RB_REMOVE(uk_sched_sleep_tree, &q->tree, t);
+}
@@ -0,0 +1,235 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#include <stdio.h>
+#include <uk/atomic.h>
+#include <uk/errptr.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/time.h>
+#include <uk/print.h>
+#include <uk/sched_impl.h>
+#include <uk/sched_stats.h>
+#include <uk/sched_store.h>
+#include <uk/store.h>
+
+static inline void stats_max(__nsec *max, __nsec val)
+{
+	__nsec cur = UK_READ_ONCE(*max);
+
+	while (val > cur && !uk_compare_exchange_n(max, &cur, val))
+		;
+}
+
+static inline void stats_hist_add(struct uk_sched_hist *h, __nsec lat)
+{
+	uk_inc(&h->count[uk_sched_hist_bucket(lat)]);
+}
+
+void _uk_sched_stats_switch(struct uk_thread *prev, struct uk_thread *next)
+{
+	struct uk_sched *s = next->sched ? next->sched : prev->sched;
+	const struct uk_thread *idle;
+	__nsec now, lat;
+
+	if (unlikely(!s))
+		return;
+
+	now = ukplat_monotonic_clock();
+	idle = uk_sched_idle_thread(s, ukplat_lcpu_idx());
+	uk_inc(&s->stats.nr_switches);
+
+	if (prev == idle) {
+		if (prev->stats.ts_run)
+			uk_fetch_add(&s->stats.idle_time,
+				     now - prev->stats.ts_run);
+	} else if (prev->stats.preempted) {
+		prev->stats.nr_involuntary++;
+		uk_inc(&s->stats.nr_involuntary);
+		_uk_thread_stats_runnable(&prev->stats, false);
+	} else {
+		/* Blocked or yielded */
+		prev->stats.nr_voluntary++;
+		uk_inc(&s->stats.nr_voluntary);
+		if (uk_thread_is_runnable(prev))
+			_uk_thread_stats_runnable(&prev->stats, false);
+	}
+
+	if (next != idle && next->stats.ts_runnable) {
+		lat = now - next->stats.ts_runnable;
+		next->stats.ts_runnable = 0;
+
+		next->stats.wait_time += lat;
+		if (lat > next->stats.wait_max)
+			next->stats.wait_max = lat;
+		stats_max(&s->stats.wait_max, lat);
+		stats_hist_add(&s->stats.wait_hist, lat);
+
+		if (next->stats.woken) {
+			if (lat > next->stats.wakeup_max)
+				next->stats.wakeup_max = lat;
+			stats_max(&s->stats.wakeup_max, lat);
+			stats_hist_add(&s->stats.wakeup_hist, lat);
+		}
+	}
+	next->stats.ts_run = now;
+}
+
+__nsec uk_sched_hist_percentile(const struct uk_sched_hist *h,
+				unsigned int permille)
+{
+	__u64 total = 0, sum = 0, rank;
+	unsigned int i;
+
+	UK_ASSERT(h);
+	UK_ASSERT(permille <= 1000);
+
+	for (i = 0; i < UK_SCHED_HIST_BUCKETS; i++)
+		total += UK_READ_ONCE(h->count[i]);
+	if (!total)
+		return 0;
+
+	rank = (total * permille + 999) / 1000;
+	for (i = 0; i < UK_SCHED_HIST_BUCKETS - 1; i++) {
+		sum += UK_READ_ONCE(h->count[i]);
+		if (sum >= rank)
+			break;
+	}
+	return uk_sched_hist_bucket_nsec(i + 1);
+}
+
+static void dumpk_hist(int klvl, const char *name,
+		       const struct uk_sched_hist *h)
+{
+	unsigned int i;
+	__u64 cnt;
+
+	uk_printk(klvl, " %s:\n", name);
+	for (i = 0; i < UK_SCHED_HIST_BUCKETS; i++) {
+		cnt = UK_READ_ONCE(h->count[i]);
+		if (!cnt)
+			continue;
+		uk_printk(klvl, "   >= %10"__PRInsec" ns: %"__PRIu64"\n",
+			  uk_sched_hist_bucket_nsec(i), cnt);
+	}
+}
+
+void uk_sched_dumpk_stats(int klvl, struct uk_sched *s)
+{
+	struct uk_thread *t;
+	unsigned long flags;
+
+	UK_ASSERT(s);
+
+	uk_printk(klvl, "sched %p: switches: %"__PRIu64" (voluntary: %"__PRIu64
+		  ", involuntary: %"__PRIu64"), idle: %"__PRInsec" ns\n",
+		  s, s->stats.nr_switches, s->stats.nr_voluntary,
+		  s->stats.nr_involuntary, s->stats.idle_time);
+	uk_printk(klvl, " wait: max %"__PRInsec" ns, p50 %"__PRInsec
+		  " ns, p99 %"__PRInsec" ns, p99.9 %"__PRInsec" ns\n",
+		  s->stats.wait_max,
+		  uk_sched_hist_percentile(&s->stats.wait_hist, 500),
+		  uk_sched_hist_percentile(&s->stats.wait_hist, 990),
+		  uk_sched_hist_percentile(&s->stats.wait_hist, 999));
+	uk_printk(klvl, " wakeup: max %"__PRInsec" ns, p50 %"__PRInsec
+		  " ns, p99 %"__PRInsec" ns, p99.9 %"__PRInsec" ns\n",
+		  s->stats.wakeup_max,
+		  uk_sched_hist_percentile(&s->stats.wakeup_hist, 500),
+		  uk_sched_hist_percentile(&s->stats.wakeup_hist, 990),
+		  uk_sched_hist_percentile(&s->stats.wakeup_hist, 999));
+	dumpk_hist(klvl, "run queue wait time", &s->stats.wait_hist);
+	dumpk_hist(klvl, "wakeup-to-run latency", &s->stats.wakeup_hist);
+
+	flags = ukplat_lcpu_save_irqf();
+	ukarch_spin_lock(&s->tl_lock);
+	uk_sched_foreach_thread(s, t) {
+		uk_printk(klvl,
+			  " + thread %p (%s), switches: %"__PRIu64"/%"__PRIu64
+			  " (vol/invol), wait: %"__PRInsec" ns (max %"__PRInsec
+			  " ns), wakeup max: %"__PRInsec" ns\n",
+			  t, t->name ? t->name : "<unnamed>",
+			  t->stats.nr_voluntary, t->stats.nr_involuntary,
+			  t->stats.wait_time, t->stats.wait_max,
+			  t->stats.wakeup_max);
+	}
+	ukarch_spin_unlock(&s->tl_lock);
+	ukplat_lcpu_restore_irqf(flags);
+}
+
+#if CONFIG_LIBUKSTORE
+#define SCHED_STATS_GETTER(entry, expr)					\
+	static int get_##entry(void *cookie, __u64 *out)		\
+	{								\
+		struct uk_sched *s = (struct uk_sched *) cookie;	\
+									\
+		UK_ASSERT(s);						\
+		*out = (__u64) (expr);					\
+		return 0;						\
+	}
+
+SCHED_STATS_GETTER(nr_switches, UK_READ_ONCE(s->stats.nr_switches))
+SCHED_STATS_GETTER(nr_voluntary, UK_READ_ONCE(s->stats.nr_voluntary))
+SCHED_STATS_GETTER(nr_involuntary, UK_READ_ONCE(s->stats.nr_involuntary))
+SCHED_STATS_GETTER(idle_time, UK_READ_ONCE(s->stats.idle_time))
+SCHED_STATS_GETTER(wait_max, UK_READ_ONCE(s->stats.wait_max))
+SCHED_STATS_GETTER(wait_p50,
+		   uk_sched_hist_percentile(&s->stats.wait_hist, 500))
+SCHED_STATS_GETTER(wait_p99,
+		   uk_sched_hist_percentile(&s->stats.wait_hist, 990))
+SCHED_STATS_GETTER(wait_p999,
+		   uk_sched_hist_percentile(&s->stats.wait_hist, 999))
+SCHED_STATS_GETTER(wakeup_max, UK_READ_ONCE(s->stats.wakeup_max))
+SCHED_STATS_GETTER(wakeup_p50,
+		   uk_sched_hist_percentile(&s->stats.wakeup_hist, 500))
+SCHED_STATS_GETTER(wakeup_p99,
+		   uk_sched_hist_percentile(&s->stats.wakeup_hist, 990))
+SCHED_STATS_GETTER(wakeup_p999,
+		   uk_sched_hist_percentile(&s->stats.wakeup_hist, 999))
+
+static const struct uk_store_entry *dyn_entries[] = {
+	UK_STORE_ENTRY(UK_SCHED_STATS_NR_SWITCHES, "nr_switches", u64,
+		       get_nr_switches, NULL),
+	UK_STORE_ENTRY(UK_SCHED_STATS_NR_VOLUNTARY, "nr_voluntary", u64,
+		       get_nr_voluntary, NULL),
+	UK_STORE_ENTRY(UK_SCHED_STATS_NR_INVOLUNTARY, "nr_involuntary", u64,
+		       get_nr_involuntary, NULL),
+	UK_STORE_ENTRY(UK_SCHED_STATS_IDLE_TIME, "idle_time_ns", u64,
+		       get_idle_time, NULL),
+	UK_STORE_ENTRY(UK_SCHED_STATS_WAIT_MAX, "wait_max_ns", u64,
+		       get_wait_max, NULL),
+	UK_STORE_ENTRY(UK_SCHED_STATS_WAIT_P50, "wait_p50_ns", u64,
+		       get_wait_p50, NULL),
+	UK_STORE_ENTRY(UK_SCHED_STATS_WAIT_P99, "wait_p99_ns", u64,
+		       get_wait_p99, NULL),
+	UK_STORE_ENTRY(UK_SCHED_STATS_WAIT_P999, "wait_p999_ns", u64,
+		       get_wait_p999, NULL),
+	UK_STORE_ENTRY(UK_SCHED_STATS_WAKEUP_MAX, "wakeup_max_ns", u64,
+		       get_wakeup_max, NULL),
+	UK_STORE_ENTRY(UK_SCHED_STATS_WAKEUP_P50, "wakeup_p50_ns", u64,
+		       get_wakeup_p50, NULL),
+	UK_STORE_ENTRY(UK_SCHED_STATS_WAKEUP_P99, "wakeup_p99_ns", u64,
+		       get_wakeup_p99, NULL),
+	UK_STORE_ENTRY(UK_SCHED_STATS_WAKEUP_P999, "wakeup_p999_ns", u64,
+		       get_wakeup_p999, NULL),
+	NULL
+};
+
+int _uk_sched_stats_register(struct uk_sched *s)
+{
+	static unsigned int sched_id;
+	struct uk_store_object *obj;
+	char obj_name[16];
+
+	UK_ASSERT(s);
+
+	snprintf(obj_name, sizeof(obj_name), "sched%u", sched_id);
+	obj = uk_store_obj_alloc(s->a, sched_id, obj_name,
+				 dyn_entries, (void *) s);
+	if (PTRISERR(obj))
+		return PTR2ERR(obj);
+	sched_id++;
+
+	return uk_store_obj_add(obj);
+}
+#endif /* CONFIG_LIBUKSTORE */
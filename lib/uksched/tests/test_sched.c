@@ -0,0 +1,393 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <uk/test.h>
+#include <uk/sched.h>
+#include <uk/sched_idlepoll.h>
+#include <uk/sched_idlework.h>
+#include <uk/sched_impl.h>
+#include <uk/thread.h>
+#include <uk/print.h>
+#include <uk/plat/time.h>
+#include <uk/arch/time.h>
+
+#define pr_info(fmt, ...)						\
+	_uk_printk(KLVL_INFO, uk_libid_self(), __NULL, 0x0, fmt,	\
+		   ##__VA_ARGS__)
+
+#define ORDER_THREADS		8
+#define ORDER_STEP		ukarch_time_msec_to_nsec(2)
+
+#define BENCH_SWITCHES		10000
+#define BENCH_SLEEP		(3600 * UKARCH_NSEC_PER_SEC)
+
+struct order_args {
+	__nsec sleep;
+	unsigned int *pos;
+	unsigned int *order;
+	unsigned int id;
+};
+
+/* Threads report their completion through a counter: An exited thread may
+ * be released by the scheduler at any time (e.g., by the garbage collector
+ * of ukschedsmp), so it must not be accessed anymore.
+ */
+static unsigned int threads_done;
+
+static void thread_done(void)
+{
+	__atomic_fetch_add(&threads_done, 1, __ATOMIC_RELEASE);
+}
+
+/* Waits until `nr` threads called thread_done() and resets the counter */
+static void wait_threads(unsigned int nr)
+{
+	while (__atomic_load_n(&threads_done, __ATOMIC_ACQUIRE) < nr)
+		uk_sched_yield();
+	threads_done = 0;
+}
+
+static __noreturn void order_func(void *arg)
+{
+	struct order_args *args = (struct order_args *)arg;
+
+	uk_sched_thread_sleep(args->sleep);
+	/* Threads on other LCPUs may wake up at the same time */
+	args->order[__atomic_fetch_add(args->pos, 1, __ATOMIC_RELAXED)] =
+		args->id;
+	thread_done();
+	uk_sched_thread_exit();
+}
+
+/* Threads that went to sleep in reverse deadline order must be woken up
+ * in deadline order.
+ */
+UK_TESTCASE(uksched, test_sleep_queue_order)
+{
+	struct order_args args[ORDER_THREADS];
+	struct uk_thread *t[ORDER_THREADS];
+	unsigned int order[ORDER_THREADS];
+	unsigned int pos = 0;
+	unsigned int i;
+
+	for (i = 0; i < ORDER_THREADS; i++) {
+		args[i].sleep = (ORDER_THREADS - i) * ORDER_STEP;
+		args[i].pos = &pos;
+		args[i].order = order;
+		args[i].id = i;
+		t[i] = uk_sched_thread_create(uk_sched_current(), order_func,
+					      &args[i], "sleepq-order");
+		UK_TEST_ASSERT(t[i] != NULL);
+	}
+
+	wait_threads(ORDER_THREADS);
+
+	UK_TEST_EXPECT_SNUM_EQ(pos, ORDER_THREADS);
+	for (i = 0; i < ORDER_THREADS; i++)
+		UK_TEST_EXPECT_SNUM_EQ(order[i], ORDER_THREADS - 1 - i);
+}
+
+static __noreturn void sleeper_func(void *arg __unused)
+{
+	uk_sched_thread_sleep(BENCH_SLEEP);
+	thread_done();
+	uk_sched_thread_exit();
+}
+
+static __noreturn void yielder_func(void *arg)
+{
+	unsigned int i;
+
+	for (i = 0; i < *(unsigned int *)arg; i++)
+		uk_sched_yield();
+	thread_done();
+	uk_sched_thread_exit();
+}
+
+/* Measures the cost of a context switch between two runnable threads while
+ * an increasing number of threads is parked in a timed sleep. With an
+ * ordered sleep queue, the switch latency stays flat.
+ */
+UK_TESTCASE(uksched, test_switch_latency_sleepers)
+{
+	static const unsigned int nr_sleepers[] = { 0, 16, 64, 256 };
+	static struct uk_thread *sleepers[256];
+	unsigned int switches = BENCH_SWITCHES;
+	struct uk_thread *yielder;
+	__nsec start, elapsed;
+	unsigned int n, i, j;
+
+	for (i = 0; i < ARRAY_SIZE(nr_sleepers); i++) {
+		for (n = 0; n < nr_sleepers[i]; n++) {
+			sleepers[n] = uk_sched_thread_create(uk_sched_current(),
+							     sleeper_func,
+							     NULL, "sleeper");
+			if (!sleepers[n])
+				break;
+		}
+
+		/* Let all sleepers enter the sleep queue */
+		uk_sched_yield();
+
+		yielder = uk_sched_thread_create(uk_sched_current(),
+						 yielder_func, &switches,
+						 "yielder");
+		UK_TEST_ASSERT(yielder != NULL);
+
+		start = ukplat_monotonic_clock();
+		for (j = 0; j < switches; j++)
+			uk_sched_yield();
+		elapsed = ukplat_monotonic_clock() - start;
+		wait_threads(1);
+
+		pr_info("sleepers: %4u, switch latency: %"__PRInsec" ns\n", n,
+			elapsed / (2 * switches));
+
+		for (j = 0; j < n; j++) {
+			UK_TEST_EXPECT(!uk_thread_is_exited(sleepers[j]));
+			uk_thread_wake(sleepers[j]);
+		}
+		wait_threads(n);
+
+		/* Stop scaling if we ran out of memory */
+		if (n < nr_sleepers[i])
+			break;
+	}
+}
+
+#define ECTX_ROUNDS		1000
+
+/* Keeps a value in a vector register across a yield. Compiled code does not
+ * preserve vector registers across calls and the scheduler code is very
+ * unlikely to use the last one, so the value only survives if the context
+ * switch stores and restores the extended context.
+ */
+static unsigned long fpu_yield(unsigned long val)
+{
+#if CONFIG_ARCH_X86_64
+	__asm__ __volatile__("movq %0, %%xmm15" : : "r" (val) : "xmm15");
+	uk_sched_yield();
+	__asm__ __volatile__("movq %%xmm15, %0" : "=r" (val));
+#elif CONFIG_ARCH_ARM_64
+	__asm__ __volatile__("fmov d31, %0" : : "r" (val) : "v31");
+	uk_sched_yield();
+	__asm__ __volatile__("fmov %0, d31" : "=r" (val));
+#else /* !CONFIG_ARCH_X86_64 && !CONFIG_ARCH_ARM_64 */
+	uk_sched_yield();
+#endif /* !CONFIG_ARCH_X86_64 && !CONFIG_ARCH_ARM_64 */
+	return val;
+}
+
+static __noreturn void fpu_func(void *arg)
+{
+	unsigned long errors = 0;
+	unsigned long val;
+	unsigned int i;
+
+	for (i = 0; i < ECTX_ROUNDS; i++) {
+		val = 0x5a5a5a5a5a5a5a5aUL ^ ((unsigned long)i << 17);
+		if (fpu_yield(val) != val)
+			errors++;
+	}
+	*(unsigned long *)arg = errors;
+	thread_done();
+	uk_sched_thread_exit();
+}
+
+static __noreturn void int_func(void *arg)
+{
+	volatile unsigned long acc = 0;
+	unsigned int i;
+
+	for (i = 0; i < ECTX_ROUNDS; i++) {
+		acc += i;
+		uk_sched_yield();
+	}
+	*(unsigned long *)arg = acc;
+	thread_done();
+	uk_sched_thread_exit();
+}
+
+/* Threads whose extended context is in initial configuration are switched
+ * without storing it. Interleaving them with a thread that uses the FPU
+ * must not corrupt the FPU thread's registers.
+ */
+UK_TESTCASE(uksched, test_ectx_preserved)
+{
+	struct uk_thread *tf, *ti[2];
+	unsigned long isum[2] = { 0, 0 };
+	unsigned long ferrors = ~0UL;
+	unsigned int i;
+
+	tf = uk_sched_thread_create(uk_sched_current(), fpu_func, &ferrors,
+				    "ectx-fpu");
+	UK_TEST_ASSERT(tf != NULL);
+	for (i = 0; i < ARRAY_SIZE(ti); i++) {
+		ti[i] = uk_sched_thread_create(uk_sched_current(), int_func,
+					       &isum[i], "ectx-int");
+		UK_TEST_ASSERT(ti[i] != NULL);
+	}
+
+	wait_threads(1 + ARRAY_SIZE(ti));
+
+	UK_TEST_EXPECT_ZERO(ferrors);
+	for (i = 0; i < ARRAY_SIZE(ti); i++)
+		UK_TEST_EXPECT_SNUM_EQ(isum[i],
+				       ECTX_ROUNDS * (ECTX_ROUNDS - 1) / 2);
+}
+
+#if CONFIG_LIBUKSCHED_THREAD_CACHE
+#define CACHE_GC_ROUNDS		1000
+
+static __thread int cache_tls = 42;
+
+static __noreturn void cache_func(void *arg)
+{
+	*(int *)arg = cache_tls;
+	cache_tls = 7;
+	thread_done();
+	uk_sched_thread_exit();
+}
+
+/* A garbage collected thread is handed out again with a fresh TLS */
+UK_TESTCASE(uksched, test_thread_cache_recycle)
+{
+	struct uk_sched *s = uk_sched_current();
+	struct uk_thread *t1, *t2;
+	unsigned int i;
+	__u64 hits;
+	int val = 0;
+
+	t1 = uk_sched_thread_create(s, cache_func, &val, "cache-1");
+	UK_TEST_ASSERT(t1 != NULL);
+	wait_threads(1);
+	UK_TEST_EXPECT_SNUM_EQ(val, 42);
+
+	/* The thread may still be exiting on another LCPU. Only its address
+	 * is compared, it must not be accessed after it exited.
+	 */
+	for (i = 0; i < CACHE_GC_ROUNDS; i++) {
+		uk_sched_thread_gc(s);
+		if (UK_TAILQ_FIRST(&s->thread_cache) == t1)
+			break;
+		uk_sched_yield();
+	}
+
+	hits = s->thread_cache_hits;
+	val = 0;
+	t2 = uk_sched_thread_create(s, cache_func, &val, "cache-2");
+	UK_TEST_ASSERT(t2 != NULL);
+	UK_TEST_EXPECT_PTR_EQ(t2, t1);
+	UK_TEST_EXPECT_SNUM_EQ(s->thread_cache_hits, hits + 1);
+	wait_threads(1);
+	UK_TEST_EXPECT_SNUM_EQ(val, 42);
+}
+#endif /* CONFIG_LIBUKSCHED_THREAD_CACHE */
+
+#if CONFIG_LIBUKSCHED_STATS
+/* Yielding and sleeping are voluntary switches, only preemptions are
+ * involuntary. Threads that are switched in are sampled in the wait time
+ * histogram.
+ */
+UK_TESTCASE(uksched, test_sched_stats)
+{
+	struct uk_sched *s = uk_sched_current();
+	struct uk_thread *self = uk_thread_current();
+	unsigned int switches = 16;
+	struct uk_thread *yielder;
+	__u64 invol, vol, samples = 0;
+	unsigned int i;
+
+	invol = self->stats.nr_involuntary;
+	vol = self->stats.nr_voluntary;
+
+	yielder = uk_sched_thread_create(s, yielder_func, &switches,
+					 "stats-yielder");
+	UK_TEST_ASSERT(yielder != NULL);
+	for (i = 0; i < switches; i++)
+		uk_sched_yield();
+	wait_threads(1);
+	uk_sched_thread_sleep(ukarch_time_msec_to_nsec(1));
+
+#if !CONFIG_HAVE_SMP && !CONFIG_LIBUKSCHEDPREEMPT
+	/* Every yield switched to the yielder, plus the sleep. On SMP, the
+	 * yielder may be stolen so that yields do not switch.
+	 */
+	UK_TEST_EXPECT_SNUM_EQ(self->stats.nr_involuntary - invol, 0);
+	UK_TEST_EXPECT(self->stats.nr_voluntary - vol >= switches + 1);
+#else /* CONFIG_HAVE_SMP || CONFIG_LIBUKSCHEDPREEMPT */
+	UK_TEST_EXPECT(self->stats.nr_involuntary >= invol);
+	UK_TEST_EXPECT(self->stats.nr_voluntary > vol);
+#endif /* CONFIG_HAVE_SMP || CONFIG_LIBUKSCHEDPREEMPT */
+	for (i = 0; i < UK_SCHED_HIST_BUCKETS; i++)
+		samples += s->stats.wait_hist.count[i];
+	UK_TEST_EXPECT(samples > 0);
+	UK_TEST_EXPECT(uk_sched_hist_percentile(&s->stats.wait_hist, 999)
+		       > 0);
+
+	uk_sched_dumpk_stats(KLVL_INFO, s);
+}
+#endif /* CONFIG_LIBUKSCHED_STATS */
+
+#if CONFIG_LIBUKSCHED_IDLEPOLL
+static int idlepoll_count(void *arg)
+{
+	(*(unsigned int *)arg)++;
+	return 0;
+}
+
+/* Short idle periods open the polling window so that the idle thread calls
+ * registered pollers before halting.
+ */
+UK_TESTCASE(uksched, test_idlepoll)
+{
+	unsigned int calls = 0;
+	struct uk_sched_idlepoll p = {
+		.poll = idlepoll_count,
+		.arg = &calls,
+	};
+	unsigned int i;
+
+	uk_sched_idlepoll_register(&p);
+	for (i = 0; i < 64; i++)
+		uk_sched_thread_sleep(ukarch_time_usec_to_nsec(20));
+	uk_sched_idlepoll_unregister(&p);
+
+	UK_TEST_EXPECT(calls > 0);
+}
+#endif /* CONFIG_LIBUKSCHED_IDLEPOLL */
+
+#if CONFIG_LIBUKSCHED_IDLEWORK
+static int idlework_steps(void *arg)
+{
+	unsigned int *steps = (unsigned int *)arg;
+
+	/* Report more work until the countdown expires */
+	if (*steps == 0)
+		return 0;
+	return --(*steps) > 0;
+}
+
+/* The idle thread runs registered work until no work is left */
+UK_TESTCASE(uksched, test_idlework)
+{
+	unsigned int steps = 8;
+	struct uk_sched_idlework w = {
+		.work = idlework_steps,
+		.arg = &steps,
+	};
+	unsigned int i;
+
+	uk_sched_idlework_register(&w);
+	for (i = 0; i < 64 && steps > 0; i++)
+		uk_sched_thread_sleep(ukarch_time_usec_to_nsec(20));
+	uk_sched_idlework_unregister(&w);
+
+	UK_TEST_EXPECT_SNUM_EQ(steps, 0);
+}
+#endif /* CONFIG_LIBUKSCHED_IDLEWORK */
+
+uk_testsuite_register(uksched, NULL);
@@ -45,6 +45,7 @@
 #include <uk/assert.h>
 #include <uk/arch/tls.h>
 #include <uk/plat/memory.h>
+#include "thread_cache.h"
 
 #if CONFIG_LIBUKSCHED_TCB_INIT && !CONFIG_UKARCH_TLS_HAVE_TCB
 #error CONFIG_LIBUKSCHED_TCB_INIT requires that a TLS contains reserved space for a TCB
@@ -225,7 +226,7 @@ void uk_thread_set_exited(struct uk_thread *t)
 		return;
 
 	_uk_thread_call_termtab(t);
-	t->flags |= UK_THREADF_EXITED;
+	__atomic_fetch_or(&t->flags, UK_THREADF_EXITED, __ATOMIC_SEQ_CST);
 }
 
 static void _uk_thread_struct_init(struct uk_thread *t,
@@ -521,6 +522,87 @@ void _uk_thread_struct_free_alloc(struct uk_thread *t)
 	}
 }
 
+#if CONFIG_LIBUKSCHED_THREAD_CACHE
+/** Like `uk_thread_release()` but keeps `struct uk_thread` together with
+ *  its stack, auxiliary stack and TLS for `_uk_thread_container_reinit()`
+ */
+void _uk_thread_container_fini(struct uk_thread *t)
+{
+	UK_ASSERT(t);
+	UK_ASSERT(t != uk_thread_current());
+	UK_ASSERT(!t->sched); /* Thread must be disconnected from scheduler */
+
+	uk_thread_set_exited(t);
+
+#if CONFIG_LIBUKSCHED_TCB_INIT
+	if (t->_mem.uktls_a && t->_mem.uktls)
+		uk_thread_uktcb_fini(t, uk_thread_uktcb(t));
+#endif /* CONFIG_LIBUKSCHED_TCB_INIT */
+	if (t->dtor)
+		t->dtor(t);
+}
+
+/** Turns a thread that was finalized with `_uk_thread_container_fini()`
+ *  into a fresh container (see `uk_thread_create_container()`). On failure,
+ *  all memory associated with the thread is released.
+ */
+int _uk_thread_container_reinit(struct uk_thread *t,
+				size_t stack_len,
+				size_t auxstack_len,
+				const char *name,
+				void *priv,
+				uk_thread_dtor_t dtor)
+{
+	__typeof__(t->_mem) mem;
+	struct ukarch_ectx *ectx;
+	int rc;
+
+	UK_ASSERT(t);
+	UK_ASSERT(uk_thread_is_exited(t));
+	UK_ASSERT(t->_mem.stack && t->_mem.auxstack && t->_mem.uktls);
+
+	/* `_uk_thread_struct_init()` clears the whole struct */
+	mem = t->_mem;
+	ectx = t->ectx;
+
+	_uk_thread_struct_init(t,
+			       ukarch_gen_sp(mem.auxstack, auxstack_len),
+			       ukarch_tls_tlsp(mem.uktls), true, ectx,
+			       name, priv, dtor);
+	t->_mem = mem;
+
+	/* Start with a pristine copy of the TLS template */
+	ukarch_tls_area_init(mem.uktls);
+#if CONFIG_LIBUKSCHED_TCB_INIT
+	rc = uk_thread_uktcb_init(t, uk_thread_uktcb(t));
+	if (rc < 0)
+		goto err_free;
+#endif /* CONFIG_LIBUKSCHED_TCB_INIT */
+
+	ukarch_ctx_init_bare(&t->ctx, ukarch_gen_sp(mem.stack, stack_len),
+			     0x0);
+
+	rc = _uk_thread_call_inittab(t);
+	if (rc < 0) {
+		_uk_thread_struct_free_alloc(t);
+		if (mem.t_a)
+			uk_free(mem.t_a, t);
+		return rc;
+	}
+	return 0;
+
+#if CONFIG_LIBUKSCHED_TCB_INIT
+err_free:
+	uk_free(mem.uktls_a, mem.uktls);
+	uk_free(mem.stack_a, mem.stack);
+	uk_free(mem.auxstack_a, mem.auxstack);
+	if (mem.t_a)
+		uk_free(mem.t_a, t);
+	return rc;
+#endif /* CONFIG_LIBUKSCHED_TCB_INIT */
+}
+#endif /* CONFIG_LIBUKSCHED_THREAD_CACHE */
+
 int uk_thread_init_fn0(struct uk_thread *t,
 		       uk_thread_fn0_t fn,
 		       struct uk_alloc *a_stack,
@@ -1075,6 +1157,7 @@ void uk_thread_wake(struct uk_thread *thread)
 	flags = ukplat_lcpu_save_irqf();
 	if (!uk_thread_is_runnable(thread)) {
 		uk_thread_set_runnable(thread);
+		uk_thread_stats_woken(thread);
 		if (thread->sched)
 			uk_sched_thread_woken(thread);
 	}
@@ -0,0 +1,119 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#include <errno.h>
+#include <uk/plat/lcpu.h>
+#include <uk/sched_impl.h>
+#include <uk/sched_store.h>
+#include <uk/store.h>
+#include "thread_cache.h"
+
+struct uk_thread *uk_sched_thread_cache_get(struct uk_sched *s,
+					    const char *name,
+					    void *priv,
+					    uk_thread_dtor_t dtor)
+{
+	struct uk_thread *t;
+	unsigned long flags;
+
+	UK_ASSERT(s);
+
+	flags = ukplat_lcpu_save_irqf();
+	ukarch_spin_lock(&s->tl_lock);
+	t = UK_TAILQ_FIRST(&s->thread_cache);
+	if (t) {
+		UK_TAILQ_REMOVE(&s->thread_cache, t, thread_list);
+		s->thread_cache_len--;
+		s->thread_cache_hits++;
+	} else {
+		s->thread_cache_misses++;
+	}
+	ukarch_spin_unlock(&s->tl_lock);
+	ukplat_lcpu_restore_irqf(flags);
+
+	if (!t)
+		return NULL;
+
+	if (_uk_thread_container_reinit(t, STACK_SIZE, AUXSTACK_SIZE,
+					name, priv, dtor) < 0)
+		return NULL;
+
+	t->flags |= UK_THREADF_CACHEABLE;
+	return t;
+}
+
+int uk_sched_thread_cache_put(struct uk_sched *s, struct uk_thread *t)
+{
+	unsigned long flags;
+
+	UK_ASSERT(s);
+	UK_ASSERT(t);
+
+	if (!(t->flags & UK_THREADF_CACHEABLE))
+		return -EINVAL;
+
+	/* Reserve a slot first: once the thread is finalized, it can only be
+	 * freed but not released anymore.
+	 */
+	flags = ukplat_lcpu_save_irqf();
+	ukarch_spin_lock(&s->tl_lock);
+	if (s->thread_cache_len >= CONFIG_LIBUKSCHED_THREAD_CACHE_MAX) {
+		ukarch_spin_unlock(&s->tl_lock);
+		ukplat_lcpu_restore_irqf(flags);
+		return -ENOSPC;
+	}
+	s->thread_cache_len++;
+	ukarch_spin_unlock(&s->tl_lock);
+	ukplat_lcpu_restore_irqf(flags);
+
+	_uk_thread_container_fini(t);
+
+	/* Most recently used threads are reused first: their stacks are
+	 * likely still cached.
+	 */
+	flags = ukplat_lcpu_save_irqf();
+	ukarch_spin_lock(&s->tl_lock);
+	UK_TAILQ_INSERT_HEAD(&s->thread_cache, t, thread_list);
+	ukarch_spin_unlock(&s->tl_lock);
+	ukplat_lcpu_restore_irqf(flags);
+
+	return 0;
+}
+
+static int get_thread_cache_hits(void *cookie __unused, __u64 *out)
+{
+	struct uk_sched *s;
+
+	*out = 0;
+	for (s = uk_sched_head; s; s = s->next)
+		*out += s->thread_cache_hits;
+	return 0;
+}
+UK_STORE_STATIC_ENTRY(UK_SCHED_STATS_THREAD_CACHE_HITS, thread_cache_hits,
+		      u64, get_thread_cache_hits, NULL);
+
+static int get_thread_cache_misses(void *cookie __unused, __u64 *out)
+{
+	struct uk_sched *s;
+
+	*out = 0;
+	for (s = uk_sched_head; s; s = s->next)
+		*out += s->thread_cache_misses;
+	return 0;
+}
+UK_STORE_STATIC_ENTRY(UK_SCHED_STATS_THREAD_CACHE_MISSES, thread_cache_misses,
+		      u64, get_thread_cache_misses, NULL);
+
+static int get_thread_cache_len(void *cookie __unused, __u64 *out)
+{
+	struct uk_sched *s;
+
+	*out = 0;
+	for (s = uk_sched_head; s; s = s->next)
+		*out += s->thread_cache_len;
+	return 0;
+}
+UK_STORE_STATIC_ENTRY(UK_SCHED_STATS_THREAD_CACHE_LEN, thread_cache_len,
+		      u64, get_thread_cache_len, NULL);
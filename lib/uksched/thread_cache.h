@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#ifndef __UK_SCHED_THREAD_CACHE_H__
+#define __UK_SCHED_THREAD_CACHE_H__
+
+#include <uk/config.h>
+#include <uk/plat/config.h>
+#include <uk/sched.h>
+
+#if CONFIG_LIBUKSCHED_THREAD_CACHE
+/* Threads are only recycled if they have default-sized stacks, a Unikraft
+ * TLS and an extended context so that a cached thread fits any request.
+ */
+#define uk_sched_thread_cacheable(stack_len, auxstack_len, no_uktls, no_ectx) \
+	(((stack_len) == 0 || (stack_len) == STACK_SIZE)		\
+	 && ((auxstack_len) == 0 || (auxstack_len) == AUXSTACK_SIZE)	\
+	 && !(no_uktls) && !(no_ectx))
+
+/* Returns a recycled thread container (see `uk_thread_create_container()`)
+ * or NULL if the cache is empty.
+ */
+struct uk_thread *uk_sched_thread_cache_get(struct uk_sched *s,
+					    const char *name,
+					    void *priv,
+					    uk_thread_dtor_t dtor);
+
+/* Puts an exited thread into the cache instead of releasing it.
+ * Returns 0 on success, or a negative error code if the thread must be
+ * released by the caller.
+ */
+int uk_sched_thread_cache_put(struct uk_sched *s, struct uk_thread *t);
+
+void _uk_thread_container_fini(struct uk_thread *t);
+int _uk_thread_container_reinit(struct uk_thread *t,
+				size_t stack_len,
+				size_t auxstack_len,
+				const char *name,
+				void *priv,
+				uk_thread_dtor_t dtor);
+#endif /* CONFIG_LIBUKSCHED_THREAD_CACHE */
+
+#endif /* __UK_SCHED_THREAD_CACHE_H__ */
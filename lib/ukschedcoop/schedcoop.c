@@ -41,7 +41,7 @@
 static void schedcoop_schedule(struct uk_sched *s)
 {
 	struct schedcoop *c = uksched2schedcoop(s);
-	struct uk_thread *prev, *next, *thread, *tmp;
+	struct uk_thread *prev, *next, *thread;
 	__snsec now, min_wakeup_time;
 	unsigned long flags;
 
@@ -65,19 +65,17 @@ static void schedcoop_schedule(struct uk_sched *s)
 	prev->exec_time += now - c->ts_prev_switch;
 	c->ts_prev_switch = now;
 
-	/* Examine all sleeping threads.
-	 * Wake up expired ones and find the time when the next timeout expires.
+	/* Wake up expired threads and find the time when the next timeout
+	 * expires. The sleep queue is ordered by wakeup time, so only expired
+	 * threads and the earliest pending one are visited.
 	 */
 	min_wakeup_time = 0;
-	UK_TAILQ_FOREACH_SAFE(thread, &c->sleep_queue,
-			      queue, tmp) {
-		if (likely(thread->wakeup_time)) {
-			if (thread->wakeup_time <= now)
-				uk_thread_wake(thread);
-			else if (!min_wakeup_time
-				 || thread->wakeup_time < min_wakeup_time)
-				min_wakeup_time = thread->wakeup_time;
+	while ((thread = uk_sched_sleepq_first(&c->sleep_queue))) {
+		if (thread->wakeup_time > now) {
+			min_wakeup_time = thread->wakeup_time;
+			break;
 		}
+		uk_thread_wake(thread);
 	}
 
 	next = UK_TAILQ_FIRST(&c->run_queue);
@@ -144,10 +142,12 @@ static void schedcoop_thread_remove(struct uk_sched *s, struct uk_thread *t)
 {
 	struct schedcoop *c = uksched2schedcoop(s);
 
-	/* Remove from run_queue */
+	/* Remove from run_queue or sleep_queue */
 	if (t != uk_thread_current()
 	    && uk_thread_is_runnable(t))
 		UK_TAILQ_REMOVE(&c->run_queue, t, queue);
+	else if (!uk_thread_is_runnable(t) && t->wakeup_time > 0)
+		uk_sched_sleepq_remove(&c->sleep_queue, t);
 }
 
 static void schedcoop_thread_blocked(struct uk_sched *s, struct uk_thread *t)
@@ -159,9 +159,18 @@ static void schedcoop_thread_blocked(struct uk_sched *s, struct uk_thread *t)
 	if (t != uk_thread_current())
 		UK_TAILQ_REMOVE(&c->run_queue, t, queue);
 	if (t->wakeup_time > 0)
-		UK_TAILQ_INSERT_TAIL(&c->sleep_queue, t, queue);
+		uk_sched_sleepq_add(&c->sleep_queue, t);
 }
 
+#if CONFIG_LIBUKSCHED_IDLEPOLL || CONFIG_LIBUKSCHED_IDLEWORK
+static int schedcoop_idle_ready(void *argp)
+{
+	struct schedcoop *c = (struct schedcoop *) argp;
+
+	return UK_TAILQ_FIRST(&c->run_queue) != NULL;
+}
+#endif /* CONFIG_LIBUKSCHED_IDLEPOLL || CONFIG_LIBUKSCHED_IDLEWORK */
+
 static __noreturn void idle_thread_fn(void *argp)
 {
 	struct schedcoop *c = (struct schedcoop *) argp;
@@ -201,6 +210,25 @@ static __noreturn void idle_thread_fn(void *argp)
 		now = ukplat_monotonic_clock();
 
 		if (!wake_up_time || wake_up_time > now) {
+#if CONFIG_LIBUKSCHED_IDLEWORK
+			/* Do background work before polling or halting */
+			if (uk_sched_idlework(wake_up_time,
+					      schedcoop_idle_ready, c)) {
+				ukplat_lcpu_restore_irqf(flags);
+				schedcoop_schedule(&c->sched);
+				continue;
+			}
+#endif /* CONFIG_LIBUKSCHED_IDLEWORK */
+#if CONFIG_LIBUKSCHED_IDLEPOLL
+			/* Spin for a while before halting the CPU */
+			if (uk_sched_idlepoll(&c->idlepoll, wake_up_time,
+					      schedcoop_idle_ready, c)) {
+				ukplat_lcpu_restore_irqf(flags);
+				schedcoop_schedule(&c->sched);
+				continue;
+			}
+#endif /* CONFIG_LIBUKSCHED_IDLEPOLL */
+
 			if (wake_up_time)
 				ukplat_lcpu_halt_irq_until(wake_up_time);
 			else
@@ -208,6 +236,9 @@ static __noreturn void idle_thread_fn(void *argp)
 
 			/* handle pending events if any */
 			ukplat_lcpu_irqs_handle_pending();
+#if CONFIG_LIBUKSCHED_IDLEPOLL
+			uk_sched_idlepoll_update(&c->idlepoll);
+#endif /* CONFIG_LIBUKSCHED_IDLEPOLL */
 		}
 
 		ukplat_lcpu_restore_irqf(flags);
@@ -269,7 +300,7 @@ struct uk_sched *uk_schedcoop_create(struct uk_alloc *a,
 		goto err_out;
 
 	UK_TAILQ_INIT(&c->run_queue);
-	UK_TAILQ_INIT(&c->sleep_queue);
+	uk_sched_sleepq_init(&c->sleep_queue);
 
 	/* Create idle thread */
 	rc = uk_thread_init_fn1(&c->idle,
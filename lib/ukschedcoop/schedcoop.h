@@ -6,16 +6,22 @@
 #ifndef __UK_SCHEDCOOP_SCHEDCOOP_H__
 #define __UK_SCHEDCOOP_SCHEDCOOP_H__
 
+#include <uk/sched_idlepoll.h>
+#include <uk/sched_idlework.h>
+#include <uk/sched_impl.h>
 #include <uk/schedcoop.h>
 
 struct schedcoop {
 	struct uk_sched sched;
 	struct uk_thread_list run_queue;
-	struct uk_thread_list sleep_queue;
+	struct uk_sched_sleepq sleep_queue;
 
 	struct uk_thread idle;
 	__nsec idle_return_time;
 	__nsec ts_prev_switch;
+#if CONFIG_LIBUKSCHED_IDLEPOLL
+	struct uk_sched_idlepoll_window idlepoll;
+#endif /* CONFIG_LIBUKSCHED_IDLEPOLL */
 };
 
 static inline struct schedcoop *uksched2schedcoop(struct uk_sched *s)
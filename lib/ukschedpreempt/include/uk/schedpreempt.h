@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UK_SCHEDPREEMPT_H__
+#define __UK_SCHEDPREEMPT_H__
+
+#include <uk/sched.h>
+#include <uk/alloc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Priority classes. A runnable thread of a lower class number always
+ * preempts threads of higher class numbers. Threads start in
+ * `UK_SCHEDPREEMPT_CLASS_LATENCY`.
+ */
+#define UK_SCHEDPREEMPT_CLASS_LATENCY	0 /**< Latency-critical threads */
+#define UK_SCHEDPREEMPT_CLASS_BATCH	1 /**< Throughput-oriented threads */
+#define UK_SCHEDPREEMPT_CLASS_COUNT	2
+
+/**
+ * Creates a preemptive scheduler instance for the boot logical CPU.
+ * Only one instance can be created.
+ *
+ * @param a
+ *   Allocator for the scheduler and thread structures
+ * @param sa
+ *   Allocator for thread stacks
+ * @param auxsa
+ *   Allocator for auxiliary stacks
+ * @param tls_a
+ *   Allocator for TLS areas
+ * @return
+ *   - (NULL): Allocation failed or an instance exists already
+ *   - Reference to the scheduler instance
+ */
+struct uk_sched *uk_schedpreempt_create(struct uk_alloc *a,
+					struct uk_alloc *sa,
+					struct uk_alloc *auxsa,
+					struct uk_alloc *tls_a);
+
+/**
+ * Moves a thread to another priority class. The change takes effect
+ * immediately, also for runnable threads.
+ *
+ * @param t
+ *   Thread that is managed by the preemptive scheduler
+ * @param cls
+ *   Priority class (`UK_SCHEDPREEMPT_CLASS_*`)
+ * @return
+ *   - (0): Success
+ *   - (-EINVAL): Invalid class or thread not managed by this scheduler
+ */
+int uk_schedpreempt_thread_set_class(struct uk_thread *t, unsigned int cls);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UK_SCHEDPREEMPT_H__ */
@@ -0,0 +1,216 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#include <uk/arch/ctx.h>
+#include <uk/arch/lcpu.h>
+#include <uk/atomic.h>
+#include <uk/event.h>
+#include <uk/intctlr.h>
+#include <uk/isr/thread.h>
+#include <uk/plat/common/_time.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/time.h>
+#include <uk/preempt.h>
+#include "schedpreempt.h"
+
+unsigned int uk_preempt_count;
+
+struct schedpreempt *schedpreempt_instance;
+
+static inline int runq_cmp(struct uk_thread *a, struct uk_thread *b)
+{
+	if (a->sched_vtime != b->sched_vtime)
+		return (a->sched_vtime < b->sched_vtime) ? -1 : 1;
+	if (a != b)
+		return ((__uptr) a < (__uptr) b) ? -1 : 1;
+	return 0;
+}
+
+UK_RB_GENERATE_STATIC(schedpreempt_runq, uk_thread, queue_link, runq_cmp);
+
+void schedpreempt_runq_add(struct schedpreempt *c, struct uk_thread *t)
+{
+	struct schedpreempt_class *cls;
+	struct uk_thread *dup __maybe_unused;
+
+	UK_ASSERT(t->sched_class < UK_SCHEDPREEMPT_CLASS_COUNT);
+
+	cls = &c->cls[t->sched_class];
+
+	/* Threads that were not runnable for a while must not monopolize the
+	 * CPU by catching up with the time they missed.
+	 */
+	if (t->sched_vtime < cls->min_vtime)
+		t->sched_vtime = cls->min_vtime;
+
+	dup = UK_RB_INSERT(schedpreempt_runq, &cls->runq, t);
+	UK_ASSERT(!dup);
+
+	if (!cls->first || runq_cmp(t, cls->first) < 0)
+		cls->first = t;
+}
+
+void schedpreempt_runq_remove(struct schedpreempt *c, struct uk_thread *t)
+{
+	struct schedpreempt_class *cls;
+
+	UK_ASSERT(t->sched_class < UK_SCHEDPREEMPT_CLASS_COUNT);
+
+	cls = &c->cls[t->sched_class];
+	UK_ASSERT(cls->first);
+
+	if (t == cls->first) {
+		cls->first = UK_RB_NEXT(schedpreempt_runq, &cls->runq, t);
+		if (t->sched_vtime > cls->min_vtime)
+			cls->min_vtime = t->sched_vtime;
+	}
+	UK_RB_REMOVE(schedpreempt_runq, &cls->runq, t);
+}
+
+struct uk_thread *schedpreempt_runq_first(struct schedpreempt *c)
+{
+	unsigned int i;
+
+	for (i = 0; i < UK_SCHEDPREEMPT_CLASS_COUNT; i++)
+		if (c->cls[i].first)
+			return c->cls[i].first;
+	return NULL;
+}
+
+__snsec schedpreempt_wake_expired(struct schedpreempt *c, __snsec now)
+{
+	struct uk_thread *thread;
+
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	while ((thread = uk_sched_sleepq_first(&c->sleep_queue))) {
+		if (thread->wakeup_time > now)
+			return thread->wakeup_time;
+		uk_thread_wake_isr(thread);
+	}
+	return 0;
+}
+
+void schedpreempt_arm(struct schedpreempt *c)
+{
+	struct uk_thread *sleeper;
+	__snsec alarm = c->slice_end;
+
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	sleeper = uk_sched_sleepq_first(&c->sleep_queue);
+	if (sleeper && sleeper->wakeup_time < alarm)
+		alarm = sleeper->wakeup_time;
+	time_set_alarm(alarm);
+}
+
+void schedpreempt_thread_woken_isr(struct uk_sched *s, struct uk_thread *t)
+{
+	struct schedpreempt *c = uksched2schedpreempt(s);
+	struct uk_thread *current;
+
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	if (t->wakeup_time > 0)
+		uk_sched_sleepq_remove(&c->sleep_queue, t);
+	if (uk_thread_is_queueable(t) && uk_thread_is_runnable(t)) {
+		schedpreempt_runq_add(c, t);
+		uk_thread_clear_queueable(t);
+
+		/* Raise the timer right away so that a thread of a higher
+		 * class preempts the current one without waiting for the
+		 * end of the time slice.
+		 */
+		current = uk_thread_current();
+		if (s->is_started && current != &c->idle
+		    && t->sched_class < current->sched_class)
+			time_set_alarm(0);
+	}
+}
+
+/* Called by `schedpreempt_preempt_entry` on the stack of the interrupted
+ * thread. The extended context is saved here because the scheduler code
+ * that runs before the context switch may clobber it.
+ */
+void schedpreempt_preempt(void)
+{
+	__sz ectx_align = ukarch_ectx_align();
+	__u8 ectxbuf[ukarch_ectx_size() + ectx_align];
+	struct ukarch_ectx *ectx = (struct ukarch_ectx *)
+		ALIGN_UP((__uptr) ectxbuf, ectx_align);
+
+	ukarch_ectx_init(ectx);
+	uk_thread_stats_preempted(uk_thread_current(), true);
+	uk_sched_yield();
+	uk_thread_stats_preempted(uk_thread_current(), false);
+	ukarch_ectx_load(ectx);
+}
+
+static bool schedpreempt_need_resched(struct schedpreempt *c,
+				      struct uk_thread *current, __snsec now)
+{
+	struct uk_thread *next;
+
+	next = schedpreempt_runq_first(c);
+	if (!next)
+		return false;
+	if (next->sched_class < current->sched_class)
+		return true;
+	return (next->sched_class == current->sched_class
+		&& now >= (__snsec) c->slice_end);
+}
+
+/* Divert the interrupted thread to `schedpreempt_preempt_entry` on return
+ * from the interrupt. The interrupted instruction pointer is pushed to the
+ * thread's stack as return address of the entry.
+ */
+static void schedpreempt_redirect(struct __regs *regs)
+{
+	__uptr sp = ukarch_regs_get_sp(regs);
+
+	sp = ukarch_rstack_push(sp, (__uptr) ukarch_regs_get_pc(regs));
+	ukarch_regs_set_sp(sp, regs);
+	ukarch_regs_set_pc((__uptr) schedpreempt_preempt_entry, regs);
+}
+
+static int schedpreempt_irq_handler(void *arg)
+{
+	struct uk_intctlr_event_irq_data *data = arg;
+	struct schedpreempt *c = schedpreempt_instance;
+	struct uk_thread *current;
+	__snsec now;
+
+	if (!c || !c->sched.is_started || data->irq != ukplat_time_get_irq())
+		return UK_EVENT_NOT_HANDLED;
+
+	now = ukplat_monotonic_clock();
+	schedpreempt_wake_expired(c, now);
+
+	/* The idle thread calls the scheduler after every interrupt */
+	current = uk_thread_current();
+	if (!current || current == &c->idle)
+		return UK_EVENT_NOT_HANDLED;
+
+	if (!schedpreempt_need_resched(c, current, now)) {
+		/* Nobody is waiting for the CPU: start a new slice */
+		if (now >= (__snsec) c->slice_end)
+			c->slice_end = now + SCHEDPREEMPT_SLICE_NSEC;
+		schedpreempt_arm(c);
+		return UK_EVENT_NOT_HANDLED;
+	}
+
+	if (c->preempt_pending || UK_READ_ONCE(uk_preempt_count)) {
+		time_set_alarm(now + SCHEDPREEMPT_RETRY_NSEC);
+		return UK_EVENT_NOT_HANDLED;
+	}
+
+	schedpreempt_redirect(data->regs);
+	c->preempt_pending = true;
+
+	/* Let the platform timer handler acknowledge the interrupt */
+	return UK_EVENT_NOT_HANDLED;
+}
+
+UK_EVENT_HANDLER(UK_INTCTLR_EVENT_IRQ, schedpreempt_irq_handler);
@@ -0,0 +1,367 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+/*
+ * Preemptive scheduler for a single logical CPU. Runnable threads are kept
+ * in one run queue per priority class, ordered by their virtual execution
+ * time (`sched_vtime`). The thread with the least vtime of the highest
+ * non-empty class runs next.
+ *
+ * Preemption: The platform timer is armed for the end of the current time
+ * slice. The timer interrupt handler (see isr.c) checks if the current
+ * thread has to give up the CPU and, if so, diverts it on return from the
+ * interrupt to an entry that calls the scheduler like a voluntary yield.
+ * The scheduler itself switches contexts with interrupts disabled so that a
+ * thread can never be preempted while it is being switched.
+ */
+#include <errno.h>
+#include <uk/plat/config.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/time.h>
+#include <uk/sched_impl.h>
+#include <uk/schedpreempt.h>
+#include <uk/essentials.h>
+#include <uk/print.h>
+#include "schedpreempt.h"
+
+static void schedpreempt_schedule(struct uk_sched *s)
+{
+	struct schedpreempt *c = uksched2schedpreempt(s);
+	struct uk_thread *prev, *next;
+	__snsec now, min_wakeup_time;
+	unsigned long flags;
+	__nsec delta;
+
+	if (unlikely(ukplat_lcpu_irqs_disabled()))
+		UK_CRASH("Must not call %s with IRQs disabled\n", __func__);
+
+	prev = uk_thread_current();
+	flags = ukplat_lcpu_save_irqf();
+	now = ukplat_monotonic_clock();
+
+	/* Update execution time of current thread */
+	delta = now - c->ts_prev_switch;
+	prev->exec_time += delta;
+	prev->sched_vtime += delta;
+	c->ts_prev_switch = now;
+	c->preempt_pending = false;
+
+	min_wakeup_time = schedpreempt_wake_expired(c, now);
+
+	next = schedpreempt_runq_first(c);
+	if (next && (prev == &c->idle
+		     || !uk_thread_is_runnable(prev)
+		     || uk_thread_is_exited(prev)
+		     || next->sched_class <= prev->sched_class)) {
+		UK_ASSERT(next != prev);
+		UK_ASSERT(uk_thread_is_runnable(next));
+		UK_ASSERT(!uk_thread_is_exited(next));
+		schedpreempt_runq_remove(c, next);
+
+		/* Put previous thread back into its run queue */
+		if ((prev != &c->idle)
+		    && uk_thread_is_runnable(prev)
+		    && !uk_thread_is_exited(prev))
+			schedpreempt_runq_add(c, prev);
+	} else if (uk_thread_is_runnable(prev)
+		   && !uk_thread_is_exited(prev)) {
+		next = prev;
+	} else {
+		/*
+		 * Schedule idle thread that will halt the CPU
+		 * We select the idle thread only if we do not have anything
+		 * else to execute
+		 */
+		c->idle_return_time = min_wakeup_time;
+		next = &c->idle;
+	}
+
+	/* The idle thread programs the timer for its halt by itself */
+	if (next != &c->idle) {
+		c->slice_end = now + SCHEDPREEMPT_SLICE_NSEC;
+		schedpreempt_arm(c);
+	}
+
+	if (next != prev) {
+		/*
+		 * Queueable is used to cover the case when during a
+		 * context switch, the thread that is about to be
+		 * evacuated is interrupted and woken up.
+		 */
+		uk_thread_set_queueable(prev);
+		uk_thread_clear_queueable(next);
+
+		/* Interrupts stay disabled until `next` is fully switched in.
+		 * New threads enable them in `schedpreempt_thread_start`.
+		 */
+		uk_sched_thread_switch(next);
+	}
+
+	ukplat_lcpu_restore_irqf(flags);
+}
+
+static int schedpreempt_thread_add(struct uk_sched *s, struct uk_thread *t)
+{
+	struct schedpreempt *c = uksched2schedpreempt(s);
+
+	UK_ASSERT(t);
+	UK_ASSERT(!uk_thread_is_exited(t));
+
+	if (t->sched_class >= UK_SCHEDPREEMPT_CLASS_COUNT)
+		return -EINVAL;
+
+	/* Threads that did not run yet start with interrupts enabled */
+	if (t != uk_thread_current()) {
+		ukarch_rctx_stackpush_packed(&t->ctx, t->ctx.ip);
+		t->ctx.ip = (__uptr) schedpreempt_thread_start;
+	}
+
+	/* New threads are not favored over existing ones */
+	t->sched_vtime = c->cls[t->sched_class].min_vtime;
+
+	/* Add to run queue if runnable */
+	if (uk_thread_is_runnable(t) && t != uk_thread_current())
+		schedpreempt_runq_add(c, t);
+
+	return 0;
+}
+
+static void schedpreempt_thread_remove(struct uk_sched *s, struct uk_thread *t)
+{
+	struct schedpreempt *c = uksched2schedpreempt(s);
+
+	/* Remove from run queue or sleep queue */
+	if (t != uk_thread_current()
+	    && uk_thread_is_runnable(t))
+		schedpreempt_runq_remove(c, t);
+	else if (!uk_thread_is_runnable(t) && t->wakeup_time > 0)
+		uk_sched_sleepq_remove(&c->sleep_queue, t);
+}
+
+static void schedpreempt_thread_blocked(struct uk_sched *s,
+					struct uk_thread *t)
+{
+	struct schedpreempt *c = uksched2schedpreempt(s);
+
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	if (t != uk_thread_current())
+		schedpreempt_runq_remove(c, t);
+	if (t->wakeup_time > 0)
+		uk_sched_sleepq_add(&c->sleep_queue, t);
+}
+
+int uk_schedpreempt_thread_set_class(struct uk_thread *t, unsigned int cls)
+{
+	struct schedpreempt *c = schedpreempt_instance;
+	unsigned long flags;
+	bool queued;
+
+	UK_ASSERT(t);
+
+	if (unlikely(cls >= UK_SCHEDPREEMPT_CLASS_COUNT))
+		return -EINVAL;
+	if (unlikely(!c || t->sched != &c->sched || t == &c->idle))
+		return -EINVAL;
+
+	flags = ukplat_lcpu_save_irqf();
+	queued = (t != uk_thread_current() && uk_thread_is_runnable(t));
+	if (queued)
+		schedpreempt_runq_remove(c, t);
+	t->sched_class = cls;
+	t->sched_vtime = c->cls[cls].min_vtime;
+	if (queued)
+		schedpreempt_runq_add(c, t);
+	ukplat_lcpu_restore_irqf(flags);
+
+	/* Give up the CPU if a thread of a higher class is waiting now */
+	if (t == uk_thread_current())
+		uk_sched_yield();
+
+	return 0;
+}
+
+#if CONFIG_LIBUKSCHED_IDLEPOLL || CONFIG_LIBUKSCHED_IDLEWORK
+static int schedpreempt_idle_ready(void *argp)
+{
+	struct schedpreempt *c = (struct schedpreempt *) argp;
+
+	return schedpreempt_runq_first(c) != NULL;
+}
+#endif /* CONFIG_LIBUKSCHED_IDLEPOLL || CONFIG_LIBUKSCHED_IDLEWORK */
+
+static __noreturn void idle_thread_fn(void *argp)
+{
+	struct schedpreempt *c = (struct schedpreempt *) argp;
+	__nsec now, wake_up_time;
+	unsigned long flags;
+
+	UK_ASSERT(c);
+
+	/* We are entered for the first time with IRQs disabled */
+	ukplat_lcpu_enable_irq();
+
+	for (;;) {
+		flags = ukplat_lcpu_save_irqf();
+
+		/*
+		 * FIXME: We assume that `uk_sched_thread_gc()` is non-blocking.
+		 *        This assumption may not be true depending on the
+		 *        destructor functions that are assigned to the threads
+		 *        and are called by `uk_sched_thred_gc()`.
+		 * NOTE:  This idle thread must be non-blocking so that the
+		 *        scheduler has always something to schedule.
+		 */
+		if (uk_sched_thread_gc(&c->sched) > 0 ||
+		    schedpreempt_runq_first(c)) {
+			ukplat_lcpu_restore_irqf(flags);
+			schedpreempt_schedule(&c->sched);
+
+			continue;
+		}
+
+		/* Read return time set by last schedule operation */
+		wake_up_time = (volatile __nsec) c->idle_return_time;
+		now = ukplat_monotonic_clock();
+
+		if (!wake_up_time || wake_up_time > now) {
+#if CONFIG_LIBUKSCHED_IDLEWORK
+			/* Do background work before polling or halting */
+			if (uk_sched_idlework(wake_up_time,
+					      schedpreempt_idle_ready, c)) {
+				ukplat_lcpu_restore_irqf(flags);
+				schedpreempt_schedule(&c->sched);
+				continue;
+			}
+#endif /* CONFIG_LIBUKSCHED_IDLEWORK */
+#if CONFIG_LIBUKSCHED_IDLEPOLL
+			/* Spin for a while before halting the CPU */
+			if (uk_sched_idlepoll(&c->idlepoll, wake_up_time,
+					      schedpreempt_idle_ready, c)) {
+				ukplat_lcpu_restore_irqf(flags);
+				schedpreempt_schedule(&c->sched);
+				continue;
+			}
+#endif /* CONFIG_LIBUKSCHED_IDLEPOLL */
+
+			if (wake_up_time)
+				ukplat_lcpu_halt_irq_until(wake_up_time);
+			else
+				ukplat_lcpu_halt_irq();
+
+			/* handle pending events if any */
+			ukplat_lcpu_irqs_handle_pending();
+#if CONFIG_LIBUKSCHED_IDLEPOLL
+			uk_sched_idlepoll_update(&c->idlepoll);
+#endif /* CONFIG_LIBUKSCHED_IDLEPOLL */
+		}
+
+		ukplat_lcpu_restore_irqf(flags);
+
+		/* try to schedule a thread that might now be available */
+		schedpreempt_schedule(&c->sched);
+	}
+}
+
+static int schedpreempt_start(struct uk_sched *s,
+			      struct uk_thread *main_thread __maybe_unused)
+{
+	struct schedpreempt *c = uksched2schedpreempt(s);
+
+	UK_ASSERT(main_thread);
+	UK_ASSERT(main_thread->sched == s);
+	UK_ASSERT(uk_thread_is_runnable(main_thread));
+	UK_ASSERT(!uk_thread_is_exited(main_thread));
+	UK_ASSERT(uk_thread_current() == main_thread);
+
+	/* Since we are now starting to schedule, we save the current timestamp
+	 * as the start time for the first time slice.
+	 */
+	c->ts_prev_switch = ukplat_monotonic_clock();
+	c->slice_end = c->ts_prev_switch + SCHEDPREEMPT_SLICE_NSEC;
+	schedpreempt_arm(c);
+
+	/* NOTE: We do not put `main_thread` into the thread list.
+	 *       Current running threads will be added as soon as
+	 *       a different thread is scheduled.
+	 */
+
+	ukplat_lcpu_enable_irq();
+
+	return 0;
+}
+
+static const struct uk_thread *schedpreempt_idle_thread(struct uk_sched *s,
+							unsigned int proc_id)
+{
+	struct schedpreempt *c = uksched2schedpreempt(s);
+
+	/* NOTE: We only support one processing LCPU */
+	if (proc_id > 0)
+		return NULL;
+
+	return &(c->idle);
+}
+
+struct uk_sched *uk_schedpreempt_create(struct uk_alloc *a,
+					struct uk_alloc *sa,
+					struct uk_alloc *auxsa,
+					struct uk_alloc *tls_a)
+{
+	struct schedpreempt *c = NULL;
+	unsigned int i;
+	int rc;
+
+	if (unlikely(schedpreempt_instance)) {
+		uk_pr_err("Only one preemptive scheduler is supported\n");
+		goto err_out;
+	}
+
+	uk_pr_info("Initializing preemptive scheduler\n");
+	c = uk_zalloc(a, sizeof(struct schedpreempt));
+	if (!c)
+		goto err_out;
+
+	for (i = 0; i < UK_SCHEDPREEMPT_CLASS_COUNT; i++)
+		UK_RB_INIT(&c->cls[i].runq);
+	uk_sched_sleepq_init(&c->sleep_queue);
+
+	/* Create idle thread */
+	rc = uk_thread_init_fn1(&c->idle,
+				idle_thread_fn, (void *) c,
+				sa, STACK_SIZE,
+				auxsa, AUXSTACK_SIZE,
+				a, false,
+				NULL,
+				"idle",
+				NULL,
+				NULL);
+	if (rc < 0)
+		goto err_free_c;
+
+	c->idle.sched = &c->sched;
+
+	uk_sched_init(&c->sched,
+			schedpreempt_start,
+			schedpreempt_schedule,
+			schedpreempt_thread_add,
+			schedpreempt_thread_remove,
+			schedpreempt_thread_blocked,
+			schedpreempt_thread_woken_isr,
+			schedpreempt_thread_woken_isr,
+			schedpreempt_idle_thread,
+			a, sa, auxsa, tls_a);
+
+	/* Add idle thread to the scheduler's thread list */
+	UK_TAILQ_INSERT_TAIL(&c->sched.thread_list, &c->idle, thread_list);
+
+	schedpreempt_instance = c;
+	return &c->sched;
+
+err_free_c:
+	uk_free(a, c);
+err_out:
+	return NULL;
+}
@@ -0,0 +1,79 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#ifndef __UK_SCHEDPREEMPT_SCHEDPREEMPT_H__
+#define __UK_SCHEDPREEMPT_SCHEDPREEMPT_H__
+
+#include <uk/arch/time.h>
+#include <uk/sched_idlepoll.h>
+#include <uk/sched_idlework.h>
+#include <uk/sched_impl.h>
+#include <uk/schedpreempt.h>
+
+#define SCHEDPREEMPT_SLICE_NSEC \
+	ukarch_time_msec_to_nsec(CONFIG_LIBUKSCHEDPREEMPT_SLICE_MS)
+
+/* Retry delay when a preemption is deferred (e.g., `uk_preempt_disable()`) */
+#define SCHEDPREEMPT_RETRY_NSEC	ukarch_time_msec_to_nsec(1)
+
+UK_RB_HEAD(schedpreempt_runq, uk_thread);
+
+/* Runnable threads of one priority class, ordered by `sched_vtime` */
+struct schedpreempt_class {
+	struct schedpreempt_runq runq;
+	struct uk_thread *first;	/**< Thread with smallest vtime */
+	__nsec min_vtime;		/**< Monotonic vtime floor of the class */
+};
+
+struct schedpreempt {
+	struct uk_sched sched;
+	struct schedpreempt_class cls[UK_SCHEDPREEMPT_CLASS_COUNT];
+	struct uk_sched_sleepq sleep_queue;
+
+	struct uk_thread idle;
+	__nsec idle_return_time;
+	__nsec ts_prev_switch;
+	__nsec slice_end;		/**< End of the current time slice */
+	bool preempt_pending;		/**< Preemption entry is in flight */
+#if CONFIG_LIBUKSCHED_IDLEPOLL
+	struct uk_sched_idlepoll_window idlepoll;
+#endif /* CONFIG_LIBUKSCHED_IDLEPOLL */
+};
+
+/* There can only be one instance because the timer IRQ is global */
+extern struct schedpreempt *schedpreempt_instance;
+
+static inline struct schedpreempt *uksched2schedpreempt(struct uk_sched *s)
+{
+	UK_ASSERT(s);
+
+	return __containerof(s, struct schedpreempt, sched);
+}
+
+void schedpreempt_runq_add(struct schedpreempt *c, struct uk_thread *t);
+void schedpreempt_runq_remove(struct schedpreempt *c, struct uk_thread *t);
+
+/* Returns the next thread to run: the thread with the smallest vtime of the
+ * highest non-empty priority class. The thread is not removed.
+ */
+struct uk_thread *schedpreempt_runq_first(struct schedpreempt *c);
+
+/* Wakes up expired sleepers and returns the next sleeper deadline (0 if
+ * there is no sleeper).
+ */
+__snsec schedpreempt_wake_expired(struct schedpreempt *c, __snsec now);
+
+/* Programs the timer for the end of the time slice or the next sleeper
+ * deadline, whichever comes first.
+ */
+void schedpreempt_arm(struct schedpreempt *c);
+
+void schedpreempt_thread_woken_isr(struct uk_sched *s, struct uk_thread *t);
+
+/* Assembly entry points (arch/) */
+void schedpreempt_thread_start(void);
+void schedpreempt_preempt_entry(void);
+
+#endif /* __UK_SCHEDPREEMPT_SCHEDPREEMPT_H__ */
@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UK_SCHEDSMP_H__
+#define __UK_SCHEDSMP_H__
+
+#include <uk/sched.h>
+#include <uk/alloc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Creates a cooperative scheduler instance that manages all logical CPUs of
+ * the system. Each logical CPU gets its own run queue and idle thread.
+ * The secondary logical CPUs are started with `uk_sched_start()`.
+ *
+ * @param a
+ *   Allocator for the scheduler and thread structures
+ * @param sa
+ *   Allocator for thread stacks
+ * @param auxsa
+ *   Allocator for auxiliary stacks
+ * @param tls_a
+ *   Allocator for TLS areas
+ * @return
+ *   - (NULL): Allocation failed
+ *   - Reference to the scheduler instance
+ */
+struct uk_sched *uk_schedsmp_create(struct uk_alloc *a,
+				    struct uk_alloc *sa,
+				    struct uk_alloc *auxsa,
+				    struct uk_alloc *tls_a);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UK_SCHEDSMP_H__ */
@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#include "schedsmp.h"
+
+void schedsmp_lcpu_kick(struct schedsmp *c __maybe_unused,
+			struct schedsmp_lcpu *l __maybe_unused)
+{
+#if CONFIG_HAVE_SMP
+	__lcpuidx idx = schedsmp_lcpu_idx(c, l);
+	unsigned int num = 1;
+
+	if (idx == ukplat_lcpu_idx() || !UK_READ_ONCE(l->halted))
+		return;
+
+	ukplat_lcpu_wakeup(&idx, &num);
+#endif /* CONFIG_HAVE_SMP */
+}
+
+void schedsmp_thread_woken_isr(struct uk_sched *s, struct uk_thread *t)
+{
+	struct schedsmp *c = uksched2schedsmp(s);
+	struct schedsmp_lcpu *l;
+	bool kick = false;
+
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	l = schedsmp_thread_lock(c, t);
+	if (t->queue_head == &l->sleep_queue)
+		schedsmp_dequeue(l, t);
+	if (uk_thread_is_queueable(t) && uk_thread_is_runnable(t)
+	    && !t->queue_head) {
+		schedsmp_runq_add(l, t);
+		uk_thread_clear_queueable(t);
+		kick = true;
+	}
+	ukarch_spin_unlock(&l->lock);
+
+	if (kick)
+		schedsmp_lcpu_kick(c, l);
+}
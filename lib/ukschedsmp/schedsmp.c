@@ -0,0 +1,692 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+/*
+ * Cooperative Round-Robin scheduler for multiple logical CPUs. Every LCPU
+ * has its own run queue, sleep queue and idle thread. Threads are created on
+ * the LCPU that creates them; idle LCPUs steal runnable threads from busy
+ * ones. Whenever work is queued while an LCPU halts in its idle thread, the
+ * LCPU is woken up with the platform wakeup IPI.
+ *
+ * Locking: Each LCPU queue is protected by its own spinlock which is always
+ * taken with IRQs disabled. A thread is only ever linked into the queues of
+ * the LCPU given by `uk_thread->lcpuidx`, which only changes while the
+ * respective queue locks are held. At most two queue locks are held at the
+ * same time: while stealing, the victim's lock is only try-locked.
+ */
+#include <string.h>
+#include <uk/plat/config.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/memory.h>
+#include <uk/plat/time.h>
+#include <uk/sched_impl.h>
+#include <uk/schedsmp.h>
+#include <uk/essentials.h>
+#include <uk/print.h>
+#include "schedsmp.h"
+
+/* LCPU startup stacks are only used until the LCPU switched to its idle
+ * thread
+ */
+#define SCHEDSMP_BOOTSTACK_SIZE	(__PAGE_SIZE * 4)
+
+#if CONFIG_HAVE_SMP
+/* Secondary LCPUs enter the scheduler without arguments */
+static struct schedsmp *schedsmp_instance;
+#endif /* CONFIG_HAVE_SMP */
+
+/* Wakes up a sleeping thread from within the scheduler while holding the
+ * queue lock of `l`. Equivalent to `uk_thread_wake()` and the woken callback.
+ */
+static inline void schedsmp_wake_locked(struct schedsmp_lcpu *l,
+					struct uk_thread *t)
+{
+	schedsmp_dequeue(l, t);
+	t->wakeup_time = 0LL;
+	uk_thread_set_runnable(t);
+	uk_thread_stats_woken(t);
+	if (uk_thread_is_queueable(t)) {
+		schedsmp_runq_add(l, t);
+		uk_thread_clear_queueable(t);
+	}
+}
+
+/* Wake up expired threads and find the time when the next timeout expires.
+ * The sleep queue is ordered by wakeup time, so only expired threads and the
+ * earliest pending one are visited.
+ */
+static __snsec schedsmp_wake_expired(struct schedsmp_lcpu *l, __snsec now)
+{
+	struct uk_thread *thread;
+	__snsec min_wakeup_time = 0;
+
+	while ((thread = uk_sched_sleepq_first(&l->sleep_queue))) {
+		if (thread->wakeup_time > now) {
+			min_wakeup_time = thread->wakeup_time;
+			break;
+		}
+		schedsmp_wake_locked(l, thread);
+	}
+
+	return min_wakeup_time;
+}
+
+/* Wakes up a halted LCPU so that it can steal the work that is queued on the
+ * current LCPU
+ */
+static void schedsmp_kick_idle(struct schedsmp *c __maybe_unused)
+{
+#if CONFIG_LIBUKSCHEDSMP_STEAL
+	struct schedsmp_lcpu *l;
+	__lcpuidx i;
+
+	for (i = 0; i < c->lcpu_count; i++) {
+		l = schedsmp_lcpu_get(c, i);
+		if (UK_READ_ONCE(l->halted)) {
+			schedsmp_lcpu_kick(c, l);
+			return;
+		}
+	}
+#endif /* CONFIG_LIBUKSCHEDSMP_STEAL */
+}
+
+#if CONFIG_LIBUKSCHEDSMP_STEAL
+/* Moves up to half of the queued threads of another LCPU to `l`. Must be
+ * called with the lock of `l` held.
+ *
+ * @return
+ *   Number of stolen threads
+ */
+static unsigned int schedsmp_steal(struct schedsmp *c,
+				   struct schedsmp_lcpu *l)
+{
+	__lcpuidx self = schedsmp_lcpu_idx(c, l);
+	struct schedsmp_lcpu *v;
+	struct uk_thread *t, *tmp;
+	unsigned int budget;
+	unsigned int moved = 0;
+	__lcpuidx i;
+
+	for (i = 1; i < c->lcpu_count && !moved; i++) {
+		v = schedsmp_lcpu_get(c, (self + i) % c->lcpu_count);
+
+		/* Cheap check without lock first */
+		if (!UK_READ_ONCE(v->nr_queued))
+			continue;
+
+		/* Only try-lock the victim: the victim could be stealing from
+		 * us at the same time.
+		 */
+		if (!ukarch_spin_trylock(&v->lock))
+			continue;
+
+		budget = MIN((v->nr_queued + 1) / 2,
+			     (unsigned int) CONFIG_LIBUKSCHEDSMP_STEAL_BATCH);
+		UK_TAILQ_FOREACH_SAFE(t, &v->run_queue, queue, tmp) {
+			if (!budget)
+				break;
+
+			/* Context of this thread might not be saved yet */
+			if (t == v->switching)
+				continue;
+
+			schedsmp_dequeue(v, t);
+			UK_WRITE_ONCE(t->lcpuidx, self);
+			schedsmp_runq_add(l, t);
+			--budget;
+			++moved;
+		}
+		ukarch_spin_unlock(&v->lock);
+	}
+
+	if (moved)
+		uk_pr_debug("lcpu %"__PRIu32": stole %u thread(s)\n",
+			    self, moved);
+	return moved;
+}
+#endif /* CONFIG_LIBUKSCHEDSMP_STEAL */
+
+static void schedsmp_schedule(struct uk_sched *s)
+{
+	struct schedsmp *c = uksched2schedsmp(s);
+	struct schedsmp_lcpu *l;
+	struct uk_thread *prev, *next;
+	__snsec now, min_wakeup_time;
+	unsigned long flags;
+	bool backlog;
+
+	if (unlikely(ukplat_lcpu_irqs_disabled()))
+		UK_CRASH("Must not call %s with IRQs disabled\n", __func__);
+
+	now = ukplat_monotonic_clock();
+	prev = uk_thread_current();
+	flags = ukplat_lcpu_save_irqf();
+	l = schedsmp_lcpu_get(c, ukplat_lcpu_idx());
+	ukarch_spin_lock(&l->lock);
+
+	UK_ASSERT(l->curr == prev);
+
+	/* We are executing in thread context, so the last switch on this
+	 * LCPU has completed.
+	 */
+	l->switching = NULL;
+
+	/* Update execution time of current thread */
+	prev->exec_time += now - l->ts_prev_switch;
+	l->ts_prev_switch = now;
+
+	min_wakeup_time = schedsmp_wake_expired(l, now);
+
+#if CONFIG_LIBUKSCHEDSMP_STEAL
+	/* Look for work on other LCPUs before we would go idle */
+	if (!UK_TAILQ_FIRST(&l->run_queue)
+	    && (prev == &l->idle || !uk_thread_is_runnable(prev)))
+		schedsmp_steal(c, l);
+#endif /* CONFIG_LIBUKSCHEDSMP_STEAL */
+
+	next = UK_TAILQ_FIRST(&l->run_queue);
+	if (next) {
+		UK_ASSERT(next != prev);
+		UK_ASSERT(uk_thread_is_runnable(next));
+		UK_ASSERT(!uk_thread_is_exited(next));
+		schedsmp_dequeue(l, next);
+
+		/* Put previous thread on the end of the list */
+		if ((prev != &l->idle)
+		    && uk_thread_is_runnable(prev)
+		    && !uk_thread_is_exited(prev)
+		    && !prev->queue_head)
+			schedsmp_runq_add(l, prev);
+	} else if (uk_thread_is_runnable(prev)
+		   && !uk_thread_is_exited(prev)) {
+		next = prev;
+	} else {
+		/*
+		 * Schedule idle thread that will halt the CPU
+		 * We select the idle thread only if we do not have anything
+		 * else to execute
+		 */
+		l->idle_return_time = min_wakeup_time;
+		next = &l->idle;
+	}
+
+	if (next != prev) {
+		/*
+		 * Queueable is used to cover the case when during a
+		 * context switch, the thread that is about to be
+		 * evacuated is interrupted and woken up.
+		 */
+		uk_thread_set_queueable(prev);
+		uk_thread_clear_queueable(next);
+		l->curr = next;
+		l->switching = prev;
+	}
+	backlog = (l->nr_queued > 0);
+
+	ukarch_spin_unlock(&l->lock);
+	ukplat_lcpu_restore_irqf(flags);
+
+	if (backlog)
+		schedsmp_kick_idle(c);
+
+	/* Interrupting the switch is equivalent to having the next thread
+	 * interrupted at the return instruction. And therefore at safe point.
+	 */
+	if (prev != next)
+		uk_sched_thread_switch(next);
+}
+
+static int schedsmp_thread_add(struct uk_sched *s, struct uk_thread *t)
+{
+	struct schedsmp *c = uksched2schedsmp(s);
+	struct schedsmp_lcpu *l;
+	__lcpuidx idx;
+	bool runnable;
+
+	UK_ASSERT(t);
+	UK_ASSERT(!uk_thread_is_exited(t));
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	/* New threads start on the creating LCPU */
+	idx = ukplat_lcpu_idx();
+	l = schedsmp_lcpu_get(c, idx);
+
+	ukarch_spin_lock(&l->lock);
+	t->lcpuidx = idx;
+	t->queue_head = NULL;
+
+	/* Add to run queue if runnable */
+	runnable = uk_thread_is_runnable(t);
+	if (runnable)
+		schedsmp_runq_add(l, t);
+	ukarch_spin_unlock(&l->lock);
+
+	if (runnable)
+		schedsmp_kick_idle(c);
+
+	return 0;
+}
+
+static void schedsmp_thread_remove(struct uk_sched *s, struct uk_thread *t)
+{
+	struct schedsmp *c = uksched2schedsmp(s);
+	struct schedsmp_lcpu *l;
+
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	l = schedsmp_thread_lock(c, t);
+	if (unlikely(t != uk_thread_current() && l->curr == t))
+		UK_CRASH("Cannot remove thread %p (%s) that executes on lcpu %"
+			 __PRIu32"\n", t, t->name ? t->name : "<unnamed>",
+			 t->lcpuidx);
+
+	/* Remove from run_queue or sleep_queue */
+	schedsmp_dequeue(l, t);
+	ukarch_spin_unlock(&l->lock);
+}
+
+static void schedsmp_thread_blocked(struct uk_sched *s, struct uk_thread *t)
+{
+	struct schedsmp *c = uksched2schedsmp(s);
+	struct schedsmp_lcpu *l;
+
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	l = schedsmp_thread_lock(c, t);
+	if (t->queue_head == &l->run_queue)
+		schedsmp_dequeue(l, t);
+	if (t->wakeup_time > 0 && !t->queue_head)
+		schedsmp_sleepq_add(l, t);
+	ukarch_spin_unlock(&l->lock);
+}
+
+/* Garbage collection of exited threads. Different to `uk_sched_thread_gc()`,
+ * threads that are still executing or being switched out on another LCPU are
+ * skipped and left for a later run.
+ */
+static unsigned int schedsmp_thread_gc(struct schedsmp *c)
+{
+	struct uk_sched *s = &c->sched;
+	struct schedsmp_lcpu *l;
+	struct uk_thread *thread;
+	unsigned long flags;
+	unsigned int num = 0;
+	bool busy;
+
+	for (;;) {
+		flags = ukplat_lcpu_save_irqf();
+		ukarch_spin_lock(&s->tl_lock);
+		UK_TAILQ_FOREACH(thread, &s->exited_threads, thread_list) {
+			l = schedsmp_lcpu_get(c, UK_READ_ONCE(thread->lcpuidx));
+			ukarch_spin_lock(&l->lock);
+			busy = (l->curr == thread || l->switching == thread);
+			ukarch_spin_unlock(&l->lock);
+			if (!busy)
+				break;
+		}
+		if (thread)
+			UK_TAILQ_REMOVE(&s->exited_threads, thread,
+					thread_list);
+		ukarch_spin_unlock(&s->tl_lock);
+		ukplat_lcpu_restore_irqf(flags);
+		if (!thread)
+			break;
+
+		UK_ASSERT(thread != uk_thread_current());
+		UK_ASSERT(uk_thread_is_exited(thread));
+
+		uk_pr_debug("%p: garbage collect thread %p (%s)\n",
+			    s, thread,
+			    thread->name ? thread->name : "<unnamed>");
+
+		if (thread->_gc_fn)
+			thread->_gc_fn(thread,  thread->_gc_argp);
+		uk_sched_thread_release(s, thread);
+		++num;
+	}
+
+	return num;
+}
+
+#if CONFIG_LIBUKSCHED_IDLEPOLL || CONFIG_LIBUKSCHED_IDLEWORK
+static int schedsmp_idle_ready(void *argp)
+{
+	struct schedsmp_lcpu *l = (struct schedsmp_lcpu *) argp;
+
+	return UK_READ_ONCE(l->nr_queued) != 0;
+}
+#endif /* CONFIG_LIBUKSCHED_IDLEPOLL || CONFIG_LIBUKSCHED_IDLEWORK */
+
+static __noreturn void idle_thread_fn(void *argp0, void *argp1)
+{
+	struct schedsmp *c = (struct schedsmp *) argp0;
+	struct schedsmp_lcpu *l = (struct schedsmp_lcpu *) argp1;
+	__nsec now, wake_up_time;
+	unsigned long flags;
+
+	UK_ASSERT(c);
+	UK_ASSERT(l);
+
+	/* Secondary LCPUs arrive here from their startup stack that we
+	 * do not need anymore
+	 */
+	if (l->bootstack) {
+		uk_free(c->sched.a, l->bootstack);
+		l->bootstack = NULL;
+	}
+	ukplat_lcpu_enable_irq();
+
+	for (;;) {
+		flags = ukplat_lcpu_save_irqf();
+
+		/*
+		 * NOTE:  This idle thread must be non-blocking so that the
+		 *        scheduler has always something to schedule.
+		 *        Same assumptions as for ukschedcoop apply to the
+		 *        destructors called by garbage collection.
+		 */
+		if (schedsmp_thread_gc(c) > 0 ||
+		    UK_READ_ONCE(l->nr_queued)) {
+			ukplat_lcpu_restore_irqf(flags);
+			schedsmp_schedule(&c->sched);
+
+			continue;
+		}
+
+#if CONFIG_LIBUKSCHED_IDLEWORK
+		/* Do background work before polling or halting */
+		if (uk_sched_idlework((volatile __nsec) l->idle_return_time,
+				      schedsmp_idle_ready, l)) {
+			ukplat_lcpu_restore_irqf(flags);
+			schedsmp_schedule(&c->sched);
+
+			continue;
+		}
+#endif /* CONFIG_LIBUKSCHED_IDLEWORK */
+
+#if CONFIG_LIBUKSCHED_IDLEPOLL
+		/* Spin for a while before halting the LCPU. Remote LCPUs do
+		 * not send wakeup IPIs while we did not announce the halt yet.
+		 */
+		if (uk_sched_idlepoll(&l->idlepoll,
+				      (volatile __nsec) l->idle_return_time,
+				      schedsmp_idle_ready, l)) {
+			ukplat_lcpu_restore_irqf(flags);
+			schedsmp_schedule(&c->sched);
+
+			continue;
+		}
+#endif /* CONFIG_LIBUKSCHED_IDLEPOLL */
+
+		/* Announce that we are going to halt. Remote LCPUs that
+		 * queue work for us after this point send a wakeup IPI
+		 * which stays pending because IRQs are disabled.
+		 */
+		ukarch_spin_lock(&l->lock);
+		if (l->nr_queued) {
+			ukarch_spin_unlock(&l->lock);
+			ukplat_lcpu_restore_irqf(flags);
+			continue;
+		}
+		l->halted = true;
+		ukarch_spin_unlock(&l->lock);
+
+		/* Read return time set by last schedule operation */
+		wake_up_time = (volatile __nsec) l->idle_return_time;
+		now = ukplat_monotonic_clock();
+
+		if (!wake_up_time || wake_up_time > now) {
+			if (wake_up_time)
+				ukplat_lcpu_halt_irq_until(wake_up_time);
+			else
+				ukplat_lcpu_halt_irq();
+
+			/* handle pending events if any */
+			ukplat_lcpu_irqs_handle_pending();
+#if CONFIG_LIBUKSCHED_IDLEPOLL
+			uk_sched_idlepoll_update(&l->idlepoll);
+#endif /* CONFIG_LIBUKSCHED_IDLEPOLL */
+		}
+
+		UK_WRITE_ONCE(l->halted, false);
+		ukplat_lcpu_restore_irqf(flags);
+
+		/* try to schedule a thread that might now be available */
+		schedsmp_schedule(&c->sched);
+	}
+}
+
+#if CONFIG_HAVE_SMP
+static void __noreturn schedsmp_lcpu_entry(void)
+{
+	struct schedsmp *c = schedsmp_instance;
+	struct schedsmp_lcpu *l;
+	struct ukarch_ctx bootctx;
+
+	UK_ASSERT(c);
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	l = schedsmp_lcpu_get(c, ukplat_lcpu_idx());
+
+	ukarch_spin_lock(&l->lock);
+	l->curr = &l->idle;
+	l->ts_prev_switch = ukplat_monotonic_clock();
+	ukarch_spin_unlock(&l->lock);
+
+	uk_pr_info("lcpu %"__PRIu32": Entering scheduler\n",
+		   schedsmp_lcpu_idx(c, l));
+
+	/* Similar to `uk_sched_thread_switch()` but there is no previous
+	 * thread to save; the startup context is dropped.
+	 */
+	ukplat_per_lcpu_current(__uk_sched_thread_current) = &l->idle;
+	l->idle.on_lcpu = true;
+	ukplat_tlsp_set(l->idle.tlsp);
+	if (l->idle.ectx)
+		ukarch_ectx_load(l->idle.ectx);
+	ukplat_lcpu_set_auxsp(l->idle.auxsp);
+	ukarch_ctx_switch(&bootctx, &l->idle.ctx);
+
+	UK_CRASH("Unexpectedly returned to startup context of lcpu %"
+		 __PRIu32"\n", schedsmp_lcpu_idx(c, l));
+}
+
+static int schedsmp_lcpu_start(struct schedsmp *c)
+{
+	__lcpuidx self = ukplat_lcpu_idx();
+	struct uk_alloc *a = c->sched.a;
+	ukplat_lcpu_entry_t *entry;
+	struct schedsmp_lcpu *l;
+	unsigned int j = 0;
+	__lcpuidx i;
+	void **sp;
+	int rc;
+
+	sp = uk_calloc(a, c->lcpu_count - 1, sizeof(*sp));
+	if (unlikely(!sp))
+		return -ENOMEM;
+	entry = uk_calloc(a, c->lcpu_count - 1, sizeof(*entry));
+	if (unlikely(!entry)) {
+		rc = -ENOMEM;
+		goto out_free_sp;
+	}
+
+	/* Without an index array, LCPUs are started in sequential order
+	 * skipping the current one
+	 */
+	for (i = 0; i < c->lcpu_count; i++) {
+		if (i == self)
+			continue;
+
+		l = schedsmp_lcpu_get(c, i);
+		l->bootstack = uk_memalign(a, UKARCH_SP_ALIGN,
+					   SCHEDSMP_BOOTSTACK_SIZE);
+		if (unlikely(!l->bootstack)) {
+			rc = -ENOMEM;
+			goto out_free_stacks;
+		}
+		sp[j] = (void *) ukarch_gen_sp(l->bootstack,
+					       SCHEDSMP_BOOTSTACK_SIZE);
+		entry[j] = schedsmp_lcpu_entry;
+		j++;
+	}
+
+	rc = ukplat_lcpu_start(NULL, NULL, sp, entry, 0);
+	if (unlikely(rc))
+		uk_pr_err("Failed to start secondary lcpus: %d\n", rc);
+	goto out_free_entry;
+
+out_free_stacks:
+	for (i = 0; i < c->lcpu_count; i++) {
+		l = schedsmp_lcpu_get(c, i);
+		if (l->bootstack) {
+			uk_free(a, l->bootstack);
+			l->bootstack = NULL;
+		}
+	}
+out_free_entry:
+	uk_free(a, entry);
+out_free_sp:
+	uk_free(a, sp);
+	return rc;
+}
+#endif /* CONFIG_HAVE_SMP */
+
+static int schedsmp_start(struct uk_sched *s,
+			  struct uk_thread *main_thread)
+{
+	struct schedsmp *c = uksched2schedsmp(s);
+	struct schedsmp_lcpu *l;
+	__lcpuidx idx = ukplat_lcpu_idx();
+
+	UK_ASSERT(main_thread);
+	UK_ASSERT(main_thread->sched == s);
+	UK_ASSERT(uk_thread_is_runnable(main_thread));
+	UK_ASSERT(!uk_thread_is_exited(main_thread));
+	UK_ASSERT(uk_thread_current() == main_thread);
+
+	l = schedsmp_lcpu_get(c, idx);
+
+	/* NOTE: We do not put `main_thread` into the thread list.
+	 *       Current running threads will be added as soon as
+	 *       a different thread is scheduled.
+	 */
+	main_thread->lcpuidx = idx;
+	l->curr = main_thread;
+
+	/* Since we are now starting to schedule, we save the current timestamp
+	 * as the start time for the first time slice.
+	 */
+	l->ts_prev_switch = ukplat_monotonic_clock();
+
+#if CONFIG_HAVE_SMP
+	if (c->lcpu_count > 1) {
+		uk_pr_info("Starting %"__PRIu32" secondary lcpus\n",
+			   c->lcpu_count - 1);
+
+		/* Threads can only get assigned to LCPUs that run their
+		 * idle thread, so we continue on failure with the LCPUs
+		 * that came up.
+		 */
+		schedsmp_lcpu_start(c);
+	}
+#endif /* CONFIG_HAVE_SMP */
+
+	ukplat_lcpu_enable_irq();
+
+	return 0;
+}
+
+static const struct uk_thread *schedsmp_idle_thread(struct uk_sched *s,
+						    unsigned int proc_id)
+{
+	struct schedsmp *c = uksched2schedsmp(s);
+
+	if (proc_id >= c->lcpu_count)
+		return NULL;
+
+	return &schedsmp_lcpu_get(c, proc_id)->idle;
+}
+
+struct uk_sched *uk_schedsmp_create(struct uk_alloc *a,
+				    struct uk_alloc *sa,
+				    struct uk_alloc *auxsa,
+				    struct uk_alloc *tls_a)
+{
+	struct schedsmp *c = NULL;
+	struct schedsmp_lcpu *l;
+	__lcpuidx i;
+	int rc;
+
+#if CONFIG_HAVE_SMP
+	/* The scheduler manages all LCPUs, there can only be one instance */
+	UK_ASSERT(!schedsmp_instance);
+#endif /* CONFIG_HAVE_SMP */
+
+	uk_pr_info("Initializing SMP cooperative scheduler\n");
+	c = uk_memalign(a, __alignof__(struct schedsmp),
+			sizeof(struct schedsmp));
+	if (!c)
+		goto err_out;
+	memset(c, 0, sizeof(*c));
+
+	c->lcpu_count = ukplat_lcpu_count();
+	UK_ASSERT(c->lcpu_count <= CONFIG_UKPLAT_LCPU_MAXCOUNT);
+
+	/* Create an idle thread for each LCPU */
+	for (i = 0; i < c->lcpu_count; i++) {
+		l = schedsmp_lcpu_get(c, i);
+
+		ukarch_spin_init(&l->lock);
+		UK_TAILQ_INIT(&l->run_queue);
+		uk_sched_sleepq_init(&l->sleep_queue);
+
+		rc = uk_thread_init_fn2(&l->idle,
+					idle_thread_fn, (void *) c, (void *) l,
+					sa, STACK_SIZE,
+					auxsa, AUXSTACK_SIZE,
+					tls_a, false,
+					NULL,
+					"idle",
+					NULL,
+					NULL);
+		if (rc < 0)
+			goto err_release_idle;
+
+		l->idle.sched = &c->sched;
+		l->idle.lcpuidx = i;
+	}
+
+	uk_sched_init(&c->sched,
+			schedsmp_start,
+			schedsmp_schedule,
+			schedsmp_thread_add,
+			schedsmp_thread_remove,
+			schedsmp_thread_blocked,
+			schedsmp_thread_woken_isr,
+			schedsmp_thread_woken_isr,
+			schedsmp_idle_thread,
+			a, sa, auxsa, tls_a);
+
+	/* Add idle threads to the scheduler's thread list */
+	for (i = 0; i < c->lcpu_count; i++) {
+		l = schedsmp_lcpu_get(c, i);
+		UK_TAILQ_INSERT_TAIL(&c->sched.thread_list, &l->idle,
+				     thread_list);
+	}
+
+#if CONFIG_HAVE_SMP
+	schedsmp_instance = c;
+#endif /* CONFIG_HAVE_SMP */
+
+	return &c->sched;
+
+err_release_idle:
+	while (i-- > 0)
+		uk_thread_release(&schedsmp_lcpu_get(c, i)->idle);
+	uk_free(a, c);
+err_out:
+	return NULL;
+}
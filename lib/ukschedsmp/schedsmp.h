@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#ifndef __UK_SCHEDSMP_SCHEDSMP_H__
+#define __UK_SCHEDSMP_SCHEDSMP_H__
+
+#include <uk/arch/lcpu.h>
+#include <uk/arch/spinlock.h>
+#include <uk/atomic.h>
+#include <uk/plat/lcpu.h>
+#include <uk/sched_idlepoll.h>
+#include <uk/sched_idlework.h>
+#include <uk/sched_impl.h>
+#include <uk/schedsmp.h>
+
+/* Per-LCPU scheduling state. Every field is protected by `lock`, except for
+ * `idle` and `bootstack` which are only touched by the owning LCPU.
+ */
+struct schedsmp_lcpu {
+	__spinlock lock;
+	struct uk_thread_list run_queue;
+	struct uk_sched_sleepq sleep_queue;
+	unsigned int nr_queued;		/**< Number of threads in run_queue */
+	bool halted;			/**< Idle thread halts the LCPU */
+	struct uk_thread *curr;		/**< Thread executing on this LCPU */
+
+	/* Thread that was switched out most recently. Its context might not
+	 * be saved yet, so it must not be taken by another LCPU until the
+	 * owning LCPU entered the scheduler again.
+	 */
+	struct uk_thread *switching;
+
+	struct uk_thread idle;
+	__nsec idle_return_time;
+	__nsec ts_prev_switch;
+#if CONFIG_LIBUKSCHED_IDLEPOLL
+	struct uk_sched_idlepoll_window idlepoll;
+#endif /* CONFIG_LIBUKSCHED_IDLEPOLL */
+	void *bootstack;		/**< Startup stack of secondary LCPUs */
+} __align(CACHE_LINE_SIZE);
+
+struct schedsmp {
+	struct uk_sched sched;
+	__u32 lcpu_count;
+	UKPLAT_PER_LCPU_DEFINE(struct schedsmp_lcpu, lcpu);
+};
+
+static inline struct schedsmp *uksched2schedsmp(struct uk_sched *s)
+{
+	UK_ASSERT(s);
+
+	return __containerof(s, struct schedsmp, sched);
+}
+
+static inline struct schedsmp_lcpu *schedsmp_lcpu_get(struct schedsmp *c,
+						      __lcpuidx idx)
+{
+	UK_ASSERT(idx < c->lcpu_count);
+
+	return &ukplat_per_lcpu(c->lcpu, idx);
+}
+
+/**
+ * Locks the LCPU queue that `t` is currently assigned to. Because work
+ * stealing can move a thread to another LCPU while we wait for the lock,
+ * the assignment is re-checked after acquiring it.
+ * Must be called with IRQs disabled.
+ */
+static inline struct schedsmp_lcpu *schedsmp_thread_lock(struct schedsmp *c,
+							 struct uk_thread *t)
+{
+	struct schedsmp_lcpu *l;
+	__lcpuidx idx;
+
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	for (;;) {
+		idx = UK_READ_ONCE(t->lcpuidx);
+		l = schedsmp_lcpu_get(c, idx);
+		ukarch_spin_lock(&l->lock);
+		if (likely(UK_READ_ONCE(t->lcpuidx) == idx))
+			return l;
+		ukarch_spin_unlock(&l->lock);
+	}
+}
+
+static inline __lcpuidx schedsmp_lcpu_idx(struct schedsmp *c,
+					  struct schedsmp_lcpu *l)
+{
+	return (__lcpuidx) (l - &ukplat_per_lcpu(c->lcpu, 0));
+}
+
+static inline void schedsmp_runq_add(struct schedsmp_lcpu *l,
+				     struct uk_thread *t)
+{
+	UK_ASSERT(!t->queue_head);
+
+	UK_TAILQ_INSERT_TAIL(&l->run_queue, t, queue);
+	t->queue_head = &l->run_queue;
+	l->nr_queued++;
+}
+
+static inline void schedsmp_sleepq_add(struct schedsmp_lcpu *l,
+				       struct uk_thread *t)
+{
+	UK_ASSERT(!t->queue_head);
+
+	uk_sched_sleepq_add(&l->sleep_queue, t);
+	t->queue_head = &l->sleep_queue;
+}
+
+/* Removes `t` from the run or sleep queue of `l` if it is queued */
+static inline void schedsmp_dequeue(struct schedsmp_lcpu *l,
+				    struct uk_thread *t)
+{
+	if (!t->queue_head)
+		return;
+
+	UK_ASSERT(t->queue_head == &l->run_queue ||
+		  t->queue_head == &l->sleep_queue);
+
+	if (t->queue_head == &l->run_queue) {
+		UK_TAILQ_REMOVE(&l->run_queue, t, queue);
+		l->nr_queued--;
+	} else {
+		uk_sched_sleepq_remove(&l->sleep_queue, t);
+	}
+	t->queue_head = NULL;
+}
+
+/* Sends a wake-up IPI if the LCPU sits in its idle halt */
+void schedsmp_lcpu_kick(struct schedsmp *c, struct schedsmp_lcpu *l);
+
+void schedsmp_thread_woken_isr(struct uk_sched *s, struct uk_thread *t);
+
+#endif /* __UK_SCHEDSMP_SCHEDSMP_H__ */
@@ -227,18 +227,28 @@ static inline int uk_vma_map_dma(struct uk_vas *vas, __vaddr_t *vaddr,
  * mappings use the file name as VMA name. The file will be kept open for the
  * lifetime of the mapping.
  *
- * Note that the current file mapping implementation only allows private
- * mappings and will return -ENOTSUP for shared mappings. Accordingly,
- * modifications are not synched back to the file. Similarly, changes to the
- * file via regular read() and write() operations are not visible in the
- * mapping. Instead, the whole file contents is loaded into memory when the
- * mapping is established.
+ * Private mappings get a copy of the file contents. Modifications are not
+ * synched back to the file and changes to the file via regular read() and
+ * write() operations are not visible in the mapping.
+ *
+ * With CONFIG_LIBVFSCORE_PAGECACHE, shared mappings of regular files map the
+ * pages of the vfscore page cache. Accordingly, writes to the file are visible
+ * in the mapping and writes to the mapping are visible to read(). Writable
+ * shared mappings are written back to the file with UK_VMA_FILE_ADV_SYNC, on
+ * fsync(), and when the file is closed. Without the page cache, shared
+ * mappings are treated as private and writable shared mappings are not
+ * supported (-ENOTSUP).
+ *
+ * In all cases, the whole mapping is paged-in when the mapping is established.
  */
 extern const struct uk_vma_ops uk_vma_file_ops;
 
 /* File mapping flags */
 #define UK_VMA_FILE_SHARED		(0x1UL << UK_VMA_MAP_EXTF_SHIFT)
 
+/* File mapping advices */
+#define UK_VMA_FILE_ADV_SYNC		(0x1UL << UK_VMA_ADV_EXTF_SHIFT)
+
 struct uk_vma_file {
 	struct uk_vma base;
 
@@ -38,6 +38,7 @@
 #include <uk/arch/types.h>
 #include <uk/arch/paging.h>
 #include <uk/list.h>
+#include <uk/tree.h>
 #include <uk/alloc.h>
 #ifdef CONFIG_HAVE_PAGING
 #include <uk/plat/paging.h>
@@ -63,11 +64,25 @@ struct uk_vas {
 
 	/** Base address where to start putting new VMAs */
 	__vaddr_t vma_base;
+
+	/**
+	 * TLB flush gather of the uk_vma_unmap() or uk_vma_set_attr() call
+	 * in progress, or __NULL. The gather lives on the stack of that call.
+	 * Like all modifications of the address space, these calls must be
+	 * serialized by the caller.
+	 */
+	struct ukplat_tlb_gather *tlb;
 #endif /* CONFIG_HAVE_PAGING */
 
 	/** List of VMAs, sorted by address */
 	struct uk_list_head vma_list;
 
+	/** Tree of VMAs for address lookups, indexed by start address */
+	UK_RB_HEAD(uk_vma_tree, uk_vma) vma_tree;
+
+	/** VMA of the last successful lookup */
+	struct uk_vma *vma_cache;
+
 	/** VAS flags */
 #define UK_VAS_FLAG_NO_PAGING		0x1 /* On-demand paging disabled */
 	unsigned long flags;
@@ -115,11 +130,19 @@ struct uk_vma {
 
 	struct uk_list_head vma_list;
 
+	/** Node in the VMA tree of the VAS */
+	UK_RB_ENTRY(uk_vma) vma_node;
+
+	/** Largest unmapped gap in front of a VMA in the subtree of this VMA */
+	__sz subtree_gap;
+
 	/** Page attributes for pages in the VMA (see PAGE_ATTR_*) */
 	unsigned long attr;
 
 	/** VMA flags - high word bits are from mapping flags */
 #define UK_VMA_FLAG_UNINITIALIZED	0x1 /* Do not initialize memory */
+#define UK_VMA_FLAG_RANDOM		0x2 /* No fault-around */
+#define UK_VMA_FLAG_SEQUENTIAL		0x4 /* Fault-around ahead of faults */
 	unsigned long flags;
 
 	/** Desired page level (-1 = no preference) */
@@ -137,7 +160,8 @@ struct uk_vm_fault {
 	/**
 	 * Number of bytes starting at vbase affected by the fault. This
 	 * is not the size of the faulting access, but the amount of contiguous
-	 * physical memory which has to be supplied by the fault handler.
+	 * physical memory which has to be supplied by the fault handler. With
+	 * fault-around, this can be a multiple of the page size of the level.
 	 */
 	const __sz len;
 
@@ -153,7 +177,8 @@ struct uk_vm_fault {
 #ifdef CONFIG_HAVE_PAGING
 	/**
 	 * Mapped physical address, if any. Modify to change mapping. The
-	 * physical memory must be aligned to its size.
+	 * physical memory must be aligned to its size. Fault-around batches
+	 * only need to be aligned to the page size of the level.
 	 */
 	__paddr_t paddr;
 
@@ -624,6 +649,9 @@ int uk_vma_set_attr(struct uk_vas *vas, __vaddr_t vaddr, __sz len,
 /* VMA advices */
 #define UK_VMA_ADV_DONTNEED		0x01 /* Physical memory can be freed */
 #define UK_VMA_ADV_WILLNEED		0x02 /* Area should be prefaulted */
+#define UK_VMA_ADV_NORMAL		0x04 /* Default fault-around */
+#define UK_VMA_ADV_RANDOM		0x08 /* Page-in faulting page only */
+#define UK_VMA_ADV_SEQUENTIAL		0x10 /* Page-in ahead of faults */
 
 /* The high word bits of the advice are usable for VMA-type specific advices */
 #define UK_VMA_ADV_EXTF_SHIFT		(sizeof(unsigned long) * 4)
@@ -656,11 +684,21 @@ int uk_vma_set_attr(struct uk_vas *vas, __vaddr_t vaddr, __sz len,
  *   UK_VMA_ADV_WILLNEED informs the virtual memory system that the pages will
  *   be needed soon and should be paged in. This can be used to reduce the
  *   number of page faults.
+ *
+ *   UK_VMA_ADV_NORMAL, UK_VMA_ADV_RANDOM, and UK_VMA_ADV_SEQUENTIAL set the
+ *   fault-around policy for the address range. With the normal policy, a
+ *   page fault in an anonymous or file VMA also pages-in the unmapped pages
+ *   in a window of CONFIG_LIBUKVMEM_FAULT_AROUND_PAGES around the faulting
+ *   page. The random policy pages-in the faulting page only. The sequential
+ *   policy pages-in CONFIG_LIBUKVMEM_FAULT_AROUND_SEQ_PAGES starting at the
+ *   faulting page. At most one policy can be given. VMAs are split to apply
+ *   the policy to the address range only.
  * @param flags
  *   One of the generic flags (UK_VMA_FLAG_*)
  *
  * @return
  *   0 on success, a negative errno error otherwise
+ *   - EINVAL if more than one fault-around policy is given
  */
 int uk_vma_advise(struct uk_vas *vas, __vaddr_t vaddr, __sz len,
 		  unsigned long advice, unsigned long flags);
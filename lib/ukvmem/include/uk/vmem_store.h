@@ -0,0 +1,17 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#ifndef __UK_VMEM_STORE_H__
+#define __UK_VMEM_STORE_H__
+
+/* Transparent huge page entry IDs (`CONFIG_LIBUKVMEM_THP`) */
+#define UK_VMEM_THP_ENABLED			0x01
+#define UK_VMEM_THP_FAULT_ALLOC			0x02
+#define UK_VMEM_THP_FAULT_FALLBACK		0x03
+#define UK_VMEM_THP_COLLAPSE_ALLOC		0x04
+#define UK_VMEM_THP_COLLAPSE_FAILED		0x05
+#define UK_VMEM_THP_FULL_SCANS			0x06
+
+#endif /* __UK_VMEM_STORE_H__ */
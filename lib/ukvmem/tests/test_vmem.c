@@ -18,6 +18,7 @@
 #include <uk/plat/paging.h>
 #include <uk/nofault.h>
 #include <uk/arch/limits.h>
+#include <uk/plat/time.h>
 
 #define MAPPING_BASE CONFIG_LIBUKVMEM_DEFAULT_BASE
 
@@ -32,7 +33,7 @@
 #define PROT_RWX PAGE_ATTR_PROT_RWX
 
 #define pr_info(fmt, ...)						\
-	_uk_printk(KLVL_INFO, __NULL, __NULL, 0x0, fmt, ##__VA_ARGS__)
+	_uk_printk(KLVL_INFO, uk_libid_self(), __NULL, 0x0, fmt, ##__VA_ARGS__)
 
 #define vmem_bug_on(cond)						\
 	do {								\
@@ -402,6 +403,10 @@ UK_TESTCASE(ukvmem, test_vma_anon)
 		{va1, va1 + 0x10000 + 0x2000, PROT_R},
 	}, 1));
 
+	/* Page-in single pages only to check the demand-paging */
+	rc = uk_vma_advise(vas, va2, 0x2000, UK_VMA_ADV_RANDOM, 0);
+	UK_TEST_EXPECT_ZERO(rc);
+
 	len = probe_r_nopage(va2, 0x2000);
 	UK_TEST_EXPECT_ZERO(len);
 
@@ -448,6 +453,112 @@ UK_TESTCASE(ukvmem, test_vma_anon)
 	vas_clean(vas);
 }
 
+#ifdef CONFIG_PAGING_STATS
+/**
+ * Tests that unmapping and changing the protections of a large range only
+ * flush the TLB once, even if the freed frames do not fit into a single
+ * batch of the TLB gather.
+ */
+UK_TESTCASE(ukvmem, test_vma_anon_tlb_gather)
+{
+	struct uk_vas *vas = vas_init();
+	unsigned long flushes;
+	__vaddr_t va;
+	int rc;
+
+	va = __VADDR_ANY;
+	rc = uk_vma_map_anon(vas, &va, 0x400000, PROT_RW,
+			     UK_VMA_MAP_POPULATE, NULL);
+	UK_TEST_EXPECT_ZERO(rc);
+
+	flushes = vas->pt->nr_tlb_flushes;
+	rc = uk_vma_set_attr(vas, va, 0x400000, PROT_R, 0);
+	UK_TEST_EXPECT_ZERO(rc);
+	UK_TEST_EXPECT_SNUM_EQ(vas->pt->nr_tlb_flushes - flushes, 1);
+
+	flushes = vas->pt->nr_tlb_flushes;
+	rc = uk_vma_unmap(vas, va, 0x400000, 0);
+	UK_TEST_EXPECT_ZERO(rc);
+	UK_TEST_EXPECT_SNUM_EQ(vas->pt->nr_tlb_flushes - flushes, 1);
+
+	vas_clean(vas);
+}
+#endif /* CONFIG_PAGING_STATS */
+
+/**
+ * Tests the fault-around policies of anonymous memory. The VMA is placed at
+ * the beginning of a page table, so that the fault-around windows are
+ * aligned to the VMA.
+ */
+UK_TESTCASE(ukvmem, test_vma_anon_fault_around)
+{
+	const unsigned long fa = CONFIG_LIBUKVMEM_FAULT_AROUND_PAGES;
+	const unsigned long seq = CONFIG_LIBUKVMEM_FAULT_AROUND_SEQ_PAGES;
+	const __sz tsize = PAGE_Lx_SIZE(PAGE_LEVEL + 1);
+	struct uk_vas *vas = vas_init();
+	__vaddr_t base, va;
+	int rc;
+	__sz len;
+
+	/* The VMA must fit into a single page table without a large page */
+	if (2 * fa + seq >= PT_Lx_PTES(PAGE_LEVEL)) {
+		vas_clean(vas);
+		return;
+	}
+
+	base = __VADDR_ANY;
+	rc = uk_vma_reserve(vas, &base, 2 * tsize);
+	vmem_bug_on(rc != 0);
+
+	va = PAGE_Lx_ALIGN_UP(base, PAGE_LEVEL + 1);
+	rc = uk_vma_map_anon(vas, &va, (2 * fa + seq) * PAGE_SIZE, PROT_RW,
+			     UK_VMA_MAP_REPLACE, NULL);
+	UK_TEST_EXPECT_ZERO(rc);
+
+	/* A fault pages-in the whole window around the faulting page */
+	len = probe_rw(va + fa * PAGE_SIZE, 1);
+	UK_TEST_EXPECT_SNUM_EQ(len, 1);
+
+	len = probe_r_nopage(va + fa * PAGE_SIZE, fa * PAGE_SIZE);
+	UK_TEST_EXPECT_SNUM_EQ(len, fa * PAGE_SIZE);
+	UK_TEST_EXPECT(is_zero(va + fa * PAGE_SIZE, fa * PAGE_SIZE));
+
+	len = probe_r_nopage(va, PAGE_SIZE);
+	UK_TEST_EXPECT_ZERO(len);
+
+	/* Random access pages-in the faulting page only */
+	rc = uk_vma_advise(vas, va, fa * PAGE_SIZE, UK_VMA_ADV_RANDOM, 0);
+	UK_TEST_EXPECT_ZERO(rc);
+
+	len = probe_rw(va + (fa - 1) * PAGE_SIZE, 1);
+	UK_TEST_EXPECT_SNUM_EQ(len, 1);
+
+	len = probe_r_nopage(va, (fa - 1) * PAGE_SIZE);
+	UK_TEST_EXPECT_ZERO(len);
+
+	/* Sequential access pages-in ahead of the faulting page */
+	rc = uk_vma_advise(vas, va + 2 * fa * PAGE_SIZE, seq * PAGE_SIZE,
+			   UK_VMA_ADV_SEQUENTIAL, 0);
+	UK_TEST_EXPECT_ZERO(rc);
+
+	len = probe_rw(va + (2 * fa + 1) * PAGE_SIZE, 1);
+	UK_TEST_EXPECT_SNUM_EQ(len, 1);
+
+	len = probe_r_nopage(va + (2 * fa + 1) * PAGE_SIZE,
+			     (seq - 1) * PAGE_SIZE);
+	UK_TEST_EXPECT_SNUM_EQ(len, (seq - 1) * PAGE_SIZE);
+
+	len = probe_r_nopage(va + 2 * fa * PAGE_SIZE, PAGE_SIZE);
+	UK_TEST_EXPECT_ZERO(len);
+
+	/* Advices with more than one policy are rejected */
+	rc = uk_vma_advise(vas, va, PAGE_SIZE,
+			   UK_VMA_ADV_RANDOM | UK_VMA_ADV_SEQUENTIAL, 0);
+	UK_TEST_EXPECT_SNUM_EQ(rc, -EINVAL);
+
+	vas_clean(vas);
+}
+
 #ifdef PAGE_LARGE_SHIFT
 /**
  * Tests if we can create anonymous mappings with large pages.
@@ -506,6 +617,51 @@ UK_TESTCASE(ukvmem, test_vma_anon_large)
 
 	vas_clean(vas);
 }
+
+#ifdef CONFIG_LIBUKVMEM_THP
+/**
+ * Tests if anonymous memory is paged-in with large pages where the whole
+ * large page fits into the VMA and with small pages elsewhere.
+ */
+UK_TESTCASE(ukvmem, test_vma_anon_thp)
+{
+	struct uk_vas *vas = vas_init();
+	__vaddr_t va, vbase;
+	unsigned int lvl;
+	int rc;
+	__sz len;
+
+	va = __VADDR_ANY;
+	rc = uk_vma_map_anon(vas, &va, PAGE_LARGE_SIZE * 3, PROT_RW, 0, NULL);
+	UK_TEST_EXPECT_ZERO(rc);
+
+	/* Touch a single small page in the middle of a large page */
+	vbase = PAGE_LARGE_ALIGN_UP(va);
+	len = probe_rw(vbase + PAGE_SIZE, PAGE_SIZE);
+	UK_TEST_EXPECT_SNUM_EQ(len, PAGE_SIZE);
+
+	lvl = PAGE_LEVEL;
+	rc = ukplat_pt_walk(vas->pt, vbase, &lvl, NULL, NULL);
+	vmem_bug_on(rc != 0);
+
+	UK_TEST_EXPECT_SNUM_EQ(lvl, PAGE_LARGE_LEVEL);
+	UK_TEST_EXPECT(is_zero(vbase, PAGE_LARGE_SIZE));
+
+	/* The end of the VMA does not cover a whole large page */
+	len = probe_rw(va + PAGE_LARGE_SIZE * 3 - PAGE_SIZE, PAGE_SIZE);
+	UK_TEST_EXPECT_SNUM_EQ(len, PAGE_SIZE);
+
+	lvl = PAGE_LEVEL;
+	rc = ukplat_pt_walk(vas->pt, va + PAGE_LARGE_SIZE * 3 - PAGE_SIZE,
+			    &lvl, NULL, NULL);
+	vmem_bug_on(rc != 0);
+
+	if (!PAGE_LARGE_ALIGNED(va))
+		UK_TEST_EXPECT_SNUM_EQ(lvl, PAGE_LEVEL);
+
+	vas_clean(vas);
+}
+#endif /* CONFIG_LIBUKVMEM_THP */
 #endif /* PAGE_LARGE_SHIFT */
 
 /**
@@ -639,7 +795,7 @@ UK_TESTCASE(ukvmem, test_vma_stack)
 
 	/* Probe the entire stack */
 	len = probe_r(va1 - UK_VMA_STACK_BOTTOM_GUARD_SIZE,
-		      VMEM_STACKSIZE + STACK_GUARDS_SIZE);
+		      VMEM_STACKSIZE + UK_VMA_STACK_GUARDS_SIZE);
 	UK_TEST_EXPECT_SNUM_EQ(len, VMEM_STACKSIZE);
 
 	rc = uk_vma_map_stack(vas, &va2, VMEM_STACKSIZE, 0,
@@ -662,7 +818,7 @@ UK_TESTCASE(ukvmem, test_vma_stack)
 
 	/* Probe the entire stack */
 	len = probe_r(va2 - UK_VMA_STACK_BOTTOM_GUARD_SIZE,
-		      VMEM_STACKSIZE + STACK_GUARDS_SIZE);
+		      VMEM_STACKSIZE + UK_VMA_STACK_GUARDS_SIZE);
 	UK_TEST_EXPECT_SNUM_EQ(len, VMEM_STACKSIZE);
 
 	/* Try to unmap only some part of the stack */
@@ -675,7 +831,7 @@ UK_TESTCASE(ukvmem, test_vma_stack)
 
 	/* But we should be able to change attributes for the whole VMA */
 	rc = uk_vma_set_attr(vas, va2 - UK_VMA_STACK_BOTTOM_GUARD_SIZE,
-			     VMEM_STACKSIZE + STACK_GUARDS_SIZE, PROT_R, 0);
+			     VMEM_STACKSIZE + UK_VMA_STACK_GUARDS_SIZE, PROT_R, 0);
 	UK_TEST_EXPECT_ZERO(rc);
 
 	vas_clean(vas);
@@ -779,6 +935,80 @@ UK_TESTCASE(ukvmem, test_vma_file)
 
 	vas_clean(vas);
 }
+
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+/**
+ * Tests that shared file mappings map the pages of the page cache
+ */
+#define VMEM_TEST_SHARED_FILENAME "/test_vma_file_shared"
+UK_TESTCASE(ukvmem, test_vma_file_shared)
+{
+	struct uk_vas *vas = vas_init();
+	unsigned char c;
+	__vaddr_t va1, va2;
+	int fd, rdfd, rc;
+	__ssz len;
+
+	fd = open(VMEM_TEST_SHARED_FILENAME, O_RDWR | O_CREAT | O_TRUNC, 0700);
+	vmem_bug_on(fd < 0);
+
+	/* Extend the file to two pages */
+	c = 0;
+	len = pwrite(fd, &c, 1, 2 * PAGE_SIZE - 1);
+	vmem_bug_on(len != 1);
+
+	va1 = __VADDR_ANY;
+	rc = uk_vma_map_file(vas, &va1, 2 * PAGE_SIZE, PROT_RW,
+			     UK_VMA_FILE_SHARED, fd, 0);
+	UK_TEST_EXPECT_ZERO(rc);
+
+	va2 = __VADDR_ANY;
+	rc = uk_vma_map_file(vas, &va2, PAGE_SIZE, PROT_R,
+			     UK_VMA_FILE_SHARED, fd, PAGE_SIZE);
+	UK_TEST_EXPECT_ZERO(rc);
+
+	/* Writes to the file are visible in the mapping */
+	c = 0xaa;
+	len = pwrite(fd, &c, 1, 0);
+	vmem_bug_on(len != 1);
+	UK_TEST_EXPECT_SNUM_EQ(*((unsigned char *)(va1)), 0xaa);
+
+	/* Writes to the mapping are visible to read() and other mappings */
+	*((unsigned char *)(va1 + PAGE_SIZE + 1)) = 0xbb;
+	len = pread(fd, &c, 1, PAGE_SIZE + 1);
+	vmem_bug_on(len != 1);
+	UK_TEST_EXPECT_SNUM_EQ(c, 0xbb);
+	UK_TEST_EXPECT_SNUM_EQ(*((unsigned char *)(va2 + 1)), 0xbb);
+
+	rc = uk_vma_advise(vas, va1, 2 * PAGE_SIZE, UK_VMA_FILE_ADV_SYNC,
+			   UK_VMA_FLAG_STRICT_VMA_CHECK);
+	UK_TEST_EXPECT_ZERO(rc);
+
+	/* Dropping the pages keeps the data in the page cache */
+	rc = uk_vma_advise(vas, va1, 2 * PAGE_SIZE, UK_VMA_ADV_DONTNEED, 0);
+	UK_TEST_EXPECT_ZERO(rc);
+	UK_TEST_EXPECT_SNUM_EQ(*((unsigned char *)(va2 + 1)), 0xbb);
+
+	rc = uk_vma_unmap(vas, va1, 2 * PAGE_SIZE, 0);
+	UK_TEST_EXPECT_ZERO(rc);
+
+	/* Writable shared mappings need write permission on the file */
+	rdfd = open(VMEM_TEST_SHARED_FILENAME, O_RDONLY);
+	vmem_bug_on(rdfd < 0);
+
+	va1 = __VADDR_ANY;
+	rc = uk_vma_map_file(vas, &va1, PAGE_SIZE, PROT_RW,
+			     UK_VMA_FILE_SHARED, rdfd, 0);
+	UK_TEST_EXPECT_SNUM_EQ(rc, -EACCES);
+
+	/* Clean up */
+	close(rdfd);
+	close(fd);
+	unlink(VMEM_TEST_SHARED_FILENAME);
+
+	vas_clean(vas);
+}
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
 #endif /* CONFIG_LIBVFSCORE */
 
 /**
@@ -852,4 +1082,80 @@ UK_TESTCASE(ukvmem, test_vma_replace)
 	vas_clean(vas);
 }
 
+/**
+ * Measures VMA lookups and first-fit allocations with a growing number of
+ * VMAs. Reservations are placed with a one page hole in between, so that
+ * they do not merge and first-fit has to skip all holes for larger ranges.
+ */
+#define VMEM_BENCH_VMAS_MIN 64
+#define VMEM_BENCH_VMAS_MAX 4096
+UK_TESTCASE(ukvmem, test_vma_tree_bench)
+{
+	struct uk_vas *vas = vas_init();
+	const struct uk_vma *vma;
+	unsigned int n, i, errors;
+	__nsec start, t_find, t_fit;
+	__vaddr_t base, va;
+	int rc;
+
+	for (n = VMEM_BENCH_VMAS_MIN; n <= VMEM_BENCH_VMAS_MAX; n *= 4) {
+		/* Find a free area that fits all reservations */
+		base = __VADDR_ANY;
+		rc = uk_vma_reserve(vas, &base, 2 * n * PAGE_SIZE);
+		UK_TEST_ASSERT(rc == 0);
+
+		rc = uk_vma_unmap(vas, base, 2 * n * PAGE_SIZE, 0);
+		UK_TEST_ASSERT(rc == 0);
+
+		for (i = 0; i < n; i++) {
+			va = base + 2 * i * PAGE_SIZE;
+			rc = uk_vma_reserve(vas, &va, PAGE_SIZE);
+			if (unlikely(rc))
+				break;
+		}
+		UK_TEST_ASSERT(i == n);
+
+		/* Look up the reservations in a scattered order */
+		errors = 0;
+		start = ukplat_monotonic_clock();
+		for (i = 0; i < n; i++) {
+			va = base + 2 * ((i * 7919) % n) * PAGE_SIZE;
+			vma = uk_vma_find(vas, va);
+			if (unlikely(!vma || vma->start != va))
+				errors++;
+		}
+		t_find = ukplat_monotonic_clock() - start;
+		UK_TEST_EXPECT_ZERO(errors);
+		UK_TEST_EXPECT_NULL(uk_vma_find(vas, base + PAGE_SIZE));
+
+		/* None of the holes fits two pages */
+		errors = 0;
+		start = ukplat_monotonic_clock();
+		for (i = 0; i < n; i++) {
+			va = __VADDR_ANY;
+			rc = uk_vma_reserve(vas, &va, 2 * PAGE_SIZE);
+			if (unlikely(rc)) {
+				errors++;
+				continue;
+			}
+
+			if (va > base && va < base + 2 * n * PAGE_SIZE)
+				errors++;
+
+			uk_vma_unmap(vas, va, 2 * PAGE_SIZE, 0);
+		}
+		t_fit = ukplat_monotonic_clock() - start;
+		UK_TEST_EXPECT_ZERO(errors);
+
+		pr_info("   %u VMAs: find %"__PRInsec" ns/op, "
+			"first-fit %"__PRInsec" ns/op\n", n,
+			t_find / n, t_fit / n);
+
+		rc = uk_vma_unmap(vas, base, 2 * n * PAGE_SIZE, 0);
+		UK_TEST_EXPECT_ZERO(rc);
+	}
+
+	vas_clean(vas);
+}
+
 uk_testsuite_register(ukvmem, NULL);
@@ -0,0 +1,242 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+
+#include "vmem.h"
+
+#include <uk/config.h>
+#include <uk/essentials.h>
+#include <uk/assert.h>
+#include <uk/print.h>
+#include <uk/list.h>
+#include <uk/falloc.h>
+#include <uk/arch/paging.h>
+#include <uk/plat/paging.h>
+#if CONFIG_LIBUKVMEM_THP_COLLAPSE
+#include <uk/arch/time.h>
+#include <uk/init.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/time.h>
+#include <uk/sched_idlework.h>
+#endif /* CONFIG_LIBUKVMEM_THP_COLLAPSE */
+#if CONFIG_LIBUKSTORE
+#include <uk/vmem_store.h>
+#include <uk/store.h>
+#endif /* CONFIG_LIBUKSTORE */
+
+struct vmem_thp_stats vmem_thp_stats;
+int vmem_thp_enabled = 1;
+
+#if CONFIG_LIBUKVMEM_THP_COLLAPSE
+/* Frames of the range that is collapsed. Ranges are only collapsed while a
+ * single LCPU is running, so a single array suffices.
+ */
+static __paddr_t thp_frames[VMEM_THP_PAGES];
+
+/* Address at which the scan continues in the next step */
+static __vaddr_t thp_scan_addr;
+
+/* Earliest time at which the next scan starts */
+static __nsec thp_next_scan;
+
+/* Migrates a large page range that is completely paged-in with small pages
+ * to a large page. Returns -ENOENT if the range is not paged-in completely
+ * or is already mapped with a large page.
+ */
+static int thp_collapse(struct uk_pagetable *pt, struct uk_vma *vma,
+			__vaddr_t vbase)
+{
+	__paddr_t paddr = __PADDR_ANY;
+	unsigned int lvl = PAGE_LEVEL;
+	__vaddr_t pt_vaddr, kvaddr;
+	unsigned long irqf;
+	unsigned int i;
+	__pte_t pte;
+	int rc;
+
+	UK_ASSERT(PAGE_Lx_ALIGNED(vbase, VMEM_THP_LEVEL));
+
+	rc = ukplat_pt_walk(pt, vbase, &lvl, &pt_vaddr, &pte);
+	if (unlikely(rc))
+		return rc;
+
+	if (lvl != PAGE_LEVEL)
+		return -ENOENT;
+
+	/* The page table at PAGE_LEVEL maps exactly the large page range */
+	UK_ASSERT(PT_Lx_PTES(PAGE_LEVEL) == VMEM_THP_PAGES);
+
+	for (i = 0; i < VMEM_THP_PAGES; i++) {
+		rc = ukarch_pte_read(pt_vaddr, PAGE_LEVEL, i, &pte);
+		if (unlikely(rc))
+			return rc;
+
+		if (!PT_Lx_PTE_PRESENT(pte, PAGE_LEVEL))
+			return -ENOENT;
+
+		thp_frames[i] = PT_Lx_PTE_PADDR(pte, PAGE_LEVEL);
+	}
+
+	rc = pt->fa->falloc(pt->fa, &paddr, VMEM_THP_PAGES,
+			    FALLOC_FLAG_ALIGNED);
+	if (unlikely(rc))
+		return rc;
+
+	kvaddr = ukplat_page_kmap(pt, paddr, VMEM_THP_PAGES, 0);
+	if (unlikely(kvaddr == __VADDR_INV)) {
+		pt->fa->ffree(pt->fa, paddr, VMEM_THP_PAGES);
+		return -ENOMEM;
+	}
+
+	/* The range must not be modified between the copy and the remap */
+	irqf = ukplat_lcpu_save_irqf();
+
+	memcpy((void *)kvaddr, (void *)vbase, VMEM_THP_SIZE);
+
+	/* Unmapping frees the page table so that the large page can be
+	 * mapped. The frames are kept to restore the mapping on failure.
+	 */
+	rc = ukplat_page_unmap(pt, vbase, VMEM_THP_PAGES,
+			       PAGE_FLAG_KEEP_FRAMES);
+	if (likely(rc == 0))
+		rc = ukplat_page_map(pt, vbase, paddr, 1, vma->attr,
+				     PAGE_FLAG_SIZE(VMEM_THP_LEVEL) |
+				     PAGE_FLAG_FORCE_SIZE);
+	if (unlikely(rc)) {
+		for (i = 0; i < VMEM_THP_PAGES; i++) {
+			if (ukplat_page_map(pt, vbase + (i << PAGE_SHIFT),
+					    thp_frames[i], 1, vma->attr, 0))
+				UK_CRASH("Failed to restore mapping at 0x%"
+					 __PRIvaddr "\n",
+					 vbase + (i << PAGE_SHIFT));
+		}
+	}
+
+	ukplat_lcpu_restore_irqf(irqf);
+	ukplat_page_kunmap(pt, kvaddr, VMEM_THP_PAGES, 0);
+
+	if (unlikely(rc)) {
+		pt->fa->ffree(pt->fa, paddr, VMEM_THP_PAGES);
+		return rc;
+	}
+
+	for (i = 0; i < VMEM_THP_PAGES; i++)
+		pt->fa->ffree(pt->fa, thp_frames[i], 1);
+
+	return 0;
+}
+
+/* Idle work that scans the anonymous VMAs of the active address space for
+ * ranges to collapse. A step does not block, so the VMA list cannot change
+ * while it is walked. Each step collapses at most
+ * LIBUKVMEM_THP_COLLAPSE_BATCH ranges and the next step continues at the
+ * same address. A new scan starts at most once per scan interval. Page table
+ * updates are not synchronized with other LCPUs, so nothing is collapsed
+ * while secondary LCPUs are running.
+ */
+static int thp_collapse_work(void *arg __unused)
+{
+	struct uk_vas *vas = uk_vas_get_active();
+	unsigned int collapsed = 0;
+	struct uk_vma *vma;
+	__vaddr_t vbase;
+	__nsec now;
+	int rc;
+
+	if (!vas || !vmem_thp_enabled || ukplat_lcpu_count() > 1)
+		return 0;
+
+	now = ukplat_monotonic_clock();
+	if (!thp_scan_addr && now < thp_next_scan)
+		return 0;
+
+	uk_list_for_each_entry(vma, &vas->vma_list, vma_list) {
+		if (vma->end <= thp_scan_addr)
+			continue;
+
+		vbase = PAGE_Lx_ALIGN_UP(MAX(vma->start, thp_scan_addr),
+					 VMEM_THP_LEVEL);
+		for (; vmem_thp_allowed(vma, vbase); vbase += VMEM_THP_SIZE) {
+			rc = thp_collapse(vas->pt, vma, vbase);
+			if (rc == -ENOENT)
+				continue;
+
+			if (unlikely(rc)) {
+				vmem_thp_stats.collapse_failed++;
+				continue;
+			}
+
+			vmem_thp_stats.collapse_alloc++;
+			if (++collapsed == CONFIG_LIBUKVMEM_THP_COLLAPSE_BATCH) {
+				thp_scan_addr = vbase + VMEM_THP_SIZE;
+				return 1;
+			}
+		}
+	}
+
+	thp_scan_addr = 0;
+	thp_next_scan = now + ukarch_time_msec_to_nsec(
+		CONFIG_LIBUKVMEM_THP_COLLAPSE_INTERVAL_MS);
+	vmem_thp_stats.full_scans++;
+	return 0;
+}
+
+static struct uk_sched_idlework thp_collapse_idlework = {
+	.work = thp_collapse_work,
+	.arg  = __NULL,
+};
+
+static int thp_init(struct uk_init_ctx *ictx __unused)
+{
+	/* Without a scheduler, idle threads and thus the collapse never run */
+	uk_sched_idlework_register(&thp_collapse_idlework);
+	return 0;
+}
+
+uk_lib_initcall(thp_init, 0x0);
+#endif /* CONFIG_LIBUKVMEM_THP_COLLAPSE */
+
+#if CONFIG_LIBUKSTORE
+static int get_thp_enabled(void *cookie __unused, __u64 *out)
+{
+	*out = (__u64)vmem_thp_enabled;
+	return 0;
+}
+
+static int set_thp_enabled(void *cookie __unused, __u64 val)
+{
+	vmem_thp_enabled = !!val;
+	return 0;
+}
+
+#define THP_STATS_GETTER(field)						\
+	static int get_thp_##field(void *cookie __unused, __u64 *out)	\
+	{								\
+		*out = vmem_thp_stats.field;				\
+		return 0;						\
+	}
+
+UK_STORE_STATIC_ENTRY(UK_VMEM_THP_ENABLED, thp_enabled, u64,
+		      get_thp_enabled, set_thp_enabled);
+THP_STATS_GETTER(fault_alloc)
+UK_STORE_STATIC_ENTRY(UK_VMEM_THP_FAULT_ALLOC, thp_fault_alloc, u64,
+		      get_thp_fault_alloc, NULL);
+THP_STATS_GETTER(fault_fallback)
+UK_STORE_STATIC_ENTRY(UK_VMEM_THP_FAULT_FALLBACK, thp_fault_fallback, u64,
+		      get_thp_fault_fallback, NULL);
+THP_STATS_GETTER(collapse_alloc)
+UK_STORE_STATIC_ENTRY(UK_VMEM_THP_COLLAPSE_ALLOC, thp_collapse_alloc, u64,
+		      get_thp_collapse_alloc, NULL);
+THP_STATS_GETTER(collapse_failed)
+UK_STORE_STATIC_ENTRY(UK_VMEM_THP_COLLAPSE_FAILED, thp_collapse_failed, u64,
+		      get_thp_collapse_failed, NULL);
+THP_STATS_GETTER(full_scans)
+UK_STORE_STATIC_ENTRY(UK_VMEM_THP_FULL_SCANS, thp_full_scans, u64,
+		      get_thp_full_scans, NULL);
+#endif /* CONFIG_LIBUKSTORE */
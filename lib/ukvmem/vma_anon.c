@@ -33,14 +33,35 @@ static int vma_op_anon_fault(struct uk_vma *vma, struct uk_vm_fault *fault)
 	struct uk_pagetable * const pt = vma->vas->pt;
 	unsigned long pages = fault->len / PAGE_SIZE;
 	__paddr_t paddr = __PADDR_ANY;
+	unsigned long fflags = 0;
 	__vaddr_t vaddr;
 	int rc;
 
 	UK_ASSERT(PAGE_ALIGNED(fault->len));
-	UK_ASSERT(fault->len == PAGE_Lx_SIZE(fault->level));
+	UK_ASSERT(PAGE_Lx_ALIGNED(fault->len, fault->level));
 	UK_ASSERT(fault->type & UK_VMA_FAULT_NONPRESENT);
 
-	rc = pt->fa->falloc(pt->fa, &paddr, pages, FALLOC_FLAG_ALIGNED);
+	/* Fault-around batches only need to be page-aligned */
+	if (fault->len == PAGE_Lx_SIZE(fault->level))
+		fflags = FALLOC_FLAG_ALIGNED;
+
+	/* Let the frame allocator zero the frames. It may hand out frames
+	 * that were zeroed in advance, which keeps zeroing off the fault path.
+	 * We zero the frames ourselves if the allocator cannot do so.
+	 */
+	if (!(vma->flags & UK_VMA_FLAG_UNINITIALIZED)) {
+		rc = pt->fa->falloc(pt->fa, &paddr, pages,
+				    fflags | FALLOC_FLAG_ZEROED);
+		if (rc != -ENOTSUP) {
+			if (unlikely(rc))
+				return rc;
+
+			fault->paddr = paddr;
+			return 0;
+		}
+	}
+
+	rc = pt->fa->falloc(pt->fa, &paddr, pages, fflags);
 	if (unlikely(rc))
 		return rc;
 
@@ -71,8 +71,8 @@ static int vma_op_dma_unmap(struct uk_vma *vma, __vaddr_t vaddr, __sz len)
 	UK_ASSERT(vaddr >= vma->start);
 	UK_ASSERT(vaddr + len <= vma->end);
 
-	return ukplat_page_unmap(vma->vas->pt, vaddr, len >> PAGE_SHIFT,
-				 PAGE_FLAG_KEEP_FRAMES);
+	return vmem_page_unmap(vma, vaddr, len >> PAGE_SHIFT,
+			       PAGE_FLAG_KEEP_FRAMES);
 }
 
 static int vma_op_dma_split(struct uk_vma *vma, __vaddr_t vaddr,
@@ -18,8 +18,12 @@
 #include <uk/plat/paging.h>
 #endif /* CONFIG_HAVE_PAGING */
 #include <vfscore/file.h>
+#include <vfscore/fs.h>
 #include <vfscore/vnode.h>
 #include <vfscore/uio.h>
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+#include <vfscore/pagecache.h>
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
 #include <uk/isr/string.h>
 
 #ifdef CONFIG_LIBUKVMEM_FILE_BASE
@@ -31,28 +35,51 @@ static __vaddr_t vma_op_file_get_base(struct uk_vas *vas __unused,
 }
 #endif /* CONFIG_LIBUKVMEM_FILE_BASE */
 
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+/* Shared mappings of regular files map the pages of the page cache */
+static inline int vma_file_cached(struct vfscore_file *f, unsigned long flags)
+{
+	return (flags & UK_VMA_FILE_SHARED) &&
+	       vfscore_pagecache_enabled(f->f_dentry->d_vnode);
+}
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
+
+/* Returns 0 if the mapping can be made writable */
+static int vma_file_check_write(struct vfscore_file *f, unsigned long flags)
+{
+	if (!(flags & UK_VMA_FILE_SHARED))
+		return 0;
+
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+	if (vma_file_cached(f, flags))
+		return (f->f_flags & UK_FWRITE) ? 0 : -EACCES;
+#else /* CONFIG_LIBVFSCORE_PAGECACHE */
+	(void)f;
+#endif /* !CONFIG_LIBVFSCORE_PAGECACHE */
+
+	/* Writable shared mappings are only supported with the page cache.
+	 * Read-only shared mappings are partially supported without it.
+	 *
+	 * We treat read-only shared mappings as private. Note that any writes
+	 * to the underlying file while the mapping is established will not be
+	 * reflected in memory.
+	 */
+	return -ENOTSUP;
+}
+
 int vma_op_file_new(struct uk_vas *vas, __vaddr_t vaddr __unused,
 		    __sz len __unused, void *data, unsigned long attr,
 		    unsigned long *flags, struct uk_vma **vma)
 {
 	struct uk_vma_file_args *args = (struct uk_vma_file_args *)data;
 	struct uk_vma_file *vma_file;
+	int rc;
 
 	UK_ASSERT(data);
 	UK_ASSERT(args->fd >= 0);
 	UK_ASSERT(args->offset >= 0);
 	UK_ASSERT(PAGE_ALIGNED(args->offset));
 
-	/* Writable shared mappings are not supported.
-	 * Read-only shared mappings are partially supported.
-	 *
-	 * We treat read-only shared mappings as private. Note that any writes
-	 * to the underlying file while the mapping is established will not be
-	 * reflected in memory.
-	 */
-	if ((*flags & UK_VMA_FILE_SHARED) && (attr & PAGE_ATTR_PROT_WRITE))
-		return -ENOTSUP;
-
 	/* Since we cannot do ISR-safe file accesses in the fault handler,
 	 * we enforce full load at mapping time for now.
 	 *
@@ -71,6 +98,15 @@ int vma_op_file_new(struct uk_vas *vas, __vaddr_t vaddr __unused,
 	}
 	vma_file->offset = args->offset;
 
+	if (attr & PAGE_ATTR_PROT_WRITE) {
+		rc = vma_file_check_write(vma_file->f, *flags);
+		if (unlikely(rc)) {
+			fdrop(vma_file->f);
+			uk_free(vas->a, vma_file);
+			return rc;
+		}
+	}
+
 	/* Use the file name as VMA name. Since the memory management of the
 	 * string is tied to the file object, we do not need to care about
 	 * freeing it. So it is ok, if the caller should override the name.
@@ -109,7 +145,12 @@ static int vma_file_read(struct vfscore_file *fp, __vaddr_t buf, __sz len,
 	int rc;
 
 	vn_lock(vp);
-	rc = VOP_READ(vp, fp, &uio, 0);
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+	if (vfscore_pagecache_enabled(vp))
+		rc = vfscore_pagecache_read(vp, fp, &uio);
+	else
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
+		rc = VOP_READ(vp, fp, &uio, 0);
 	vn_unlock(vp);
 
 	if (unlikely(rc))
@@ -121,22 +162,192 @@ static int vma_file_read(struct vfscore_file *fp, __vaddr_t buf, __sz len,
 	return 0;
 }
 
+static inline __off vma_file_offset(struct uk_vma *vma, __vaddr_t vaddr)
+{
+	UK_ASSERT(vaddr >= vma->start);
+
+	return ((struct uk_vma_file *)vma)->offset + (vaddr - vma->start);
+}
+
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+/* Maps the page of the page cache. Larger pages are refused with -ENOMEM so
+ * that the range is mapped with single pages instead.
+ */
+static int vma_file_fault_cached(struct uk_vma *vma,
+				 struct uk_vm_fault *fault)
+{
+	struct uk_vma_file *vma_file = (struct uk_vma_file *)vma;
+	struct vnode *vp = vma_file->f->f_dentry->d_vnode;
+	int rc;
+
+	if (fault->len != PAGE_SIZE)
+		return -ENOMEM;
+
+	vn_lock(vp);
+	rc = vfscore_pagecache_map(vp, vma_file->f,
+				   vma_file_offset(vma, fault->vbase),
+				   vma->attr & PAGE_ATTR_PROT_WRITE,
+				   &fault->paddr);
+	vn_unlock(vp);
+
+	return -rc;
+}
+
+/* Calls fn for every page that is mapped in the given range of a cached
+ * mapping. Cached mappings only use pages of PAGE_LEVEL. The vnode is locked
+ * during the walk.
+ */
+static int vma_file_walk(struct uk_vma *vma, __vaddr_t vaddr, __sz len,
+			 int (*fn)(struct uk_vma *, struct vnode *,
+				   __vaddr_t, void *), void *arg)
+{
+	struct uk_vma_file *vma_file = (struct uk_vma_file *)vma;
+	struct vnode *vp = vma_file->f->f_dentry->d_vnode;
+	struct uk_pagetable *pt = vma->vas->pt;
+	__vaddr_t end = vaddr + len;
+	unsigned int lvl;
+	__pte_t pte;
+	int rc = 0;
+
+	vn_lock(vp);
+	while (vaddr < end) {
+		lvl = PAGE_LEVEL;
+		rc = ukplat_pt_walk(pt, vaddr, &lvl, __NULL, &pte);
+		if (unlikely(rc))
+			break;
+
+		if (!PT_Lx_PTE_PRESENT(pte, lvl)) {
+			/* Skip the range without page table */
+			vaddr = PAGE_Lx_ALIGN_DOWN(vaddr, lvl) +
+				PAGE_Lx_SIZE(lvl);
+			continue;
+		}
+
+		UK_ASSERT(lvl == PAGE_LEVEL);
+
+		rc = fn(vma, vp, vaddr, arg);
+		if (unlikely(rc))
+			break;
+
+		vaddr += PAGE_SIZE;
+	}
+	vn_unlock(vp);
+
+	return rc;
+}
+
+#define VMA_FILE_UNMAP_BATCH	64
+
+struct vma_file_unmap_batch {
+	struct vnode *vp;
+	unsigned int count;
+	__off offs[VMA_FILE_UNMAP_BATCH];
+};
+
+/* Drops the page cache references of the unmapped pages in the batch. The
+ * page cache may reuse a frame as soon as its last mapping is dropped, so
+ * the TLB flush gathered by uk_vma_unmap() must have happened before.
+ */
+static void vma_file_unmap_release(struct uk_vma *vma,
+				   struct vma_file_unmap_batch *b)
+{
+	unsigned int i;
+
+	if (vma->vas->tlb)
+		ukplat_tlb_gather_flush(vma->vas->tlb);
+
+	for (i = 0; i < b->count; i++)
+		vfscore_pagecache_unmap(b->vp, b->offs[i]);
+
+	b->count = 0;
+}
+
+static int vma_file_unmap_page(struct uk_vma *vma, struct vnode *vp,
+			       __vaddr_t vaddr, void *arg)
+{
+	struct vma_file_unmap_batch *b = arg;
+	int rc;
+
+	/* The frame belongs to the page cache */
+	rc = vmem_page_unmap(vma, vaddr, 1, PAGE_FLAG_KEEP_FRAMES);
+	if (unlikely(rc))
+		return rc;
+
+	b->vp = vp;
+	b->offs[b->count++] = vma_file_offset(vma, vaddr);
+	if (b->count == VMA_FILE_UNMAP_BATCH)
+		vma_file_unmap_release(vma, b);
+
+	return 0;
+}
+
+static int vma_file_unmap(struct uk_vma *vma, __vaddr_t vaddr, __sz len)
+{
+	struct vma_file_unmap_batch b;
+	int rc;
+
+	b.count = 0;
+	rc = vma_file_walk(vma, vaddr, len, vma_file_unmap_page, &b);
+
+	/* Also release the pages unmapped before a failure */
+	if (b.count) {
+		vn_lock(b.vp);
+		vma_file_unmap_release(vma, &b);
+		vn_unlock(b.vp);
+	}
+
+	return rc;
+}
+
+static int vma_file_dirty_page(struct uk_vma *vma, struct vnode *vp,
+			       __vaddr_t vaddr, void *arg __unused)
+{
+	vfscore_pagecache_set_dirty(vp, vma_file_offset(vma, vaddr));
+	return 0;
+}
+
+static int vma_file_sync(struct uk_vma *vma, __vaddr_t vaddr, __sz len)
+{
+	struct uk_vma_file *vma_file = (struct uk_vma_file *)vma;
+	struct vnode *vp = vma_file->f->f_dentry->d_vnode;
+	int rc;
+
+	vn_lock(vp);
+	rc = vfscore_pagecache_sync(vp, vma_file_offset(vma, vaddr), len);
+	if (!rc)
+		rc = VOP_FSYNC(vp, vma_file->f);
+	vn_unlock(vp);
+
+	return -rc;
+}
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
+
 static int vma_op_file_fault(struct uk_vma *vma, struct uk_vm_fault *fault)
 {
 	struct uk_vma_file *vma_file = (struct uk_vma_file *)vma;
 	struct uk_pagetable * const pt = vma->vas->pt;
 	unsigned long pages = fault->len / PAGE_SIZE;
 	__paddr_t paddr = __PADDR_ANY;
+	unsigned long fflags = 0;
 	__vaddr_t vaddr;
 	__sz bytes;
 	__off off;
 	int rc;
 
 	UK_ASSERT(PAGE_ALIGNED(fault->len));
-	UK_ASSERT(fault->len == PAGE_Lx_SIZE(fault->level));
+	UK_ASSERT(PAGE_Lx_ALIGNED(fault->len, fault->level));
 	UK_ASSERT(fault->type & UK_VMA_FAULT_NONPRESENT);
 
-	rc = pt->fa->falloc(pt->fa, &paddr, pages, FALLOC_FLAG_ALIGNED);
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+	if (vma_file_cached(vma_file->f, vma->flags))
+		return vma_file_fault_cached(vma, fault);
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
+
+	/* Fault-around batches only need to be page-aligned */
+	if (fault->len == PAGE_Lx_SIZE(fault->level))
+		fflags = FALLOC_FLAG_ALIGNED;
+
+	rc = pt->fa->falloc(pt->fa, &paddr, pages, fflags);
 	if (unlikely(rc))
 		return rc;
 
@@ -147,7 +358,7 @@ static int vma_op_file_fault(struct uk_vma *vma, struct uk_vm_fault *fault)
 			return -ENOMEM;
 		}
 
-		off = (fault->vbase - vma->start) + vma_file->offset;
+		off = vma_file_offset(vma, fault->vbase);
 
 		rc = vma_file_read(vma_file->f, vaddr, fault->len, off, &bytes);
 		if (unlikely(rc)) {
@@ -217,21 +428,78 @@ static int vma_op_file_merge(struct uk_vma *vma, struct uk_vma *next)
 	return 0;
 }
 
+static int vma_op_file_unmap(struct uk_vma *vma, __vaddr_t vaddr, __sz len)
+{
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+	struct uk_vma_file *vma_file = (struct uk_vma_file *)vma;
+
+	if (vma_file_cached(vma_file->f, vma->flags))
+		return vma_file_unmap(vma, vaddr, len);
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
+
+	/* Default handler */
+	return vma_op_unmap(vma, vaddr, len);
+}
+
 static int vma_op_file_set_attr(struct uk_vma *vma, unsigned long attr)
 {
-	/* Writable shared mappings are not supported. */
-	if ((vma->flags & UK_VMA_FILE_SHARED) && (attr & PAGE_ATTR_PROT_WRITE))
-		return -EPERM;
+	struct uk_vma_file *vma_file = (struct uk_vma_file *)vma;
+	int rc;
+
+	if (attr & PAGE_ATTR_PROT_WRITE) {
+		if (vma_file_check_write(vma_file->f, vma->flags))
+			return -EPERM;
+	}
+
+	/* Default handler */
+	rc = vma_op_set_attr(vma, attr);
+	if (unlikely(rc))
+		return rc;
+
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+	/* Pages that become writable can be modified from now on */
+	if (vma_file_cached(vma_file->f, vma->flags) &&
+	    (attr & PAGE_ATTR_PROT_WRITE) &&
+	    !(vma->attr & PAGE_ATTR_PROT_WRITE))
+		return vma_file_walk(vma, vma->start, vmem_vma_len(vma),
+				     vma_file_dirty_page, __NULL);
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
+
+	return 0;
+}
+
+static int vma_op_file_advise(struct uk_vma *vma, __vaddr_t vaddr, __sz len,
+			      unsigned long advice)
+{
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+	struct uk_vma_file *vma_file = (struct uk_vma_file *)vma;
+	int rc;
+
+	if (vma_file_cached(vma_file->f, vma->flags)) {
+		if (advice & UK_VMA_FILE_ADV_SYNC) {
+			rc = vma_file_sync(vma, vaddr, len);
+			if (unlikely(rc))
+				return rc;
+		}
+
+		/* WILLNEED takes precedence over DONTNEED. The frames
+		 * belong to the page cache, so only the mapping is removed.
+		 */
+		if ((advice & UK_VMA_ADV_DONTNEED) &&
+		    !(advice & UK_VMA_ADV_WILLNEED))
+			return vma_file_unmap(vma, vaddr, len);
+	}
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
 
 	/* Default handler */
-	return vma_op_set_attr(vma, attr);
+	return vma_op_advise(vma, vaddr, len, advice);
 }
 
-/* We only support private mappings. Changes are not carried through to the
- * underlying file. So we can just use the default unmap handler that unmaps
- * the memory and forgets about it. Private file mappings can also change their
- * protections without checking for the permissions on the underlying file. We
- * can thus also use the default attribute setter.
+/* Private mappings are not carried through to the underlying file, so they
+ * are unmapped like anonymous memory and can also change their protections
+ * without checking for the permissions on the underlying file. Shared mappings
+ * of the page cache only drop their page references when unmapped, because
+ * the frames belong to the page cache.
  */
 const struct uk_vma_ops uk_vma_file_ops = {
 #ifdef CONFIG_LIBUKVMEM_FILE_BASE
@@ -242,9 +510,9 @@ const struct uk_vma_ops uk_vma_file_ops = {
 	.new		= vma_op_file_new,
 	.destroy	= vma_op_file_destroy,
 	.fault		= vma_op_file_fault,
-	.unmap		= vma_op_unmap,		/* default */
+	.unmap		= vma_op_file_unmap,
 	.split		= vma_op_file_split,
 	.merge		= vma_op_file_merge,
 	.set_attr	= vma_op_file_set_attr,
-	.advise		= vma_op_advise,	/* default */
+	.advise		= vma_op_file_advise,
 };
@@ -79,6 +79,18 @@ static int vma_op_stack_fault(struct uk_vma *vma, struct uk_vm_fault *fault)
 		return -EFAULT;
 	}
 
+	/* See vma_op_anon_fault() */
+	if (!(vma->flags & UK_VMA_FLAG_UNINITIALIZED)) {
+		rc = pt->fa->falloc(pt->fa, &paddr, 1, FALLOC_FLAG_ZEROED);
+		if (rc != -ENOTSUP) {
+			if (unlikely(rc))
+				return rc;
+
+			fault->paddr = paddr;
+			return 0;
+		}
+	}
+
 	rc = pt->fa->falloc(pt->fa, &paddr, 1, 0);
 	if (unlikely(rc))
 		return rc;
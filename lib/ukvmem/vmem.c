@@ -14,11 +14,16 @@
 #include <uk/arch/paging.h>
 #ifdef CONFIG_HAVE_PAGING
 #include <uk/plat/paging.h>
+#include <uk/falloc.h>
 #endif /* CONFIG_HAVE_PAGING */
 #include <uk/alloc.h>
 #include <uk/assert.h>
 #include <uk/list.h>
+#include <uk/tree.h>
 #include <uk/config.h>
+#if CONFIG_LIBVFSCORE_PAGECACHE
+#include <vfscore/pagecache.h>
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
 
 /*
  * Pointer to currently active virtual address space.
@@ -30,6 +35,101 @@ static struct uk_vas *vmem_active_vas;
 static void vmem_vma_unmap(struct uk_vma *vma, __vaddr_t vaddr, __sz len);
 static void vmem_vma_unlink_and_free(struct uk_vma *vma);
 
+/*
+ * VMA tree
+ * --------
+ * In addition to the sorted list, the VMAs of a VAS are indexed by a
+ * red-black tree on their start address. Each node stores the largest gap
+ * between a VMA and its predecessor within its subtree, so that
+ * vmem_first_fit() can skip subtrees without a large enough hole. Gaps are
+ * computed from the list, so a VMA must be linked into the list before it
+ * is inserted into the tree and removed from the tree before it is unlinked.
+ * Whenever the predecessor of a VMA changes, the VMA has to be updated with
+ * UK_RB_UPDATE_AUGMENT().
+ */
+static inline __sz vmem_vma_gap(struct uk_vma *vma)
+{
+	const struct uk_vma *prev = uk_vma_prev(vma);
+
+	return vma->start - ((prev) ? prev->end : 0);
+}
+
+static inline void vmem_vma_augment(struct uk_vma *vma)
+{
+	struct uk_vma *child;
+	__sz gap = vmem_vma_gap(vma);
+
+	child = UK_RB_LEFT(vma, vma_node);
+	if (child && child->subtree_gap > gap)
+		gap = child->subtree_gap;
+
+	child = UK_RB_RIGHT(vma, vma_node);
+	if (child && child->subtree_gap > gap)
+		gap = child->subtree_gap;
+
+	vma->subtree_gap = gap;
+}
+
+static inline int vmem_vma_cmp(struct uk_vma *a, struct uk_vma *b)
+{
+	return (a->start > b->start) - (a->start < b->start);
+}
+
+/* Always continue the update up to the root. Stopping at the first node
+ * whose gap did not change leaves stale gaps behind after removals.
+ */
+#undef UK_RB_AUGMENT_CHECK
+#define UK_RB_AUGMENT_CHECK(x) (vmem_vma_augment(x), 1)
+
+UK_RB_GENERATE_STATIC(uk_vma_tree, uk_vma, vma_node, vmem_vma_cmp);
+
+static inline void vmem_vma_tree_insert(struct uk_vas *vas,
+					struct uk_vma *vma)
+{
+	struct uk_vma *next;
+
+	vma->subtree_gap = 0;
+	UK_RB_INSERT(uk_vma_tree, &vas->vma_tree, vma);
+
+	/* The gap in front of the next VMA shrinks */
+	next = (struct uk_vma *)uk_vma_next(vma);
+	if (next)
+		UK_RB_UPDATE_AUGMENT(next, vma_node);
+}
+
+static inline void vmem_vma_tree_remove(struct uk_vas *vas,
+					struct uk_vma *vma)
+{
+	UK_RB_REMOVE(uk_vma_tree, &vas->vma_tree, vma);
+
+	if (vas->vma_cache == vma)
+		vas->vma_cache = __NULL;
+}
+
+/* Unlinks the VMAs from start to end from the list and tree of the VAS */
+static void vmem_vma_unlink_range(struct uk_vas *vas, struct uk_vma *start,
+				  struct uk_vma *end)
+{
+	struct uk_vma *vma = start, *next;
+
+	for (;;) {
+		vmem_vma_tree_remove(vas, vma);
+		if (vma == end)
+			break;
+
+		vma = uk_list_next_entry(vma, vma_list);
+	}
+
+	next = (struct uk_vma *)uk_vma_next(end);
+
+	start->vma_list.prev->next = end->vma_list.next;
+	end->vma_list.next->prev   = start->vma_list.prev;
+
+	/* The gap in front of the next VMA grows */
+	if (next)
+		UK_RB_UPDATE_AUGMENT(next, vma_node);
+}
+
 struct uk_vas *uk_vas_get_active(void)
 {
 	return vmem_active_vas;
@@ -63,11 +163,15 @@ int uk_vas_init(struct uk_vas *vas, struct uk_pagetable *pt __maybe_unused,
 
 	vas->vma_base = PAGE_ALIGN_UP(CONFIG_LIBUKVMEM_DEFAULT_BASE);
 	UK_ASSERT(ukarch_vaddr_isvalid(vas->vma_base));
+
+	vas->tlb = __NULL;
 #endif /* CONFIG_HAVE_PAGING */
 
 	vas->flags = 0;
 
 	UK_INIT_LIST_HEAD(&vas->vma_list);
+	UK_RB_INIT(&vas->vma_tree);
+	vas->vma_cache = __NULL;
 
 	return 0;
 }
@@ -82,6 +186,7 @@ void uk_vas_destroy(struct uk_vas *vas)
 	}
 
 	UK_ASSERT(uk_list_empty(&vas->vma_list));
+	UK_ASSERT(UK_RB_EMPTY(&vas->vma_tree));
 
 	if (vmem_active_vas == vas)
 		vmem_active_vas = __NULL;
@@ -102,26 +207,42 @@ static void vmem_vma_unlink_and_free(struct uk_vma *vma)
 	UK_ASSERT(vma);
 	UK_ASSERT(!uk_list_empty(&vma->vma_list));
 
-	uk_list_del(&vma->vma_list);
+	vmem_vma_unlink_range(vma->vas, vma, vma);
 	vmem_vma_destroy(vma);
 }
 
+/* Returns the first VMA that overlaps with the given address range */
 static struct uk_vma *vmem_vma_find(struct uk_vas *vas, __vaddr_t vaddr,
 				    __sz len)
 {
-	struct uk_vma *vma;
+	struct uk_vma *vma, *found = __NULL;
 	__vaddr_t vstart = vaddr;
 	__vaddr_t vend = vaddr + MAX(len, (__sz)1);
 
 	UK_ASSERT(vas);
 	UK_ASSERT(vaddr <= __VADDR_MAX - len);
 
-	uk_list_for_each_entry(vma, &vas->vma_list, vma_list) {
-		if ((vend > vma->start) && (vstart < vma->end))
-			return vma;
+	/* Consecutive faults and lookups often hit the same VMA */
+	vma = vas->vma_cache;
+	if (vma && vstart >= vma->start && vend <= vma->end)
+		return vma;
+
+	/* VMAs do not overlap, so their end addresses are sorted as well */
+	vma = UK_RB_ROOT(&vas->vma_tree);
+	while (vma) {
+		if (vstart < vma->end) {
+			found = vma;
+			vma = UK_RB_LEFT(vma, vma_node);
+		} else {
+			vma = UK_RB_RIGHT(vma, vma_node);
+		}
 	}
 
-	return __NULL;
+	if (!found || vend <= found->start)
+		return __NULL;
+
+	vas->vma_cache = found;
+	return found;
 }
 
 const struct uk_vma *uk_vma_find(struct uk_vas *vas, __vaddr_t vaddr)
@@ -230,26 +351,22 @@ static int vmem_vma_find_range(struct uk_vas *vas, __vaddr_t *vaddr, __sz *len,
 
 static void vmem_vma_insert(struct uk_vas *vas, struct uk_vma *vma)
 {
-	struct uk_list_head *prev;
-	struct uk_vma *cur;
+	struct uk_vma *next;
 
 	UK_ASSERT(vas);
 	UK_ASSERT(uk_list_empty(&vma->vma_list));
 	UK_ASSERT(!vmem_vma_find(vas, vma->start, vma->end - vma->start));
 
-	prev = &vas->vma_list;
-	uk_list_for_each_entry(cur, &vas->vma_list, vma_list) {
-		if (vma->start < cur->end) {
-			UK_ASSERT(vma->end <= cur->start);
+	next = UK_RB_NFIND(uk_vma_tree, &vas->vma_tree, vma);
+	if (next) {
+		UK_ASSERT(vma->end <= next->start);
 
-			uk_list_add(&vma->vma_list, prev);
-			return;
-		}
-
-		prev = &cur->vma_list;
+		uk_list_add_tail(&vma->vma_list, &next->vma_list);
+	} else {
+		uk_list_add_tail(&vma->vma_list, &vas->vma_list);
 	}
 
-	uk_list_add_tail(&vma->vma_list, &vas->vma_list);
+	vmem_vma_tree_insert(vas, vma);
 }
 
 static inline int vmem_vma_can_merge(struct uk_vma *vma, struct uk_vma *next)
@@ -356,6 +473,7 @@ static int vmem_vma_split(struct uk_vma *vma, __vaddr_t vaddr,
 	vma->end	= vaddr;
 
 	uk_list_add(&v->vma_list, &vma->vma_list);
+	vmem_vma_tree_insert(vma->vas, v);
 
 	*new_vma = v;
 	return 0;
@@ -444,7 +562,7 @@ int vma_op_unmap(struct uk_vma *vma, __vaddr_t vaddr, __sz len)
 	UK_ASSERT(vaddr + len <= vma->end);
 	UK_ASSERT(PAGE_ALIGNED(len));
 
-	return ukplat_page_unmap(vma->vas->pt, vaddr, len / PAGE_SIZE, 0);
+	return vmem_page_unmap(vma, vaddr, len / PAGE_SIZE, 0);
 }
 
 static void vmem_vma_unmap(struct uk_vma *vma, __vaddr_t vaddr, __sz len)
@@ -499,6 +617,9 @@ int uk_vma_unmap(struct uk_vas *vas, __vaddr_t vaddr, __sz len,
 		 unsigned long flags)
 {
 	struct uk_vma *vma_start = __NULL, *vma_end;
+#ifdef CONFIG_HAVE_PAGING
+	struct ukplat_tlb_gather tlb;
+#endif /* CONFIG_HAVE_PAGING */
 	int strict = (flags & UK_VMA_FLAG_STRICT_VMA_CHECK);
 	int rc;
 
@@ -515,19 +636,78 @@ int uk_vma_unmap(struct uk_vas *vas, __vaddr_t vaddr, __sz len,
 	}
 
 	/* Unlink all VMAs starting from vma_start to vma_end */
-	vma_start->vma_list.prev->next = vma_end->vma_list.next;
-	vma_end->vma_list.next->prev   = vma_start->vma_list.prev;
+	vmem_vma_unlink_range(vas, vma_start, vma_end);
+
+#ifdef CONFIG_HAVE_PAGING
+	/* Flush the TLB once for all VMAs instead of for every page */
+	UK_ASSERT(!vas->tlb);
+	ukplat_tlb_gather_begin(vas->pt, &tlb);
+	vas->tlb = &tlb;
+#endif /* CONFIG_HAVE_PAGING */
 
 	vmem_vma_unmap_and_free_vmas(vma_start, vma_end);
 
+#ifdef CONFIG_HAVE_PAGING
+	vas->tlb = __NULL;
+	ukplat_tlb_gather_end(&tlb);
+#endif /* CONFIG_HAVE_PAGING */
+
 	return 0;
 }
 
+/* Returns the lowest aligned address in the gap in front of the VMA that can
+ * accommodate len bytes at or above base, or __VADDR_INV.
+ */
+static __vaddr_t vmem_first_fit_gap(struct uk_vma *vma, __vaddr_t base,
+				    __sz align, __sz len)
+{
+	const struct uk_vma *prev = uk_vma_prev(vma);
+	__vaddr_t vaddr = MAX((prev) ? prev->end : 0, base);
+
+	if (unlikely(vaddr > __VADDR_MAX - align))
+		return __VADDR_INV;
+
+	vaddr = ALIGN_UP(vaddr, align);
+
+	if (unlikely(vaddr > __VADDR_MAX - len))
+		return __VADDR_INV;
+
+	return (vaddr + len <= vma->start) ? vaddr : __VADDR_INV;
+}
+
+/* Searches the subtree in address order. Subtrees without a large enough gap
+ * are skipped. The gaps in front of VMAs that start at or below base cannot
+ * contain a fitting address range, so only the right subtree of such a VMA
+ * is searched.
+ */
+static __vaddr_t vmem_first_fit_subtree(struct uk_vma *vma, __vaddr_t base,
+					__sz align, __sz len)
+{
+	__vaddr_t vaddr;
+
+	if (!vma || vma->subtree_gap < len)
+		return __VADDR_INV;
+
+	if (vma->start > base) {
+		vaddr = vmem_first_fit_subtree(UK_RB_LEFT(vma, vma_node),
+					       base, align, len);
+		if (vaddr != __VADDR_INV)
+			return vaddr;
+
+		vaddr = vmem_first_fit_gap(vma, base, align, len);
+		if (vaddr != __VADDR_INV)
+			return vaddr;
+	}
+
+	return vmem_first_fit_subtree(UK_RB_RIGHT(vma, vma_node),
+				      base, align, len);
+}
+
 static __vaddr_t vmem_first_fit(struct uk_vas *vas, __vaddr_t base, __sz align,
 				__sz len)
 {
-	__vaddr_t vaddr = base;
-	struct uk_vma *cur;
+	const struct uk_vma *last;
+	__vaddr_t vaddr;
 
 	UK_ASSERT(vas);
 
@@ -535,20 +715,14 @@ static __vaddr_t vmem_first_fit(struct uk_vas *vas, __vaddr_t base, __sz align,
 	 * to be careful not to overflow. Checks are thus always active and not
 	 * just asserts.
 	 */
-	uk_list_for_each_entry(cur, &vas->vma_list, vma_list) {
-		if (unlikely(vaddr > __VADDR_MAX - align))
-			return __VADDR_INV;
-
-		vaddr = ALIGN_UP(vaddr, align);
+	vaddr = vmem_first_fit_subtree(UK_RB_ROOT(&vas->vma_tree), base,
+				       align, len);
+	if (vaddr != __VADDR_INV)
+		return vaddr;
 
-		if (unlikely(vaddr > __VADDR_MAX - len))
-			return __VADDR_INV;
-
-		if (vaddr + len <= cur->start)
-			return vaddr;
-
-		vaddr = MAX(cur->end, base);
-	}
+	/* Use the address range after the last VMA */
+	last  = uk_vma_last(vas);
+	vaddr = (last) ? MAX(last->end, base) : base;
 
 	if (unlikely(vaddr > __VADDR_MAX - align))
 		return __VADDR_INV;
@@ -693,8 +867,7 @@ int uk_vma_map(struct uk_vas *vas, __vaddr_t *vaddr, __sz len,
 		UK_ASSERT(vma_end);
 
 		/* Unlink all VMAs starting from vma_start to vma_end */
-		vma_start->vma_list.prev->next = vma_end->vma_list.next;
-		vma_end->vma_list.next->prev   = vma_start->vma_list.prev;
+		vmem_vma_unlink_range(vas, vma_start, vma_end);
 
 		vmem_vma_unmap_and_free_vmas(vma_start, vma_end);
 	}
@@ -758,7 +931,7 @@ int vma_op_set_attr(struct uk_vma *vma, unsigned long attr)
 {
 	unsigned long pgs = vmem_vma_len(vma) / PAGE_SIZE;
 
-	return ukplat_page_set_attr(vma->vas->pt, vma->start, pgs, attr, 0);
+	return vmem_page_set_attr(vma, vma->start, pgs, attr, 0);
 }
 
 static void vmem_vma_set_attr(struct uk_vma *vma, unsigned long attr)
@@ -788,6 +961,23 @@ static void vmem_vma_set_attr(struct uk_vma *vma, unsigned long attr)
 	vma->attr = attr;
 }
 
+/* Tries to merge the VMAs from start to end with their neighbors */
+static void vmem_vma_try_merge_vmas(struct uk_vma *start, struct uk_vma *end)
+{
+	struct uk_vma *vma;
+
+	vma = vmem_vma_try_merge_with_next(end);
+	UK_ASSERT(vma == end);
+
+	vma = start;
+	while (vma != end) {
+		vma = vmem_vma_try_merge_with_prev(vma);
+		vma = uk_list_next_entry(vma, vma_list);
+	}
+
+	vmem_vma_try_merge_with_prev(end);
+}
+
 static void vmem_vma_set_attr_vmas(struct uk_vma *start, struct uk_vma *end,
 				   unsigned long attr)
 {
@@ -804,22 +994,16 @@ static void vmem_vma_set_attr_vmas(struct uk_vma *start, struct uk_vma *end,
 	vmem_vma_set_attr(end, attr);
 
 	/* Do a second pass and try to merge VMAs */
-	vma = vmem_vma_try_merge_with_next(end);
-	UK_ASSERT(vma == end);
-
-	vma = start;
-	while (vma != end) {
-		vma = vmem_vma_try_merge_with_prev(vma);
-		vma = uk_list_next_entry(vma, vma_list);
-	}
-
-	vmem_vma_try_merge_with_prev(end);
+	vmem_vma_try_merge_vmas(start, end);
 }
 
 int uk_vma_set_attr(struct uk_vas *vas, __vaddr_t vaddr, __sz len,
 		    unsigned long attr, unsigned long flags)
 {
 	struct uk_vma *vma_start = __NULL, *vma_end;
+#ifdef CONFIG_HAVE_PAGING
+	struct ukplat_tlb_gather tlb;
+#endif /* CONFIG_HAVE_PAGING */
 	int strict = (flags & UK_VMA_FLAG_STRICT_VMA_CHECK);
 	int rc;
 
@@ -835,8 +1019,20 @@ int uk_vma_set_attr(struct uk_vas *vas, __vaddr_t vaddr, __sz len,
 		return rc;
 	}
 
+#ifdef CONFIG_HAVE_PAGING
+	/* Flush the TLB once for all VMAs instead of for every page */
+	UK_ASSERT(!vas->tlb);
+	ukplat_tlb_gather_begin(vas->pt, &tlb);
+	vas->tlb = &tlb;
+#endif /* CONFIG_HAVE_PAGING */
+
 	vmem_vma_set_attr_vmas(vma_start, vma_end, attr);
 
+#ifdef CONFIG_HAVE_PAGING
+	vas->tlb = __NULL;
+	ukplat_tlb_gather_end(&tlb);
+#endif /* CONFIG_HAVE_PAGING */
+
 	return 0;
 }
 
@@ -914,17 +1110,69 @@ static int vmem_vma_advise(struct uk_vma *vma, __vaddr_t vaddr, __sz len,
 	return VMA_ADVISE(vma, vaddr, len, advice);
 }
 
+/* Sets the fault-around policy for the address range. VMAs are split so that
+ * the policy only applies to the address range and merged again if possible.
+ */
+static int vmem_vma_set_policy(struct uk_vas *vas, __vaddr_t vaddr, __sz len,
+			       unsigned long policy, int strict)
+{
+	struct uk_vma *vma_start = __NULL, *vma_end, *vma;
+	unsigned long pflags = 0;
+	int rc;
+
+	if (policy & UK_VMA_ADV_RANDOM)
+		pflags = UK_VMA_FLAG_RANDOM;
+	else if (policy & UK_VMA_ADV_SEQUENTIAL)
+		pflags = UK_VMA_FLAG_SEQUENTIAL;
+
+	rc = vmem_vma_split_vmas(vas, vaddr, len, __NULL,
+				 &vma_start, &vma_end, strict);
+	if (unlikely(rc))
+		return rc;
+
+	vma = vma_start;
+	for (;;) {
+		vma->flags &= ~(UK_VMA_FLAG_RANDOM | UK_VMA_FLAG_SEQUENTIAL);
+		vma->flags |= pflags;
+
+		if (vma == vma_end)
+			break;
+
+		vma = uk_list_next_entry(vma, vma_list);
+	}
+
+	vmem_vma_try_merge_vmas(vma_start, vma_end);
+
+	return 0;
+}
+
 int uk_vma_advise(struct uk_vas *vas, __vaddr_t vaddr, __sz len,
 		  unsigned long advice, unsigned long flags)
 {
 	struct uk_vma *vma_start = __NULL, *vma_end, *vma;
 	int strict = (flags & UK_VMA_FLAG_STRICT_VMA_CHECK);
+	unsigned long policy;
 	__vaddr_t vend;
 	int rc;
 
 	if (unlikely(len == 0))
 		return 0;
 
+	policy = advice & (UK_VMA_ADV_NORMAL | UK_VMA_ADV_RANDOM |
+			   UK_VMA_ADV_SEQUENTIAL);
+	if (policy) {
+		if (unlikely(policy & (policy - 1)))
+			return -EINVAL;
+
+		rc = vmem_vma_set_policy(vas, vaddr, len, policy, strict);
+		if (unlikely(rc)) {
+			if (rc == -ENOENT && !strict)
+				return 0;
+
+			return rc;
+		}
+	}
+
 	rc = vmem_vma_find_range(vas, &vaddr, &len,
 				 &vma_start, &vma_end, strict);
 	if (unlikely(rc)) {
@@ -1027,6 +1275,160 @@ static int vmem_mapx_pagefault(struct uk_pagetable *pt __unused,
 	return 0;
 }
 
+#ifdef CONFIG_LIBUKVMEM_THP
+/* Pages-in a large page if the whole large page is within the VMA and no
+ * part of it is paged-in with small pages yet. Ranges with small pages are
+ * left to the background collapse. Returns -ENOENT if the fault has to be
+ * served with small pages.
+ */
+static int vmem_thp_pagefault(struct uk_pagetable *pt, __vaddr_t vaddr,
+			      struct uk_vma *vma, struct ukplat_page_mapx *mapx)
+{
+	__vaddr_t vbase = PAGE_Lx_ALIGN_DOWN(vaddr, VMEM_THP_LEVEL);
+	unsigned int lvl = PAGE_LEVEL;
+	int rc;
+
+	if (!vmem_thp_allowed(vma, vbase))
+		return -ENOENT;
+
+	rc = ukplat_pt_walk(pt, vbase, &lvl, __NULL, __NULL);
+	if (unlikely(rc))
+		return rc;
+
+	if (lvl < VMEM_THP_LEVEL)
+		return -ENOENT;
+
+	rc = ukplat_page_mapx(pt, vbase, 0, 1, vma->attr,
+			      PAGE_FLAG_SIZE(VMEM_THP_LEVEL) |
+			      PAGE_FLAG_FORCE_SIZE, mapx);
+	if (rc == -ENOMEM) {
+		/* No free large frame, retry with small pages */
+		vmem_thp_stats.fault_fallback++;
+		return -ENOENT;
+	}
+
+	if (rc == 0)
+		vmem_thp_stats.fault_alloc++;
+
+	return rc;
+}
+#endif /* CONFIG_LIBUKVMEM_THP */
+
+/* Pages-in the given range of unmapped pages with a single call to the fault
+ * handler and a single page table update
+ */
+static int vmem_fault_around_populate(struct uk_pagetable *pt,
+				      struct uk_vma *vma, __vaddr_t vaddr,
+				      unsigned int type, struct __regs *regs,
+				      __vaddr_t vbase, unsigned long pages)
+{
+	struct uk_vm_fault fault = {
+		.vaddr = vaddr,
+		.vbase = vbase,
+		.len   = pages << PAGE_SHIFT,
+		.paddr = __PADDR_ANY,
+		.type  = type,
+		.pte   = 0,
+		.level = PAGE_LEVEL,
+		.regs  = regs,
+	};
+	int rc;
+
+	rc = vma->ops->fault(vma, &fault);
+	if (unlikely(rc))
+		return rc;
+
+	UK_ASSERT(PAGE_ALIGNED(fault.paddr));
+
+	rc = ukplat_page_map(pt, vbase, fault.paddr, pages, vma->attr,
+			     PAGE_FLAG_SIZE(PAGE_LEVEL) | PAGE_FLAG_FORCE_SIZE);
+	if (unlikely(rc)) {
+		ukplat_page_unmap(pt, vbase, pages, PAGE_FLAG_KEEP_FRAMES);
+		pt->fa->ffree(pt->fa, fault.paddr, pages);
+		return rc;
+	}
+
+	return 0;
+}
+
+/* Pages-in the unmapped pages in the fault-around window of the VMA. The
+ * window is confined to the page table that maps the faulting page and
+ * shrunk to the unmapped pages around the faulting page. Returns -ENOENT if
+ * the fault has to be served with a single page.
+ */
+static int vmem_fault_around(struct uk_pagetable *pt, __vaddr_t vaddr,
+			     unsigned int type, struct __regs *regs,
+			     struct uk_vma *vma)
+{
+	unsigned long pages = vmem_fault_around_pages(vma);
+	__vaddr_t tbase = PAGE_Lx_ALIGN_DOWN(vaddr, PAGE_LEVEL + 1);
+	unsigned long idx = PT_Lx_IDX(vaddr, PAGE_LEVEL);
+	unsigned long first, last, i;
+	unsigned int lvl = PAGE_LEVEL;
+	__vaddr_t pt_vaddr;
+	__pte_t pte;
+	int rc;
+
+	if (pages <= 1)
+		return -ENOENT;
+
+	/* Determine the window as page indices in the page table */
+	first = (vma->flags & UK_VMA_FLAG_SEQUENTIAL) ? idx : idx - idx % pages;
+	last  = MIN(first + pages, (unsigned long)PT_Lx_PTES(PAGE_LEVEL));
+
+	if (vma->start > tbase)
+		first = MAX(first, (vma->start - tbase) >> PAGE_SHIFT);
+	if (vma->end - tbase < (last << PAGE_SHIFT))
+		last = (vma->end - tbase) >> PAGE_SHIFT;
+
+	UK_ASSERT(first <= idx && idx < last);
+
+	rc = ukplat_pt_walk(pt, vaddr, &lvl, &pt_vaddr, &pte);
+	if (unlikely(rc))
+		return rc;
+
+	if (PT_Lx_PTE_PRESENT(pte, lvl))
+		return -ENOENT;
+
+	/* Without a page table at PAGE_LEVEL, the whole window is unmapped.
+	 * Otherwise, the window ends at the nearest mapped pages.
+	 */
+	if (lvl == PAGE_LEVEL) {
+		for (i = idx; i > first; i--) {
+			rc = ukarch_pte_read(pt_vaddr, PAGE_LEVEL, i - 1, &pte);
+			if (unlikely(rc))
+				return rc;
+
+			if (PT_Lx_PTE_PRESENT(pte, PAGE_LEVEL))
+				break;
+		}
+		first = i;
+
+		for (i = idx + 1; i < last; i++) {
+			rc = ukarch_pte_read(pt_vaddr, PAGE_LEVEL, i, &pte);
+			if (unlikely(rc))
+				return rc;
+
+			if (PT_Lx_PTE_PRESENT(pte, PAGE_LEVEL))
+				break;
+		}
+		last = i;
+	}
+
+	if (last - first <= 1)
+		return -ENOENT;
+
+	rc = vmem_fault_around_populate(pt, vma, vaddr, type, regs,
+					tbase + (first << PAGE_SHIFT),
+					last - first);
+
+	/* Not enough contiguous memory for the window */
+	if (rc == -ENOMEM)
+		return -ENOENT;
+
+	return rc;
+}
+
 int vmem_pagefault(__vaddr_t vaddr, unsigned int type, struct __regs *regs)
 {
 	const unsigned int demand_lvl =
@@ -1095,6 +1497,20 @@ int vmem_pagefault(__vaddr_t vaddr, unsigned int type, struct __regs *regs)
 		flags = 0;
 	}
 
+#ifdef CONFIG_LIBUKVMEM_THP
+	if (lvl < VMEM_THP_LEVEL) {
+		rc = vmem_thp_pagefault(pt, vaddr, ctx.vma, &mapx);
+		if (rc != -ENOENT)
+			return rc;
+	}
+#endif /* CONFIG_LIBUKVMEM_THP */
+
+	if (lvl == PAGE_LEVEL) {
+		rc = vmem_fault_around(pt, vaddr, type, regs, ctx.vma);
+		if (rc != -ENOENT)
+			return rc;
+	}
+
 	vbase = PAGE_Lx_ALIGN_DOWN(vaddr, lvl);
 
 	UK_ASSERT(vbase >= ctx.vma->start &&
@@ -1103,7 +1519,16 @@ int vmem_pagefault(__vaddr_t vaddr, unsigned int type, struct __regs *regs)
 	UK_ASSERT(vbase + PAGE_Lx_SIZE(lvl) >= ctx.vma->start &&
 		  vbase + PAGE_Lx_SIZE(lvl) <= ctx.vma->end);
 
-	return ukplat_page_mapx(pt, vbase, 0, 1, ctx.vma->attr,
-				PAGE_FLAG_SIZE(lvl) | flags, &mapx);
+	rc = ukplat_page_mapx(pt, vbase, 0, 1, ctx.vma->attr,
+			      PAGE_FLAG_SIZE(lvl) | flags, &mapx);
+#if CONFIG_LIBVFSCORE_PAGECACHE
+	/* Evict unused file pages to free frames before failing the fault */
+	while (rc == -ENOMEM &&
+	       vfscore_pagecache_reclaim(PAGE_Lx_SIZE(lvl) >> PAGE_SHIFT))
+		rc = ukplat_page_mapx(pt, vbase, 0, 1, ctx.vma->attr,
+				      PAGE_FLAG_SIZE(lvl) | flags, &mapx);
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
+
+	return rc;
 }
 #endif /* CONFIG_HAVE_PAGING */
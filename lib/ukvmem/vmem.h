@@ -59,6 +59,100 @@ vmem_len_to_pages(struct uk_vma *vma, __sz len, unsigned long *flags)
 	UK_ASSERT(PAGE_Lx_ALIGNED(len, to_lvl));
 	return len / PAGE_Lx_SIZE(to_lvl);
 }
+
+/**
+ * Returns the number of pages to page-in for a fault in the VMA according to
+ * its fault-around policy. Only the fault handlers of anonymous and file VMAs
+ * can supply memory for more than one page at once.
+ */
+static inline unsigned long vmem_fault_around_pages(struct uk_vma *vma)
+{
+	UK_ASSERT(vma);
+
+	if (vma->ops != &uk_vma_anon_ops
+#ifdef CONFIG_LIBVFSCORE
+	    && vma->ops != &uk_vma_file_ops
+#endif /* CONFIG_LIBVFSCORE */
+	   )
+		return 1;
+
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+	/* Shared file mappings map the pages of the page cache one by one */
+	if (vma->ops == &uk_vma_file_ops && (vma->flags & UK_VMA_FILE_SHARED))
+		return 1;
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
+
+	if (vma->flags & UK_VMA_FLAG_RANDOM)
+		return 1;
+
+	if (vma->flags & UK_VMA_FLAG_SEQUENTIAL)
+		return CONFIG_LIBUKVMEM_FAULT_AROUND_SEQ_PAGES;
+
+	return CONFIG_LIBUKVMEM_FAULT_AROUND_PAGES;
+}
+
+#ifdef CONFIG_LIBUKVMEM_THP
+/* Transparent huge pages (see thp.c) */
+#define VMEM_THP_LEVEL			PAGE_LARGE_LEVEL
+#define VMEM_THP_SIZE			PAGE_Lx_SIZE(VMEM_THP_LEVEL)
+#define VMEM_THP_PAGES			(VMEM_THP_SIZE >> PAGE_SHIFT)
+
+struct vmem_thp_stats {
+	__u64 fault_alloc;	/* faults that paged-in a large page */
+	__u64 fault_fallback;	/* large page faults that fell back */
+	__u64 collapse_alloc;	/* ranges collapsed to a large page */
+	__u64 collapse_failed;	/* ranges that could not be collapsed */
+	__u64 full_scans;	/* completed scans of the address space */
+};
+
+extern struct vmem_thp_stats vmem_thp_stats;
+extern int vmem_thp_enabled;
+
+/**
+ * Checks if the large page at vbase may back anonymous memory of the VMA
+ */
+static inline int vmem_thp_allowed(struct uk_vma *vma, __vaddr_t vbase)
+{
+	return vmem_thp_enabled && vma->ops == &uk_vma_anon_ops &&
+	       vma->page_lvl < 0 && PAGE_Lx_ALIGNED(vbase, VMEM_THP_LEVEL) &&
+	       vbase >= vma->start && vbase < vma->end &&
+	       vma->end - vbase >= VMEM_THP_SIZE;
+}
+#endif /* CONFIG_LIBUKVMEM_THP */
+#endif /* CONFIG_HAVE_PAGING */
+
+#ifdef CONFIG_HAVE_PAGING
+/**
+ * Unmaps pages of a VMA. Within uk_vma_unmap() and uk_vma_set_attr(), the
+ * TLB flush and freeing the frames are deferred to the end of the call.
+ */
+static inline int vmem_page_unmap(struct uk_vma *vma, __vaddr_t vaddr,
+				  unsigned long pages, unsigned long flags)
+{
+	struct uk_vas *vas = vma->vas;
+
+	if (vas->tlb)
+		return ukplat_page_unmap_gather(vas->tlb, vaddr, pages, flags);
+
+	return ukplat_page_unmap(vas->pt, vaddr, pages, flags);
+}
+
+/**
+ * Changes the attributes of pages of a VMA. Within uk_vma_unmap() and
+ * uk_vma_set_attr(), the TLB flush is deferred to the end of the call.
+ */
+static inline int vmem_page_set_attr(struct uk_vma *vma, __vaddr_t vaddr,
+				     unsigned long pages, unsigned long attr,
+				     unsigned long flags)
+{
+	struct uk_vas *vas = vma->vas;
+
+	if (vas->tlb)
+		return ukplat_page_set_attr_gather(vas->tlb, vaddr, pages,
+						   attr, flags);
+
+	return ukplat_page_set_attr(vas->pt, vaddr, pages, attr, flags);
+}
 #endif /* CONFIG_HAVE_PAGING */
 
 /* Macros for safe VMA op invocation */
@@ -35,7 +35,9 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include <uk/arch/lcpu.h>
 #include <uk/list.h>
+#include <uk/rculist.h>
 #include <vfscore/dentry.h>
 #include <vfscore/vnode.h>
 #include <uk/mutex.h>
@@ -43,10 +45,21 @@
 
 #define DENTRY_BUCKETS 32
 
+/*
+ * The hash table is read without locks in RCU read-side critical sections.
+ * Updaters serialize with dentry_hash_lock. Dentries are freed after a
+ * grace period.
+ */
 static struct uk_hlist_head dentry_hash_table[DENTRY_BUCKETS];
-static UK_HLIST_HEAD(fake);
 static struct uk_mutex dentry_hash_lock = UK_MUTEX_INITIALIZER(dentry_hash_lock);
 
+/*
+ * Odd while dentry_move() relinks a dentry into another bucket. A lock-free
+ * reader that is on the moved dentry continues in the new bucket and may
+ * miss entries, so it retries under the lock if the sequence changed.
+ */
+static unsigned int dentry_hash_seq;
+
 /*
  * Get the hash value from the mount point and path name.
  * XXX: replace with a better hash for 64-bit pointers.
@@ -101,27 +114,54 @@ dentry_alloc(struct dentry *parent_dp, struct vnode *vp, const char *path)
 	vn_add_name(vp, dp);
 
 	uk_mutex_lock(&dentry_hash_lock);
-	uk_hlist_add_head(&dp->d_link,
-			  &dentry_hash_table[dentry_hash(mp, path)]);
+	uk_hlist_add_head_rcu(&dp->d_link,
+			      &dentry_hash_table[dentry_hash(mp, path)]);
 	uk_mutex_unlock(&dentry_hash_lock);
 	return dp;
 };
 
+/*
+ * Finds a dentry and takes a reference on it. Must be called in an RCU
+ * read-side critical section or with dentry_hash_lock held.
+ */
+static struct dentry *
+dentry_find(struct mount *mp, const char *path)
+{
+	struct uk_hlist_head *head = &dentry_hash_table[dentry_hash(mp, path)];
+	struct dentry *dp;
+
+	uk_hlist_for_each_entry_rcu(dp, head, d_link) {
+		if (dp->d_mount == mp &&
+		    !strncmp(uk_rcu_dereference(dp->d_path), path, PATH_MAX) &&
+		    vfscore_ref_get_unless_zero(&dp->d_refcnt))
+			return dp;
+	}
+	return NULL;                /* not found */
+}
+
 struct dentry *
 dentry_lookup(struct mount *mp, char *path)
 {
 	struct dentry *dp;
+	unsigned int seq;
+
+	uk_rcu_read_lock();
+	seq = UK_READ_ONCE(dentry_hash_seq);
+	rmb();
+	dp = dentry_find(mp, path);
+	uk_rcu_read_unlock();
+	if (dp)
+		return dp;
+
+	rmb();
+	if (!(seq & 1) && UK_READ_ONCE(dentry_hash_seq) == seq)
+		return NULL;
 
+	/* A dentry was moved concurrently: retry with a stable table */
 	uk_mutex_lock(&dentry_hash_lock);
-	uk_hlist_for_each_entry(dp, &dentry_hash_table[dentry_hash(mp, path)], d_link) {
-		if (dp->d_mount == mp && !strncmp(dp->d_path, path, PATH_MAX)) {
-			dp->d_refcnt++;
-			uk_mutex_unlock(&dentry_hash_lock);
-			return dp;
-		}
-	}
+	dp = dentry_find(mp, path);
 	uk_mutex_unlock(&dentry_hash_lock);
-	return NULL;                /* not found */
+	return dp;
 }
 
 static void dentry_children_remove(struct dentry *dp)
@@ -132,7 +172,8 @@ static void dentry_children_remove(struct dentry *dp)
 	uk_list_for_each_entry(entry, &dp->d_child_list, d_child_link) {
 		UK_ASSERT(entry);
 		UK_ASSERT(entry->d_refcnt > 0);
-		uk_hlist_del(&entry->d_link);
+		if (!uk_hlist_unhashed(&entry->d_link))
+			uk_hlist_del_rcu(&entry->d_link);
 	}
 	uk_mutex_unlock(&dp->d_lock);
 
@@ -167,23 +208,30 @@ dentry_move(struct dentry *dp, struct dentry *parent_dp, char *path)
 	}
 
 	uk_mutex_lock(&dentry_hash_lock);
+	UK_WRITE_ONCE(dentry_hash_seq, dentry_hash_seq + 1);
+	wmb();
 	// Remove all dp's child dentries from the hashtable.
 	dentry_children_remove(dp);
 	// Remove dp with outdated hash info from the hashtable.
-	uk_hlist_del(&dp->d_link);
+	if (!uk_hlist_unhashed(&dp->d_link))
+		uk_hlist_del_rcu(&dp->d_link);
 	// Update dp.
-	dp->d_path = new_path;
+	uk_rcu_assign_pointer(dp->d_path, new_path);
 
 	dp->d_parent = parent_dp;
 	// Insert dp updated hash info into the hashtable.
-	uk_hlist_add_head(&dp->d_link,
-			  &dentry_hash_table[dentry_hash(dp->d_mount, path)]);
+	uk_hlist_add_head_rcu(&dp->d_link,
+		&dentry_hash_table[dentry_hash(dp->d_mount, path)]);
+	wmb();
+	UK_WRITE_ONCE(dentry_hash_seq, dentry_hash_seq + 1);
 	uk_mutex_unlock(&dentry_hash_lock);
 
 	if (old_pdp) {
 		drele(old_pdp);
 	}
 
+	// Lock-free readers may still compare against the old path.
+	uk_synchronize_rcu();
 	free(old_path);
 	return 0;
 }
@@ -192,9 +240,8 @@ void
 dentry_remove(struct dentry *dp)
 {
 	uk_mutex_lock(&dentry_hash_lock);
-	uk_hlist_del(&dp->d_link);
-	/* put it on a fake list for drele() to work*/
-	uk_hlist_add_head(&dp->d_link, &fake);
+	if (!uk_hlist_unhashed(&dp->d_link))
+		uk_hlist_del_rcu(&dp->d_link);
 	uk_mutex_unlock(&dentry_hash_lock);
 }
 
@@ -204,9 +251,16 @@ dref(struct dentry *dp)
 	UK_ASSERT(dp);
 	UK_ASSERT(dp->d_refcnt > 0);
 
-	uk_mutex_lock(&dentry_hash_lock);
-	dp->d_refcnt++;
-	uk_mutex_unlock(&dentry_hash_lock);
+	uk_inc(&dp->d_refcnt);
+}
+
+static void
+dentry_free_rcu(struct uk_rcu_head *head)
+{
+	struct dentry *dp = __containerof(head, struct dentry, d_rcu);
+
+	free(dp->d_path);
+	free(dp);
 }
 
 void
@@ -215,12 +269,16 @@ drele(struct dentry *dp)
 	UK_ASSERT(dp);
 	UK_ASSERT(dp->d_refcnt > 0);
 
+	if (vfscore_ref_put_unless_one(&dp->d_refcnt))
+		return;
+
 	uk_mutex_lock(&dentry_hash_lock);
-	if (--dp->d_refcnt) {
+	if (uk_sub_fetch(&dp->d_refcnt, 1)) {
 		uk_mutex_unlock(&dentry_hash_lock);
 		return;
 	}
-	uk_hlist_del(&dp->d_link);
+	if (!uk_hlist_unhashed(&dp->d_link))
+		uk_hlist_del_rcu(&dp->d_link);
 	vn_del_name(dp->d_vnode, dp);
 
 	uk_mutex_unlock(&dentry_hash_lock);
@@ -236,8 +294,7 @@ drele(struct dentry *dp)
 
 	vrele(dp->d_vnode);
 
-	free(dp->d_path);
-	free(dp);
+	uk_call_rcu(&dp->d_rcu, dentry_free_rcu);
 }
 
 void
@@ -35,6 +35,7 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <vfscore/file.h>
+#include <vfscore/pagecache.h>
 #include "vfs.h"
 
 #include <uk/assert.h>
@@ -51,6 +52,15 @@ int vfs_close(struct vfscore_file *fp)
 	 * NOTE: We do this because on umount not all of our filesystem drivers
 	 * may flush cached contents.
 	 */
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+	if (vfscore_pagecache_enabled(vp)) {
+		error = vfscore_pagecache_sync(vp, 0, 0);
+		if (unlikely(error)) {
+			vn_unlock(vp);
+			return error;
+		}
+	}
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
 	error = VOP_FSYNC(vp, fp);
 	if (unlikely(error))
 		return error;
@@ -81,7 +91,12 @@ int vfs_read(struct vfscore_file *fp, struct uio *uio, int flags)
 	if ((flags & FOF_OFFSET) == 0)
 		uio->uio_offset = fp->f_offset;
 
-	error = VOP_READ(vp, fp, uio, 0);
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+	if (vfscore_pagecache_enabled(vp))
+		error = vfscore_pagecache_read(vp, fp, uio);
+	else
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
+		error = VOP_READ(vp, fp, uio, 0);
 	if (!error) {
 		count = bytes - uio->uio_resid;
 		if (((flags & FOF_OFFSET) == 0) &&
@@ -101,6 +116,9 @@ int vfs_write(struct vfscore_file *fp, struct uio *uio, int flags)
 	int error;
 	size_t count;
 	ssize_t bytes;
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+	off_t off;
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
 
 	bytes = uio->uio_resid;
 
@@ -114,7 +132,21 @@ int vfs_write(struct vfscore_file *fp, struct uio *uio, int flags)
 	if ((flags & FOF_OFFSET) == 0)
 		uio->uio_offset = fp->f_offset;
 
-	error = VOP_WRITE(vp, uio, ioflags);
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+	/* The data is written through. Cached pages are updated first so
+	 * that mappings of the pages see the data.
+	 */
+	if (vfscore_pagecache_enabled(vp)) {
+		off = (ioflags & IO_APPEND) ? vp->v_size : uio->uio_offset;
+
+		error = vfscore_pagecache_write(vp, uio, off);
+		if (!error)
+			error = VOP_WRITE(vp, uio, ioflags);
+		if (unlikely(error))
+			vfscore_pagecache_invalidate(vp, fp, off, bytes);
+	} else
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
+		error = VOP_WRITE(vp, uio, ioflags);
 	if (!error) {
 		count = bytes - uio->uio_resid;
 		if (!(flags & FOF_OFFSET) &&
@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __VFSCORE_PAGECACHE_H__
+#define __VFSCORE_PAGECACHE_H__
+
+#include <sys/types.h>
+#include <uk/arch/types.h>
+#include <uk/config.h>
+#include <vfscore/uio.h>
+#include <vfscore/vnode.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct vfscore_file;
+
+#if CONFIG_LIBVFSCORE_PAGECACHE
+/*
+ * The page cache keeps the contents of regular files in page frames that are
+ * indexed by vnode and page-aligned file offset. read() is served from the
+ * cache and write() updates cached pages before writing through to the file
+ * system, so that shared file mappings can map the cached frames directly.
+ *
+ * Pages are reference counted. Every mapping of a page holds a reference.
+ * Unreferenced pages are evicted in least-recently used order if the cache
+ * exceeds CONFIG_LIBVFSCORE_PAGECACHE_MAX_PAGES or the frame allocator runs
+ * out of memory. Dirty pages are never evicted but must be written back with
+ * vfscore_pagecache_sync() first.
+ *
+ * All functions except vfscore_pagecache_reclaim() must be called with the
+ * vnode locked. Errors are returned as positive errno values like for the
+ * vnode operations.
+ */
+
+/**
+ * Returns non-zero if the contents of the vnode are kept in the page cache.
+ */
+static inline int vfscore_pagecache_enabled(struct vnode *vp)
+{
+	return vp->v_type == VREG;
+}
+
+/**
+ * Reads from the file via the page cache. Missing pages are read from the
+ * file system.
+ *
+ * @param vp
+ *   The locked vnode to read from
+ * @param fp
+ *   The file used to read missing pages
+ * @param uio
+ *   Describes the destination buffers and the file offset
+ * @return
+ *   0 on success, a positive errno value otherwise
+ */
+int vfscore_pagecache_read(struct vnode *vp, struct vfscore_file *fp,
+			   struct uio *uio);
+
+/**
+ * Takes a mapping reference on the page at the given file offset. The page is
+ * read from the file if it is not cached. A page mapped writable is marked
+ * dirty and remains dirty until it is not mapped anymore, because writes
+ * through mappings cannot be tracked.
+ *
+ * @param vp
+ *   The locked vnode
+ * @param fp
+ *   The file used to read the page if it is missing
+ * @param off
+ *   Page-aligned file offset
+ * @param writable
+ *   Non-zero if the page is mapped writable
+ * @param[out] paddr
+ *   The physical address of the frame holding the page
+ * @return
+ *   0 on success, a positive errno value otherwise
+ */
+int vfscore_pagecache_map(struct vnode *vp, struct vfscore_file *fp,
+			  off_t off, int writable, __paddr_t *paddr);
+
+/**
+ * Drops a mapping reference taken with vfscore_pagecache_map(). The caller
+ * must have removed the mapping already.
+ *
+ * @param vp
+ *   The locked vnode
+ * @param off
+ *   Page-aligned file offset
+ */
+void vfscore_pagecache_unmap(struct vnode *vp, off_t off);
+
+/**
+ * Marks a cached page as dirty, for example, when a mapping becomes writable.
+ *
+ * @param vp
+ *   The locked vnode
+ * @param off
+ *   Page-aligned file offset
+ */
+void vfscore_pagecache_set_dirty(struct vnode *vp, off_t off);
+
+/**
+ * Writes the dirty pages in the given range back to the file system. Data
+ * beyond the end of the file is discarded.
+ *
+ * @param vp
+ *   The locked vnode
+ * @param off
+ *   File offset at which the range starts
+ * @param len
+ *   Length of the range in bytes. 0 selects all pages from off on.
+ * @return
+ *   0 on success, a positive errno value otherwise
+ */
+int vfscore_pagecache_sync(struct vnode *vp, off_t off, off_t len);
+
+/**
+ * Evicts unreferenced pages that are not dirty to return their frames to the
+ * frame allocator. Called by memory consumers before they fail an allocation.
+ *
+ * @param count
+ *   Maximum number of pages to evict
+ * @return
+ *   The number of evicted pages
+ */
+unsigned long vfscore_pagecache_reclaim(unsigned long count);
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VFSCORE_PAGECACHE_H__ */
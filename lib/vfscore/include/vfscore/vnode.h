@@ -38,6 +38,7 @@
 
 #include <uk/mutex.h>
 #include <uk/list.h>
+#include <uk/rcu.h>
 #include <uk/config.h>
 #include <time.h>
 #include <vfscore/uio.h>
@@ -95,6 +96,10 @@ struct vnode {
 	struct uk_mutex	v_lock;		/* lock for this vnode */
 	struct uk_list_head v_names;	/* directory entries pointing at this */
 	void		*v_data;	/* private data for fs */
+	struct uk_rcu_head v_rcu;	/* deferred free */
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+	struct uk_list_head v_pages;	/* pages in the page cache */
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
 };
 
 /* flags for vnode */
@@ -2619,6 +2619,9 @@ static void vfscore_init(void)
 	main_task = &_main_task_impl;
 
 	vnode_init();
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+	pagecache_init();
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
 	lookup_init();
 }
 
@@ -0,0 +1,694 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#include <uk/config.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/print.h>
+#include <uk/list.h>
+#include <uk/mutex.h>
+#include <uk/falloc.h>
+#include <uk/arch/paging.h>
+#include <uk/plat/paging.h>
+#include <vfscore/file.h>
+#include <vfscore/vnode.h>
+#include <vfscore/uio.h>
+#include <vfscore/pagecache.h>
+#include "vfs.h"
+
+#define PAGECACHE_BUCKETS	256	/* size of page hash table */
+
+/* Number of pages to evict when the frame allocator is out of memory */
+#define PAGECACHE_EVICT_BATCH	16
+
+/* Maximum number of missing pages that are read from the file at once */
+#define PAGECACHE_READ_BATCH	16
+
+/* flags for pages */
+#define PG_DIRTY	0x0001		/* not yet written back to the file */
+
+struct vfscore_page {
+	struct uk_list_head pg_link;	/* link for hash list */
+	struct uk_list_head pg_vlink;	/* link for pages of the vnode */
+	struct uk_list_head pg_lru;	/* link for LRU list */
+	struct vnode	*pg_vnode;	/* vnode of the cached data */
+	off_t		pg_off;		/* page-aligned file offset */
+	__paddr_t	pg_paddr;	/* frame holding the data */
+	unsigned int	pg_refcnt;	/* reference count */
+	unsigned int	pg_mapcnt;	/* number of mappings */
+	int		pg_flags;	/* page flags */
+};
+
+/*
+ * pagecache table.
+ * All cached pages are stored on this hash table.
+ * They can be accessed by their vnode and file offset.
+ */
+static struct uk_list_head pagecache_table[PAGECACHE_BUCKETS];
+
+/* Unreferenced pages, least-recently used first */
+static UK_LIST_HEAD(page_lru);
+
+/* Number of cached pages */
+static unsigned long page_count;
+
+/*
+ * Global lock to access the pagecache table, the LRU list, the page lists of
+ * the vnodes, and the reference counts and flags of all pages. The contents
+ * of a page are protected by the lock of its vnode.
+ */
+static struct uk_mutex page_lock = UK_MUTEX_INITIALIZER(page_lock);
+#define PAGE_LOCK()	uk_mutex_lock(&page_lock)
+#define PAGE_UNLOCK()	uk_mutex_unlock(&page_lock)
+
+static unsigned int pg_hash(struct vnode *vp, off_t off)
+{
+	return (((unsigned long)vp >> 4) ^ ((unsigned long)off >> PAGE_SHIFT))
+		& (PAGECACHE_BUCKETS - 1);
+}
+
+static inline struct uk_falloc *pg_falloc(void)
+{
+	return ukplat_pt_get_active()->fa;
+}
+
+static void *pg_kmap(struct vfscore_page *pg)
+{
+	__vaddr_t vaddr;
+
+	vaddr = ukplat_page_kmap(ukplat_pt_get_active(), pg->pg_paddr, 1, 0);
+	if (unlikely(vaddr == __VADDR_INV))
+		return NULL;
+
+	return (void *)vaddr;
+}
+
+static void pg_kunmap(void *addr)
+{
+	ukplat_page_kunmap(ukplat_pt_get_active(), (__vaddr_t)addr, 1, 0);
+}
+
+/*
+ * Locking: PAGE_LOCK must be held.
+ */
+static struct vfscore_page *pg_lookup(struct vnode *vp, off_t off)
+{
+	struct uk_list_head *head = &pagecache_table[pg_hash(vp, off)];
+	struct vfscore_page *pg;
+
+	uk_list_for_each_entry(pg, head, pg_link) {
+		if (pg->pg_vnode == vp && pg->pg_off == off)
+			return pg;
+	}
+	return NULL;
+}
+
+/*
+ * Locking: PAGE_LOCK must be held.
+ */
+static void pg_hold(struct vfscore_page *pg)
+{
+	if (pg->pg_refcnt++ == 0)
+		uk_list_del(&pg->pg_lru);
+}
+
+/*
+ * Locking: PAGE_LOCK must be held.
+ */
+static void pg_rele(struct vfscore_page *pg)
+{
+	UK_ASSERT(pg->pg_refcnt > 0);
+
+	if (--pg->pg_refcnt == 0)
+		uk_list_add_tail(&pg->pg_lru, &page_lru);
+}
+
+static void pg_put(struct vfscore_page *pg)
+{
+	PAGE_LOCK();
+	pg_rele(pg);
+	PAGE_UNLOCK();
+}
+
+/*
+ * Removes an unreferenced page from the cache and frees it.
+ *
+ * Locking: PAGE_LOCK must be held.
+ */
+static void pg_free(struct vfscore_page *pg)
+{
+	struct uk_falloc *fa = pg_falloc();
+
+	UK_ASSERT(pg->pg_refcnt == 0);
+	UK_ASSERT(pg->pg_mapcnt == 0);
+
+	uk_list_del(&pg->pg_link);
+	uk_list_del(&pg->pg_vlink);
+	uk_list_del(&pg->pg_lru);
+	page_count--;
+
+	fa->ffree(fa, pg->pg_paddr, 1);
+	free(pg);
+}
+
+/*
+ * Evicts up to count unreferenced pages that are not dirty.
+ * Returns the number of evicted pages.
+ *
+ * Locking: PAGE_LOCK must be held.
+ */
+static unsigned long pg_evict(unsigned long count)
+{
+	struct vfscore_page *pg, *next;
+	unsigned long n = 0;
+
+	uk_list_for_each_entry_safe(pg, next, &page_lru, pg_lru) {
+		if (n == count)
+			break;
+
+		if (pg->pg_flags & PG_DIRTY)
+			continue;
+
+		pg_free(pg);
+		n++;
+	}
+	return n;
+}
+
+static int pg_alloc_frame(__paddr_t *paddr)
+{
+	struct uk_falloc *fa = pg_falloc();
+	unsigned long n;
+
+	for (;;) {
+		*paddr = __PADDR_ANY;
+		if (fa->falloc(fa, paddr, 1, 0) == 0)
+			return 0;
+
+		PAGE_LOCK();
+		n = pg_evict(PAGECACHE_EVICT_BATCH);
+		PAGE_UNLOCK();
+
+		if (n == 0)
+			return ENOMEM;
+	}
+}
+
+/*
+ * Reads the given part of the page from the file. The part beyond the end of
+ * the file is filled with zeros.
+ */
+static int pg_fill_range(struct vfscore_page *pg, struct vfscore_file *fp,
+			 size_t poff, size_t len)
+{
+	struct iovec iov;
+	struct uio uio;
+	char *addr;
+	int error;
+
+	UK_ASSERT(poff + len <= PAGE_SIZE);
+
+	addr = pg_kmap(pg);
+	if (unlikely(!addr))
+		return ENOMEM;
+
+	iov.iov_base = addr + poff;
+	iov.iov_len = len;
+	uio.uio_iov = &iov;
+	uio.uio_iovcnt = 1;
+	uio.uio_offset = pg->pg_off + poff;
+	uio.uio_resid = len;
+	uio.uio_rw = UIO_READ;
+
+	error = VOP_READ(pg->pg_vnode, fp, &uio, 0);
+	if (!error)
+		memset(addr + poff + len - uio.uio_resid, 0, uio.uio_resid);
+
+	pg_kunmap(addr);
+	return error;
+}
+
+/*
+ * Reads the given pages, which cover consecutive file offsets, from the file
+ * with a single read operation. The part beyond the end of the file is
+ * filled with zeros.
+ */
+static int pg_fill_batch(struct vfscore_page **pgs, unsigned long n,
+			 struct vfscore_file *fp)
+{
+	struct iovec iov[PAGECACHE_READ_BATCH];
+	struct uio uio;
+	unsigned long i, j;
+	size_t done, poff;
+	int error = 0;
+
+	UK_ASSERT(n > 0 && n <= PAGECACHE_READ_BATCH);
+
+	for (i = 0; i < n; i++) {
+		iov[i].iov_base = pg_kmap(pgs[i]);
+		if (unlikely(!iov[i].iov_base)) {
+			error = ENOMEM;
+			goto out;
+		}
+		iov[i].iov_len = PAGE_SIZE;
+	}
+
+	uio.uio_iov = iov;
+	uio.uio_iovcnt = n;
+	uio.uio_offset = pgs[0]->pg_off;
+	uio.uio_resid = n * PAGE_SIZE;
+	uio.uio_rw = UIO_READ;
+
+	error = VOP_READ(pgs[0]->pg_vnode, fp, &uio, 0);
+	if (!error) {
+		done = n * PAGE_SIZE - uio.uio_resid;
+		for (j = done >> PAGE_SHIFT; j < n; j++) {
+			poff = (j == done >> PAGE_SHIFT) ?
+				done & (PAGE_SIZE - 1) : 0;
+			memset((char *)iov[j].iov_base + poff, 0,
+			       PAGE_SIZE - poff);
+		}
+	}
+
+out:
+	while (i-- > 0)
+		pg_kunmap(iov[i].iov_base);
+	return error;
+}
+
+/*
+ * Writes the page back to the file. The part of the page beyond the end of
+ * the file is discarded.
+ */
+static int pg_writeback(struct vfscore_page *pg)
+{
+	struct vnode *vp = pg->pg_vnode;
+	struct iovec iov;
+	struct uio uio;
+	char *addr;
+	off_t len;
+	int error;
+
+	len = MIN((off_t)PAGE_SIZE, vp->v_size - pg->pg_off);
+	if (len <= 0)
+		return 0;
+
+	addr = pg_kmap(pg);
+	if (unlikely(!addr))
+		return ENOMEM;
+
+	iov.iov_base = addr;
+	iov.iov_len = len;
+	uio.uio_iov = &iov;
+	uio.uio_iovcnt = 1;
+	uio.uio_offset = pg->pg_off;
+	uio.uio_resid = len;
+	uio.uio_rw = UIO_WRITE;
+
+	error = VOP_WRITE(vp, &uio, 0);
+
+	pg_kunmap(addr);
+	return error;
+}
+
+/*
+ * Returns the page at the given file offset with a reference held. If the
+ * page is not cached, it is read from the file together with up to count - 1
+ * following pages that are not cached either.
+ */
+static int pg_get(struct vnode *vp, struct vfscore_file *fp, off_t off,
+		  unsigned long count, struct vfscore_page **pgp)
+{
+	struct vfscore_page *pgs[PAGECACHE_READ_BATCH];
+	struct vfscore_page *pg;
+	unsigned long i, n;
+	int error;
+
+	UK_ASSERT(PAGE_ALIGNED(off));
+	UK_ASSERT(count > 0);
+
+	count = MIN(count, (unsigned long)PAGECACHE_READ_BATCH);
+
+	PAGE_LOCK();
+	pg = pg_lookup(vp, off);
+	if (pg) {
+		pg_hold(pg);
+		PAGE_UNLOCK();
+		*pgp = pg;
+		return 0;
+	}
+
+	/* Read the following missing pages with the same operation */
+	for (n = 1; n < count; n++) {
+		if (pg_lookup(vp, off + (off_t)(n << PAGE_SHIFT)))
+			break;
+	}
+
+	/* The limit is exceeded if all pages are in use or dirty */
+	if (page_count + n > CONFIG_LIBVFSCORE_PAGECACHE_MAX_PAGES)
+		pg_evict(page_count + n -
+			 CONFIG_LIBVFSCORE_PAGECACHE_MAX_PAGES);
+	PAGE_UNLOCK();
+
+	for (i = 0; i < n; i++) {
+		pg = calloc(1, sizeof(*pg));
+		if (!pg)
+			break;
+
+		if (pg_alloc_frame(&pg->pg_paddr)) {
+			free(pg);
+			break;
+		}
+
+		pg->pg_vnode = vp;
+		pg->pg_off = off + (off_t)(i << PAGE_SHIFT);
+		pgs[i] = pg;
+	}
+
+	/* Only the requested page is mandatory */
+	if (i == 0)
+		return ENOMEM;
+	n = i;
+
+	/* Nobody else can add the pages while we hold the vnode lock */
+	error = pg_fill_batch(pgs, n, fp);
+	if (error) {
+		for (i = 0; i < n; i++) {
+			pg_falloc()->ffree(pg_falloc(), pgs[i]->pg_paddr, 1);
+			free(pgs[i]);
+		}
+		return error;
+	}
+
+	PAGE_LOCK();
+	for (i = 0; i < n; i++) {
+		pg = pgs[i];
+		UK_ASSERT(!pg_lookup(vp, pg->pg_off));
+		uk_list_add(&pg->pg_link,
+			    &pagecache_table[pg_hash(vp, pg->pg_off)]);
+		uk_list_add_tail(&pg->pg_vlink, &vp->v_pages);
+		page_count++;
+
+		/* The pages read ahead are unreferenced */
+		if (i > 0)
+			uk_list_add_tail(&pg->pg_lru, &page_lru);
+	}
+	pgs[0]->pg_refcnt = 1;
+	PAGE_UNLOCK();
+
+	*pgp = pgs[0];
+	return 0;
+}
+
+int vfscore_pagecache_read(struct vnode *vp, struct vfscore_file *fp,
+			   struct uio *uio)
+{
+	struct vfscore_page *pg;
+	off_t off, end;
+	char *addr;
+	int error;
+
+	if (uio->uio_offset < 0)
+		return EINVAL;
+
+	while (uio->uio_resid > 0 && uio->uio_offset < vp->v_size) {
+		off = PAGE_ALIGN_DOWN(uio->uio_offset);
+		end = MIN(uio->uio_offset + uio->uio_resid, vp->v_size);
+		error = pg_get(vp, fp, off,
+			       (PAGE_ALIGN_UP(end) - off) >> PAGE_SHIFT, &pg);
+		if (error)
+			return error;
+
+		addr = pg_kmap(pg);
+		if (unlikely(!addr)) {
+			pg_put(pg);
+			return ENOMEM;
+		}
+
+		end = MIN(off + (off_t)PAGE_SIZE, vp->v_size);
+		error = vfscore_uiomove(addr + (uio->uio_offset - off),
+					end - uio->uio_offset, uio);
+
+		pg_kunmap(addr);
+		pg_put(pg);
+		if (error)
+			return error;
+	}
+	return 0;
+}
+
+int vfscore_pagecache_write(struct vnode *vp, struct uio *uio, off_t off)
+{
+	struct vfscore_page *pg;
+	ssize_t resid = uio->uio_resid;
+	size_t len, n, poff;
+	const char *buf;
+	char *addr;
+	int i;
+
+	if (off < 0)
+		return 0;
+
+	for (i = 0; i < uio->uio_iovcnt && resid > 0; i++) {
+		buf = uio->uio_iov[i].iov_base;
+		len = MIN(uio->uio_iov[i].iov_len, (size_t)resid);
+		resid -= len;
+
+		while (len > 0) {
+			poff = off & (PAGE_SIZE - 1);
+			n = MIN(len, PAGE_SIZE - poff);
+
+			PAGE_LOCK();
+			pg = pg_lookup(vp, off - poff);
+			if (pg)
+				pg_hold(pg);
+			PAGE_UNLOCK();
+
+			if (pg) {
+				addr = pg_kmap(pg);
+				if (likely(addr)) {
+					memcpy(addr + poff, buf, n);
+					pg_kunmap(addr);
+				}
+				pg_put(pg);
+
+				if (unlikely(!addr))
+					return ENOMEM;
+			}
+
+			off += n;
+			buf += n;
+			len -= n;
+		}
+	}
+	return 0;
+}
+
+void vfscore_pagecache_invalidate(struct vnode *vp, struct vfscore_file *fp,
+				  off_t off, off_t len)
+{
+	struct vfscore_page *pg, *next;
+	off_t start = PAGE_ALIGN_DOWN(off);
+	size_t poff, plen;
+	int error;
+
+	PAGE_LOCK();
+	pg = uk_list_first_entry(&vp->v_pages, struct vfscore_page, pg_vlink);
+	while (&pg->pg_vlink != &vp->v_pages) {
+		next = uk_list_next_entry(pg, pg_vlink);
+
+		if (pg->pg_off < start || pg->pg_off >= off + len) {
+			pg = next;
+			continue;
+		}
+
+		if (pg->pg_refcnt == 0 && !(pg->pg_flags & PG_DIRTY)) {
+			pg_free(pg);
+			pg = next;
+			continue;
+		}
+
+		/* The page is in use or has data that is not written back,
+		 * so we cannot drop it. Only the range is read again.
+		 */
+		poff = MAX(off - pg->pg_off, 0);
+		plen = MIN(off + len - pg->pg_off, (off_t)PAGE_SIZE) - poff;
+
+		pg_hold(pg);
+		PAGE_UNLOCK();
+
+		error = pg_fill_range(pg, fp, poff, plen);
+		if (unlikely(error))
+			uk_pr_warn("Failed to read page at %lld: %d\n",
+				   (long long)pg->pg_off, error);
+
+		PAGE_LOCK();
+		next = uk_list_next_entry(pg, pg_vlink);
+		pg_rele(pg);
+		pg = next;
+	}
+	PAGE_UNLOCK();
+}
+
+void vfscore_pagecache_truncate(struct vnode *vp, off_t size)
+{
+	struct vfscore_page *pg, *next;
+	off_t poff;
+	char *addr;
+
+	PAGE_LOCK();
+	uk_list_for_each_entry_safe(pg, next, &vp->v_pages, pg_vlink) {
+		if (pg->pg_off + (off_t)PAGE_SIZE <= size)
+			continue;
+
+		/* Dirty pages are only dropped if all their data is beyond
+		 * the end of the file
+		 */
+		if (pg->pg_refcnt == 0 &&
+		    (!(pg->pg_flags & PG_DIRTY) || pg->pg_off >= size)) {
+			pg_free(pg);
+			continue;
+		}
+
+		/* The page is mapped or dirty, so clear the truncated part
+		 * instead. The rest is written back with the next sync.
+		 */
+		addr = pg_kmap(pg);
+		if (unlikely(!addr)) {
+			uk_pr_warn("Failed to clear page at %lld\n",
+				   (long long)pg->pg_off);
+			continue;
+		}
+
+		poff = MAX(size - pg->pg_off, 0);
+		memset(addr + poff, 0, PAGE_SIZE - poff);
+		pg_kunmap(addr);
+	}
+	PAGE_UNLOCK();
+}
+
+void vfscore_pagecache_release(struct vnode *vp)
+{
+	struct vfscore_page *pg, *next;
+
+	PAGE_LOCK();
+	uk_list_for_each_entry_safe(pg, next, &vp->v_pages, pg_vlink)
+		pg_free(pg);
+	PAGE_UNLOCK();
+}
+
+int vfscore_pagecache_map(struct vnode *vp, struct vfscore_file *fp,
+			  off_t off, int writable, __paddr_t *paddr)
+{
+	struct vfscore_page *pg;
+	int error;
+
+	error = pg_get(vp, fp, off, 1, &pg);
+	if (error)
+		return error;
+
+	/* The reference is kept for the mapping */
+	PAGE_LOCK();
+	pg->pg_mapcnt++;
+	if (writable)
+		pg->pg_flags |= PG_DIRTY;
+	PAGE_UNLOCK();
+
+	*paddr = pg->pg_paddr;
+	return 0;
+}
+
+void vfscore_pagecache_unmap(struct vnode *vp, off_t off)
+{
+	struct vfscore_page *pg;
+
+	PAGE_LOCK();
+	pg = pg_lookup(vp, off);
+	UK_ASSERT(pg);
+	UK_ASSERT(pg->pg_mapcnt > 0);
+
+	pg->pg_mapcnt--;
+	pg_rele(pg);
+	PAGE_UNLOCK();
+}
+
+void vfscore_pagecache_set_dirty(struct vnode *vp, off_t off)
+{
+	struct vfscore_page *pg;
+
+	PAGE_LOCK();
+	pg = pg_lookup(vp, off);
+	if (pg)
+		pg->pg_flags |= PG_DIRTY;
+	PAGE_UNLOCK();
+}
+
+int vfscore_pagecache_sync(struct vnode *vp, off_t off, off_t len)
+{
+	struct vfscore_page *pg, *next;
+	off_t end = (len > 0) ? off + len : __OFF_MAX;
+	int error = 0;
+
+	PAGE_LOCK();
+	pg = uk_list_first_entry(&vp->v_pages, struct vfscore_page, pg_vlink);
+	while (&pg->pg_vlink != &vp->v_pages) {
+		if (!(pg->pg_flags & PG_DIRTY) ||
+		    pg->pg_off + (off_t)PAGE_SIZE <= off || pg->pg_off >= end) {
+			pg = uk_list_next_entry(pg, pg_vlink);
+			continue;
+		}
+
+		/* The reference keeps the page on the list while unlocked */
+		pg_hold(pg);
+		PAGE_UNLOCK();
+
+		error = pg_writeback(pg);
+
+		PAGE_LOCK();
+
+		/* Mapped pages may be written again at any time */
+		if (!error && pg->pg_mapcnt == 0)
+			pg->pg_flags &= ~PG_DIRTY;
+
+		next = uk_list_next_entry(pg, pg_vlink);
+		pg_rele(pg);
+		if (error)
+			break;
+
+		pg = next;
+	}
+	PAGE_UNLOCK();
+
+	return error;
+}
+
+unsigned long vfscore_pagecache_reclaim(unsigned long count)
+{
+	unsigned long n;
+
+	PAGE_LOCK();
+	n = pg_evict(count);
+	PAGE_UNLOCK();
+
+	return n;
+}
+
+/*
+ * pagecache_init() is called once (from vfscore_init)
+ * in initialization.
+ */
+void pagecache_init(void)
+{
+	int i;
+
+	for (i = 0; i < PAGECACHE_BUCKETS; i++)
+		UK_INIT_LIST_HEAD(&pagecache_table[i]);
+}
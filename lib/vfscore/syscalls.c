@@ -54,6 +54,7 @@
 #include <vfscore/prex.h>
 #include <vfscore/vnode.h>
 #include <vfscore/file.h>
+#include <vfscore/pagecache.h>
 
 #include "vfs.h"
 #include <vfscore/fs.h>
@@ -219,6 +220,9 @@ sys_open(char *path, int flags, mode_t mode, struct vfscore_file **fpp)
 		error = VOP_TRUNCATE(vp, 0);
 		if (error)
 			goto out_fp_free_unlock;
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+		vfscore_pagecache_truncate(vp, 0);
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
 	}
 
 	error = VOP_OPEN(vp, fp);
@@ -443,6 +447,15 @@ sys_fsync(struct vfscore_file *fp)
 
 	vp = fp->f_dentry->d_vnode;
 	vn_lock(vp);
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+	if (vfscore_pagecache_enabled(vp)) {
+		error = vfscore_pagecache_sync(vp, 0, 0);
+		if (error) {
+			vn_unlock(vp);
+			return error;
+		}
+	}
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
 	error = VOP_FSYNC(vp, fp);
 	vn_unlock(vp);
 	return error;
@@ -1179,6 +1192,10 @@ sys_truncate(char *path, off_t length)
 
 	vn_lock(dp->d_vnode);
 	error = VOP_TRUNCATE(dp->d_vnode, length);
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+	if (!error)
+		vfscore_pagecache_truncate(dp->d_vnode, length);
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
 	vn_unlock(dp->d_vnode);
 
 	drele(dp);
@@ -1197,6 +1214,10 @@ sys_ftruncate(struct vfscore_file *fp, off_t length)
 	vp = fp->f_dentry->d_vnode;
 	vn_lock(vp);
 	error = VOP_TRUNCATE(vp, length);
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+	if (!error)
+		vfscore_pagecache_truncate(vp, length);
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
 	vn_unlock(vp);
 
 	return error;
@@ -1545,6 +1566,11 @@ sys_fallocate(struct vfscore_file *fp, int mode, off_t offset, off_t len)
 	}
 
 	error = VOP_FALLOCATE(vp, mode, offset, len);
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+	// Punched holes read as zeros, so refresh the cached pages.
+	if (!error && (mode & FALLOC_FL_PUNCH_HOLE))
+		vfscore_pagecache_invalidate(vp, fp, offset, len);
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
 ret:
 	vn_unlock(vp);
 	return error;
@@ -40,6 +40,7 @@
 #include <fcntl.h>
 #include <sys/statfs.h>
 #include <sys/time.h>
+#include <uk/atomic.h>
 
 /*
  * Tunable parameters
@@ -701,6 +702,68 @@ int lookup(char *path, struct dentry **dpp, char **name);
  */
 void vnode_init(void);
 
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+/**
+ * Initializes the buckets of the page cache hash table.
+ * It is called once (from vfscore_init()) in initialization.
+ */
+void pagecache_init(void);
+
+/**
+ * Copies data that is about to be written to the file into the pages that are
+ * already cached. The uio is not modified.
+ *
+ * @param vp
+ *	Locked vnode
+ * @param uio
+ *	Describes the source buffers
+ * @param off
+ *	File offset at which the data is written
+ * @return
+ *	- (0):  Completed successfully
+ *	- (>0): Positive value with error code
+ */
+int vfscore_pagecache_write(struct vnode *vp, struct uio *uio, off_t off);
+
+/**
+ * Drops the unreferenced clean pages in the given range, for example, after
+ * a failed write. Of referenced and dirty pages, only the part within the
+ * range is read again from the file.
+ *
+ * @param vp
+ *	Locked vnode
+ * @param fp
+ *	File used to read the pages
+ * @param off
+ *	File offset at which the range starts
+ * @param len
+ *	Length of the range in bytes
+ */
+void vfscore_pagecache_invalidate(struct vnode *vp, struct vfscore_file *fp,
+				  off_t off, off_t len);
+
+/**
+ * Drops the cached data beyond the new size of a truncated file. In pages
+ * that are still mapped or that have dirty data below the new size, only the
+ * truncated part is zeroed instead.
+ *
+ * @param vp
+ *	Locked vnode
+ * @param size
+ *	New size of the file
+ */
+void vfscore_pagecache_truncate(struct vnode *vp, off_t size);
+
+/**
+ * Frees all cached pages of a vnode that is released. The pages must not be
+ * referenced anymore.
+ *
+ * @param vp
+ *	Vnode without references
+ */
+void vfscore_pagecache_release(struct vnode *vp);
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
+
 /**
  * Calls dentry_init().
  */
@@ -858,6 +921,49 @@ int fget(int fd, struct vfscore_file **out_fp);
  */
 int fdalloc(struct vfscore_file *fp, int *newfd);
 
+/**
+ * Takes a reference on a dentry or vnode that was found by a lock-free
+ * lookup, unless its last reference has been dropped already.
+ *
+ * @param refcnt
+ *	Reference counter of the object
+ * @return
+ *	- (1): A reference was taken
+ *	- (0): The object is being released
+ */
+static inline int vfscore_ref_get_unless_zero(int *refcnt)
+{
+	int old = UK_READ_ONCE(*refcnt);
+
+	do {
+		if (old <= 0)
+			return 0;
+	} while (!uk_compare_exchange_n(refcnt, &old, old + 1));
+	return 1;
+}
+
+/**
+ * Drops a reference on a dentry or vnode unless it is the last one. The
+ * last reference has to be dropped with the hash table lock held, so that
+ * the object is unhashed before a locked lookup can miss it.
+ *
+ * @param refcnt
+ *	Reference counter of the object
+ * @return
+ *	- (1): The reference was dropped
+ *	- (0): This is the last reference
+ */
+static inline int vfscore_ref_put_unless_one(int *refcnt)
+{
+	int old = UK_READ_ONCE(*refcnt);
+
+	do {
+		if (old <= 1)
+			return 0;
+	} while (!uk_compare_exchange_n(refcnt, &old, old - 1));
+	return 1;
+}
+
 #ifdef DEBUG_VFS
 
 /**
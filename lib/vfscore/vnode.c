@@ -44,6 +44,7 @@
 #include <errno.h>
 #include <sys/stat.h>
 
+#include <uk/rculist.h>
 #include <vfscore/prex.h>
 #include <vfscore/dentry.h>
 #include <vfscore/vnode.h>
@@ -86,6 +87,8 @@ static struct uk_list_head vnode_table[VNODE_BUCKETS];
  * Global lock to access all vnodes and vnode table.
  * If a vnode is already locked, there is no need to
  * lock this global lock to access internal data.
+ * The table can also be searched in an RCU read-side critical section.
+ * Vnodes are freed after a grace period.
  */
 static struct uk_mutex vnode_lock = UK_MUTEX_INITIALIZER(vnode_lock);
 #define VNODE_LOCK()	uk_mutex_lock(&vnode_lock)
@@ -105,6 +108,25 @@ static unsigned int vn_hash(struct mount *mp, uint64_t ino)
 	return (ino ^ (unsigned long)mp) & (VNODE_BUCKETS - 1);
 }
 
+/*
+ * Finds a vnode and takes a reference on it.
+ *
+ * Locking: VNODE_LOCK must be held or the caller must be in an RCU
+ * read-side critical section.
+ */
+static struct vnode *
+vn_find(struct mount *mp, uint64_t ino)
+{
+	struct vnode *vp;
+
+	uk_list_for_each_entry_rcu(vp, &vnode_table[vn_hash(mp, ino)], v_link) {
+		if (vp->v_mount == mp && vp->v_ino == ino &&
+		    vfscore_ref_get_unless_zero(&vp->v_refcnt))
+			return vp;
+	}
+	return NULL;		/* not found */
+}
+
 /*
  * Returns locked vnode for specified mount point and path.
  * vn_lock() will increment the reference count of vnode.
@@ -117,14 +139,10 @@ vn_lookup(struct mount *mp, uint64_t ino)
 	struct vnode *vp;
 
 	UK_ASSERT(VNODE_OWNED());
-	uk_list_for_each_entry(vp, &vnode_table[vn_hash(mp, ino)], v_link) {
-		if (vp->v_mount == mp && vp->v_ino == ino) {
-			vp->v_refcnt++;
-			uk_mutex_lock(&vp->v_lock);
-			return vp;
-		}
-	}
-	return NULL;		/* not found */
+	vp = vn_find(mp, ino);
+	if (vp)
+		uk_mutex_lock(&vp->v_lock);
+	return vp;
 }
 
 #ifdef DEBUG_VFS
@@ -182,6 +200,16 @@ vfscore_vget(struct mount *mp, uint64_t ino, struct vnode **vpp)
 
 	DPRINTF(VFSDB_VNODE, ("vfscore_vget %llu\n", (unsigned long long) ino));
 
+	/* Fast path: the vnode is cached */
+	uk_rcu_read_lock();
+	vp = vn_find(mp, ino);
+	uk_rcu_read_unlock();
+	if (vp) {
+		uk_mutex_lock(&vp->v_lock);
+		*vpp = vp;
+		return 1;
+	}
+
 	VNODE_LOCK();
 
 	vp = vn_lookup(mp, ino);
@@ -198,6 +226,9 @@ vfscore_vget(struct mount *mp, uint64_t ino, struct vnode **vpp)
 	}
 
 	UK_INIT_LIST_HEAD(&vp->v_names);
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+	UK_INIT_LIST_HEAD(&vp->v_pages);
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
 	vp->v_ino = ino;
 	vp->v_mount = mp;
 	vp->v_refcnt = 1;
@@ -214,7 +245,7 @@ vfscore_vget(struct mount *mp, uint64_t ino, struct vnode **vpp)
 	vfs_busy(vp->v_mount);
 	uk_mutex_lock(&vp->v_lock);
 
-	uk_list_add(&vp->v_link, &vnode_table[vn_hash(mp, ino)]);
+	uk_list_add_rcu(&vp->v_link, &vnode_table[vn_hash(mp, ino)]);
 	VNODE_UNLOCK();
 
 	*vpp = vp;
@@ -222,6 +253,12 @@ vfscore_vget(struct mount *mp, uint64_t ino, struct vnode **vpp)
 	return 0;
 }
 
+static void
+vn_free_rcu(struct uk_rcu_head *head)
+{
+	free(__containerof(head, struct vnode, v_rcu));
+}
+
 /*
  * Unlock vnode and decrement its reference count.
  */
@@ -232,16 +269,23 @@ vput(struct vnode *vp)
 	UK_ASSERT(vp->v_refcnt > 0);
 	DPRINTF(VFSDB_VNODE, ("vput: ref=%d %s\n", vp->v_refcnt, vn_path(vp)));
 
+	if (vfscore_ref_put_unless_one(&vp->v_refcnt)) {
+		vn_unlock(vp);
+		return;
+	}
 	VNODE_LOCK();
-	vp->v_refcnt--;
-	if (vp->v_refcnt > 0) {
-	    VNODE_UNLOCK();
+	if (uk_sub_fetch(&vp->v_refcnt, 1) > 0) {
+		VNODE_UNLOCK();
 		vn_unlock(vp);
 		return;
 	}
-	uk_list_del(&vp->v_link);
+	uk_list_del_rcu(&vp->v_link);
 	VNODE_UNLOCK();
 
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+	vfscore_pagecache_release(vp);
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
+
 	/*
 	 * Deallocate fs specific vnode data
 	 */
@@ -249,7 +293,7 @@ vput(struct vnode *vp)
 		VOP_INACTIVE(vp);
 	vfs_unbusy(vp->v_mount);
 	uk_mutex_unlock(&vp->v_lock);
-	free(vp);
+	uk_call_rcu(&vp->v_rcu, vn_free_rcu);
 }
 
 /*
@@ -261,10 +305,8 @@ vref(struct vnode *vp)
 	UK_ASSERT(vp);
 	UK_ASSERT(vp->v_refcnt > 0);	/* Need vfscore_vget */
 
-	VNODE_LOCK();
 	DPRINTF(VFSDB_VNODE, ("vref: ref=%d\n", vp->v_refcnt));
-	vp->v_refcnt++;
-	VNODE_UNLOCK();
+	uk_inc(&vp->v_refcnt);
 }
 
 /*
@@ -279,22 +321,28 @@ vrele(struct vnode *vp)
 	UK_ASSERT(vp);
 	UK_ASSERT(vp->v_refcnt > 0);
 
-	VNODE_LOCK();
 	DPRINTF(VFSDB_VNODE, ("vrele: ref=%d\n", vp->v_refcnt));
-	vp->v_refcnt--;
-	if (vp->v_refcnt > 0) {
+	if (vfscore_ref_put_unless_one(&vp->v_refcnt))
+		return;
+
+	VNODE_LOCK();
+	if (uk_sub_fetch(&vp->v_refcnt, 1) > 0) {
 		VNODE_UNLOCK();
 		return;
 	}
-	uk_list_del(&vp->v_link);
+	uk_list_del_rcu(&vp->v_link);
 	VNODE_UNLOCK();
 
+#ifdef CONFIG_LIBVFSCORE_PAGECACHE
+	vfscore_pagecache_release(vp);
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
+
 	/*
 	 * Deallocate fs specific vnode data
 	 */
 	VOP_INACTIVE(vp);
 	vfs_unbusy(vp->v_mount);
-	free(vp);
+	uk_call_rcu(&vp->v_rcu, vn_free_rcu);
 }
 
 /*
@@ -37,4 +37,10 @@
 
 void time_block_until(__snsec until);
 
+/* Raises the timer interrupt at `until` without halting the CPU.
+ * Only provided by platforms that select HAVE_TIME_ALARM.
+ * Must be called with interrupts disabled.
+ */
+void time_set_alarm(__snsec until);
+
 #endif /* __PLAT_CMN_TIME_H__ */
@@ -335,6 +335,32 @@ void __weak __noreturn lcpu_entry_default(struct lcpu *this_lcpu);
  * @return 0 on success, -errno otherwise
  */
 int lcpu_fn_enqueue(struct lcpu *lcpu, const struct ukplat_lcpu_func *fn);
+
+/**
+ * Queues a function on the supplied LCPU and triggers its execution. In
+ * contrast to ukplat_lcpu_run(), the caller learns if the LCPU was skipped
+ * because it is not online.
+ *
+ * @param lcpu the LCPU to run the function on. Must not be the current LCPU
+ * @param fn the function to run
+ * @param flags flags that specify how the function should be executed (see
+ *    UKPLAT_LCPU_RFLG_* flags)
+ *
+ * @return 0 on success, -ENODEV if the LCPU is not online, -EAGAIN if another
+ *    function is still queued on the LCPU, -errno otherwise
+ */
+int lcpu_fn_run_on(struct lcpu *lcpu, const struct ukplat_lcpu_func *fn,
+		   unsigned long flags);
+
+/**
+ * Runs the function that another LCPU queued for the current LCPU, if any.
+ * LCPUs that wait for other LCPUs with interrupts disabled call this
+ * function so that they do not block LCPUs waiting for them in return. Must be
+ * called with interrupts disabled.
+ *
+ * @return 1 if a function was run, 0 otherwise
+ */
+int lcpu_fn_run_pending(void);
 #endif /* CONFIG_HAVE_SMP */
 
 /*
@@ -207,11 +207,15 @@ __lcpuidx ukplat_lcpu_idx(void)
 	return lcpu_arch_idx();
 }
 
+/* Marks a slot that is acquired but whose function object is not complete */
+#define LCPU_FN_RESERVED ((void (*)(struct __regs *, void *))1)
+
 int lcpu_fn_enqueue(struct lcpu *lcpu, const struct ukplat_lcpu_func *fn)
 {
 	void (*old_fn)(struct __regs *, void *);
 
 	UK_ASSERT(fn->fn);
+	UK_ASSERT(fn->fn != LCPU_FN_RESERVED);
 
 	old_fn = uk_load_n(&lcpu->fn.fn);
 
@@ -219,17 +223,19 @@ int lcpu_fn_enqueue(struct lcpu *lcpu, const struct ukplat_lcpu_func *fn)
 	if (old_fn != NULL)
 		return -EAGAIN;
 
-	/* It is empty, try to store the function */
+	/* It is empty, try to reserve it */
 	if (uk_compare_exchange_sync(&lcpu->fn.fn, old_fn,
-					 fn->fn) != fn->fn)
+				     LCPU_FN_RESERVED) != LCPU_FN_RESERVED)
 		return -EAGAIN;
 
-	/* We have acquired the slot! Also store the user argument.
-	 * It is safe to do it afterwards, because the RUN IRQ handler will
-	 * only take one function and return afterwards. And we only raise the
-	 * IRQ after finishing setup.
+	/* We have acquired the slot! Store the user argument first. The
+	 * target LCPU may poll the slot with lcpu_fn_run_pending() before the
+	 * IRQ arrives, so the function must only be visible once the object
+	 * is complete.
 	 */
 	lcpu->fn.user = fn->user;
+	wmb();
+	UK_WRITE_ONCE(lcpu->fn.fn, fn->fn);
 
 	/* Ensure everything is written back when we return and the arch
 	 * support code will raise the IRQ
@@ -239,25 +245,33 @@ int lcpu_fn_enqueue(struct lcpu *lcpu, const struct ukplat_lcpu_func *fn)
 	return 0;
 }
 
-static void lcpu_fn_dequeue(struct lcpu *this_lcpu, struct ukplat_lcpu_func *fn)
+static int lcpu_fn_dequeue(struct lcpu *this_lcpu, struct ukplat_lcpu_func *fn)
 {
-	*fn = this_lcpu->fn;
+	fn->fn = uk_load_n(&this_lcpu->fn.fn);
+	if (!fn->fn || fn->fn == LCPU_FN_RESERVED)
+		return 0;
 
 	/* Ensure that we have captured the whole function object */
 	rmb();
-
-	UK_ASSERT(fn->fn);
+	fn->user = this_lcpu->fn.user;
 
 	/* Free the slot. Another function object can be queued afterwards */
 	this_lcpu->fn.fn = NULL;
+
+	return 1;
 }
 
-static int lcpu_ipi_run_handler(void *args __unused)
+/* Runs the function queued for the current LCPU, if any. Must be called with
+ * interrupts disabled so that it does not race with the RUN IRQ handler.
+ */
+static int lcpu_fn_run(struct lcpu *this_lcpu)
 {
-	struct lcpu *this_lcpu = lcpu_get_current();
 	struct ukplat_lcpu_func fn;
 
-	lcpu_fn_dequeue(this_lcpu, &fn);
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	if (!lcpu_fn_dequeue(this_lcpu, &fn))
+		return 0;
 
 	/* TODO: Provide the register snapshot from the trap frame */
 	fn.fn(NULL, fn.user);
@@ -273,6 +287,21 @@ static int lcpu_ipi_run_handler(void *args __unused)
 	return 1;
 }
 
+int lcpu_fn_run_pending(void)
+{
+	return lcpu_fn_run(lcpu_get_current());
+}
+
+static int lcpu_ipi_run_handler(void *args __unused)
+{
+	/* The function might have been run already by lcpu_fn_run_pending()
+	 * while the IRQ was pending.
+	 */
+	lcpu_fn_run(lcpu_get_current());
+
+	return 1;
+}
+
 static int lcpu_ipi_wakeup_handler(void *args __unused)
 {
 	/* Nothing to do */
@@ -495,6 +524,29 @@ static inline int lcpu_transition_safe(struct lcpu *lcpu, int incr)
 	return 1;
 }
 
+int lcpu_fn_run_on(struct lcpu *lcpu, const struct ukplat_lcpu_func *fn,
+		   unsigned long flags)
+{
+	int rc;
+
+	/* Try to transition state to a higher busy level */
+	if (!lcpu_transition_safe(lcpu, 1))
+		return -ENODEV;
+
+	/* We successfully performed the state transition. Now queue the
+	 * function and trigger its execution
+	 */
+	rc = lcpu_arch_run(lcpu, fn, flags);
+	if (unlikely(rc)) {
+		/* Try to transition back one busy level. We don't care if the
+		 * CPU is no longer online
+		 */
+		lcpu_transition_safe(lcpu, -1);
+	}
+
+	return rc;
+}
+
 int ukplat_lcpu_run(const __lcpuidx lcpuidx[], unsigned int *num,
 		    const struct ukplat_lcpu_func *fn, unsigned long flags)
 {
@@ -510,35 +562,20 @@ int ukplat_lcpu_run(const __lcpuidx lcpuidx[], unsigned int *num,
 		if (lcpu->id == this_cpu_id)
 			continue;
 
-		/* Try to transition state to a higher busy level.
-		 * We ignore CPUs that are not online
+		/* Retry if we could not enqueue the function and it is ok to
+		 * block
 		 */
-		if (!lcpu_transition_safe(lcpu, 1))
-			continue;
+		do {
+			rc = lcpu_fn_run_on(lcpu, fn, flags);
+		} while ((rc == -EAGAIN) &&
+			 (!(flags & UKPLAT_LCPU_RFLG_DONOTBLOCK)));
 
-		/* We successfully performed the state transition. Now queue
-		 * the function and trigger its execution
-		 */
-		while (1) {
-			rc = lcpu_arch_run(lcpu, fn, flags);
-			if (unlikely(rc)) {
-				/* Retry if we could not enqueue the function
-				 * and it is ok to block
-				 */
-				if ((rc == -EAGAIN) &&
-				    (!(flags & UKPLAT_LCPU_RFLG_DONOTBLOCK)))
-					continue;
-
-				/* Try to transition back one busy level. We
-				 * don't care if the CPU is no longer online
-				 */
-				lcpu_transition_safe(lcpu, -1);
-
-				return rc;
-			}
+		/* We ignore CPUs that are not online */
+		if (rc == -ENODEV)
+			continue;
 
-			break;
-		}
+		if (unlikely(rc))
+			return rc;
 	}
 
 	return 0;
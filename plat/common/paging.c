@@ -49,6 +49,10 @@
 #include <uk/plat/common/sections.h>
 #include <uk/plat/common/bootinfo.h>
 #include <uk/falloc.h>
+#ifdef CONFIG_HAVE_SMP
+#include <uk/atomic.h>
+#include <uk/plat/common/lcpu.h>
+#endif /* CONFIG_HAVE_SMP */
 
 #define __PLAT_CMN_ARCH_PAGING_H__
 #if defined CONFIG_ARCH_ARM_64
@@ -63,8 +67,9 @@
 static inline int pg_pt_alloc(struct uk_pagetable *pt, __vaddr_t *pt_vaddr,
 			      __paddr_t *pt_paddr, unsigned int level);
 
-static inline void pg_pt_free(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
-			      unsigned int level);
+static inline void pg_pt_free(struct uk_pagetable *pt,
+			      struct ukplat_tlb_gather *tlb,
+			      __vaddr_t pt_vaddr, unsigned int level);
 
 static int pg_page_split(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
 			 __vaddr_t vaddr, unsigned int level);
@@ -75,7 +80,8 @@ static int pg_page_mapx(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
 			__pte_t template, unsigned int template_level,
 			struct ukplat_page_mapx *mapx);
 
-static int pg_page_unmap(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
+static int pg_page_unmap(struct uk_pagetable *pt,
+			 struct ukplat_tlb_gather *tlb, __vaddr_t pt_vaddr,
 			 unsigned int level, __vaddr_t vaddr, __sz len,
 			 unsigned long flags);
 
@@ -177,7 +183,7 @@ static int pg_pt_clone(struct uk_pagetable *pt_dst, struct uk_pagetable *pt_src,
 			rc = ukarch_pte_write(pt_vaddr_dcache[lvl], lvl,
 					      pte_idx, pte);
 			if (unlikely(rc)) {
-				pg_pt_free(pt_dst, pt_dvaddr, lvl - 1);
+				pg_pt_free(pt_dst, __NULL, pt_dvaddr, lvl - 1);
 				goto EXIT_FREE;
 			}
 
@@ -240,10 +246,12 @@ EXIT:
 	return 0;
 
 EXIT_FREE:
-	pg_page_unmap(pt_dst, pt_vaddr_dcache[PT_LEVELS - 1], PT_LEVELS - 1,
-		      __VADDR_ANY, __SZ_MAX, PAGE_FLAG_KEEP_FRAMES);
+	pg_page_unmap(pt_dst, __NULL, pt_vaddr_dcache[PT_LEVELS - 1],
+		      PT_LEVELS - 1, __VADDR_ANY, __SZ_MAX,
+		      PAGE_FLAG_KEEP_FRAMES);
 
-	pg_pt_free(pt_dst, pt_vaddr_dcache[PT_LEVELS - 1], PT_LEVELS - 1);
+	pg_pt_free(pt_dst, __NULL, pt_vaddr_dcache[PT_LEVELS - 1],
+		   PT_LEVELS - 1);
 
 	return rc;
 }
@@ -354,13 +362,14 @@ int ukplat_pt_free(struct uk_pagetable *pt, unsigned long flags)
 	UK_ASSERT(pt->pt_vbase != __VADDR_INV);
 	UK_ASSERT(pt->pt_pbase != __PADDR_INV);
 
-	rc = pg_page_unmap(pt, pt->pt_vbase, PT_LEVELS - 1, __VADDR_ANY,
-			   __SZ_MAX, flags & PAGE_FLAG_KEEP_FRAMES);
+	rc = pg_page_unmap(pt, __NULL, pt->pt_vbase, PT_LEVELS - 1,
+			   __VADDR_ANY, __SZ_MAX,
+			   flags & PAGE_FLAG_KEEP_FRAMES);
 	if (unlikely(rc))
 		return rc;
 
 	/* Also free the top-level page table */
-	pg_pt_free(pt, pt->pt_vbase, PT_LEVELS - 1);
+	pg_pt_free(pt, __NULL, pt->pt_vbase, PT_LEVELS - 1);
 
 	pt->pt_vbase = __VADDR_INV;
 	pt->pt_pbase = __PADDR_INV;
@@ -503,8 +512,337 @@ EXIT_FREE:
 	return -ENOMEM;
 }
 
-static inline void pg_pt_free(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
-			      unsigned int level)
+/* Gathered ranges with more pages are flushed by flushing the whole TLB */
+#define PG_TLB_FLUSH_MAX_PAGES		32
+
+static void pg_tlb_flush_local(__vaddr_t start, __vaddr_t end,
+			       unsigned int level, int flush_all)
+{
+	__sz page_size = PAGE_Lx_SIZE(level);
+
+	if (flush_all || (end - start) / page_size > PG_TLB_FLUSH_MAX_PAGES) {
+		ukarch_tlb_flush();
+		return;
+	}
+
+	for (; start < end; start += page_size)
+		ukarch_tlb_flush_entry(start);
+}
+
+#ifdef CONFIG_HAVE_SMP
+struct pg_tlb_shootdown {
+	__vaddr_t start;
+	__vaddr_t end;
+	unsigned int level;
+	int flush_all;
+
+	/* Set by each LCPU when it has flushed */
+	int done[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+};
+
+static void pg_tlb_shootdown_fn(struct __regs *regs __unused, void *arg)
+{
+	struct pg_tlb_shootdown *sd = (struct pg_tlb_shootdown *)arg;
+
+	pg_tlb_flush_local(sd->start, sd->end, sd->level, sd->flush_all);
+
+	/* The initiator may return as soon as it sees the flag */
+	wmb();
+	UK_WRITE_ONCE(sd->done[ukplat_lcpu_idx()], 1);
+}
+
+/* Flushes the gathered range on all other online LCPUs and waits until they
+ * are done. All LCPUs share the active page table. Interrupts are disabled
+ * while we wait, so we run the functions that other LCPUs queue for us in the
+ * meantime. Otherwise, two LCPUs that shoot down at the same time would wait
+ * for each other. LCPUs that are not online have nothing to flush and are not
+ * waited for.
+ */
+static void pg_tlb_shootdown(struct ukplat_tlb_gather *tlb)
+{
+	struct pg_tlb_shootdown sd = {
+		.start = tlb->start,
+		.end = tlb->end,
+		.level = tlb->level,
+		.flush_all = tlb->flush_all,
+	};
+	struct ukplat_lcpu_func fn = {
+		.fn = pg_tlb_shootdown_fn,
+		.user = &sd,
+	};
+	__lcpuidx this_idx = ukplat_lcpu_idx();
+	unsigned int count = ukplat_lcpu_count();
+	unsigned long irqf;
+	unsigned int i;
+	int pending;
+	int rc;
+
+	if (count <= 1)
+		return;
+
+	irqf = ukplat_lcpu_save_irqf();
+
+	for (i = 0; i < count; i++) {
+		if (i == this_idx) {
+			sd.done[i] = 1;
+			continue;
+		}
+
+		do {
+			rc = lcpu_fn_run_on(lcpu_get(i), &fn,
+					    UKPLAT_LCPU_RFLG_DONOTBLOCK);
+			if (rc == -EAGAIN) {
+				lcpu_fn_run_pending();
+				ukarch_spinwait();
+			}
+		} while (rc == -EAGAIN);
+
+		if (rc == -ENODEV) {
+			/* Skipped, the LCPU is not online */
+			sd.done[i] = 1;
+			continue;
+		}
+
+		if (unlikely(rc))
+			UK_CRASH("TLB shootdown failed: %d\n", rc);
+	}
+
+	do {
+		pending = 0;
+		for (i = 0; i < count; i++) {
+			if (UK_READ_ONCE(sd.done[i]))
+				continue;
+
+			/* An LCPU that went offline will not flush anymore */
+			if (!lcpu_state_is_online(
+					UK_READ_ONCE(lcpu_get(i)->state)))
+				continue;
+
+			pending = 1;
+			break;
+		}
+
+		if (pending) {
+			lcpu_fn_run_pending();
+			ukarch_spinwait();
+		}
+	} while (pending);
+
+	ukplat_lcpu_restore_irqf(irqf);
+}
+#endif /* CONFIG_HAVE_SMP */
+
+/* Frames that a gather frees after the flush and that do not fit into the
+ * gather itself are recorded in batch frames. Batch frames are allocated from
+ * the frame allocator of the page table and chained into a list. We do not
+ * chain the released frames themselves, since stale TLB entries may still
+ * write to them until the flush.
+ */
+struct pg_tlb_batch {
+	__paddr_t next;
+	unsigned long nr_frames;
+	__paddr_t frames[];
+};
+
+#define PG_TLB_BATCH_FRAMES						\
+	((PAGE_SIZE - sizeof(struct pg_tlb_batch)) / sizeof(__paddr_t))
+
+/* The frames are page-aligned, so we encode the page level in the low bits */
+#define PG_TLB_FRAME(paddr, level)	((paddr) | (level))
+#define PG_TLB_FRAME_PADDR(frame)	PAGE_ALIGN_DOWN(frame)
+#define PG_TLB_FRAME_LEVEL(frame)	((unsigned int)((frame) & ~PAGE_MASK))
+
+static inline struct pg_tlb_batch *pg_tlb_batch_map(struct uk_pagetable *pt,
+						    __paddr_t paddr)
+{
+	__vaddr_t vaddr;
+
+	vaddr = pgarch_pt_map(pt, paddr, PAGE_LEVEL);
+	UK_ASSERT(vaddr != __VADDR_INV);
+
+	return (struct pg_tlb_batch *)vaddr;
+}
+
+static inline void pg_tlb_gather_reset(struct ukplat_tlb_gather *tlb)
+{
+	tlb->start = 0;
+	tlb->end = 0;
+	tlb->level = PT_LEVELS - 1;
+	tlb->flush_all = 0;
+	tlb->nr_frames = 0;
+	tlb->batch = __PADDR_INV;
+}
+
+/* Flushes the gathered range and frees the gathered frames afterwards */
+static void pg_tlb_gather_flush(struct ukplat_tlb_gather *tlb)
+{
+	struct uk_pagetable *pt = tlb->pt;
+	struct pg_tlb_batch *batch;
+	__paddr_t batch_paddr;
+	__paddr_t frame;
+	unsigned long i;
+
+	if (pt == pg_active_pt && (tlb->flush_all || tlb->start < tlb->end)) {
+		pg_tlb_flush_local(tlb->start, tlb->end, tlb->level,
+				   tlb->flush_all);
+#ifdef CONFIG_HAVE_SMP
+		pg_tlb_shootdown(tlb);
+#endif /* CONFIG_HAVE_SMP */
+
+#ifdef CONFIG_PAGING_STATS
+		pt->nr_tlb_flushes++;
+#endif /* CONFIG_PAGING_STATS */
+	}
+
+	for (i = 0; i < tlb->nr_frames; i++) {
+		frame = tlb->frames[i];
+		pg_ffree(pt, PG_TLB_FRAME_PADDR(frame),
+			 PG_TLB_FRAME_LEVEL(frame));
+	}
+
+	while (tlb->batch != __PADDR_INV) {
+		batch_paddr = tlb->batch;
+		batch = pg_tlb_batch_map(pt, batch_paddr);
+
+		for (i = 0; i < batch->nr_frames; i++) {
+			frame = batch->frames[i];
+			pg_ffree(pt, PG_TLB_FRAME_PADDR(frame),
+				 PG_TLB_FRAME_LEVEL(frame));
+		}
+
+		tlb->batch = batch->next;
+		pgarch_pt_unmap(pt, (__vaddr_t)batch, PAGE_LEVEL);
+		pg_ffree(pt, batch_paddr, PAGE_LEVEL);
+	}
+
+	pg_tlb_gather_reset(tlb);
+}
+
+/* Flushes the TLB entry for the page of the given level at vaddr. If a
+ * gather is given, the page is added to the gathered range instead.
+ */
+static inline void pg_tlb_flush_page(struct uk_pagetable *pt,
+				     struct ukplat_tlb_gather *tlb,
+				     __vaddr_t vaddr, unsigned int level)
+{
+	__vaddr_t end;
+
+	UK_ASSERT(vaddr != __VADDR_ANY);
+	UK_ASSERT(PAGE_Lx_ALIGNED(vaddr, level));
+
+	if (!tlb) {
+		if (pt == pg_active_pt)
+			ukarch_tlb_flush_entry(vaddr);
+		return;
+	}
+
+	UK_ASSERT(tlb->pt == pt);
+
+	end = vaddr + PAGE_Lx_SIZE(level);
+	if (tlb->start == tlb->end) {
+		tlb->start = vaddr;
+		tlb->end = end;
+	} else {
+		tlb->start = MIN(tlb->start, vaddr);
+		tlb->end = MAX(tlb->end, end);
+	}
+	tlb->level = MIN(tlb->level, level);
+}
+
+/* Flushes the whole TLB, or defers the flush if a gather is given */
+static inline void pg_tlb_flush_all(struct uk_pagetable *pt,
+				    struct ukplat_tlb_gather *tlb)
+{
+	if (tlb)
+		tlb->flush_all = 1;
+	else if (pt == pg_active_pt)
+		ukarch_tlb_flush();
+}
+
+/* Frees a frame that might still be accessed through the TLB. If a gather is
+ * given, the frame is freed after the gathered range has been flushed.
+ */
+static void pg_tlb_ffree(struct uk_pagetable *pt,
+			 struct ukplat_tlb_gather *tlb, __paddr_t paddr,
+			 unsigned int level)
+{
+	struct pg_tlb_batch *batch = __NULL;
+	__paddr_t batch_paddr;
+	int rc;
+
+	UK_ASSERT(PAGE_ALIGNED(paddr));
+
+	if (!tlb) {
+		pg_ffree(pt, paddr, level);
+		return;
+	}
+
+	UK_ASSERT(tlb->pt == pt);
+
+	if (tlb->nr_frames < UKPLAT_TLB_GATHER_FRAMES) {
+		tlb->frames[tlb->nr_frames++] = PG_TLB_FRAME(paddr, level);
+		return;
+	}
+
+	if (tlb->batch != __PADDR_INV) {
+		batch = pg_tlb_batch_map(pt, tlb->batch);
+		if (batch->nr_frames == PG_TLB_BATCH_FRAMES) {
+			pgarch_pt_unmap(pt, (__vaddr_t)batch, PAGE_LEVEL);
+			batch = __NULL;
+		}
+	}
+
+	if (!batch) {
+		rc = pg_falloc(pt, &batch_paddr, PAGE_LEVEL);
+		if (unlikely(rc)) {
+			/* Without memory for the records, we flush early */
+			pg_tlb_gather_flush(tlb);
+
+			tlb->frames[tlb->nr_frames++] =
+				PG_TLB_FRAME(paddr, level);
+			return;
+		}
+
+		batch = pg_tlb_batch_map(pt, batch_paddr);
+		batch->next = tlb->batch;
+		batch->nr_frames = 0;
+		tlb->batch = batch_paddr;
+	}
+
+	batch->frames[batch->nr_frames++] = PG_TLB_FRAME(paddr, level);
+	pgarch_pt_unmap(pt, (__vaddr_t)batch, PAGE_LEVEL);
+}
+
+void ukplat_tlb_gather_begin(struct uk_pagetable *pt,
+			     struct ukplat_tlb_gather *tlb)
+{
+	UK_ASSERT(pt);
+	UK_ASSERT(tlb);
+
+	tlb->pt = pt;
+	pg_tlb_gather_reset(tlb);
+}
+
+void ukplat_tlb_gather_flush(struct ukplat_tlb_gather *tlb)
+{
+	UK_ASSERT(tlb);
+	UK_ASSERT(tlb->pt);
+
+	pg_tlb_gather_flush(tlb);
+}
+
+void ukplat_tlb_gather_end(struct ukplat_tlb_gather *tlb)
+{
+	UK_ASSERT(tlb);
+	UK_ASSERT(tlb->pt);
+
+	pg_tlb_gather_flush(tlb);
+	tlb->pt = __NULL;
+}
+
+static inline void pg_pt_free(struct uk_pagetable *pt,
+			      struct ukplat_tlb_gather *tlb,
+			      __vaddr_t pt_vaddr, unsigned int level)
 {
 	__paddr_t pt_paddr;
 
@@ -513,7 +851,8 @@ static inline void pg_pt_free(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
 	pt_paddr = pgarch_pt_unmap(pt, pt_vaddr, level);
 	UK_ASSERT(pt_paddr != __PADDR_INV);
 
-	pg_ffree(pt, pt_paddr, PAGE_LEVEL);
+	/* The page table might still be cached in the TLB */
+	pg_tlb_ffree(pt, tlb, pt_paddr, PAGE_LEVEL);
 
 #ifdef CONFIG_PAGING_STATS
 	UK_ASSERT(pt->nr_pt_pages[level] > 0);
@@ -632,7 +971,8 @@ static int pg_page_mapx(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
 				rc = ukarch_pte_write(pt_vaddr_cache[lvl], lvl,
 						      pte_idx, pte);
 				if (unlikely(rc)) {
-					pg_pt_free(pt, pt_vaddr, lvl - 1);
+					pg_pt_free(pt, __NULL, pt_vaddr,
+						   lvl - 1);
 					return rc;
 				}
 			}
@@ -952,15 +1292,16 @@ EXIT_FREE:
 	flags |= PAGE_FLAG_INTERN_STATS_KEEP;
 #endif /* CONFIG_PAGING_STATS */
 
-	pg_page_unmap(pt, new_pt_vaddr, level - 1, __VADDR_ANY,
+	pg_page_unmap(pt, __NULL, new_pt_vaddr, level - 1, __VADDR_ANY,
 		      __SZ_MAX, flags);
 
-	pg_pt_free(pt, new_pt_vaddr, level - 1);
+	pg_pt_free(pt, __NULL, new_pt_vaddr, level - 1);
 
 	return rc;
 }
 
-static int pg_page_unmap(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
+static int pg_page_unmap(struct uk_pagetable *pt,
+			 struct ukplat_tlb_gather *tlb, __vaddr_t pt_vaddr,
 			 unsigned int level, __vaddr_t vaddr, __sz len,
 			 unsigned long flags)
 {
@@ -1073,8 +1414,8 @@ static int pg_page_unmap(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
 			if (unlikely(rc))
 				return rc;
 
-			if (vaddr != __VADDR_ANY && pt == pg_active_pt)
-				ukarch_tlb_flush_entry(vaddr);
+			if (vaddr != __VADDR_ANY)
+				pg_tlb_flush_page(pt, tlb, vaddr, lvl);
 
 #ifdef CONFIG_PAGING_STATS
 			if (!(flags & PAGE_FLAG_INTERN_STATS_KEEP)) {
@@ -1084,7 +1425,8 @@ static int pg_page_unmap(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
 #endif /* CONFIG_PAGING_STATS */
 
 			if (!(flags & PAGE_FLAG_KEEP_FRAMES))
-				pg_ffree(pt, PT_Lx_PTE_PADDR(pte, lvl), lvl);
+				pg_tlb_ffree(pt, tlb,
+					     PT_Lx_PTE_PADDR(pte, lvl), lvl);
 		}
 
 		/* If this is not the last PTE and there are still pages to
@@ -1183,10 +1525,12 @@ static int pg_page_unmap(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
 			if (unlikely(rc))
 				return rc;
 
-			if (vaddr != __VADDR_ANY && pt == pg_active_pt)
-				ukarch_tlb_flush_entry(vaddr);
+			if (vaddr != __VADDR_ANY)
+				pg_tlb_flush_page(pt, tlb,
+						  PAGE_ALIGN_DOWN(vaddr),
+						  PAGE_LEVEL);
 
-			pg_pt_free(pt, pt_vaddr_cache[plvl], plvl);
+			pg_pt_free(pt, tlb, pt_vaddr_cache[plvl], plvl);
 		}
 
 		if (len <= page_size)
@@ -1207,18 +1551,24 @@ static int pg_page_unmap(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
 
 	} while (1);
 
-	if (vaddr == __VADDR_ANY && pt == pg_active_pt)
-		ukarch_tlb_flush();
+	if (vaddr == __VADDR_ANY)
+		pg_tlb_flush_all(pt, tlb);
 
 	return 0;
 }
 
-int ukplat_page_unmap(struct uk_pagetable *pt, __vaddr_t vaddr,
-		      unsigned long pages, unsigned long flags)
+int ukplat_page_unmap_gather(struct ukplat_tlb_gather *tlb, __vaddr_t vaddr,
+			     unsigned long pages, unsigned long flags)
 {
 	unsigned int level = PAGE_FLAG_SIZE_TO_LEVEL(flags);
+	struct uk_pagetable *pt;
 	__sz len = __SZ_MAX;
 
+	UK_ASSERT(tlb);
+	UK_ASSERT(tlb->pt);
+
+	pt = tlb->pt;
+
 	if (unlikely(pages == 0))
 		return 0;
 
@@ -1238,11 +1588,25 @@ int ukplat_page_unmap(struct uk_pagetable *pt, __vaddr_t vaddr,
 	UK_ASSERT(pt->pt_vbase != __VADDR_INV);
 	UK_ASSERT(pt->pt_pbase != __PADDR_INV);
 
-	return pg_page_unmap(pt, pt->pt_vbase, PT_LEVELS - 1, vaddr, len,
+	return pg_page_unmap(pt, tlb, pt->pt_vbase, PT_LEVELS - 1, vaddr, len,
 			     flags);
 }
 
-static int pg_page_set_attr(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
+int ukplat_page_unmap(struct uk_pagetable *pt, __vaddr_t vaddr,
+		      unsigned long pages, unsigned long flags)
+{
+	struct ukplat_tlb_gather tlb;
+	int rc;
+
+	ukplat_tlb_gather_begin(pt, &tlb);
+	rc = ukplat_page_unmap_gather(&tlb, vaddr, pages, flags);
+	ukplat_tlb_gather_end(&tlb);
+
+	return rc;
+}
+
+static int pg_page_set_attr(struct uk_pagetable *pt,
+			    struct ukplat_tlb_gather *tlb, __vaddr_t pt_vaddr,
 			    unsigned int level, __vaddr_t vaddr, __sz len,
 			    unsigned long new_attr, unsigned long flags)
 {
@@ -1345,8 +1709,8 @@ static int pg_page_set_attr(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
 			if (unlikely(rc))
 				return rc;
 
-			if (vaddr != __VADDR_ANY && pt == pg_active_pt)
-				ukarch_tlb_flush_entry(vaddr);
+			if (vaddr != __VADDR_ANY)
+				pg_tlb_flush_page(pt, tlb, vaddr, lvl);
 		}
 
 		/* Bail out if there is nothing more to do */
@@ -1385,19 +1749,25 @@ static int pg_page_set_attr(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
 
 	} while (1);
 
-	if (vaddr == __VADDR_ANY && pt == pg_active_pt)
-		ukarch_tlb_flush();
+	if (vaddr == __VADDR_ANY)
+		pg_tlb_flush_all(pt, tlb);
 
 	return 0;
 }
 
-int ukplat_page_set_attr(struct uk_pagetable *pt, __vaddr_t vaddr,
-			 unsigned long pages, unsigned long new_attr,
-			 unsigned long flags)
+int ukplat_page_set_attr_gather(struct ukplat_tlb_gather *tlb,
+				__vaddr_t vaddr, unsigned long pages,
+				unsigned long new_attr, unsigned long flags)
 {
 	unsigned int level = PAGE_FLAG_SIZE_TO_LEVEL(flags);
+	struct uk_pagetable *pt;
 	__sz len = __SZ_MAX;
 
+	UK_ASSERT(tlb);
+	UK_ASSERT(tlb->pt);
+
+	pt = tlb->pt;
+
 	if (unlikely(pages == 0))
 		return 0;
 
@@ -1417,8 +1787,22 @@ int ukplat_page_set_attr(struct uk_pagetable *pt, __vaddr_t vaddr,
 	UK_ASSERT(pt->pt_vbase != __VADDR_INV);
 	UK_ASSERT(pt->pt_pbase != __PADDR_INV);
 
-	return pg_page_set_attr(pt, pt->pt_vbase, PT_LEVELS - 1, vaddr, len,
-				new_attr, flags);
+	return pg_page_set_attr(pt, tlb, pt->pt_vbase, PT_LEVELS - 1, vaddr,
+				len, new_attr, flags);
+}
+
+int ukplat_page_set_attr(struct uk_pagetable *pt, __vaddr_t vaddr,
+			 unsigned long pages, unsigned long new_attr,
+			 unsigned long flags)
+{
+	struct ukplat_tlb_gather tlb;
+	int rc;
+
+	ukplat_tlb_gather_begin(pt, &tlb);
+	rc = ukplat_page_set_attr_gather(&tlb, vaddr, pages, new_attr, flags);
+	ukplat_tlb_gather_end(&tlb);
+
+	return rc;
 }
 
 __vaddr_t ukplat_page_kmap(struct uk_pagetable *pt, __paddr_t paddr,
@@ -312,6 +312,28 @@ __u64 tscclock_epochoffset(void)
  */
 #define PIT_MIN_DELTA	16
 
+/*
+ * Program the timer to interrupt the CPU after the delay has expired.
+ * Maximum timer delay is 65535 ticks.
+ */
+static void tscclock_set_timer(__u64 delta_ticks)
+{
+	unsigned int ticks;
+
+	if (delta_ticks > 65535)
+		ticks = 65535;
+	else
+		ticks = delta_ticks;
+
+	/*
+	 * Note that according to the Intel 82C54 datasheet, p12 the
+	 * interrupt is actually delivered in N + 1 ticks.
+	 */
+	ticks -= 1;
+	outb(TIMER_CNTR, ticks & 0xff);
+	outb(TIMER_CNTR, ticks >> 8);
+}
+
 /*
  * Returns early if any interrupts are serviced, or if the requested delay is
  * too short. Must be called with interrupts disabled, will enable interrupts
@@ -327,7 +349,6 @@ static void tscclock_cpu_block(__u64 until)
 {
 	__u64 now, delta_ns;
 	__u64 delta_ticks;
-	unsigned int ticks;
 
 	UK_ASSERT(ukplat_lcpu_irqs_disabled());
 
@@ -352,22 +373,7 @@ static void tscclock_cpu_block(__u64 until)
 		return;
 	}
 
-	/*
-	 * Program the timer to interrupt the CPU after the delay has expired.
-	 * Maximum timer delay is 65535 ticks.
-	 */
-	if (delta_ticks > 65535)
-		ticks = 65535;
-	else
-		ticks = delta_ticks;
-
-	/*
-	 * Note that according to the Intel 82C54 datasheet, p12 the
-	 * interrupt is actually delivered in N + 1 ticks.
-	 */
-	ticks -= 1;
-	outb(TIMER_CNTR, ticks & 0xff);
-	outb(TIMER_CNTR, ticks >> 8);
+	tscclock_set_timer(delta_ticks);
 
 	/*
 	 * Wait for any interrupt. If we got an interrupt then just
@@ -382,6 +388,27 @@ static void tscclock_cpu_block(__u64 until)
 	ukplat_lcpu_halt_irq();
 }
 
+/*
+ * Programs the timer to interrupt the CPU at `until` without halting. A
+ * deadline that already passed or is too close fires after the minimum delay.
+ * Deadlines beyond the maximum timer delay fire early.
+ */
+void time_set_alarm(__snsec until)
+{
+	__snsec now;
+	__u64 delta_ticks = 0;
+
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	now = ukplat_monotonic_clock();
+	if (until > now)
+		delta_ticks = mul64_32(until - now, pit_mult);
+	if (delta_ticks < PIT_MIN_DELTA)
+		delta_ticks = PIT_MIN_DELTA;
+
+	tscclock_set_timer(delta_ticks);
+}
+
 unsigned long sched_have_pending_events;
 
 void time_block_until(__snsec until)